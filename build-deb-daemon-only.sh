@@ -26,6 +26,7 @@ echo "Creating package structure..."
 mkdir -p "$PACKAGE_DIR/DEBIAN"
 mkdir -p "$PACKAGE_DIR/usr/bin"
 mkdir -p "$PACKAGE_DIR/usr/lib/systemd/user"
+mkdir -p "$PACKAGE_DIR/usr/lib/systemd/system"
 mkdir -p "$PACKAGE_DIR/etc/xdg/novasearch"
 mkdir -p "$PACKAGE_DIR/usr/share/doc/novasearch-daemon"
 
@@ -42,6 +43,8 @@ chmod 755 "$PACKAGE_DIR/usr/bin/novasearch-daemon"
 # Copy systemd service
 cp novasearch-daemon.service "$PACKAGE_DIR/usr/lib/systemd/user/"
 chmod 644 "$PACKAGE_DIR/usr/lib/systemd/user/novasearch-daemon.service"
+cp novasearch-system-index.service novasearch-system-index.path novasearch-system-index.timer "$PACKAGE_DIR/usr/lib/systemd/system/"
+chmod 644 "$PACKAGE_DIR/usr/lib/systemd/system/"novasearch-system-index.*
 
 # Copy default configuration
 cp debian/novasearch.toml "$PACKAGE_DIR/etc/xdg/novasearch/config.toml"
@@ -103,6 +106,14 @@ case "$1" in
             fi
         done
         
+        # Index the system applications once for all users, and again
+        # whenever they change and hourly
+        if [ -d /run/systemd/system ]; then
+            systemctl daemon-reload || true
+            systemctl enable --now novasearch-system-index.path novasearch-system-index.timer || true
+            systemctl start --no-block novasearch-system-index.service || true
+        fi
+        
         echo ""
         echo "NovaSearch daemon installed successfully!"
         echo ""
@@ -138,6 +149,11 @@ case "$1" in
                 su - "$user_name" -c "systemctl --user stop novasearch-daemon" 2>/dev/null || true
             fi
         done
+        
+        # Stop rebuilding the system application index
+        if [ -d /run/systemd/system ]; then
+            systemctl disable --now novasearch-system-index.path novasearch-system-index.timer 2>/dev/null || true
+        fi
         ;;
 esac
 
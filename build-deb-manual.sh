@@ -27,6 +27,7 @@ mkdir -p "$PACKAGE_DIR/usr/bin"
 mkdir -p "$PACKAGE_DIR/usr/lib/x86_64-linux-gnu/xfce4/panel/plugins"
 mkdir -p "$PACKAGE_DIR/usr/share/xfce4/panel/plugins"
 mkdir -p "$PACKAGE_DIR/usr/lib/systemd/user"
+mkdir -p "$PACKAGE_DIR/usr/lib/systemd/system"
 mkdir -p "$PACKAGE_DIR/etc/xdg/novasearch"
 mkdir -p "$PACKAGE_DIR/usr/share/doc/novasearch"
 
@@ -58,6 +59,8 @@ fi
 # Copy systemd service
 cp novasearch-daemon.service "$PACKAGE_DIR/usr/lib/systemd/user/"
 chmod 644 "$PACKAGE_DIR/usr/lib/systemd/user/novasearch-daemon.service"
+cp novasearch-system-index.service novasearch-system-index.path novasearch-system-index.timer "$PACKAGE_DIR/usr/lib/systemd/system/"
+chmod 644 "$PACKAGE_DIR/usr/lib/systemd/system/"novasearch-system-index.*
 
 # Copy default configuration
 cp debian/novasearch.toml "$PACKAGE_DIR/etc/xdg/novasearch/config.toml"
@@ -119,6 +122,14 @@ case "$1" in
             fi
         done
         
+        # Index the system applications once for all users, and again
+        # whenever they change and hourly
+        if [ -d /run/systemd/system ]; then
+            systemctl daemon-reload || true
+            systemctl enable --now novasearch-system-index.path novasearch-system-index.timer || true
+            systemctl start --no-block novasearch-system-index.service || true
+        fi
+        
         echo ""
         echo "NovaSearch installed successfully!"
         echo ""
@@ -152,6 +163,11 @@ case "$1" in
                 su - "$user_name" -c "systemctl --user stop novasearch-daemon" 2>/dev/null || true
             fi
         done
+        
+        # Stop rebuilding the system application index
+        if [ -d /run/systemd/system ]; then
+            systemctl disable --now novasearch-system-index.path novasearch-system-index.timer 2>/dev/null || true
+        fi
         ;;
 esac
 
@@ -0,0 +1,65 @@
+//! Debouncer throughput under event storms
+//!
+//! `NOVASEARCH_BENCH_STORM_EVENTS` sets the events per storm (default
+//! 100,000), spread over the paths of a synthetic tree sized by
+//! `NOVASEARCH_BENCH_STORM_PATHS` (default 20,000). The tree is created on
+//! disk, so processing pays for the same metadata lookups as in the daemon.
+
+mod support;
+
+use criterion::{criterion_group, criterion_main, BatchSize, Criterion, Throughput};
+use novasearch_daemon::watcher::{EventProcessor, FilesystemEvent};
+use std::path::PathBuf;
+use std::time::Duration;
+use support::{env_or, event_storm, TreeSpec};
+use tempfile::TempDir;
+
+/// Queue limit large enough that no operation is dropped
+const MAX_QUEUE_SIZE: usize = usize::MAX;
+
+/// A storm over a tree created in a new temporary directory
+fn storm() -> (TempDir, Vec<FilesystemEvent>) {
+    let spec = TreeSpec::from_env("NOVASEARCH_BENCH_STORM_PATHS", 20_000);
+    let tree = support::temp_dir();
+    spec.materialize(tree.path()).unwrap();
+
+    let paths: Vec<PathBuf> = spec.entries(tree.path()).map(|entry| entry.path).collect();
+    let events = event_storm(&paths, env_or("NOVASEARCH_BENCH_STORM_EVENTS", 100_000), 0x5374_6f72);
+    (tree, events)
+}
+
+fn bench_event_processor(c: &mut Criterion) {
+    let (_tree, storm) = storm();
+
+    let mut group = c.benchmark_group("event_processor");
+    group.throughput(Throughput::Elements(storm.len() as u64));
+
+    // Coalescing only: nothing becomes due within the debounce window
+    group.bench_function("add_events", |b| {
+        b.iter_batched(
+            || (storm.clone(), EventProcessor::new(Duration::from_secs(60), MAX_QUEUE_SIZE)),
+            |(events, mut processor)| {
+                processor.add_events(events);
+                processor
+            },
+            BatchSize::LargeInput,
+        )
+    });
+
+    // Coalescing and converting everything into index operations
+    group.bench_function("add_and_process", |b| {
+        b.iter_batched(
+            || (storm.clone(), EventProcessor::new(Duration::ZERO, MAX_QUEUE_SIZE)),
+            |(events, mut processor)| {
+                processor.add_events(events);
+                let operations = processor.process_pending();
+                (processor, operations)
+            },
+            BatchSize::LargeInput,
+        )
+    });
+    group.finish();
+}
+
+criterion_group!(benches, bench_event_processor);
+criterion_main!(benches);
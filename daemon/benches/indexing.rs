@@ -0,0 +1,100 @@
+//! Scan and bulk insert throughput
+//!
+//! `NOVASEARCH_BENCH_SCAN_ENTRIES` sizes the tree created on disk for the
+//! scan (default 20,000) and `NOVASEARCH_BENCH_INSERT_ENTRIES` the entries
+//! inserted (default 100,000, up to 5,000,000). The scan also walks the
+//! system application directories, as the daemon's does.
+
+mod support;
+
+use criterion::{criterion_group, criterion_main, BatchSize, Criterion, Throughput};
+use novasearch_daemon::config::Config;
+use novasearch_daemon::database::Database;
+use novasearch_daemon::models::IndexOperation;
+use novasearch_daemon::scanner::Scanner;
+use support::TreeSpec;
+use std::path::Path;
+use tempfile::TempDir;
+
+fn bench_scan(c: &mut Criterion) {
+    let spec = TreeSpec::from_env("NOVASEARCH_BENCH_SCAN_ENTRIES", 20_000);
+    let tree = support::temp_dir();
+    let entries = spec.materialize(tree.path()).unwrap();
+
+    let mut config = Config::default();
+    config.indexing.include_paths = vec![tree.path().to_string_lossy().to_string()];
+
+    let mut group = c.benchmark_group("scan");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(entries as u64));
+
+    for threads in [1, 0] {
+        config.performance.scan_threads = threads;
+        let scanner = Scanner::new(config.clone());
+        let name = if threads == 0 { "all_threads" } else { "one_thread" };
+        group.bench_function(name, |b| b.iter(|| scanner.scan().len()));
+    }
+    group.finish();
+}
+
+fn bench_bulk_insert(c: &mut Criterion) {
+    let spec = TreeSpec::from_env("NOVASEARCH_BENCH_INSERT_ENTRIES", 100_000);
+    let batch_size = Config::default().performance.batch_size;
+
+    let mut group = c.benchmark_group("bulk_insert");
+    group.sample_size(10);
+    group.throughput(Throughput::Elements(spec.max_entries as u64));
+
+    // Entries are generated while inserting, so millions never sit in memory.
+    // The database and its directory are returned to be dropped untimed.
+    group.bench_function("execute_batch", |b| {
+        b.iter_batched(
+            support::temp_dir,
+            |dir| (insert_tree(&dir, &spec, batch_size), dir),
+            BatchSize::PerIteration,
+        )
+    });
+    group.bench_function("rebuild", |b| {
+        b.iter_batched(
+            support::temp_dir,
+            |dir| {
+                let db = Database::open(dir.path().join("index.db")).unwrap();
+                let rebuild = db.begin_rebuild().unwrap();
+                for_each_batch(&spec, Path::new("/home/bench"), batch_size, |batch| {
+                    rebuild.execute_batch(batch).unwrap()
+                });
+                rebuild.finish().unwrap();
+                (db, dir)
+            },
+            BatchSize::PerIteration,
+        )
+    });
+    group.finish();
+}
+
+/// Index the tree into a new database in `dir`
+fn insert_tree(dir: &TempDir, spec: &TreeSpec, batch_size: usize) -> Database {
+    let db = Database::open(dir.path().join("index.db")).unwrap();
+    for_each_batch(spec, Path::new("/home/bench"), batch_size, |batch| {
+        db.execute_batch(batch).unwrap();
+    });
+    db
+}
+
+/// Hand the tree's entries to `commit` as `Add` batches of `batch_size`
+fn for_each_batch(spec: &TreeSpec, root: &Path, batch_size: usize, mut commit: impl FnMut(&[IndexOperation])) {
+    let mut batch = Vec::with_capacity(batch_size);
+    for entry in spec.entries(root) {
+        batch.push(IndexOperation::Add(entry));
+        if batch.len() == batch_size {
+            commit(&batch);
+            batch.clear();
+        }
+    }
+    if !batch.is_empty() {
+        commit(&batch);
+    }
+}
+
+criterion_group!(benches, bench_scan, bench_bulk_insert);
+criterion_main!(benches);
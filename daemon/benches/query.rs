@@ -0,0 +1,136 @@
+//! Query latency by query length, through SQLite and the hot index
+//!
+//! `NOVASEARCH_BENCH_QUERY_ENTRIES` sizes the index (default 100,000, up to
+//! 5,000,000). Besides Criterion's estimates, latency percentiles of each
+//! query length are written to `query-latency.json` in the report directory
+//! (see `support::report_dir`).
+
+mod support;
+
+use criterion::{criterion_group, criterion_main, BenchmarkId, Criterion};
+use novasearch_daemon::database::Database;
+use novasearch_daemon::models::{FileEntry, IndexOperation};
+use novasearch_daemon::query_server::HotIndex;
+use std::path::Path;
+use std::time::{Duration, Instant};
+use support::{percentiles_json, queries_of_length, report_dir, TreeSpec};
+use tempfile::TempDir;
+
+/// Query lengths measured, in characters; the first two miss the trigram index
+const QUERY_LENGTHS: &[usize] = &[1, 2, 3, 4, 6, 8, 12];
+
+/// Queries per length; each benchmark iteration runs the next one
+const QUERIES_PER_LENGTH: usize = 200;
+
+/// Results asked for, as the panel does
+const MAX_RESULTS: usize = 50;
+
+/// An index filled with a synthetic tree, and a sample of its entries
+struct Fixture {
+    _dir: TempDir,
+    db: Database,
+    hot: HotIndex,
+    sample: Vec<FileEntry>,
+}
+
+impl Fixture {
+    fn new() -> Self {
+        let spec = TreeSpec::from_env("NOVASEARCH_BENCH_QUERY_ENTRIES", 100_000);
+        let dir = support::temp_dir();
+        let db = Database::open(dir.path().join("index.db")).unwrap();
+
+        // Every 97th entry is kept to cut queries from
+        let mut sample = Vec::new();
+        let mut batch = Vec::with_capacity(1000);
+        for (i, entry) in spec.entries(Path::new("/home/bench")).enumerate() {
+            if i % 97 == 0 {
+                sample.push(entry.clone());
+            }
+            batch.push(IndexOperation::Add(entry));
+            if batch.len() == batch.capacity() {
+                db.execute_batch(&batch).unwrap();
+                batch.clear();
+            }
+        }
+        db.execute_batch(&batch).unwrap();
+
+        let hot = HotIndex::load(&db).unwrap();
+        Fixture { _dir: dir, db, hot, sample }
+    }
+
+    fn queries(&self, length: usize) -> Vec<String> {
+        queries_of_length(&self.sample, length, QUERIES_PER_LENGTH, 0x5175_6572)
+    }
+}
+
+fn bench_query(c: &mut Criterion) {
+    let fixture = Fixture::new();
+
+    let mut group = c.benchmark_group("query");
+    for &length in QUERY_LENGTHS {
+        let queries = fixture.queries(length);
+
+        group.bench_with_input(BenchmarkId::new("query_files", length), &queries, |b, queries| {
+            let mut next = queries.iter().cycle();
+            b.iter(|| fixture.db.query_files(next.next().unwrap(), MAX_RESULTS).unwrap().len())
+        });
+        group.bench_with_input(BenchmarkId::new("hot_index", length), &queries, |b, queries| {
+            let mut next = queries.iter().cycle();
+            b.iter(|| fixture.hot.query(next.next().unwrap(), MAX_RESULTS).len())
+        });
+    }
+    group.finish();
+
+    write_latency_report(&fixture);
+}
+
+/// Time every query once per backend and write the percentiles as JSON
+///
+/// Criterion reports means over repeated runs; a release gate on tail
+/// latency needs the spread across distinct queries instead.
+fn write_latency_report(fixture: &Fixture) {
+    let mut lengths = Vec::new();
+    for &length in QUERY_LENGTHS {
+        let queries = fixture.queries(length);
+        let mut sqlite = time_each(&queries, |query| fixture.db.query_files(query, MAX_RESULTS).unwrap().len());
+        let mut hot = time_each(&queries, |query| fixture.hot.query(query, MAX_RESULTS).len());
+        lengths.push(format!(
+            "    \"{}\": {{\"query_files\": {}, \"hot_index\": {}}}",
+            length,
+            percentiles_json(&mut sqlite),
+            percentiles_json(&mut hot),
+        ));
+    }
+
+    let report = format!(
+        "{{\n  \"entries\": {},\n  \"max_results\": {},\n  \"lengths\": {{\n{}\n  }}\n}}\n",
+        fixture.hot.len(),
+        MAX_RESULTS,
+        lengths.join(",\n"),
+    );
+
+    let dir = report_dir();
+    let path = dir.join("query-latency.json");
+    match std::fs::create_dir_all(&dir).and_then(|_| std::fs::write(&path, report)) {
+        Ok(()) => println!("Query latency percentiles written to {}", path.display()),
+        Err(e) => eprintln!("Error writing {}: {}", path.display(), e),
+    }
+}
+
+/// Run each query once after a warm-up pass, returning the durations
+fn time_each(queries: &[String], mut run: impl FnMut(&str) -> usize) -> Vec<Duration> {
+    for query in queries {
+        criterion::black_box(run(query));
+    }
+    queries
+        .iter()
+        .map(|query| {
+            let start = Instant::now();
+            criterion::black_box(run(query));
+            start.elapsed()
+        })
+        .collect()
+}
+
+criterion_group!(benches, bench_query);
+criterion_main!(benches);
@@ -0,0 +1,350 @@
+//! Synthetic workloads shared by the benchmarks
+//!
+//! Trees and event storms are generated from a seed, so every run measures
+//! the same input. Sizes come from environment variables, letting the same
+//! benchmarks run quickly by default and at multi-million entry scale when
+//! gating a release.
+
+#![allow(dead_code)]
+
+use novasearch_daemon::models::{FileEntry, FileType};
+use novasearch_daemon::watcher::FilesystemEvent;
+use std::fs::{self, File};
+use std::io;
+use std::path::{Path, PathBuf};
+use std::time::{Duration, UNIX_EPOCH};
+use tempfile::TempDir;
+
+/// Largest tree the generator is meant to produce
+pub const MAX_ENTRIES: usize = 5_000_000;
+
+/// Words filenames are built from, most common first
+const WORDS: &[&str] = &[
+    "report", "notes", "main", "photo", "invoice", "draft", "config", "index",
+    "readme", "backup", "budget", "project", "meeting", "summary", "test", "data",
+    "image", "scan", "letter", "music", "video", "thesis", "login", "plan",
+    "chapter", "screenshot", "export", "archive", "slides", "recipe", "contract", "diagram",
+    "schedule", "resume", "manual", "release", "changelog", "module", "server", "client",
+    "utils", "render", "parser", "kernel", "driver", "theme", "wallpaper", "holiday",
+    "family", "receipt", "statement", "tax", "lecture", "homework", "novel", "poem",
+    "podcast", "episode", "track", "album", "sketch", "model", "texture", "shader",
+];
+
+/// Extensions and their relative weights
+const EXTENSIONS: &[(&str, u32)] = &[
+    ("txt", 12), ("pdf", 10), ("jpg", 14), ("png", 8), ("rs", 6), ("c", 5),
+    ("h", 4), ("md", 6), ("odt", 3), ("ods", 2), ("mp3", 5), ("mkv", 2),
+    ("tar.gz", 1), ("json", 4), ("toml", 2), ("desktop", 1),
+];
+
+/// Small deterministic generator (SplitMix64)
+#[derive(Debug, Clone)]
+pub struct Rng(u64);
+
+impl Rng {
+    pub fn new(seed: u64) -> Self {
+        Rng(seed)
+    }
+
+    pub fn next_u64(&mut self) -> u64 {
+        self.0 = self.0.wrapping_add(0x9E37_79B9_7F4A_7C15);
+        let mut z = self.0;
+        z = (z ^ (z >> 30)).wrapping_mul(0xBF58_476D_1CE4_E5B9);
+        z = (z ^ (z >> 27)).wrapping_mul(0x94D0_49BB_1331_11EB);
+        z ^ (z >> 31)
+    }
+
+    /// Uniform in `[0, 1)`
+    pub fn next_f64(&mut self) -> f64 {
+        (self.next_u64() >> 11) as f64 / (1u64 << 53) as f64
+    }
+
+    /// Uniform in `[0, n)`
+    pub fn below(&mut self, n: usize) -> usize {
+        (self.next_u64() % n as u64) as usize
+    }
+
+    /// Index in `[0, n)` favouring low indices; `skew` 0 is uniform
+    pub fn skewed(&mut self, n: usize, skew: f64) -> usize {
+        ((self.next_f64().powf(1.0 + skew) * n as f64) as usize).min(n - 1)
+    }
+}
+
+/// Shape of a synthetic directory tree
+#[derive(Debug, Clone)]
+pub struct TreeSpec {
+    /// Subdirectories in each directory above the deepest level
+    pub fan_out: usize,
+    /// Directory levels below the root
+    pub depth: usize,
+    /// Regular files in each directory
+    pub files_per_dir: usize,
+    /// How strongly filenames favour common words; 0 picks words uniformly
+    pub name_skew: f64,
+    /// Entries generated at most, cutting the tree short
+    pub max_entries: usize,
+    pub seed: u64,
+}
+
+impl TreeSpec {
+    /// A tree of about `entries` entries with typical home directory proportions
+    pub fn with_entries(entries: usize) -> Self {
+        TreeSpec::shaped(entries, 8, 24, 1.5)
+    }
+
+    /// A tree of about `entries` entries, as deep as the shape needs
+    pub fn shaped(entries: usize, fan_out: usize, files_per_dir: usize, name_skew: f64) -> Self {
+        let mut spec = TreeSpec {
+            fan_out: fan_out.max(1),
+            depth: 1,
+            files_per_dir,
+            name_skew,
+            max_entries: entries.min(MAX_ENTRIES),
+            seed: 0x4e6f_7661,
+        };
+        while spec.full_size() < spec.max_entries && spec.depth < 64 {
+            spec.depth += 1;
+        }
+        spec
+    }
+
+    /// A tree sized by the environment variable `var`, or `default` entries
+    ///
+    /// `NOVASEARCH_BENCH_FAN_OUT`, `NOVASEARCH_BENCH_FILES_PER_DIR` and
+    /// `NOVASEARCH_BENCH_NAME_SKEW` override the shape.
+    pub fn from_env(var: &str, default: usize) -> Self {
+        TreeSpec::shaped(
+            env_or(var, default),
+            env_or("NOVASEARCH_BENCH_FAN_OUT", 8),
+            env_or("NOVASEARCH_BENCH_FILES_PER_DIR", 24),
+            env_or("NOVASEARCH_BENCH_NAME_SKEW", 1.5),
+        )
+    }
+
+    /// Entries in the tree before `max_entries` cuts it short
+    fn full_size(&self) -> usize {
+        let mut total = 0usize;
+        let mut dirs = 1usize;
+        for level in 0..=self.depth {
+            total = total.saturating_add(dirs.saturating_mul(self.files_per_dir));
+            if level < self.depth {
+                dirs = dirs.saturating_mul(self.fan_out);
+                total = total.saturating_add(dirs);
+            }
+        }
+        total
+    }
+
+    /// The tree's entries below `root`, parents before their children
+    pub fn entries(&self, root: &Path) -> TreeEntries {
+        TreeEntries {
+            spec: self.clone(),
+            rng: Rng::new(self.seed),
+            stack: vec![(root.to_path_buf(), 0)],
+            pending: Vec::new(),
+            remaining: self.max_entries,
+        }
+    }
+
+    /// Create the tree on disk below `root`, with empty files
+    pub fn materialize(&self, root: &Path) -> io::Result<usize> {
+        let mut count = 0;
+        for entry in self.entries(root) {
+            match entry.file_type {
+                FileType::Directory => fs::create_dir(&entry.path)?,
+                _ => drop(File::create(&entry.path)?),
+            }
+            count += 1;
+        }
+        Ok(count)
+    }
+}
+
+/// Iterator over a synthetic tree, see `TreeSpec::entries`
+pub struct TreeEntries {
+    spec: TreeSpec,
+    rng: Rng,
+    /// Directories still to be filled, with their level
+    stack: Vec<(PathBuf, usize)>,
+    /// Children of the last directory filled, in reverse
+    pending: Vec<FileEntry>,
+    remaining: usize,
+}
+
+impl TreeEntries {
+    /// Generate the children of the next directory into `pending`
+    fn fill(&mut self) -> bool {
+        let Some((dir, level)) = self.stack.pop() else {
+            return false;
+        };
+
+        let mut children = Vec::with_capacity(self.spec.files_per_dir + self.spec.fan_out);
+        for i in 0..self.spec.files_per_dir {
+            let filename = file_name(&mut self.rng, self.spec.name_skew, i);
+            let size = self.rng.skewed(64 << 20, 6.0) as u64;
+            children.push(synthetic_entry(dir.join(&filename), filename, size, FileType::Regular, &mut self.rng));
+        }
+        if level < self.spec.depth {
+            for i in 0..self.spec.fan_out {
+                let word = WORDS[self.rng.skewed(WORDS.len(), self.spec.name_skew)];
+                let filename = format!("{}-{}", word, i);
+                let path = dir.join(&filename);
+                self.stack.push((path.clone(), level + 1));
+                children.push(synthetic_entry(path, filename, 4096, FileType::Directory, &mut self.rng));
+            }
+        }
+
+        children.reverse();
+        self.pending = children;
+        true
+    }
+}
+
+impl Iterator for TreeEntries {
+    type Item = FileEntry;
+
+    fn next(&mut self) -> Option<FileEntry> {
+        if self.remaining == 0 {
+            return None;
+        }
+        while self.pending.is_empty() {
+            if !self.fill() {
+                return None;
+            }
+        }
+        self.remaining -= 1;
+        self.pending.pop()
+    }
+}
+
+/// A filename of one or two words, unique within its directory through `index`
+fn file_name(rng: &mut Rng, skew: f64, index: usize) -> String {
+    let first = WORDS[rng.skewed(WORDS.len(), skew)];
+    let total_weight: u32 = EXTENSIONS.iter().map(|(_, weight)| weight).sum();
+    let mut pick = (rng.next_u64() % total_weight as u64) as u32;
+    let extension = EXTENSIONS
+        .iter()
+        .find(|(_, weight)| {
+            if pick < *weight {
+                true
+            } else {
+                pick -= weight;
+                false
+            }
+        })
+        .map(|(extension, _)| *extension)
+        .unwrap();
+
+    match rng.below(3) {
+        0 => format!("{}_{}.{}", first, index, extension),
+        1 => format!("{}_{}_{}.{}", first, WORDS[rng.skewed(WORDS.len(), skew)], index, extension),
+        _ => format!("{}{}.{}", capitalize(first), index, extension),
+    }
+}
+
+fn capitalize(word: &str) -> String {
+    let mut chars = word.chars();
+    chars
+        .next()
+        .map(|first| first.to_ascii_uppercase().to_string() + chars.as_str())
+        .unwrap_or_default()
+}
+
+fn synthetic_entry(path: PathBuf, filename: String, size: u64, file_type: FileType, rng: &mut Rng) -> FileEntry {
+    let modified_time = UNIX_EPOCH + Duration::from_secs(1_600_000_000 + rng.below(100_000_000) as u64);
+    let mut entry = FileEntry::new(filename, path, size, modified_time, file_type);
+    entry.indexed_time = modified_time;
+    entry
+}
+
+/// Queries of `length` characters cut from indexed filenames, so most match
+pub fn queries_of_length(entries: &[FileEntry], length: usize, count: usize, seed: u64) -> Vec<String> {
+    let mut rng = Rng::new(seed ^ length as u64);
+    let mut queries = Vec::with_capacity(count);
+    while queries.len() < count {
+        let chars: Vec<char> = entries[rng.below(entries.len())].filename.chars().collect();
+        if chars.len() < length {
+            continue;
+        }
+        let start = rng.below(chars.len() - length + 1);
+        queries.push(chars[start..start + length].iter().collect());
+    }
+    queries
+}
+
+/// A burst of filesystem events over `paths`, as editors, builds and
+/// downloads produce them
+///
+/// Most events hit a small set of hot files repeatedly, which is what the
+/// debouncer has to coalesce. The rest create, delete and rename files, and
+/// save through a temporary file the way editors do.
+pub fn event_storm(paths: &[PathBuf], events: usize, seed: u64) -> Vec<FilesystemEvent> {
+    let mut rng = Rng::new(seed);
+    let mut storm = Vec::with_capacity(events);
+    let mut created = 0usize;
+
+    while storm.len() < events {
+        let path = paths[rng.skewed(paths.len(), 3.0)].clone();
+        match rng.below(10) {
+            0..=4 => storm.push(FilesystemEvent::Modified(path)),
+            5 | 6 => {
+                created += 1;
+                storm.push(FilesystemEvent::Created(path.with_file_name(format!("new-{}.part", created))));
+            }
+            7 => storm.push(FilesystemEvent::Deleted(path)),
+            8 => {
+                let temporary = path.with_file_name(format!(".{}.swp", created));
+                storm.push(FilesystemEvent::Created(temporary.clone()));
+                storm.push(FilesystemEvent::Modified(temporary.clone()));
+                storm.push(FilesystemEvent::Moved { from: temporary, to: path });
+            }
+            _ => {
+                let to = path.with_extension("renamed");
+                storm.push(FilesystemEvent::Moved { from: path, to });
+            }
+        }
+    }
+
+    storm.truncate(events);
+    storm
+}
+
+/// A new temporary directory, named so the default exclusions (`.*`) keep it
+pub fn temp_dir() -> TempDir {
+    tempfile::Builder::new().prefix("novasearch-bench").tempdir().unwrap()
+}
+
+/// Read a size or ratio from the environment
+pub fn env_or<T: std::str::FromStr>(var: &str, default: T) -> T {
+    std::env::var(var)
+        .ok()
+        .and_then(|value| value.parse().ok())
+        .unwrap_or(default)
+}
+
+/// Where machine-readable reports are written
+///
+/// `NOVASEARCH_BENCH_REPORT_DIR` overrides the default, a directory under
+/// Cargo's target directory next to Criterion's own results.
+pub fn report_dir() -> PathBuf {
+    std::env::var_os("NOVASEARCH_BENCH_REPORT_DIR")
+        .map(PathBuf::from)
+        .unwrap_or_else(|| Path::new(env!("CARGO_TARGET_TMPDIR")).join("novasearch-bench"))
+}
+
+/// Latency summary of a set of samples, as a JSON object
+pub fn percentiles_json(samples: &mut [Duration]) -> String {
+    samples.sort_unstable();
+    let at = |fraction: f64| {
+        let index = ((samples.len() as f64 - 1.0) * fraction).round() as usize;
+        samples[index].as_secs_f64() * 1e6
+    };
+    format!(
+        "{{\"samples\": {}, \"p50_us\": {:.1}, \"p90_us\": {:.1}, \"p99_us\": {:.1}, \"max_us\": {:.1}}}",
+        samples.len(),
+        at(0.50),
+        at(0.90),
+        at(0.99),
+        at(1.0),
+    )
+}
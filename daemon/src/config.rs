@@ -5,6 +5,12 @@ use std::time::Duration;
 use notify::{Watcher, RecursiveMode, Event, EventKind};
 use std::sync::{Arc, Mutex};
 
+/// Rough in-memory size of one scanned entry (struct, path and filename buffers)
+const ESTIMATED_ENTRY_BYTES: u64 = 256;
+
+/// Upper bound on the number of scan batches queued ahead of the database writer
+const MAX_SCAN_PIPELINE_DEPTH: usize = 256;
+
 /// Main configuration structure
 #[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct Config {
@@ -14,6 +20,10 @@ pub struct Config {
     pub performance: PerformanceConfig,
     #[serde(default)]
     pub ui: UiConfig,
+    #[serde(default)]
+    pub database: DatabaseConfig,
+    #[serde(default)]
+    pub metrics: MetricsConfig,
 }
 
 /// Indexing configuration
@@ -23,19 +33,34 @@ pub struct IndexingConfig {
     pub include_paths: Vec<String>,
     #[serde(default = "default_exclude_patterns")]
     pub exclude_patterns: Vec<String>,
+    /// On startup, only list directories whose modification time changed
+    #[serde(default = "default_startup_reconcile")]
+    pub startup_reconcile: bool,
+    /// How changes are watched: "notify", "fanotify" or "auto"
+    #[serde(default = "default_watch_backend")]
+    pub watch_backend: String,
 }
 
 /// Performance configuration
 #[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct PerformanceConfig {
+    /// Share of all CPUs the daemon may use while other processes need them
     #[serde(default = "default_max_cpu_percent")]
     pub max_cpu_percent: u8,
+    /// Resident memory above which scans pause
     #[serde(default = "default_max_memory_mb")]
     pub max_memory_mb: u64,
     #[serde(default = "default_batch_size")]
     pub batch_size: usize,
     #[serde(default = "default_flush_interval_ms")]
     pub flush_interval_ms: u64,
+    /// Number of scanner threads (0 = one per CPU, capped by max_cpu_percent)
+    #[serde(default = "default_scan_threads")]
+    pub scan_threads: usize,
+    /// Operations held for writing before the affected directories are
+    /// marked for rescanning instead
+    #[serde(default = "default_max_queue_size")]
+    pub max_queue_size: usize,
 }
 
 /// UI configuration
@@ -47,6 +72,35 @@ pub struct UiConfig {
     pub max_results: usize,
 }
 
+/// SQLite connection tuning for the daemon's index database
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct DatabaseConfig {
+    /// Use write-ahead logging so readers never wait for the indexer
+    #[serde(default = "default_wal")]
+    pub wal: bool,
+    /// Durability level: "off", "normal", "full" or "extra"
+    #[serde(default = "default_synchronous")]
+    pub synchronous: String,
+    /// Size of the memory-mapped I/O window (0 disables mmap)
+    #[serde(default = "default_mmap_size_mb")]
+    pub mmap_size_mb: u64,
+    /// Page cache size per connection
+    #[serde(default = "default_cache_size_mb")]
+    pub cache_size_mb: u64,
+    /// How long SQLite waits on a locked database before reporting busy
+    #[serde(default = "default_busy_timeout_ms")]
+    pub busy_timeout_ms: u64,
+}
+
+/// Where the daemon's runtime metrics are exposed
+#[derive(Debug, Clone, Default, Serialize, Deserialize)]
+pub struct MetricsConfig {
+    /// Address serving metrics in the Prometheus text format, such as
+    /// "127.0.0.1:9469" (empty disables the endpoint)
+    #[serde(default)]
+    pub prometheus_address: String,
+}
+
 // Default value functions for serde
 fn default_include_paths() -> Vec<String> {
     vec!["~".to_string()]
@@ -61,6 +115,14 @@ fn default_exclude_patterns() -> Vec<String> {
     ]
 }
 
+fn default_startup_reconcile() -> bool {
+    true
+}
+
+fn default_watch_backend() -> String {
+    "notify".to_string()
+}
+
 fn default_max_cpu_percent() -> u8 {
     10
 }
@@ -77,6 +139,34 @@ fn default_flush_interval_ms() -> u64 {
     1000
 }
 
+fn default_scan_threads() -> usize {
+    0
+}
+
+fn default_max_queue_size() -> usize {
+    10000
+}
+
+fn default_wal() -> bool {
+    true
+}
+
+fn default_synchronous() -> String {
+    "normal".to_string()
+}
+
+fn default_mmap_size_mb() -> u64 {
+    256
+}
+
+fn default_cache_size_mb() -> u64 {
+    16
+}
+
+fn default_busy_timeout_ms() -> u64 {
+    5000
+}
+
 fn default_keyboard_shortcut() -> String {
     "Super+Space".to_string()
 }
@@ -91,6 +181,8 @@ impl Default for Config {
             indexing: IndexingConfig::default(),
             performance: PerformanceConfig::default(),
             ui: UiConfig::default(),
+            database: DatabaseConfig::default(),
+            metrics: MetricsConfig::default(),
         }
     }
 }
@@ -105,6 +197,8 @@ impl Default for IndexingConfig {
                 ".git".to_string(),
                 "target".to_string(),
             ],
+            startup_reconcile: true,
+            watch_backend: default_watch_backend(),
         }
     }
 }
@@ -116,6 +210,8 @@ impl Default for PerformanceConfig {
             max_memory_mb: 100,
             batch_size: 100,
             flush_interval_ms: 1000,
+            scan_threads: 0,
+            max_queue_size: 10000,
         }
     }
 }
@@ -129,6 +225,18 @@ impl Default for UiConfig {
     }
 }
 
+impl Default for DatabaseConfig {
+    fn default() -> Self {
+        DatabaseConfig {
+            wal: true,
+            synchronous: "normal".to_string(),
+            mmap_size_mb: 256,
+            cache_size_mb: 16,
+            busy_timeout_ms: 5000,
+        }
+    }
+}
+
 impl Config {
     /// Load configuration from a TOML file
     pub fn load_from_file<P: AsRef<Path>>(path: P) -> Result<Self, ConfigError> {
@@ -169,6 +277,13 @@ impl Config {
             ));
         }
 
+        // Validate watch_backend names a known backend
+        if !["notify", "fanotify", "auto"].contains(&self.indexing.watch_backend.to_lowercase().as_str()) {
+            return Err(ConfigError::ValidationError(
+                "watch_backend must be one of notify, fanotify or auto".to_string()
+            ));
+        }
+
         // Validate max_cpu_percent is reasonable
         if self.performance.max_cpu_percent == 0 || self.performance.max_cpu_percent > 100 {
             return Err(ConfigError::ValidationError(
@@ -197,6 +312,13 @@ impl Config {
             ));
         }
 
+        // Validate max_queue_size is reasonable
+        if self.performance.max_queue_size == 0 {
+            return Err(ConfigError::ValidationError(
+                "max_queue_size must be greater than 0".to_string()
+            ));
+        }
+
         // Validate max_results is reasonable
         if self.ui.max_results == 0 {
             return Err(ConfigError::ValidationError(
@@ -211,6 +333,21 @@ impl Config {
             ));
         }
 
+        // Validate synchronous is a level SQLite understands
+        if !["off", "normal", "full", "extra"].contains(&self.database.synchronous.to_lowercase().as_str()) {
+            return Err(ConfigError::ValidationError(
+                "synchronous must be one of off, normal, full or extra".to_string()
+            ));
+        }
+
+        // Validate prometheus_address is a socket address, if set
+        let prometheus_address = &self.metrics.prometheus_address;
+        if !prometheus_address.is_empty() && prometheus_address.parse::<std::net::SocketAddr>().is_err() {
+            return Err(ConfigError::ValidationError(
+                "prometheus_address must be an IP address and port, such as 127.0.0.1:9469".to_string()
+            ));
+        }
+
         Ok(())
     }
 
@@ -219,6 +356,35 @@ impl Config {
         Duration::from_millis(self.performance.flush_interval_ms)
     }
 
+    /// Get the number of threads the initial scan may use
+    ///
+    /// A thread keeps roughly one CPU busy, so the count is capped at the share of
+    /// CPUs allowed by `max_cpu_percent` (at least one).
+    pub fn scan_threads(&self) -> usize {
+        let cpus = std::thread::available_parallelism()
+            .map(|n| n.get())
+            .unwrap_or(1);
+
+        let requested = match self.performance.scan_threads {
+            0 => cpus,
+            n => n,
+        };
+
+        let cpu_budget = (cpus * self.performance.max_cpu_percent as usize + 99) / 100;
+        requested.min(cpu_budget.max(1))
+    }
+
+    /// Get the number of scan batches that may wait for the database writer
+    ///
+    /// Half of `max_memory_mb` is reserved for in-flight scan results; the rest is
+    /// left for the database cache and the daemon itself.
+    pub fn scan_pipeline_depth(&self) -> usize {
+        let budget = self.performance.max_memory_mb * 1024 * 1024 / 2;
+        let batch_bytes = (self.performance.batch_size as u64).max(1) * ESTIMATED_ENTRY_BYTES;
+
+        ((budget / batch_bytes) as usize).clamp(1, MAX_SCAN_PIPELINE_DEPTH)
+    }
+
     /// Expand tilde in paths to home directory
     pub fn expand_paths(&self) -> Vec<PathBuf> {
         self.indexing.include_paths
@@ -228,6 +394,43 @@ impl Config {
     }
 }
 
+/// Changes to what is indexed between two configurations
+///
+/// Include paths are compared after expansion. Nested or overlapping paths
+/// are reported as they are; deciding what they cover is left to the caller.
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct IndexingChanges {
+    pub added_paths: Vec<PathBuf>,
+    pub removed_paths: Vec<PathBuf>,
+    pub added_patterns: Vec<String>,
+    pub removed_patterns: Vec<String>,
+}
+
+impl IndexingChanges {
+    /// Compare the include paths and exclusion patterns of `old` and `new`
+    pub fn between(old: &Config, new: &Config) -> Self {
+        let old_paths = old.expand_paths();
+        let new_paths = new.expand_paths();
+        let old_patterns = &old.indexing.exclude_patterns;
+        let new_patterns = &new.indexing.exclude_patterns;
+
+        IndexingChanges {
+            added_paths: new_paths.iter().filter(|p| !old_paths.contains(p)).cloned().collect(),
+            removed_paths: old_paths.iter().filter(|p| !new_paths.contains(p)).cloned().collect(),
+            added_patterns: new_patterns.iter().filter(|p| !old_patterns.contains(p)).cloned().collect(),
+            removed_patterns: old_patterns.iter().filter(|p| !new_patterns.contains(p)).cloned().collect(),
+        }
+    }
+
+    /// Check whether the index is unaffected
+    pub fn is_empty(&self) -> bool {
+        self.added_paths.is_empty()
+            && self.removed_paths.is_empty()
+            && self.added_patterns.is_empty()
+            && self.removed_patterns.is_empty()
+    }
+}
+
 /// Expand tilde (~) to home directory
 fn expand_tilde(path: &str) -> PathBuf {
     if path.starts_with("~/") {
@@ -390,12 +593,17 @@ mod tests {
     fn test_default_config() {
         let config = Config::default();
         assert_eq!(config.indexing.include_paths, vec!["~"]);
+        assert!(config.indexing.startup_reconcile);
+        assert_eq!(config.indexing.watch_backend, "notify");
         assert_eq!(config.performance.max_cpu_percent, 10);
         assert_eq!(config.performance.max_memory_mb, 100);
         assert_eq!(config.performance.batch_size, 100);
         assert_eq!(config.performance.flush_interval_ms, 1000);
+        assert_eq!(config.performance.max_queue_size, 10000);
         assert_eq!(config.ui.keyboard_shortcut, "Super+Space");
         assert_eq!(config.ui.max_results, 50);
+        assert!(config.database.wal);
+        assert_eq!(config.database.synchronous, "normal");
     }
 
     #[test]
@@ -481,11 +689,46 @@ max_results = 100
         config.performance.flush_interval_ms = 0;
         assert!(config.validate().is_err());
         
+        config = Config::default();
+        config.performance.max_queue_size = 0;
+        assert!(config.validate().is_err());
+        
         config = Config::default();
         config.ui.max_results = 0;
         assert!(config.validate().is_err());
     }
 
+    #[test]
+    fn test_validation_invalid_synchronous() {
+        let mut config = Config::default();
+        config.database.synchronous = "FULL".to_string();
+        assert!(config.validate().is_ok());
+        
+        config.database.synchronous = "sometimes".to_string();
+        assert!(config.validate().is_err());
+    }
+
+    #[test]
+    fn test_validation_invalid_watch_backend() {
+        let mut config = Config::default();
+        config.indexing.watch_backend = "Fanotify".to_string();
+        assert!(config.validate().is_ok());
+        
+        config.indexing.watch_backend = "inotify".to_string();
+        assert!(config.validate().is_err());
+    }
+
+    #[test]
+    fn test_validation_invalid_prometheus_address() {
+        let mut config = Config::default();
+        assert!(config.metrics.prometheus_address.is_empty());
+        config.metrics.prometheus_address = "127.0.0.1:9469".to_string();
+        assert!(config.validate().is_ok());
+        
+        config.metrics.prometheus_address = "localhost".to_string();
+        assert!(config.validate().is_err());
+    }
+
     #[test]
     fn test_validation_empty_keyboard_shortcut() {
         let mut config = Config::default();
@@ -528,12 +771,66 @@ max_results = 100
         assert_eq!(expanded[1], PathBuf::from(&home).join("Documents"));
     }
 
+    #[test]
+    fn test_indexing_changes() {
+        let old = Config::default();
+        assert!(IndexingChanges::between(&old, &old.clone()).is_empty());
+
+        let mut new = old.clone();
+        new.indexing.include_paths = vec!["/srv/data".to_string()];
+        new.indexing.exclude_patterns.retain(|pattern| pattern != "node_modules");
+        new.indexing.exclude_patterns.push("*.iso".to_string());
+        new.performance.batch_size = 10;
+
+        let changes = IndexingChanges::between(&old, &new);
+        assert_eq!(changes.added_paths, vec![PathBuf::from("/srv/data")]);
+        assert_eq!(changes.removed_paths, old.expand_paths());
+        assert_eq!(changes.added_patterns, vec!["*.iso".to_string()]);
+        assert_eq!(changes.removed_patterns, vec!["node_modules".to_string()]);
+    }
+
     #[test]
     fn test_flush_interval() {
         let config = Config::default();
         assert_eq!(config.flush_interval(), Duration::from_millis(1000));
     }
 
+    #[test]
+    fn test_scan_threads() {
+        let cpus = std::thread::available_parallelism().map(|n| n.get()).unwrap_or(1);
+        let mut config = Config::default();
+        
+        // Explicit count is honoured when the CPU budget allows it
+        config.performance.max_cpu_percent = 100;
+        config.performance.scan_threads = 1;
+        assert_eq!(config.scan_threads(), 1);
+        
+        // Automatic count uses every CPU under a full budget
+        config.performance.scan_threads = 0;
+        assert_eq!(config.scan_threads(), cpus);
+        
+        // The CPU budget caps the thread count but never below one
+        config.performance.max_cpu_percent = 1;
+        config.performance.scan_threads = 64;
+        assert_eq!(config.scan_threads(), 1);
+    }
+
+    #[test]
+    fn test_scan_pipeline_depth() {
+        let mut config = Config::default();
+        
+        // 50 MB budget / (100 entries * 256 bytes) exceeds the cap
+        assert_eq!(config.scan_pipeline_depth(), MAX_SCAN_PIPELINE_DEPTH);
+        
+        // 0.5 MB budget / 25.6 KB batches
+        config.performance.max_memory_mb = 1;
+        assert_eq!(config.scan_pipeline_depth(), 20);
+        
+        // Huge batches still leave room for one in flight
+        config.performance.batch_size = 1_000_000;
+        assert_eq!(config.scan_pipeline_depth(), 1);
+    }
+
     #[test]
     fn test_partial_config() {
         let mut temp_file = NamedTempFile::new().unwrap();
@@ -1,10 +1,125 @@
-use rusqlite::{Connection, Result as SqliteResult, params, OptionalExtension};
+use rusqlite::{Connection, OpenFlags, Result as SqliteResult, params, OptionalExtension};
+use std::collections::HashMap;
 use std::path::{Path, PathBuf};
-use std::time::{SystemTime, UNIX_EPOCH, Duration};
-use crate::models::{FileEntry, FileType, IndexOperation};
+use std::time::{SystemTime, UNIX_EPOCH, Duration, Instant};
+use crate::config::DatabaseConfig;
+use crate::desktop::is_desktop_file;
+use crate::metrics::METRICS;
+use crate::models::{AppMetadata, FileEntry, FileType, IndexOperation};
 
 /// Database schema version
-const SCHEMA_VERSION: i32 = 2;
+const SCHEMA_VERSION: i32 = 8;
+
+/// Number of prepared statements kept per connection; covers every batch
+/// statement for both the live and the rebuild tables
+const STATEMENT_CACHE_CAPACITY: usize = 32;
+
+/// Minimum query length (in characters) that can be served by the trigram index
+const MIN_TRIGRAM_QUERY_CHARS: usize = 3;
+
+/// Time after which a launch counts half as much towards an entry's frecency
+const FRECENCY_HALF_LIFE_SECS: f64 = 30.0 * 24.0 * 60.0 * 60.0;
+
+/// Frecency units per half-life, so that scores can be stored as integers
+const FRECENCY_SCALE: f64 = 1024.0;
+
+/// Column definitions of the `files` table, shared with the rebuild shadow table
+///
+/// An entry is stored as its parent directory's id and its own name; the
+/// directory path is kept once in `dirs` instead of in every row. `file_type`
+/// holds `FileType::as_code`. `frecency` is the `add_launch_to_frecency` score
+/// of the entry's launches, kept next to the name so that ranked queries can
+/// read results in order from `idx_frecency`.
+const FILES_COLUMNS: &str = "
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    dir_id INTEGER NOT NULL,
+    filename TEXT NOT NULL,
+    size INTEGER NOT NULL,
+    modified_time INTEGER NOT NULL,
+    file_type INTEGER NOT NULL,
+    indexed_time INTEGER NOT NULL,
+    frecency INTEGER NOT NULL DEFAULT 0,
+    UNIQUE (dir_id, filename)
+";
+
+/// Column definitions of the `dirs` table, shared with the rebuild shadow table
+///
+/// `path` is a `directory_key`. `modified_time_ns` is set once the directory's
+/// listing has been indexed and is NULL for directories that are only known as
+/// the parent of an entry.
+const DIRS_COLUMNS: &str = "
+    id INTEGER PRIMARY KEY AUTOINCREMENT,
+    path TEXT NOT NULL UNIQUE,
+    modified_time_ns INTEGER
+";
+
+/// Column definitions of the `app_metadata` table, shared with the rebuild
+/// shadow table
+///
+/// One row per indexed `.desktop` file, keyed by its `files` id. Rows of
+/// deleted entries are removed by the `app_metadata_delete` trigger.
+const APPS_COLUMNS: &str = "
+    file_id INTEGER PRIMARY KEY,
+    name TEXT NOT NULL,
+    icon TEXT NOT NULL,
+    exec TEXT NOT NULL,
+    keywords TEXT NOT NULL
+";
+
+/// Entries with their full paths and type names, the form readers query
+const FILE_PATHS_VIEW: &str = "
+    CREATE VIEW IF NOT EXISTS file_paths AS
+    SELECT f.id AS id,
+           f.dir_id AS dir_id,
+           f.filename AS filename,
+           d.path || '/' || f.filename AS path,
+           f.size AS size,
+           f.modified_time AS modified_time,
+           CASE f.file_type
+               WHEN 0 THEN 'regular'
+               WHEN 1 THEN 'directory'
+               WHEN 2 THEN 'symlink'
+               ELSE 'other'
+           END AS file_type,
+           f.indexed_time AS indexed_time,
+           f.frecency AS frecency
+    FROM files f
+    JOIN dirs d ON d.id = f.dir_id
+";
+
+/// Schema name the system index is attached under
+const SYSTEM_SCHEMA: &str = "system";
+
+/// Tables that index operations are applied to
+struct IndexTables {
+    files: &'static str,
+    dirs: &'static str,
+    apps: &'static str,
+    /// Whether `PruneDir` has to look for stale children. A rebuild starts from
+    /// empty tables, so nothing in them can be stale.
+    prune: bool,
+    /// Whether batches count towards the index generation. Shadow tables
+    /// only count once they are swapped in.
+    live: bool,
+}
+
+/// The live index read by the panel
+const LIVE_TABLES: IndexTables = IndexTables {
+    files: "files",
+    dirs: "dirs",
+    apps: "app_metadata",
+    prune: true,
+    live: true,
+};
+
+/// Shadow tables filled by `IndexRebuild` before being swapped in
+const REBUILD_TABLES: IndexTables = IndexTables {
+    files: "files_rebuild",
+    dirs: "dirs_rebuild",
+    apps: "app_metadata_rebuild",
+    prune: false,
+    live: false,
+};
 
 /// Database connection wrapper
 pub struct Database {
@@ -14,12 +129,65 @@ pub struct Database {
 impl Database {
     /// Open or create the database at the specified path
     pub fn open<P: AsRef<Path>>(path: P) -> SqliteResult<Self> {
+        Self::open_with_config(path, &DatabaseConfig::default())
+    }
+
+    /// Open or create the database, tuning the connection as configured
+    pub fn open_with_config<P: AsRef<Path>>(path: P, config: &DatabaseConfig) -> SqliteResult<Self> {
         let connection = Connection::open(path)?;
         let db = Database { connection };
+        db.configure(config)?;
         db.initialize()?;
         Ok(db)
     }
 
+    /// Open an existing database for reading only
+    ///
+    /// The schema is left as it is; the connection only waits out locks.
+    pub fn open_read_only<P: AsRef<Path>>(path: P, config: &DatabaseConfig) -> SqliteResult<Self> {
+        let connection = Connection::open_with_flags(
+            path,
+            OpenFlags::SQLITE_OPEN_READ_ONLY | OpenFlags::SQLITE_OPEN_NO_MUTEX | OpenFlags::SQLITE_OPEN_URI,
+        )?;
+        connection.busy_timeout(Duration::from_millis(config.busy_timeout_ms))?;
+        Ok(Database { connection })
+    }
+
+    /// Apply the connection settings
+    ///
+    /// In WAL mode the panel's readers work from a snapshot and never wait for the
+    /// indexer, and with `synchronous=NORMAL` commits no longer fsync; a power
+    /// loss can drop the last transactions but never corrupts the database.
+    fn configure(&self, config: &DatabaseConfig) -> SqliteResult<()> {
+        self.connection.busy_timeout(Duration::from_millis(config.busy_timeout_ms))?;
+
+        if config.wal {
+            // The journal mode persists in the database file, so readers opening
+            // it later pick up WAL as well
+            let mode: String = self.connection.pragma_update_and_check(
+                None,
+                "journal_mode",
+                "WAL",
+                |row| row.get(0),
+            )?;
+            if !mode.eq_ignore_ascii_case("wal") {
+                eprintln!("Warning: database does not support WAL, using {} journal", mode);
+            }
+        }
+
+        self.connection.pragma_update(None, "synchronous", config.synchronous.as_str())?;
+        self.connection.pragma_update(
+            None,
+            "mmap_size",
+            (config.mmap_size_mb * 1024 * 1024) as i64,
+        )?;
+        // A negative cache_size is in KiB rather than pages
+        self.connection.pragma_update(None, "cache_size", -((config.cache_size_mb * 1024) as i64))?;
+
+        self.connection.set_prepared_statement_cache_capacity(STATEMENT_CACHE_CAPACITY);
+        Ok(())
+    }
+
     /// Initialize the database schema
     fn initialize(&self) -> SqliteResult<()> {
         // Check current schema version
@@ -41,15 +209,7 @@ impl Database {
     fn create_schema(&self) -> SqliteResult<()> {
         // Create files table
         self.connection.execute(
-            "CREATE TABLE IF NOT EXISTS files (
-                id INTEGER PRIMARY KEY AUTOINCREMENT,
-                filename TEXT NOT NULL,
-                path TEXT NOT NULL UNIQUE,
-                size INTEGER NOT NULL,
-                modified_time INTEGER NOT NULL,
-                file_type TEXT NOT NULL,
-                indexed_time INTEGER NOT NULL
-            )",
+            &format!("CREATE TABLE IF NOT EXISTS files ({})", FILES_COLUMNS),
             [],
         )?;
 
@@ -66,43 +226,150 @@ impl Database {
         )?;
 
         // Create indexes for efficient searching
+        self.create_file_indexes()?;
+
+        self.create_usage_index()?;
+
         self.connection.execute(
-            "CREATE INDEX IF NOT EXISTS idx_filename ON files(filename COLLATE NOCASE)",
+            "CREATE INDEX IF NOT EXISTS idx_usage_launch_count ON usage_stats(launch_count DESC)",
             [],
         )?;
 
+        // Create metadata table
         self.connection.execute(
-            "CREATE INDEX IF NOT EXISTS idx_path ON files(path COLLATE NOCASE)",
+            "CREATE TABLE IF NOT EXISTS metadata (
+                key TEXT PRIMARY KEY,
+                value TEXT NOT NULL
+            )",
             [],
         )?;
 
+        // Create substring search index
+        self.create_filename_index()?;
+
+        // Create directory tracking for startup reconciliation
+        self.create_directory_tables()?;
+
+        // Create the full-path view over both
+        self.create_path_view()?;
+
+        // Create launcher metadata for applications
+        self.create_app_table()?;
+
+        // Create launch tracking for entries of the system index
+        self.create_system_usage_table()?;
+
+        Ok(())
+    }
+
+    /// Create the table holding launches of entries in the system index
+    ///
+    /// Those entries are not in `files`, so their launches are keyed by path.
+    /// `frecency` is the `add_launch_to_frecency` score, as in `files`.
+    fn create_system_usage_table(&self) -> SqliteResult<()> {
         self.connection.execute(
-            "CREATE INDEX IF NOT EXISTS idx_modified_time ON files(modified_time)",
+            "CREATE TABLE IF NOT EXISTS system_usage (
+                path TEXT PRIMARY KEY,
+                launch_count INTEGER NOT NULL DEFAULT 0,
+                last_launched INTEGER,
+                frecency INTEGER NOT NULL DEFAULT 0
+            )",
             [],
         )?;
+        Ok(())
+    }
 
+    /// Create the secondary indexes on `files`
+    fn create_file_indexes(&self) -> SqliteResult<()> {
         self.connection.execute(
-            "CREATE INDEX IF NOT EXISTS idx_usage_file_id ON usage_stats(file_id)",
+            "CREATE INDEX IF NOT EXISTS idx_filename ON files(filename COLLATE NOCASE)",
             [],
         )?;
 
         self.connection.execute(
-            "CREATE INDEX IF NOT EXISTS idx_usage_launch_count ON usage_stats(launch_count DESC)",
+            "CREATE INDEX IF NOT EXISTS idx_modified_time ON files(modified_time)",
             [],
         )?;
 
-        // Create metadata table
+        // Ranked queries walk this in result order and stop at their limit
         self.connection.execute(
-            "CREATE TABLE IF NOT EXISTS metadata (
-                key TEXT PRIMARY KEY,
-                value TEXT NOT NULL
-            )",
+            "CREATE INDEX IF NOT EXISTS idx_frecency ON files(frecency DESC, filename COLLATE NOCASE)",
+            [],
+        )?;
+
+        Ok(())
+    }
+
+    /// Create the index that gives each entry at most one `usage_stats` row
+    fn create_usage_index(&self) -> SqliteResult<()> {
+        self.connection.execute(
+            "CREATE UNIQUE INDEX IF NOT EXISTS idx_usage_file_id ON usage_stats(file_id)",
             [],
         )?;
+        Ok(())
+    }
+
+    /// Create the trigram FTS5 index over filenames and the triggers that keep it in sync
+    ///
+    /// `files_fts` is an external-content table backed by `files`, so it stores only the
+    /// trigram postings. The triggers fire for every statement issued by
+    /// `try_execute_batch`, keeping the index consistent within the same transaction.
+    fn create_filename_index(&self) -> SqliteResult<()> {
+        self.connection.execute_batch(
+            "CREATE VIRTUAL TABLE IF NOT EXISTS files_fts USING fts5(
+                filename,
+                content='files',
+                content_rowid='id',
+                tokenize='trigram'
+            );
+
+            CREATE TRIGGER IF NOT EXISTS files_fts_insert AFTER INSERT ON files BEGIN
+                INSERT INTO files_fts (rowid, filename) VALUES (new.id, new.filename);
+            END;
+
+            CREATE TRIGGER IF NOT EXISTS files_fts_delete AFTER DELETE ON files BEGIN
+                INSERT INTO files_fts (files_fts, rowid, filename)
+                VALUES ('delete', old.id, old.filename);
+            END;
+
+            CREATE TRIGGER IF NOT EXISTS files_fts_update AFTER UPDATE OF filename ON files
+            WHEN old.filename IS NOT new.filename BEGIN
+                INSERT INTO files_fts (files_fts, rowid, filename)
+                VALUES ('delete', old.id, old.filename);
+                INSERT INTO files_fts (rowid, filename) VALUES (new.id, new.filename);
+            END;",
+        )
+    }
 
+    /// Create the directory table
+    ///
+    /// `dirs` holds the path of every directory containing an indexed entry and
+    /// the modification time of every directory whose listing was indexed. The
+    /// children of a directory are found through the `(dir_id, filename)` index
+    /// of `files`, and a subtree through a range on `dirs.path`.
+    fn create_directory_tables(&self) -> SqliteResult<()> {
+        self.connection.execute(&format!("CREATE TABLE IF NOT EXISTS dirs ({})", DIRS_COLUMNS), [])?;
         Ok(())
     }
 
+    /// Create the `file_paths` view that joins entries to their directories
+    fn create_path_view(&self) -> SqliteResult<()> {
+        self.connection.execute(FILE_PATHS_VIEW, [])?;
+        Ok(())
+    }
+
+    /// Create the launcher metadata table and the trigger that follows deletions
+    fn create_app_table(&self) -> SqliteResult<()> {
+        self.connection.execute_batch(&format!(
+            "CREATE TABLE IF NOT EXISTS app_metadata ({});
+
+            CREATE TRIGGER IF NOT EXISTS app_metadata_delete AFTER DELETE ON files BEGIN
+                DELETE FROM app_metadata WHERE file_id = old.id;
+            END;",
+            APPS_COLUMNS,
+        ))
+    }
+
     /// Get the current schema version
     fn get_schema_version(&self) -> SqliteResult<i32> {
         // Check if metadata table exists
@@ -141,6 +408,12 @@ impl Database {
         for version in from_version..to_version {
             match version {
                 1 => self.migrate_v1_to_v2()?,
+                2 => self.migrate_v2_to_v3()?,
+                3 => self.migrate_v3_to_v4()?,
+                4 => self.migrate_v4_to_v5()?,
+                5 => self.migrate_v5_to_v6()?,
+                6 => self.migrate_v6_to_v7()?,
+                7 => self.migrate_v7_to_v8()?,
                 _ => {
                     // Unknown migration path
                     return Err(rusqlite::Error::InvalidQuery);
@@ -179,6 +452,237 @@ impl Database {
         Ok(())
     }
 
+    /// Migrate from version 2 to version 3 (add trigram filename index)
+    fn migrate_v2_to_v3(&self) -> SqliteResult<()> {
+        self.create_filename_index()?;
+
+        // Populate the index from the existing rows
+        self.connection.execute(
+            "INSERT INTO files_fts (files_fts) VALUES ('rebuild')",
+            [],
+        )?;
+
+        Ok(())
+    }
+
+    /// Migrate from version 3 to version 4 (add directory tracking)
+    ///
+    /// `dirs` starts empty, so the first reconciliation lists every directory.
+    fn migrate_v3_to_v4(&self) -> SqliteResult<()> {
+        self.create_directory_tables()
+    }
+
+    /// Migrate from version 4 to version 5 (intern directory paths)
+    ///
+    /// Entries keep their ids, so usage statistics and the trigram index stay
+    /// valid. The file is vacuumed afterwards to hand the freed pages back.
+    fn migrate_v4_to_v5(&self) -> SqliteResult<()> {
+        let tx = self.connection.unchecked_transaction()?;
+        tx.execute_batch(&format!(
+            "CREATE TABLE dirs_v5 ({dirs_columns});
+            INSERT OR IGNORE INTO dirs_v5 (path, modified_time_ns)
+                SELECT rtrim(path, '/'), modified_time_ns FROM dirs;
+            INSERT OR IGNORE INTO dirs_v5 (path)
+                SELECT DISTINCT substr(path, 1, length(path) - length(filename) - 1) FROM files;
+
+            CREATE TABLE files_v5 ({files_columns});
+            INSERT OR IGNORE INTO files_v5
+                (id, dir_id, filename, size, modified_time, file_type, indexed_time)
+                SELECT f.id, d.id, f.filename, f.size, f.modified_time,
+                       CASE f.file_type
+                           WHEN 'regular' THEN 0
+                           WHEN 'directory' THEN 1
+                           WHEN 'symlink' THEN 2
+                           ELSE 3
+                       END,
+                       f.indexed_time
+                FROM files f
+                JOIN dirs_v5 d ON d.path = substr(f.path, 1, length(f.path) - length(f.filename) - 1);
+
+            DROP TABLE files;
+            ALTER TABLE files_v5 RENAME TO files;
+            DROP TABLE dirs;
+            ALTER TABLE dirs_v5 RENAME TO dirs;
+            DELETE FROM usage_stats WHERE file_id NOT IN (SELECT id FROM files);",
+            dirs_columns = DIRS_COLUMNS,
+            files_columns = FILES_COLUMNS,
+        ))?;
+        
+        // Dropping `files` also dropped its indexes and the FTS triggers
+        self.create_file_indexes()?;
+        self.create_path_view()?;
+        self.create_filename_index()?;
+        tx.execute("INSERT INTO files_fts (files_fts) VALUES ('rebuild')", [])?;
+        tx.commit()?;
+        
+        self.connection.execute_batch("VACUUM")
+    }
+
+    /// Migrate from version 5 to version 6 (add launcher metadata)
+    ///
+    /// The table starts empty; application directories are walked in full on
+    /// every start, which fills it in.
+    fn migrate_v5_to_v6(&self) -> SqliteResult<()> {
+        self.create_app_table()
+    }
+
+    /// Migrate from version 6 to version 7 (add frecency ranking)
+    ///
+    /// Duplicate usage rows, which the panel could create before file ids
+    /// were unique, are merged. Only the latest launch of each entry is
+    /// known, so existing scores count every launch as made at that time.
+    fn migrate_v6_to_v7(&self) -> SqliteResult<()> {
+        let tx = self.connection.unchecked_transaction()?;
+
+        // Tables rebuilt by the version 5 migration already have the column
+        let has_frecency: bool = tx.query_row(
+            "SELECT COUNT(*) FROM pragma_table_info('files') WHERE name = 'frecency'",
+            [],
+            |row| row.get::<_, i64>(0),
+        )? > 0;
+        if !has_frecency {
+            tx.execute("ALTER TABLE files ADD COLUMN frecency INTEGER NOT NULL DEFAULT 0", [])?;
+        }
+
+        tx.execute_batch(
+            "DROP VIEW IF EXISTS file_paths;
+            DROP INDEX IF EXISTS idx_usage_file_id;
+            CREATE TEMP TABLE usage_merged AS
+                SELECT file_id, SUM(launch_count) AS launch_count, MAX(last_launched) AS last_launched
+                FROM usage_stats GROUP BY file_id;
+            DELETE FROM usage_stats;
+            INSERT INTO usage_stats (file_id, launch_count, last_launched)
+                SELECT file_id, launch_count, last_launched FROM usage_merged;
+            DROP TABLE usage_merged;",
+        )?;
+        self.create_usage_index()?;
+        self.create_file_indexes()?;
+        self.create_path_view()?;
+
+        let usage: Vec<(i64, i64, Option<i64>)> = {
+            let mut stmt = tx.prepare("SELECT file_id, launch_count, last_launched FROM usage_stats")?;
+            let rows = stmt.query_map([], |row| Ok((row.get(0)?, row.get(1)?, row.get(2)?)))?;
+            rows.collect::<SqliteResult<_>>()?
+        };
+        for (file_id, launch_count, last_launched) in usage {
+            tx.execute(
+                "UPDATE files SET frecency = ? WHERE id = ?",
+                params![frecency_from_usage(launch_count, last_launched.unwrap_or(0)), file_id],
+            )?;
+        }
+
+        tx.commit()
+    }
+
+    /// Migrate from version 7 to version 8 (add launches of system index entries)
+    fn migrate_v7_to_v8(&self) -> SqliteResult<()> {
+        self.create_system_usage_table()
+    }
+
+    /// Attach the system index at `path` read-only, if there is one
+    ///
+    /// The system index holds the applications shared by every user. It is
+    /// built by `novasearch-daemon system-index` with the same schema and read
+    /// alongside this database. Returns false if `path` holds no index.
+    pub fn attach_system_index(&self, path: &Path) -> SqliteResult<bool> {
+        if !path.is_file() {
+            return Ok(false);
+        }
+
+        // A URI, so even a read-write connection cannot write to it
+        let mut uri = String::from("file:");
+        for c in path.to_string_lossy().chars() {
+            match c {
+                '%' => uri.push_str("%25"),
+                '?' => uri.push_str("%3f"),
+                '#' => uri.push_str("%23"),
+                c => uri.push(c),
+            }
+        }
+        uri.push_str("?mode=ro");
+        self.connection.execute(&format!("ATTACH DATABASE ?1 AS {}", SYSTEM_SCHEMA), [uri])?;
+
+        let has_entries: bool = self.connection.query_row(
+            &format!("SELECT COUNT(*) FROM {}.sqlite_master WHERE name = 'file_paths'", SYSTEM_SCHEMA),
+            [],
+            |row| row.get::<_, i64>(0),
+        )? > 0;
+        if !has_entries {
+            self.connection.execute(&format!("DETACH DATABASE {}", SYSTEM_SCHEMA), [])?;
+        }
+        Ok(has_entries)
+    }
+
+    /// Check whether a system index is attached
+    pub fn has_system_index(&self) -> bool {
+        self.connection
+            .query_row(
+                &format!("SELECT COUNT(*) FROM pragma_database_list WHERE name = '{}'", SYSTEM_SCHEMA),
+                [],
+                |row| row.get::<_, i64>(0),
+            )
+            .map_or(false, |count| count > 0)
+    }
+
+    /// Get the number of batches committed to the attached system index, or
+    /// 0 without one
+    pub fn system_generation(&self) -> SqliteResult<u64> {
+        if !self.has_system_index() {
+            return Ok(0);
+        }
+        let generation: Option<i64> = self.connection.query_row(
+            &format!(
+                "SELECT CAST(value AS INTEGER) FROM {}.metadata WHERE key = 'index_generation'",
+                SYSTEM_SCHEMA,
+            ),
+            [],
+            |row| row.get(0),
+        ).optional()?;
+
+        Ok(generation.unwrap_or(0) as u64)
+    }
+
+    /// Move the launches of entries below `roots` to `system_usage`
+    ///
+    /// Used once a system index takes over the system application
+    /// directories, whose entries this index then drops. Returns the roots
+    /// that have entries indexed here.
+    pub fn copy_usage_to_system(&self, roots: &[PathBuf]) -> SqliteResult<Vec<PathBuf>> {
+        let tx = self.connection.unchecked_transaction()?;
+        let mut indexed = Vec::new();
+        for root in roots {
+            let key = directory_key(root);
+            let lower = format!("{}/", key);
+            let upper = format!("{}0", key);
+
+            let has_entries: bool = tx.query_row(
+                "SELECT COUNT(*) FROM dirs WHERE path = ?1 OR (path >= ?2 AND path < ?3)",
+                params![key, lower, upper],
+                |row| row.get::<_, i64>(0),
+            )? > 0;
+            if !has_entries {
+                continue;
+            }
+
+            tx.execute(
+                "INSERT INTO system_usage (path, launch_count, last_launched, frecency)
+                 SELECT f.path, u.launch_count, u.last_launched, f.frecency
+                 FROM usage_stats u
+                 JOIN file_paths f ON f.id = u.file_id
+                 JOIN dirs d ON d.id = f.dir_id
+                 WHERE d.path = ?1 OR (d.path >= ?2 AND d.path < ?3)
+                 ON CONFLICT(path) DO UPDATE SET
+                    launch_count = MAX(launch_count, excluded.launch_count),
+                    last_launched = MAX(last_launched, excluded.last_launched),
+                    frecency = MAX(frecency, excluded.frecency)",
+                params![key, lower, upper],
+            )?;
+            indexed.push(root.clone());
+        }
+        tx.commit()?;
+        Ok(indexed)
+    }
+
     /// Get the underlying connection (for testing and operations)
     pub fn connection(&self) -> &Connection {
         &self.connection
@@ -188,16 +692,18 @@ impl Database {
     pub fn insert_file(&self, entry: &FileEntry) -> SqliteResult<i64> {
         let modified_time = system_time_to_timestamp(entry.modified_time);
         let indexed_time = system_time_to_timestamp(entry.indexed_time);
+        let (dir, filename) = entry_location(&entry.path);
+        let dir_id = directory_id(&self.connection, &LIVE_TABLES, &dir, &mut HashMap::new())?;
         
         self.connection.execute(
-            "INSERT INTO files (filename, path, size, modified_time, file_type, indexed_time)
+            "INSERT INTO files (dir_id, filename, size, modified_time, file_type, indexed_time)
              VALUES (?, ?, ?, ?, ?, ?)",
             params![
-                entry.filename,
-                entry.path.to_string_lossy().to_string(),
+                dir_id,
+                filename,
                 entry.size as i64,
                 modified_time,
-                entry.file_type.as_str(),
+                entry.file_type.as_code(),
                 indexed_time,
             ],
         )?;
@@ -207,82 +713,72 @@ impl Database {
 
     /// Update an existing file entry
     pub fn update_file(&self, entry: &FileEntry) -> SqliteResult<()> {
-        let modified_time = system_time_to_timestamp(entry.modified_time);
-        let indexed_time = system_time_to_timestamp(entry.indexed_time);
-        
-        self.connection.execute(
-            "INSERT INTO files (filename, path, size, modified_time, file_type, indexed_time)
-             VALUES (?, ?, ?, ?, ?, ?)
-             ON CONFLICT(path) DO UPDATE SET
-                filename = excluded.filename,
-                size = excluded.size,
-                modified_time = excluded.modified_time,
-                file_type = excluded.file_type,
-                indexed_time = excluded.indexed_time",
-            params![
-                entry.filename,
-                entry.path.to_string_lossy().to_string(),
-                entry.size as i64,
-                modified_time,
-                entry.file_type.as_str(),
-                indexed_time,
-            ],
-        )?;
-        
-        Ok(())
+        upsert_file(&self.connection, &LIVE_TABLES, entry, &mut HashMap::new())
     }
 
     /// Delete a file entry by path
     pub fn delete_file<P: AsRef<Path>>(&self, path: P) -> SqliteResult<()> {
-        self.connection.execute(
-            "DELETE FROM files WHERE path = ?",
-            params![path.as_ref().to_string_lossy().to_string()],
-        )?;
-        Ok(())
+        delete_file(&self.connection, &LIVE_TABLES, path.as_ref())
     }
 
     /// Move a file entry (update its path)
     pub fn move_file<P: AsRef<Path>>(&self, from: P, to: P) -> SqliteResult<()> {
-        let to_path = to.as_ref();
-        let filename = to_path
-            .file_name()
-            .and_then(|n| n.to_str())
-            .unwrap_or("")
-            .to_string();
-        
-        self.connection.execute(
-            "UPDATE files SET path = ?, filename = ? WHERE path = ?",
-            params![
-                to_path.to_string_lossy().to_string(),
-                filename,
-                from.as_ref().to_string_lossy().to_string(),
-            ],
-        )?;
-        Ok(())
+        move_file(&self.connection, &LIVE_TABLES, from.as_ref(), to.as_ref(), &mut HashMap::new())
     }
 
     /// Query files by filename pattern with usage-based ranking
+    ///
+    /// Queries of at least three characters are answered from the trigram index, so the
+    /// cost scales with the number of candidates rather than the size of `files`. Shorter
+    /// queries cannot be decomposed into trigrams. For them, the best `limit` prefix and
+    /// substring matches are read from `idx_frecency` in ranked order, stopping at the
+    /// limit, and only those are ranked together with the exact matches.
     pub fn query_files(&self, query: &str, limit: usize) -> SqliteResult<Vec<FileEntry>> {
-        let mut stmt = self.connection.prepare(
+        // Applications also match on their name and keywords; app_metadata
+        // holds one row per launcher, so scanning it is cheap
+        let filter = if query.chars().count() >= MIN_TRIGRAM_QUERY_CHARS {
+            "WHERE f.id IN (SELECT rowid FROM files_fts WHERE filename LIKE '%' || ?1 || '%')
+                OR f.id IN (SELECT file_id FROM app_metadata
+                            WHERE name LIKE '%' || ?1 || '%' OR keywords LIKE '%' || ?1 || '%')"
+        } else {
+            // A result after the first `limit` prefix or substring matches by
+            // frecency would rank behind all of them
+            "WHERE f.id IN (
+                SELECT id FROM files WHERE filename = ?1 COLLATE NOCASE
+                UNION ALL
+                SELECT * FROM (SELECT id FROM files WHERE filename LIKE ?1 || '%'
+                               ORDER BY frecency DESC, filename COLLATE NOCASE LIMIT ?2)
+                UNION ALL
+                SELECT * FROM (SELECT id FROM files WHERE filename LIKE '%' || ?1 || '%'
+                               ORDER BY frecency DESC, filename COLLATE NOCASE LIMIT ?2)
+                UNION ALL
+                SELECT file_id FROM app_metadata
+                WHERE name LIKE '%' || ?1 || '%' OR keywords LIKE '%' || ?1 || '%'
+            )"
+        };
+
+        let sql = format!(
             "SELECT f.id, f.filename, f.path, f.size, f.modified_time, f.file_type, f.indexed_time,
-                    COALESCE(u.launch_count, 0) as launch_count,
-                    COALESCE(u.last_launched, 0) as last_launched
-             FROM files f
-             LEFT JOIN usage_stats u ON f.id = u.file_id
-             WHERE f.filename LIKE '%' || ? || '%'
+                    a.name, a.icon, a.exec, a.keywords
+             FROM file_paths f
+             LEFT JOIN app_metadata a ON f.id = a.file_id
+             {}
              ORDER BY 
                 CASE 
-                    WHEN f.filename = ? THEN 0
-                    WHEN f.filename LIKE ? || '%' THEN 1
+                    WHEN f.filename = ?1 OR a.name = ?1 THEN 0
+                    WHEN f.filename LIKE ?1 || '%' OR a.name LIKE ?1 || '%' THEN 1
                     ELSE 2
                 END,
-                COALESCE(u.launch_count, 0) DESC,
+                f.frecency DESC,
                 f.filename COLLATE NOCASE
-             LIMIT ?"
-        )?;
+             LIMIT ?2",
+            filter
+        );
+
+        let mut stmt = self.connection.prepare(&sql)?;
 
         let entries = stmt.query_map(
-            params![query, query, query, limit as i64],
+            params![query, limit as i64],
             |row| {
                 Ok(FileEntry {
                     id: Some(row.get(0)?),
@@ -292,6 +788,7 @@ impl Database {
                     modified_time: timestamp_to_system_time(row.get(4)?),
                     file_type: FileType::from_str(&row.get::<_, String>(5)?),
                     indexed_time: timestamp_to_system_time(row.get(6)?),
+                    app: app_metadata_from_row(row, 7)?,
                 })
             },
         )?;
@@ -300,88 +797,134 @@ impl Database {
     }
 
     /// Execute a batch of operations with retry logic
-    pub fn execute_batch(&self, operations: &[IndexOperation]) -> SqliteResult<()> {
-        let max_retries = 5;
-        let mut delay_ms = 100;
-        
-        for attempt in 0..max_retries {
-            match self.try_execute_batch(operations) {
-                Ok(()) => return Ok(()),
-                Err(rusqlite::Error::SqliteFailure(err, _)) 
-                    if err.code == rusqlite::ErrorCode::DatabaseBusy 
-                    || err.code == rusqlite::ErrorCode::DatabaseLocked => 
-                {
-                    if attempt < max_retries - 1 {
-                        std::thread::sleep(Duration::from_millis(delay_ms));
-                        delay_ms = (delay_ms * 2).min(1600); // Cap at 1600ms
-                    } else {
-                        return Err(rusqlite::Error::SqliteFailure(err, None));
-                    }
-                }
-                Err(e) => return Err(e),
-            }
+    ///
+    /// Returns the index generation the batch was committed at.
+    pub fn execute_batch(&self, operations: &[IndexOperation]) -> SqliteResult<u64> {
+        self.execute_batch_into(operations, &LIVE_TABLES)
+    }
+
+    /// Start a full rebuild of the index into shadow tables
+    ///
+    /// The live tables stay untouched, and queryable, until `IndexRebuild::finish`
+    /// swaps the rebuilt tables in.
+    pub fn begin_rebuild(&self) -> SqliteResult<IndexRebuild<'_>> {
+        // Shadow tables carry only the UNIQUE path index needed for upserts;
+        // the remaining indexes are built once the bulk load is complete
+        self.connection.execute_batch(&format!(
+            "DROP TABLE IF EXISTS {files};
+            DROP TABLE IF EXISTS {dirs};
+            DROP TABLE IF EXISTS {apps};
+            CREATE TABLE {files} ({files_columns});
+            CREATE TABLE {dirs} ({dirs_columns});
+            CREATE TABLE {apps} ({apps_columns});",
+            files = REBUILD_TABLES.files,
+            dirs = REBUILD_TABLES.dirs,
+            apps = REBUILD_TABLES.apps,
+            files_columns = FILES_COLUMNS,
+            dirs_columns = DIRS_COLUMNS,
+            apps_columns = APPS_COLUMNS,
+        ))?;
+
+        Ok(IndexRebuild { db: self, finished: false })
+    }
+
+    /// Execute a batch against `tables`, recording its size and duration
+    fn execute_batch_into(&self, operations: &[IndexOperation], tables: &IndexTables) -> SqliteResult<u64> {
+        let start = Instant::now();
+        let result = self.execute_with_retry(|| self.try_execute_batch(operations, tables));
+        METRICS.batch_size.record(operations.len() as u64);
+        METRICS.batch_duration.record_since(start);
+        if result.is_err() {
+            METRICS.batch_errors.incr();
         }
-        
-        unreachable!()
+        result
     }
 
     /// Try to execute a batch of operations (helper for retry logic)
-    fn try_execute_batch(&self, operations: &[IndexOperation]) -> SqliteResult<()> {
+    ///
+    /// Returns the index generation the batch was committed at; batches into
+    /// shadow tables leave it alone and return 0.
+    fn try_execute_batch(
+        &self,
+        operations: &[IndexOperation],
+        tables: &IndexTables,
+    ) -> SqliteResult<u64> {
         // Use unchecked_transaction to work with immutable self
         let tx = self.connection.unchecked_transaction()?;
-            
-            for operation in operations {
-                match operation {
-                    IndexOperation::Add(entry) | IndexOperation::Update(entry) => {
-                        let modified_time = system_time_to_timestamp(entry.modified_time);
-                        let indexed_time = system_time_to_timestamp(entry.indexed_time);
-                        
-                        tx.execute(
-                            "INSERT INTO files (filename, path, size, modified_time, file_type, indexed_time)
-                             VALUES (?, ?, ?, ?, ?, ?)
-                             ON CONFLICT(path) DO UPDATE SET
-                                filename = excluded.filename,
-                                size = excluded.size,
-                                modified_time = excluded.modified_time,
-                                file_type = excluded.file_type,
-                                indexed_time = excluded.indexed_time",
-                            params![
-                                entry.filename,
-                                entry.path.to_string_lossy().to_string(),
-                                entry.size as i64,
-                                modified_time,
-                                entry.file_type.as_str(),
-                                indexed_time,
-                            ],
-                        )?;
-                    }
-                    IndexOperation::Delete(path) => {
-                        tx.execute(
-                            "DELETE FROM files WHERE path = ?",
-                            params![path.to_string_lossy().to_string()],
-                        )?;
-                    }
-                    IndexOperation::Move { from, to } => {
-                        let filename = to
-                            .file_name()
-                            .and_then(|n| n.to_str())
-                            .unwrap_or("")
-                            .to_string();
-                        
-                        tx.execute(
-                            "UPDATE files SET path = ?, filename = ? WHERE path = ?",
-                            params![
-                                to.to_string_lossy().to_string(),
-                                filename,
-                                from.to_string_lossy().to_string(),
-                            ],
-                        )?;
+        // Directory ids looked up so far; subtree operations change them
+        let mut dir_ids = HashMap::new();
+
+        for operation in operations {
+            match operation {
+                IndexOperation::Add(entry) | IndexOperation::Update(entry) => {
+                    upsert_file(&tx, tables, entry, &mut dir_ids)?;
+                }
+                IndexOperation::Delete(path) => {
+                    delete_file(&tx, tables, path)?;
+                }
+                IndexOperation::Move { from, to } => {
+                    move_file(&tx, tables, from, to, &mut dir_ids)?;
+                }
+                IndexOperation::ConfirmDir {
+                    path,
+                    modified_time,
+                } => {
+                    tx.prepare_cached(&format!(
+                        "INSERT INTO {} (path, modified_time_ns) VALUES (?, ?)
+                         ON CONFLICT(path) DO UPDATE SET
+                            modified_time_ns = excluded.modified_time_ns",
+                        tables.dirs,
+                    ))?
+                    .execute(params![
+                        directory_key(path),
+                        system_time_to_nanos(*modified_time),
+                    ])?;
+                }
+                IndexOperation::PruneDir { .. } if !tables.prune => {}
+                IndexOperation::PruneDir { path, keep } => {
+                    let stale: Vec<String> = {
+                        let mut stmt = tx.prepare_cached(&format!(
+                            "SELECT filename FROM {}
+                             WHERE dir_id = (SELECT id FROM {} WHERE path = ?)",
+                            tables.files, tables.dirs,
+                        ))?;
+                        let children = stmt.query_map(params![directory_key(path)], |row| {
+                            row.get::<_, String>(0)
+                        })?;
+
+                        let mut stale = Vec::new();
+                        for child in children {
+                            let filename = child?;
+                            if !keep.contains(&filename) {
+                                stale.push(filename);
+                            }
+                        }
+                        stale
+                    };
+
+                    for filename in stale {
+                        delete_tree(&tx, tables, &path.join(filename))?;
                     }
+                    dir_ids.clear();
+                }
+                IndexOperation::DeleteTree(path) => {
+                    delete_tree(&tx, tables, path)?;
+                    dir_ids.clear();
+                }
+                IndexOperation::MoveTree { from, to } => {
+                    move_tree(&tx, tables, from, to)?;
+                    dir_ids.clear();
                 }
             }
-            
-            tx.commit()?;
-            Ok(())
+        }
+
+        let generation = if tables.live {
+            bump_index_generation(&tx)?
+        } else {
+            0
+        };
+        tx.commit()?;
+        Ok(generation)
     }
 
     /// Execute an operation with exponential backoff retry logic
@@ -400,6 +943,7 @@ impl Database {
                     || err.code == rusqlite::ErrorCode::DatabaseLocked => 
                 {
                     if attempt < max_retries - 1 {
+                        METRICS.batch_retries.incr();
                         std::thread::sleep(Duration::from_millis(delay_ms));
                         delay_ms = (delay_ms * 2).min(1600); // Cap at 1600ms
                     } else {
@@ -413,52 +957,209 @@ impl Database {
         unreachable!()
     }
 
-    /// Get the count of indexed files
-    pub fn count_files(&self) -> SqliteResult<i64> {
-        self.connection.query_row(
-            "SELECT COUNT(*) FROM files",
-            [],
-            |row| row.get(0),
-        )
+    /// Return as much of the page cache to the allocator as possible
+    ///
+    /// Used when the daemon is over its memory budget; the cache refills as
+    /// pages are read again.
+    pub fn release_memory(&self) {
+        if let Err(e) = self.connection.execute_batch("PRAGMA shrink_memory") {
+            eprintln!("Error releasing database memory: {}", e);
+        }
     }
 
-    /// Record that a file was launched/opened
-    pub fn record_file_launch<P: AsRef<Path>>(&self, path: P) -> SqliteResult<()> {
-        let path_str = path.as_ref().to_string_lossy().to_string();
-        let current_time = current_timestamp();
-        
-        // First, get the file ID
-        let file_id: Option<i64> = self.connection.query_row(
-            "SELECT id FROM files WHERE path = ?",
-            params![path_str],
-            |row| row.get(0),
-        ).optional()?;
-        
-        if let Some(file_id) = file_id {
-            // Insert or update usage stats
-            self.connection.execute(
-                "INSERT INTO usage_stats (file_id, launch_count, last_launched)
-                 VALUES (?, 1, ?)
-                 ON CONFLICT(file_id) DO UPDATE SET
-                    launch_count = launch_count + 1,
-                    last_launched = ?",
-                params![file_id, current_time, current_time],
-            )?;
-        }
+    /// Load the modification times recorded for indexed directories
+    pub fn load_directory_times(&self) -> SqliteResult<HashMap<PathBuf, i64>> {
+        let mut stmt = self.connection.prepare(
+            "SELECT path, modified_time_ns FROM dirs WHERE modified_time_ns IS NOT NULL"
+        )?;
+        let rows = stmt.query_map([], |row| {
+            Ok((directory_path(row.get::<_, String>(0)?), row.get::<_, i64>(1)?))
+        })?;
         
-        Ok(())
+        rows.collect()
     }
 
-    /// Get usage statistics for a file
-    pub fn get_file_usage<P: AsRef<Path>>(&self, path: P) -> SqliteResult<Option<(i32, i64)>> {
-        let path_str = path.as_ref().to_string_lossy().to_string();
-        
-        let result = self.connection.query_row(
-            "SELECT u.launch_count, u.last_launched
-             FROM files f
+    /// Load the paths of the indexed entries that are directories
+    ///
+    /// A directory's row is written when its parent is listed, before the
+    /// directory itself is, so this includes directories a scan never got to.
+    pub fn load_indexed_directories(&self) -> SqliteResult<Vec<PathBuf>> {
+        let mut stmt = self.connection.prepare(
+            "SELECT d.path || '/' || f.filename FROM files f JOIN dirs d ON d.id = f.dir_id
+             WHERE f.file_type = ?1"
+        )?;
+        let rows = stmt.query_map([FileType::Directory.as_code()], |row| {
+            Ok(PathBuf::from(row.get::<_, String>(0)?))
+        })?;
+
+        rows.collect()
+    }
+
+    /// Load every indexed entry
+    pub fn load_files(&self) -> SqliteResult<Vec<FileEntry>> {
+        self.load_files_from("main")
+    }
+
+    /// Load every entry of the attached system index
+    pub fn load_system_files(&self) -> SqliteResult<Vec<FileEntry>> {
+        if !self.has_system_index() {
+            return Ok(Vec::new());
+        }
+        self.load_files_from(SYSTEM_SCHEMA)
+    }
+
+    /// Load every entry of the database attached as `schema`
+    fn load_files_from(&self, schema: &str) -> SqliteResult<Vec<FileEntry>> {
+        let mut stmt = self.connection.prepare(&format!(
+            "SELECT f.id, f.filename, f.path, f.size, f.modified_time, f.file_type, f.indexed_time,
+                    a.name, a.icon, a.exec, a.keywords
+             FROM {schema}.file_paths f
+             LEFT JOIN {schema}.app_metadata a ON f.id = a.file_id",
+            schema = schema,
+        ))?;
+        let entries = stmt.query_map([], |row| {
+            Ok(FileEntry {
+                id: Some(row.get(0)?),
+                filename: row.get(1)?,
+                path: PathBuf::from(row.get::<_, String>(2)?),
+                size: row.get::<_, i64>(3)? as u64,
+                modified_time: timestamp_to_system_time(row.get(4)?),
+                file_type: FileType::from_str(&row.get::<_, String>(5)?),
+                indexed_time: timestamp_to_system_time(row.get(6)?),
+                app: app_metadata_from_row(row, 7)?,
+            })
+        })?;
+        
+        entries.collect()
+    }
+
+    /// Load the frecency of every file that has been launched, by path,
+    /// including entries of the system index
+    pub fn load_frecencies(&self) -> SqliteResult<HashMap<String, i64>> {
+        let mut stmt = self.connection.prepare(
+            "SELECT f.path, f.frecency FROM file_paths f WHERE f.frecency > 0
+             UNION ALL
+             SELECT path, frecency FROM main.system_usage WHERE frecency > 0"
+        )?;
+        let rows = stmt.query_map([], |row| Ok((row.get::<_, String>(0)?, row.get::<_, i64>(1)?)))?;
+        
+        rows.collect()
+    }
+
+    /// Load the paths of the most recently launched files, newest first
+    pub fn load_recent_launches(&self, limit: usize) -> SqliteResult<Vec<PathBuf>> {
+        let mut stmt = self.connection.prepare(
+            "SELECT f.path
+             FROM usage_stats u
+             JOIN file_paths f ON f.id = u.file_id
+             WHERE u.last_launched IS NOT NULL
+             GROUP BY f.id
+             ORDER BY MAX(u.last_launched) DESC
+             LIMIT ?1"
+        )?;
+        let rows = stmt.query_map([limit as i64], |row| Ok(PathBuf::from(row.get::<_, String>(0)?)))?;
+
+        rows.collect()
+    }
+
+    /// Get the number of batches committed to the index so far
+    pub fn index_generation(&self) -> SqliteResult<u64> {
+        let generation: Option<i64> = self.connection.query_row(
+            "SELECT CAST(value AS INTEGER) FROM metadata WHERE key = 'index_generation'",
+            [],
+            |row| row.get(0),
+        ).optional()?;
+        
+        Ok(generation.unwrap_or(0) as u64)
+    }
+
+    /// Get a value that changes whenever another connection commits
+    pub fn data_version(&self) -> SqliteResult<i64> {
+        self.connection.pragma_query_value(None, "data_version", |row| row.get(0))
+    }
+
+    /// Get the count of indexed files
+    pub fn count_files(&self) -> SqliteResult<i64> {
+        self.connection.query_row(
+            "SELECT COUNT(*) FROM files",
+            [],
+            |row| row.get(0),
+        )
+    }
+
+    /// Record that a file was launched/opened
+    ///
+    /// Updates the usage statistics and the file's frecency together. Entries
+    /// of the attached system index are counted in `system_usage` instead.
+    pub fn record_file_launch<P: AsRef<Path>>(&self, path: P) -> SqliteResult<()> {
+        let (dir, filename) = entry_location(path.as_ref());
+        let current_time = current_timestamp();
+        let tx = self.connection.unchecked_transaction()?;
+        
+        // First, get the file ID
+        let file: Option<(i64, i64)> = tx.query_row(
+            "SELECT f.id, f.frecency FROM files f JOIN dirs d ON d.id = f.dir_id
+             WHERE d.path = ? AND f.filename = ?",
+            params![dir, filename],
+            |row| Ok((row.get(0)?, row.get(1)?)),
+        ).optional()?;
+        
+        if let Some((file_id, frecency)) = file {
+            // Insert or update usage stats
+            tx.execute(
+                "INSERT INTO usage_stats (file_id, launch_count, last_launched)
+                 VALUES (?, 1, ?)
+                 ON CONFLICT(file_id) DO UPDATE SET
+                    launch_count = launch_count + 1,
+                    last_launched = excluded.last_launched",
+                params![file_id, current_time],
+            )?;
+            tx.execute(
+                "UPDATE files SET frecency = ? WHERE id = ?",
+                params![add_launch_to_frecency(frecency, current_time), file_id],
+            )?;
+        } else if self.has_system_index() {
+            // Entries of the system index are tracked by path in this index
+            let path = path.as_ref().to_string_lossy().into_owned();
+            let frecency: Option<i64> = tx.query_row(
+                &format!(
+                    "SELECT COALESCE(
+                        (SELECT frecency FROM main.system_usage WHERE path = ?3), 0)
+                     FROM {}.files f JOIN {}.dirs d ON d.id = f.dir_id
+                     WHERE d.path = ?1 AND f.filename = ?2",
+                    SYSTEM_SCHEMA, SYSTEM_SCHEMA,
+                ),
+                params![dir, filename, path],
+                |row| row.get(0),
+            ).optional()?;
+
+            if let Some(frecency) = frecency {
+                tx.execute(
+                    "INSERT INTO main.system_usage (path, launch_count, last_launched, frecency)
+                     VALUES (?1, 1, ?2, ?3)
+                     ON CONFLICT(path) DO UPDATE SET
+                        launch_count = launch_count + 1,
+                        last_launched = excluded.last_launched,
+                        frecency = excluded.frecency",
+                    params![path, current_time, add_launch_to_frecency(frecency, current_time)],
+                )?;
+            }
+        }
+        
+        tx.commit()
+    }
+
+    /// Get usage statistics for a file
+    pub fn get_file_usage<P: AsRef<Path>>(&self, path: P) -> SqliteResult<Option<(i32, i64)>> {
+        let (dir, filename) = entry_location(path.as_ref());
+        
+        let result = self.connection.query_row(
+            "SELECT u.launch_count, u.last_launched
+             FROM files f
+             JOIN dirs d ON d.id = f.dir_id
              JOIN usage_stats u ON f.id = u.file_id
-             WHERE f.path = ?",
-            params![path_str],
+             WHERE d.path = ? AND f.filename = ?",
+            params![dir, filename],
             |row| Ok((row.get::<_, i32>(0)?, row.get::<_, i64>(1)?)),
         ).optional()?;
         
@@ -469,7 +1170,7 @@ impl Database {
     pub fn get_most_used_files(&self, limit: usize) -> SqliteResult<Vec<FileEntry>> {
         let mut stmt = self.connection.prepare(
             "SELECT f.id, f.filename, f.path, f.size, f.modified_time, f.file_type, f.indexed_time
-             FROM files f
+             FROM file_paths f
              JOIN usage_stats u ON f.id = u.file_id
              ORDER BY u.launch_count DESC, u.last_launched DESC
              LIMIT ?"
@@ -486,6 +1187,7 @@ impl Database {
                     modified_time: timestamp_to_system_time(row.get(4)?),
                     file_type: FileType::from_str(&row.get::<_, String>(5)?),
                     indexed_time: timestamp_to_system_time(row.get(6)?),
+                    app: None,
                 })
             },
         )?;
@@ -494,6 +1196,379 @@ impl Database {
     }
 }
 
+/// A full index rebuild in progress
+///
+/// Operations are written to shadow tables without secondary indexes, so the
+/// bulk load avoids per-row index maintenance and queries keep reading the
+/// complete previous index. Dropping an unfinished rebuild discards it.
+pub struct IndexRebuild<'a> {
+    db: &'a Database,
+    finished: bool,
+}
+
+impl IndexRebuild<'_> {
+    /// Execute a batch of operations against the shadow tables
+    pub fn execute_batch(&self, operations: &[IndexOperation]) -> SqliteResult<()> {
+        self.db.execute_batch_into(operations, &REBUILD_TABLES).map(|_| ())
+    }
+
+    /// Build the indexes and replace the live tables in a single transaction
+    ///
+    /// Usage statistics are carried over by path. Statistics of files that are
+    /// no longer present are dropped.
+    pub fn finish(mut self) -> SqliteResult<()> {
+        self.db.execute_with_retry(|| self.try_swap())?;
+        self.finished = true;
+        Ok(())
+    }
+
+    /// Try to swap in the rebuilt tables (helper for retry logic)
+    fn try_swap(&self) -> SqliteResult<()> {
+        let db = self.db;
+        // Cached statements still refer to the tables about to be dropped
+        db.connection.flush_prepared_statement_cache();
+        let tx = db.connection.unchecked_transaction()?;
+        
+        // Old and new rows of the same path
+        let renumbering = format!(
+            "files old
+             JOIN dirs old_dir ON old_dir.id = old.dir_id
+             JOIN {dirs} new_dir ON new_dir.path = old_dir.path
+             JOIN {files} new ON new.dir_id = new_dir.id AND new.filename = old.filename",
+            files = REBUILD_TABLES.files,
+            dirs = REBUILD_TABLES.dirs,
+        );
+        
+        // Usage rows move out of the id range first, so that no new id can
+        // meet the old id of another row under the UNIQUE index on file_id.
+        // The view has to go while its tables are swapped, or the renames
+        // would fail on it.
+        tx.execute_batch(&format!(
+            "DELETE FROM usage_stats WHERE file_id NOT IN (SELECT old.id FROM {renumbering});
+            UPDATE usage_stats SET file_id = -file_id;
+            UPDATE usage_stats SET file_id = (
+                SELECT new.id FROM {renumbering} WHERE old.id = -usage_stats.file_id
+            );
+            UPDATE {files} SET frecency = (
+                SELECT old.frecency FROM {renumbering} WHERE new.id = {files}.id
+            ) WHERE id IN (SELECT new.id FROM {renumbering} WHERE old.frecency > 0);
+
+            DROP VIEW file_paths;
+            DROP TABLE files;
+            ALTER TABLE {files} RENAME TO files;
+            DROP TABLE dirs;
+            ALTER TABLE {dirs} RENAME TO dirs;
+            DROP TABLE app_metadata;
+            ALTER TABLE {apps} RENAME TO app_metadata;",
+            renumbering = renumbering,
+            files = REBUILD_TABLES.files,
+            dirs = REBUILD_TABLES.dirs,
+            apps = REBUILD_TABLES.apps,
+        ))?;
+        
+        // Dropping `files` also dropped its indexes and the triggers
+        db.create_file_indexes()?;
+        db.create_path_view()?;
+        db.create_app_table()?;
+        db.create_filename_index()?;
+        tx.execute("INSERT INTO files_fts(files_fts) VALUES('rebuild')", [])?;
+        bump_index_generation(&tx)?;
+        
+        tx.commit()
+    }
+}
+
+impl Drop for IndexRebuild<'_> {
+    fn drop(&mut self) {
+        if !self.finished {
+            let _ = self.db.connection.execute_batch(&format!(
+                "DROP TABLE IF EXISTS {};
+                DROP TABLE IF EXISTS {};
+                DROP TABLE IF EXISTS {};",
+                REBUILD_TABLES.files, REBUILD_TABLES.dirs, REBUILD_TABLES.apps,
+            ));
+        }
+    }
+}
+
+/// Get the id of a directory, adding it to the table if it is new
+///
+/// `dir_ids` caches the ids found so far within one batch.
+fn directory_id(
+    connection: &Connection,
+    tables: &IndexTables,
+    key: &str,
+    dir_ids: &mut HashMap<String, i64>,
+) -> SqliteResult<i64> {
+    if let Some(&id) = dir_ids.get(key) {
+        return Ok(id);
+    }
+    
+    let existing: Option<i64> = connection
+        .prepare_cached(&format!("SELECT id FROM {} WHERE path = ?", tables.dirs))?
+        .query_row(params![key], |row| row.get(0))
+        .optional()?;
+    let id = match existing {
+        Some(id) => id,
+        None => {
+            connection
+                .prepare_cached(&format!("INSERT INTO {} (path) VALUES (?)", tables.dirs))?
+                .execute(params![key])?;
+            connection.last_insert_rowid()
+        }
+    };
+    
+    dir_ids.insert(key.to_string(), id);
+    Ok(id)
+}
+
+/// Insert an entry, or update the one already indexed at its path
+fn upsert_file(
+    connection: &Connection,
+    tables: &IndexTables,
+    entry: &FileEntry,
+    dir_ids: &mut HashMap<String, i64>,
+) -> SqliteResult<()> {
+    let (dir, filename) = entry_location(&entry.path);
+    let dir_id = directory_id(connection, tables, &dir, dir_ids)?;
+    
+    connection
+        .prepare_cached(&format!(
+            "INSERT INTO {} (dir_id, filename, size, modified_time, file_type, indexed_time)
+             VALUES (?, ?, ?, ?, ?, ?)
+             ON CONFLICT(dir_id, filename) DO UPDATE SET
+                size = excluded.size,
+                modified_time = excluded.modified_time,
+                file_type = excluded.file_type,
+                indexed_time = excluded.indexed_time",
+            tables.files,
+        ))?
+        .execute(params![
+            dir_id,
+            filename,
+            entry.size as i64,
+            system_time_to_timestamp(entry.modified_time),
+            entry.file_type.as_code(),
+            system_time_to_timestamp(entry.indexed_time),
+        ])?;
+    
+    if is_desktop_file(&entry.path) {
+        set_app_metadata(connection, tables, dir_id, &filename, entry.app.as_ref())?;
+    }
+    Ok(())
+}
+
+/// Store or clear the launcher metadata of an indexed entry
+fn set_app_metadata(
+    connection: &Connection,
+    tables: &IndexTables,
+    dir_id: i64,
+    filename: &str,
+    app: Option<&AppMetadata>,
+) -> SqliteResult<()> {
+    let file_id: i64 = connection
+        .prepare_cached(&format!("SELECT id FROM {} WHERE dir_id = ? AND filename = ?", tables.files))?
+        .query_row(params![dir_id, filename], |row| row.get(0))?;
+    
+    match app {
+        Some(app) => {
+            connection
+                .prepare_cached(&format!(
+                    "INSERT OR REPLACE INTO {} (file_id, name, icon, exec, keywords)
+                     VALUES (?, ?, ?, ?, ?)",
+                    tables.apps,
+                ))?
+                .execute(params![file_id, app.name, app.icon, app.exec, app.keywords])?;
+        }
+        None => {
+            connection
+                .prepare_cached(&format!("DELETE FROM {} WHERE file_id = ?", tables.apps))?
+                .execute(params![file_id])?;
+        }
+    }
+    Ok(())
+}
+
+/// Delete the entry at a path, leaving anything beneath it
+fn delete_file(connection: &Connection, tables: &IndexTables, path: &Path) -> SqliteResult<()> {
+    let (dir, filename) = entry_location(path);
+    connection
+        .prepare_cached(&format!(
+            "DELETE FROM {} WHERE dir_id = (SELECT id FROM {} WHERE path = ?) AND filename = ?",
+            tables.files, tables.dirs,
+        ))?
+        .execute(params![dir, filename])?;
+    Ok(())
+}
+
+/// Move the entry at a path, leaving anything beneath it
+fn move_file(
+    connection: &Connection,
+    tables: &IndexTables,
+    from: &Path,
+    to: &Path,
+    dir_ids: &mut HashMap<String, i64>,
+) -> SqliteResult<()> {
+    let (from_dir, from_name) = entry_location(from);
+    let (to_dir, to_name) = entry_location(to);
+    let to_dir_id = directory_id(connection, tables, &to_dir, dir_ids)?;
+    
+    connection
+        .prepare_cached(&format!(
+            "UPDATE {} SET dir_id = ?, filename = ?
+             WHERE dir_id = (SELECT id FROM {} WHERE path = ?) AND filename = ?",
+            tables.files, tables.dirs,
+        ))?
+        .execute(params![to_dir_id, to_name, from_dir, from_name])?;
+    Ok(())
+}
+
+/// Delete an entry and everything indexed beneath it
+///
+/// Descendant directories are matched with a range on the binary `dirs.path`
+/// index: every path below `dir` sorts between `dir/` and `dir0`, '0' being the
+/// character after '/'. Their entries go with them.
+fn delete_tree(connection: &Connection, tables: &IndexTables, path: &Path) -> SqliteResult<()> {
+    delete_file(connection, tables, path)?;
+    
+    let key = directory_key(path);
+    let lower = format!("{}/", key);
+    let upper = format!("{}0", key);
+    
+    connection
+        .prepare_cached(&format!(
+            "DELETE FROM {} WHERE dir_id IN (
+                SELECT id FROM {} WHERE path = ? OR (path >= ? AND path < ?)
+            )",
+            tables.files, tables.dirs,
+        ))?
+        .execute(params![key, lower, upper])?;
+    connection
+        .prepare_cached(&format!(
+            "DELETE FROM {} WHERE path = ? OR (path >= ? AND path < ?)",
+            tables.dirs,
+        ))?
+        .execute(params![key, lower, upper])?;
+    Ok(())
+}
+
+/// Count a change to the index, so that copies derived from it, such as the
+/// snapshot, can tell whether they are still current
+///
+/// Returns the new generation.
+fn bump_index_generation(connection: &Connection) -> SqliteResult<u64> {
+    connection
+        .prepare_cached(
+            "INSERT INTO metadata (key, value) VALUES ('index_generation', '1')
+             ON CONFLICT(key) DO UPDATE SET value = CAST(value AS INTEGER) + 1",
+        )?
+        .execute([])?;
+    let generation: i64 = connection
+        .prepare_cached("SELECT CAST(value AS INTEGER) FROM metadata WHERE key = 'index_generation'")?
+        .query_row([], |row| row.get(0))?;
+    Ok(generation as u64)
+}
+
+/// Move an entry and everything indexed beneath it to a new path
+///
+/// Whatever was indexed at the destination is replaced. Only the moved entry
+/// and the paths of the directories beneath it are rewritten, with the same
+/// range as `delete_tree`; the entries inside those directories keep their
+/// rows, so neither `files` nor the filename index is touched for them.
+fn move_tree(connection: &Connection, tables: &IndexTables, from: &Path, to: &Path) -> SqliteResult<()> {
+    if from == to {
+        return Ok(());
+    }
+    delete_tree(connection, tables, to)?;
+    move_file(connection, tables, from, to, &mut HashMap::new())?;
+    
+    // substr() and length() count characters, so the suffix starts right after
+    // the old prefix
+    let from_key = directory_key(from);
+    let suffix_start = from_key.chars().count() as i64 + 1;
+    let lower = format!("{}/", from_key);
+    let upper = format!("{}0", from_key);
+    
+    connection
+        .prepare_cached(&format!(
+            "UPDATE {} SET path = ? || substr(path, ?) WHERE path = ? OR (path >= ? AND path < ?)",
+            tables.dirs,
+        ))?
+        .execute(params![directory_key(to), suffix_start, from_key, lower, upper])?;
+    Ok(())
+}
+
+/// Get the key under which a directory is stored in `dirs`
+///
+/// A path without its trailing separator, so `/` is keyed by the empty string
+/// and the full path of an entry is always its directory key, '/' and its name.
+pub fn directory_key(path: &Path) -> String {
+    path.to_string_lossy().trim_end_matches('/').to_string()
+}
+
+/// Read the launcher metadata columns starting at `first` of a row that left
+/// joins `app_metadata`
+fn app_metadata_from_row(row: &rusqlite::Row<'_>, first: usize) -> SqliteResult<Option<AppMetadata>> {
+    let name: Option<String> = row.get(first)?;
+    match name {
+        Some(name) => Ok(Some(AppMetadata {
+            name,
+            icon: row.get(first + 1)?,
+            exec: row.get(first + 2)?,
+            keywords: row.get(first + 3)?,
+        })),
+        None => Ok(None),
+    }
+}
+
+/// Convert a `dirs` key back to the directory's path
+fn directory_path(key: String) -> PathBuf {
+    if key.is_empty() {
+        PathBuf::from("/")
+    } else {
+        PathBuf::from(key)
+    }
+}
+
+/// Split a path into the key of its parent directory and its final component
+pub fn entry_location(path: &Path) -> (String, String) {
+    let dir = path.parent().map(directory_key).unwrap_or_default();
+    let filename = path
+        .file_name()
+        .map(|n| n.to_string_lossy().to_string())
+        .unwrap_or_default();
+    (dir, filename)
+}
+
+/// Add a launch at `launched` (seconds since the epoch) to a frecency score
+///
+/// The score is `FRECENCY_SCALE * log2(sum of 2^(t / half-life))` over the
+/// launch times t, so a launch counts twice as much as one made a half-life
+/// earlier. Every score decays at the same rate, which leaves their order,
+/// and so the stored values, valid as time passes. 0 means never launched.
+pub fn add_launch_to_frecency(frecency: i64, launched: i64) -> i64 {
+    let launch = launched.max(0) as f64 / FRECENCY_HALF_LIFE_SECS * FRECENCY_SCALE;
+    if frecency <= 0 {
+        return launch.round() as i64;
+    }
+
+    let (high, low) = if frecency as f64 > launch {
+        (frecency as f64, launch)
+    } else {
+        (launch, frecency as f64)
+    };
+    (high + FRECENCY_SCALE * (1.0 + ((low - high) / FRECENCY_SCALE).exp2()).log2()).round() as i64
+}
+
+/// Frecency of `launch_count` launches all made at `last_launched`
+fn frecency_from_usage(launch_count: i64, last_launched: i64) -> i64 {
+    if launch_count <= 0 {
+        return 0;
+    }
+    let launch = last_launched.max(0) as f64 / FRECENCY_HALF_LIFE_SECS * FRECENCY_SCALE;
+    (launch + FRECENCY_SCALE * (launch_count as f64).log2()).round() as i64
+}
+
 /// Get current Unix timestamp
 pub fn current_timestamp() -> i64 {
     SystemTime::now()
@@ -503,12 +1578,22 @@ pub fn current_timestamp() -> i64 {
 }
 
 /// Convert SystemTime to Unix timestamp
-fn system_time_to_timestamp(time: SystemTime) -> i64 {
+pub fn system_time_to_timestamp(time: SystemTime) -> i64 {
     time.duration_since(UNIX_EPOCH)
         .unwrap_or(Duration::from_secs(0))
         .as_secs() as i64
 }
 
+/// Convert SystemTime to nanoseconds since the Unix epoch
+///
+/// Directory modification times are compared at full resolution so that changes
+/// within the same second as the previous scan are still detected.
+pub fn system_time_to_nanos(time: SystemTime) -> i64 {
+    time.duration_since(UNIX_EPOCH)
+        .unwrap_or(Duration::from_secs(0))
+        .as_nanos() as i64
+}
+
 /// Convert Unix timestamp to SystemTime
 fn timestamp_to_system_time(timestamp: i64) -> SystemTime {
     UNIX_EPOCH + Duration::from_secs(timestamp as u64)
@@ -569,15 +1654,15 @@ mod tests {
             .unwrap();
         assert_eq!(index_exists, 1);
 
-        // Check for path index
-        let index_exists: i32 = db.connection()
+        // Check for the full-path view
+        let view_exists: i32 = db.connection()
             .query_row(
-                "SELECT COUNT(*) FROM sqlite_master WHERE type='index' AND name='idx_path'",
+                "SELECT COUNT(*) FROM sqlite_master WHERE type='view' AND name='file_paths'",
                 [],
                 |row| row.get(0),
             )
             .unwrap();
-        assert_eq!(index_exists, 1);
+        assert_eq!(view_exists, 1);
 
         // Check for modified_time index
         let index_exists: i32 = db.connection()
@@ -816,4 +1901,731 @@ mod tests {
         let results = db.query_files("file2", 10).unwrap();
         assert_eq!(results.len(), 1);
     }
+
+    #[test]
+    fn test_fts_index_created() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        let table_exists: i32 = db.connection()
+            .query_row(
+                "SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name='files_fts'",
+                [],
+                |row| row.get(0),
+            )
+            .unwrap();
+        assert_eq!(table_exists, 1);
+
+        let trigger_count: i32 = db.connection()
+            .query_row(
+                "SELECT COUNT(*) FROM sqlite_master WHERE type='trigger' AND name LIKE 'files_fts_%'",
+                [],
+                |row| row.get(0),
+            )
+            .unwrap();
+        assert_eq!(trigger_count, 3);
+    }
+
+    #[test]
+    fn test_query_files_substring() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        let files = vec![
+            ("Report.pdf", "/home/user/Report.pdf"),
+            ("annual_report_2024.ods", "/home/user/annual_report_2024.ods"),
+            ("notes.md", "/home/user/notes.md"),
+        ];
+        
+        for (filename, path) in files {
+            let entry = FileEntry::new(
+                filename.to_string(),
+                PathBuf::from(path),
+                1024,
+                SystemTime::now(),
+                FileType::Regular,
+            );
+            db.insert_file(&entry).unwrap();
+        }
+        
+        // Trigram lookup matches in the middle of a name and ignores case
+        let results = db.query_files("REPORT", 10).unwrap();
+        assert_eq!(results.len(), 2);
+        
+        let results = db.query_files("port_20", 10).unwrap();
+        assert_eq!(results.len(), 1);
+        assert_eq!(results[0].filename, "annual_report_2024.ods");
+        
+        // Short queries use the fallback scan
+        let results = db.query_files("md", 10).unwrap();
+        assert_eq!(results.len(), 1);
+        assert_eq!(results[0].filename, "notes.md");
+    }
+
+    #[test]
+    fn test_fts_index_follows_batch_operations() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        let operations = vec![
+            IndexOperation::Add(FileEntry::new(
+                "alpha.txt".to_string(),
+                PathBuf::from("/home/user/alpha.txt"),
+                1024,
+                SystemTime::now(),
+                FileType::Regular,
+            )),
+            IndexOperation::Add(FileEntry::new(
+                "beta.txt".to_string(),
+                PathBuf::from("/home/user/beta.txt"),
+                1024,
+                SystemTime::now(),
+                FileType::Regular,
+            )),
+        ];
+        db.execute_batch(&operations).unwrap();
+        
+        let operations = vec![
+            IndexOperation::Move {
+                from: PathBuf::from("/home/user/alpha.txt"),
+                to: PathBuf::from("/home/user/gamma.txt"),
+            },
+            IndexOperation::Delete(PathBuf::from("/home/user/beta.txt")),
+        ];
+        db.execute_batch(&operations).unwrap();
+        
+        assert!(db.query_files("alpha", 10).unwrap().is_empty());
+        assert!(db.query_files("beta", 10).unwrap().is_empty());
+        
+        let results = db.query_files("gamma", 10).unwrap();
+        assert_eq!(results.len(), 1);
+        assert_eq!(results[0].path, PathBuf::from("/home/user/gamma.txt"));
+    }
+
+    #[test]
+    fn test_load_recent_launches() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        let operations: Vec<IndexOperation> = ["a.txt", "b.txt", "c.txt"]
+            .iter()
+            .map(|name| IndexOperation::Add(FileEntry::new(
+                name.to_string(),
+                PathBuf::from("/home/user").join(name),
+                100,
+                SystemTime::now(),
+                FileType::Regular,
+            )))
+            .collect();
+        db.execute_batch(&operations).unwrap();
+        
+        // b.txt was launched last; c.txt never was
+        db.connection().execute_batch(
+            "INSERT INTO usage_stats (file_id, launch_count, last_launched)
+             SELECT id, 1, CASE filename WHEN 'a.txt' THEN 100 WHEN 'b.txt' THEN 200 END
+             FROM files WHERE filename != 'c.txt'"
+        ).unwrap();
+        
+        assert_eq!(
+            db.load_recent_launches(10).unwrap(),
+            vec![PathBuf::from("/home/user/b.txt"), PathBuf::from("/home/user/a.txt")],
+        );
+        assert_eq!(db.load_recent_launches(1).unwrap().len(), 1);
+    }
+
+    #[test]
+    fn test_record_file_launch_updates_frecency() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        add_entries(&db, &[
+            ("/home/user/notes.txt", FileType::Regular),
+            ("/home/user/notes.md", FileType::Regular),
+        ]);
+        
+        // Launches are counted in one usage row per file
+        db.record_file_launch("/home/user/notes.txt").unwrap();
+        db.record_file_launch("/home/user/notes.txt").unwrap();
+        assert_eq!(db.get_file_usage("/home/user/notes.txt").unwrap().map(|(count, _)| count), Some(2));
+        
+        let frecencies = db.load_frecencies().unwrap();
+        assert_eq!(frecencies.len(), 1);
+        assert!(frecencies["/home/user/notes.txt"] > 0);
+        
+        // The launched file ranks first among the prefix matches, with both
+        // query plans
+        for query in ["no", "notes"] {
+            let results = db.query_files(query, 1).unwrap();
+            assert_eq!(results[0].filename, "notes.txt");
+        }
+    }
+
+    #[test]
+    fn test_frecency_decays_by_half_life() {
+        let now = 1_700_000_000;
+        let half_life = FRECENCY_HALF_LIFE_SECS as i64;
+        let once = add_launch_to_frecency(0, now);
+        let twice = add_launch_to_frecency(once, now);
+        
+        assert!(once > 0);
+        assert_eq!(twice - once, FRECENCY_SCALE as i64);
+        assert_eq!(frecency_from_usage(2, now), twice);
+        assert_eq!(frecency_from_usage(0, now), 0);
+        
+        // One launch a half-life later counts as much as two now
+        assert_eq!(add_launch_to_frecency(0, now + half_life), twice);
+        
+        // Launches never lower a score, however old they are
+        assert!(add_launch_to_frecency(twice, now - 100 * half_life) >= twice);
+    }
+
+    #[test]
+    fn test_migrate_v6_to_v7() {
+        let temp_file = NamedTempFile::new().unwrap();
+        
+        // Turn a new database back into version 6, with duplicate usage rows
+        {
+            let db = Database::open(temp_file.path()).unwrap();
+            add_entries(&db, &[("/home/user/a.txt", FileType::Regular), ("/home/user/b.txt", FileType::Regular)]);
+            db.connection().execute_batch(
+                "DROP VIEW file_paths;
+                DROP INDEX idx_frecency;
+                DROP INDEX idx_usage_file_id;
+                ALTER TABLE files DROP COLUMN frecency;
+                CREATE INDEX idx_usage_file_id ON usage_stats(file_id);
+                INSERT INTO usage_stats (file_id, launch_count, last_launched)
+                    SELECT id, 2, 100 FROM files WHERE filename = 'a.txt';
+                INSERT INTO usage_stats (file_id, launch_count, last_launched)
+                    SELECT id, 1, 1000000 FROM files WHERE filename = 'a.txt';
+                UPDATE metadata SET value = '6' WHERE key = 'schema_version';",
+            ).unwrap();
+        }
+        
+        let db = Database::open(temp_file.path()).unwrap();
+        assert_eq!(db.get_schema_version().unwrap(), SCHEMA_VERSION);
+        
+        assert_eq!(db.get_file_usage("/home/user/a.txt").unwrap(), Some((3, 1000000)));
+        assert_eq!(
+            db.load_frecencies().unwrap(),
+            HashMap::from([("/home/user/a.txt".to_string(), frecency_from_usage(3, 1000000))]),
+        );
+        
+        // Further launches update the merged row
+        db.record_file_launch("/home/user/a.txt").unwrap();
+        assert_eq!(db.get_file_usage("/home/user/a.txt").unwrap().map(|(count, _)| count), Some(4));
+    }
+
+    #[test]
+    fn test_system_index_is_shared_read_only() {
+        let system_file = NamedTempFile::new().unwrap();
+        {
+            let system = Database::open(system_file.path()).unwrap();
+            add_entries(&system, &[("/usr/share/applications/firefox.desktop", FileType::Regular)]);
+        }
+        
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        add_entries(&db, &[
+            ("/usr/share/applications/gimp.desktop", FileType::Regular),
+            ("/home/user/notes.txt", FileType::Regular),
+        ]);
+        db.record_file_launch("/usr/share/applications/gimp.desktop").unwrap();
+        assert_eq!(db.system_generation().unwrap(), 0);
+        
+        assert!(db.attach_system_index(system_file.path()).unwrap());
+        assert!(db.has_system_index());
+        assert!(db.system_generation().unwrap() > 0);
+        let paths: Vec<PathBuf> = db.load_system_files().unwrap().into_iter().map(|entry| entry.path).collect();
+        assert_eq!(paths, vec![PathBuf::from("/usr/share/applications/firefox.desktop")]);
+        
+        // Launches below the system directories move to system_usage
+        let roots = [PathBuf::from("/usr/share/applications"), PathBuf::from("/opt")];
+        assert_eq!(db.copy_usage_to_system(&roots).unwrap(), vec![roots[0].clone()]);
+        let gimp_frecency = db.load_frecencies().unwrap()["/usr/share/applications/gimp.desktop"];
+        db.execute_batch(&[IndexOperation::DeleteTree(roots[0].clone())]).unwrap();
+        assert_eq!(
+            db.load_frecencies().unwrap().get("/usr/share/applications/gimp.desktop"),
+            Some(&gimp_frecency),
+        );
+        
+        // Entries of the system index are ranked by their launches here
+        db.record_file_launch("/usr/share/applications/firefox.desktop").unwrap();
+        assert!(db.load_frecencies().unwrap()["/usr/share/applications/firefox.desktop"] > 0);
+        assert!(db.record_file_launch("/usr/share/applications/missing.desktop").is_ok());
+        
+        // The system index cannot be written through a user's connection
+        assert!(db.connection().execute("DELETE FROM system.files", []).is_err());
+        
+        // Neither can a file without an index be attached
+        let empty_file = NamedTempFile::new().unwrap();
+        let other = Database::open(NamedTempFile::new().unwrap().path()).unwrap();
+        assert!(!other.attach_system_index(empty_file.path()).unwrap());
+        assert!(!other.has_system_index());
+    }
+
+    #[test]
+    fn test_app_metadata_follows_entries() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        let mut launcher = FileEntry::new(
+            "org.gnome.Terminal.desktop".to_string(),
+            PathBuf::from("/usr/share/applications/org.gnome.Terminal.desktop"),
+            512,
+            SystemTime::now(),
+            FileType::Regular,
+        );
+        launcher.app = Some(AppMetadata {
+            name: "Terminal".to_string(),
+            icon: "utilities-terminal".to_string(),
+            exec: "gnome-terminal".to_string(),
+            keywords: "shell;prompt;command;".to_string(),
+        });
+        db.execute_batch(&[IndexOperation::Add(launcher.clone())]).unwrap();
+        
+        // Found by name and by keyword, with the metadata attached
+        let results = db.query_files("terminal", 10).unwrap();
+        assert_eq!(results.len(), 1);
+        assert_eq!(results[0].app, launcher.app);
+        assert_eq!(db.query_files("prompt", 10).unwrap().len(), 1);
+        assert_eq!(db.query_files("sh", 10).unwrap().len(), 1);
+        assert_eq!(db.load_files().unwrap().iter().filter(|e| e.app.is_some()).count(), 1);
+        
+        // An update without a [Desktop Entry] group clears it
+        launcher.app = None;
+        db.execute_batch(&[IndexOperation::Update(launcher)]).unwrap();
+        assert!(db.query_files("prompt", 10).unwrap().is_empty());
+        assert!(db.query_files("Terminal", 10).unwrap()[0].app.is_none());
+        
+        // Deleting the entry deletes its metadata
+        db.connection().execute(
+            "INSERT INTO app_metadata (file_id, name, icon, exec, keywords)
+             SELECT id, 'Terminal', '', '', 'prompt' FROM files",
+            [],
+        ).unwrap();
+        db.execute_batch(&[IndexOperation::Delete(PathBuf::from(
+            "/usr/share/applications/org.gnome.Terminal.desktop",
+        ))]).unwrap();
+        assert!(db.load_files().unwrap().iter().all(|e| e.app.is_none()));
+    }
+
+    #[test]
+    fn test_migrate_v2_to_v3() {
+        let temp_file = NamedTempFile::new().unwrap();
+        
+        // Build a version 2 database by hand
+        {
+            let connection = Connection::open(temp_file.path()).unwrap();
+            connection.execute_batch(
+                "CREATE TABLE files (
+                    id INTEGER PRIMARY KEY AUTOINCREMENT,
+                    filename TEXT NOT NULL,
+                    path TEXT NOT NULL UNIQUE,
+                    size INTEGER NOT NULL,
+                    modified_time INTEGER NOT NULL,
+                    file_type TEXT NOT NULL,
+                    indexed_time INTEGER NOT NULL
+                );
+                CREATE TABLE usage_stats (
+                    id INTEGER PRIMARY KEY AUTOINCREMENT,
+                    file_id INTEGER NOT NULL,
+                    launch_count INTEGER NOT NULL DEFAULT 0,
+                    last_launched INTEGER
+                );
+                CREATE TABLE metadata (key TEXT PRIMARY KEY, value TEXT NOT NULL);
+                INSERT INTO metadata (key, value) VALUES ('schema_version', '2');
+                INSERT INTO files (filename, path, size, modified_time, file_type, indexed_time)
+                VALUES ('existing_file.txt', '/home/user/existing_file.txt', 1, 0, 'regular', 0);",
+            ).unwrap();
+        }
+        
+        let db = Database::open(temp_file.path()).unwrap();
+        assert_eq!(db.get_schema_version().unwrap(), SCHEMA_VERSION);
+        
+        // Rows present before the migration are searchable through the new index
+        let results = db.query_files("ting_fi", 10).unwrap();
+        assert_eq!(results.len(), 1);
+        assert_eq!(results[0].filename, "existing_file.txt");
+    }
+
+    #[test]
+    fn test_migrate_v4_to_v5() {
+        let temp_file = NamedTempFile::new().unwrap();
+        
+        // Build a version 4 database by hand, paths stored in full
+        {
+            let connection = Connection::open(temp_file.path()).unwrap();
+            connection.execute_batch(
+                "CREATE TABLE files (
+                    id INTEGER PRIMARY KEY AUTOINCREMENT,
+                    filename TEXT NOT NULL,
+                    path TEXT NOT NULL UNIQUE,
+                    size INTEGER NOT NULL,
+                    modified_time INTEGER NOT NULL,
+                    file_type TEXT NOT NULL,
+                    indexed_time INTEGER NOT NULL
+                );
+                CREATE TABLE usage_stats (
+                    id INTEGER PRIMARY KEY AUTOINCREMENT,
+                    file_id INTEGER NOT NULL,
+                    launch_count INTEGER NOT NULL DEFAULT 0,
+                    last_launched INTEGER
+                );
+                CREATE TABLE metadata (key TEXT PRIMARY KEY, value TEXT NOT NULL);
+                CREATE TABLE dirs (
+                    id INTEGER PRIMARY KEY AUTOINCREMENT,
+                    path TEXT NOT NULL UNIQUE,
+                    modified_time_ns INTEGER NOT NULL
+                );
+                CREATE VIRTUAL TABLE files_fts USING fts5(
+                    filename, content='files', content_rowid='id', tokenize='trigram'
+                );
+                INSERT INTO metadata (key, value) VALUES ('schema_version', '4');
+                INSERT INTO files (id, filename, path, size, modified_time, file_type, indexed_time) VALUES
+                    (3, 'docs', '/home/user/docs', 0, 0, 'directory', 0),
+                    (5, 'report.pdf', '/home/user/docs/report.pdf', 10, 0, 'regular', 0),
+                    (8, 'vmlinuz', '/vmlinuz', 20, 0, 'symlink', 0);
+                INSERT INTO usage_stats (file_id, launch_count, last_launched) VALUES (5, 4, 0);
+                INSERT INTO dirs (path, modified_time_ns) VALUES ('/home/user/docs', 42);",
+            ).unwrap();
+        }
+        
+        let db = Database::open(temp_file.path()).unwrap();
+        assert_eq!(db.get_schema_version().unwrap(), SCHEMA_VERSION);
+        
+        assert_eq!(indexed_paths(&db), vec![
+            "/home/user/docs",
+            "/home/user/docs/report.pdf",
+            "/vmlinuz",
+        ]);
+        let results = db.query_files("vmlin", 10).unwrap();
+        assert_eq!(results.len(), 1);
+        assert_eq!(results[0].file_type, FileType::Symlink);
+        
+        // Ids are kept, so usage statistics still apply
+        assert_eq!(db.get_file_usage("/home/user/docs/report.pdf").unwrap().map(|(count, _)| count), Some(4));
+        
+        let times = db.load_directory_times().unwrap();
+        assert_eq!(times.len(), 1);
+        assert_eq!(times[&PathBuf::from("/home/user/docs")], 42);
+        
+        add_entries(&db, &[("/home/user/docs/notes.txt", FileType::Regular)]);
+        assert_eq!(db.query_files("notes", 10).unwrap().len(), 1);
+    }
+
+    #[test]
+    fn test_entry_location() {
+        assert_eq!(
+            entry_location(Path::new("/home/user/a.txt")),
+            ("/home/user".to_string(), "a.txt".to_string()),
+        );
+        assert_eq!(entry_location(Path::new("/vmlinuz")), (String::new(), "vmlinuz".to_string()));
+        assert_eq!(directory_path(String::new()), PathBuf::from("/"));
+    }
+
+    fn add_entries(db: &Database, paths: &[(&str, FileType)]) {
+        let operations: Vec<IndexOperation> = paths
+            .iter()
+            .map(|(path, file_type)| {
+                let path = PathBuf::from(path);
+                IndexOperation::Add(FileEntry::new(
+                    path.file_name().unwrap().to_string_lossy().to_string(),
+                    path,
+                    0,
+                    SystemTime::now(),
+                    file_type.clone(),
+                ))
+            })
+            .collect();
+        db.execute_batch(&operations).unwrap();
+    }
+
+    fn indexed_paths(db: &Database) -> Vec<String> {
+        let mut stmt = db.connection().prepare("SELECT path FROM file_paths ORDER BY path").unwrap();
+        let paths = stmt.query_map([], |row| row.get(0)).unwrap();
+        paths.collect::<SqliteResult<Vec<String>>>().unwrap()
+    }
+
+    #[test]
+    fn test_confirm_dir_records_modified_time() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        let modified_time = UNIX_EPOCH + Duration::new(1_700_000_000, 123_456_789);
+        let operations = vec![
+            IndexOperation::ConfirmDir { path: PathBuf::from("/home/user"), modified_time },
+            IndexOperation::ConfirmDir { path: PathBuf::from("/home/user"), modified_time },
+        ];
+        db.execute_batch(&operations).unwrap();
+        
+        let times = db.load_directory_times().unwrap();
+        assert_eq!(times.len(), 1);
+        assert_eq!(times[&PathBuf::from("/home/user")], 1_700_000_000_123_456_789);
+    }
+
+    #[test]
+    fn test_prune_dir_removes_stale_children() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        add_entries(&db, &[
+            ("/home/user/docs", FileType::Directory),
+            ("/home/user/docs/keep.txt", FileType::Regular),
+            ("/home/user/docs/gone.txt", FileType::Regular),
+            ("/home/user/docs/old", FileType::Directory),
+            ("/home/user/docs/old/nested.txt", FileType::Regular),
+            ("/home/user/docs2/other.txt", FileType::Regular),
+        ]);
+        db.execute_batch(&[IndexOperation::ConfirmDir {
+            path: PathBuf::from("/home/user/docs/old"),
+            modified_time: SystemTime::now(),
+        }]).unwrap();
+        
+        let keep = ["keep.txt".to_string()].into_iter().collect();
+        db.execute_batch(&[IndexOperation::PruneDir {
+            path: PathBuf::from("/home/user/docs"),
+            keep,
+        }]).unwrap();
+        
+        assert_eq!(indexed_paths(&db), vec![
+            "/home/user/docs",
+            "/home/user/docs/keep.txt",
+            "/home/user/docs2/other.txt",
+        ]);
+        assert!(db.load_directory_times().unwrap().is_empty());
+        assert_eq!(db.load_indexed_directories().unwrap(), vec![PathBuf::from("/home/user/docs")]);
+        
+        // The trigram index follows the deletions
+        assert!(db.query_files("nested", 10).unwrap().is_empty());
+    }
+
+    #[test]
+    fn test_delete_tree() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        add_entries(&db, &[
+            ("/home/user/docs", FileType::Directory),
+            ("/home/user/docs/a.txt", FileType::Regular),
+            ("/home/user/docs/sub/b.txt", FileType::Regular),
+            ("/home/user/docs2", FileType::Directory),
+            ("/home/user/docs-old.txt", FileType::Regular),
+        ]);
+        
+        db.execute_batch(&[IndexOperation::DeleteTree(PathBuf::from("/home/user/docs"))]).unwrap();
+        
+        // Siblings sharing the name as a prefix are untouched
+        assert_eq!(indexed_paths(&db), vec![
+            "/home/user/docs-old.txt",
+            "/home/user/docs2",
+        ]);
+    }
+
+    #[test]
+    fn test_move_tree() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        add_entries(&db, &[
+            ("/home/user/docs", FileType::Directory),
+            ("/home/user/docs/a.txt", FileType::Regular),
+            ("/home/user/docs/sub/b.txt", FileType::Regular),
+            ("/home/user/docs2", FileType::Directory),
+            ("/home/user/archive", FileType::Directory),
+            ("/home/user/archive/old.txt", FileType::Regular),
+        ]);
+        let modified_time = UNIX_EPOCH + Duration::from_secs(1_700_000_000);
+        db.execute_batch(&[
+            IndexOperation::ConfirmDir { path: PathBuf::from("/home/user/docs/sub"), modified_time },
+        ]).unwrap();
+        
+        // The destination is replaced by the moved tree
+        db.execute_batch(&[IndexOperation::MoveTree {
+            from: PathBuf::from("/home/user/docs"),
+            to: PathBuf::from("/home/user/archive"),
+        }]).unwrap();
+        
+        assert_eq!(indexed_paths(&db), vec![
+            "/home/user/archive",
+            "/home/user/archive/a.txt",
+            "/home/user/archive/sub/b.txt",
+            "/home/user/docs2",
+        ]);
+        
+        let times = db.load_directory_times().unwrap();
+        assert_eq!(times.len(), 1);
+        assert!(times.contains_key(&PathBuf::from("/home/user/archive/sub")));
+        
+        // Descendants keep their filenames; the moved root is renamed
+        let moved = db.query_files("b.txt", 10).unwrap();
+        assert_eq!(moved.len(), 1);
+        assert_eq!(moved[0].path, PathBuf::from("/home/user/archive/sub/b.txt"));
+        assert_eq!(db.query_files("archive", 10).unwrap().len(), 1);
+        assert!(db.query_files("docs", 10).unwrap().iter().all(|e| e.filename == "docs2"));
+    }
+
+    #[test]
+    fn test_rebuild_swaps_in_new_index() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        add_entries(&db, &[
+            ("/home/user/kept.txt", FileType::Regular),
+            ("/home/user/removed.txt", FileType::Regular),
+        ]);
+        db.connection().execute(
+            "INSERT INTO usage_stats (file_id, launch_count, last_launched)
+             SELECT id, length(filename), 0 FROM files",
+            [],
+        ).unwrap();
+        db.record_file_launch("/home/user/kept.txt").unwrap();
+        
+        let rebuild = db.begin_rebuild().unwrap();
+        let operations: Vec<IndexOperation> = ["/home/user/added.txt", "/home/user/kept.txt"]
+            .iter()
+            .map(|path| {
+                let path = PathBuf::from(path);
+                IndexOperation::Add(FileEntry::new(
+                    path.file_name().unwrap().to_string_lossy().to_string(),
+                    path,
+                    0,
+                    SystemTime::now(),
+                    FileType::Regular,
+                ))
+            })
+            .collect();
+        rebuild.execute_batch(&operations).unwrap();
+        rebuild.execute_batch(&[IndexOperation::ConfirmDir {
+            path: PathBuf::from("/home/user"),
+            modified_time: SystemTime::now(),
+        }]).unwrap();
+        
+        // The live index is untouched until the rebuild finishes
+        assert_eq!(indexed_paths(&db), vec!["/home/user/kept.txt", "/home/user/removed.txt"]);
+        
+        rebuild.finish().unwrap();
+        
+        assert_eq!(indexed_paths(&db), vec!["/home/user/added.txt", "/home/user/kept.txt"]);
+        assert_eq!(db.load_directory_times().unwrap().len(), 1);
+        
+        // Usage statistics follow the file to its new row
+        assert_eq!(db.get_file_usage("/home/user/kept.txt").unwrap().map(|(count, _)| count), Some(9));
+        assert!(db.load_frecencies().unwrap().contains_key("/home/user/kept.txt"));
+        let usage_rows: i64 = db.connection()
+            .query_row("SELECT COUNT(*) FROM usage_stats", [], |row| row.get(0))
+            .unwrap();
+        assert_eq!(usage_rows, 1);
+        
+        // Indexes, triggers and the trigram index are rebuilt
+        let index_count: i64 = db.connection()
+            .query_row(
+                "SELECT COUNT(*) FROM sqlite_master
+                 WHERE type IN ('index', 'trigger') AND tbl_name = 'files' AND sql IS NOT NULL",
+                [],
+                |row| row.get(0),
+            )
+            .unwrap();
+        assert_eq!(index_count, 7);
+        assert_eq!(db.query_files("dded", 10).unwrap().len(), 1);
+        
+        add_entries(&db, &[("/home/user/later.txt", FileType::Regular)]);
+        assert_eq!(db.query_files("later", 10).unwrap().len(), 1);
+    }
+
+    #[test]
+    fn test_rebuild_renumbers_usage_of_many_files() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        let paths: Vec<String> = (0..8).map(|i| format!("/home/user/file{}.txt", i)).collect();
+        let entries: Vec<(&str, FileType)> =
+            paths.iter().map(|path| (path.as_str(), FileType::Regular)).collect();
+        add_entries(&db, &entries);
+        for (i, path) in paths.iter().enumerate() {
+            for _ in 0..=i {
+                db.record_file_launch(path).unwrap();
+            }
+        }
+        
+        // Added in reverse, each file takes the old id of another launched one
+        let rebuild = db.begin_rebuild().unwrap();
+        let operations: Vec<IndexOperation> = paths
+            .iter()
+            .rev()
+            .map(|path| {
+                let path = PathBuf::from(path);
+                IndexOperation::Add(FileEntry::new(
+                    path.file_name().unwrap().to_string_lossy().to_string(),
+                    path,
+                    0,
+                    SystemTime::now(),
+                    FileType::Regular,
+                ))
+            })
+            .collect();
+        rebuild.execute_batch(&operations).unwrap();
+        rebuild.finish().unwrap();
+        
+        for (i, path) in paths.iter().enumerate() {
+            assert_eq!(
+                db.get_file_usage(path).unwrap().map(|(count, _)| count),
+                Some(i as i32 + 1)
+            );
+        }
+    }
+
+    #[test]
+    fn test_abandoned_rebuild_is_discarded() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        add_entries(&db, &[("/home/user/kept.txt", FileType::Regular)]);
+        
+        {
+            let rebuild = db.begin_rebuild().unwrap();
+            rebuild.execute_batch(&[IndexOperation::Delete(PathBuf::from("/home/user/kept.txt"))]).unwrap();
+        }
+        
+        assert_eq!(indexed_paths(&db), vec!["/home/user/kept.txt"]);
+        let shadow_tables: i64 = db.connection()
+            .query_row(
+                "SELECT COUNT(*) FROM sqlite_master
+                 WHERE name IN ('files_rebuild', 'dirs_rebuild', 'app_metadata_rebuild')",
+                [],
+                |row| row.get(0),
+            )
+            .unwrap();
+        assert_eq!(shadow_tables, 0);
+    }
+
+    #[test]
+    fn test_connection_profile() {
+        let temp_file = NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        
+        let journal_mode: String = db.connection()
+            .pragma_query_value(None, "journal_mode", |row| row.get(0))
+            .unwrap();
+        assert_eq!(journal_mode, "wal");
+        let synchronous: i64 = db.connection()
+            .pragma_query_value(None, "synchronous", |row| row.get(0))
+            .unwrap();
+        assert_eq!(synchronous, 1);
+        
+        let temp_file = NamedTempFile::new().unwrap();
+        let config = DatabaseConfig {
+            wal: false,
+            synchronous: "full".to_string(),
+            ..DatabaseConfig::default()
+        };
+        let db = Database::open_with_config(temp_file.path(), &config).unwrap();
+        
+        let journal_mode: String = db.connection()
+            .pragma_query_value(None, "journal_mode", |row| row.get(0))
+            .unwrap();
+        assert_eq!(journal_mode, "delete");
+        let synchronous: i64 = db.connection()
+            .pragma_query_value(None, "synchronous", |row| row.get(0))
+            .unwrap();
+        assert_eq!(synchronous, 2);
+    }
 }
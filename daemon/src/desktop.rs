@@ -0,0 +1,147 @@
+use crate::models::{AppMetadata, FileType};
+use std::fs::File;
+use std::io::Read;
+use std::path::Path;
+
+/// Largest `.desktop` file read; launchers are a few KiB at most
+const MAX_DESKTOP_FILE_LEN: u64 = 256 * 1024;
+
+/// Check whether a path names a `.desktop` launcher
+pub fn is_desktop_file(path: &Path) -> bool {
+    path.extension().map_or(false, |extension| extension == "desktop")
+}
+
+/// Read the launcher metadata of an entry, if it is a `.desktop` file
+///
+/// Called while indexing, so the panel can show and search applications
+/// without opening their files.
+pub fn read_app_metadata(path: &Path, file_type: &FileType) -> Option<AppMetadata> {
+    if *file_type != FileType::Regular || !is_desktop_file(path) {
+        return None;
+    }
+
+    let mut contents = String::new();
+    File::open(path)
+        .ok()?
+        .take(MAX_DESKTOP_FILE_LEN)
+        .read_to_string(&mut contents)
+        .ok()?;
+    parse_desktop_entry(&contents)
+}
+
+/// Extract Name, Icon, Exec and Keywords from the `[Desktop Entry]` group
+///
+/// Only the unlocalized keys are read. Returns `None` if the group is missing.
+pub fn parse_desktop_entry(contents: &str) -> Option<AppMetadata> {
+    let mut metadata = AppMetadata::default();
+    let mut found = false;
+    let mut in_entry = false;
+
+    for line in contents.lines() {
+        let line = line.trim();
+        if line.is_empty() || line.starts_with('#') {
+            continue;
+        }
+        if line.starts_with('[') {
+            in_entry = line == "[Desktop Entry]";
+            found |= in_entry;
+            continue;
+        }
+        if !in_entry {
+            continue;
+        }
+
+        let Some((key, value)) = line.split_once('=') else {
+            continue;
+        };
+        let field = match key.trim_end() {
+            "Name" => &mut metadata.name,
+            "Icon" => &mut metadata.icon,
+            "Exec" => &mut metadata.exec,
+            "Keywords" => &mut metadata.keywords,
+            _ => continue,
+        };
+        *field = unescape_value(value.trim_start());
+    }
+
+    found.then_some(metadata)
+}
+
+/// Undo the escapes of the desktop entry format
+///
+/// `\;` in lists is kept as written, so Keywords stays `;`-separated.
+fn unescape_value(value: &str) -> String {
+    let mut unescaped = String::with_capacity(value.len());
+    let mut chars = value.chars();
+    while let Some(c) = chars.next() {
+        if c != '\\' {
+            unescaped.push(c);
+            continue;
+        }
+        match chars.next() {
+            Some('s') => unescaped.push(' '),
+            Some('n') => unescaped.push('\n'),
+            Some('t') => unescaped.push('\t'),
+            Some('r') => unescaped.push('\r'),
+            Some('\\') => unescaped.push('\\'),
+            Some(other) => {
+                unescaped.push('\\');
+                unescaped.push(other);
+            }
+            None => unescaped.push('\\'),
+        }
+    }
+    unescaped
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tempfile::TempDir;
+
+    #[test]
+    fn test_parse_desktop_entry() {
+        let metadata = parse_desktop_entry(
+            "# Launcher\n\
+             [Desktop Entry]\n\
+             Type=Application\n\
+             Name=Web Browser\n\
+             Name[de]=Webbrowser\n\
+             Icon = firefox\n\
+             Exec=firefox %u\n\
+             Keywords=web;browser;internet;\n\
+             \n\
+             [Desktop Action new-window]\n\
+             Name=New Window\n\
+             Exec=firefox --new-window\n",
+        )
+        .unwrap();
+
+        assert_eq!(metadata.name, "Web Browser");
+        assert_eq!(metadata.icon, "firefox");
+        assert_eq!(metadata.exec, "firefox %u");
+        assert_eq!(metadata.keywords, "web;browser;internet;");
+    }
+
+    #[test]
+    fn test_parse_desktop_entry_escapes_and_missing_group() {
+        let metadata = parse_desktop_entry("[Desktop Entry]\nName=\\sTerm\\\\inal\n").unwrap();
+        assert_eq!(metadata.name, " Term\\inal");
+        assert_eq!(metadata.exec, "");
+
+        assert!(parse_desktop_entry("[Other]\nName=Nope\n").is_none());
+    }
+
+    #[test]
+    fn test_read_app_metadata_only_for_desktop_files() {
+        let temp_dir = TempDir::new().unwrap();
+        let desktop = temp_dir.path().join("editor.desktop");
+        let text = temp_dir.path().join("editor.txt");
+        std::fs::write(&desktop, "[Desktop Entry]\nName=Editor\n").unwrap();
+        std::fs::write(&text, "[Desktop Entry]\nName=Editor\n").unwrap();
+
+        assert_eq!(read_app_metadata(&desktop, &FileType::Regular).unwrap().name, "Editor");
+        assert!(read_app_metadata(&text, &FileType::Regular).is_none());
+        assert!(read_app_metadata(&desktop, &FileType::Directory).is_none());
+    }
+}
@@ -0,0 +1,166 @@
+use crate::config::Config;
+use globset::{Candidate, GlobBuilder, GlobSet, GlobSetBuilder};
+use std::collections::HashSet;
+use std::ffi::{OsStr, OsString};
+use std::path::{Component, Path};
+use std::sync::{Arc, RwLock};
+
+/// Compiled form of `IndexingConfig::exclude_patterns`
+///
+/// Patterns apply to single path components. Patterns without glob syntax are
+/// looked up in a hash set; the rest are compiled once into a `GlobSet`, which
+/// matches all of them in a single pass. Build it once per configuration and
+/// share it between the scanner and the watcher.
+#[derive(Debug, Clone)]
+pub struct ExcludeMatcher {
+    literals: HashSet<OsString>,
+    globs: GlobSet,
+}
+
+impl ExcludeMatcher {
+    /// Compile a list of exclusion patterns
+    ///
+    /// Invalid patterns are reported and skipped, as they could never match.
+    pub fn new(patterns: &[String]) -> Self {
+        let mut literals = HashSet::new();
+        let mut builder = GlobSetBuilder::new();
+
+        for pattern in patterns {
+            if !pattern.contains(['*', '?', '[', '{', '\\']) {
+                literals.insert(OsString::from(pattern));
+                continue;
+            }
+
+            match GlobBuilder::new(pattern).backslash_escape(true).build() {
+                Ok(glob) => {
+                    builder.add(glob);
+                }
+                Err(e) => {
+                    eprintln!("Warning: Ignoring invalid exclude pattern '{}': {}", pattern, e);
+                }
+            }
+        }
+
+        let globs = builder.build().unwrap_or_else(|e| {
+            eprintln!("Warning: Failed to compile exclude patterns: {}", e);
+            GlobSet::empty()
+        });
+
+        ExcludeMatcher { literals, globs }
+    }
+
+    /// Compile the exclusion patterns of a configuration
+    pub fn from_config(config: &Config) -> Self {
+        Self::new(&config.indexing.exclude_patterns)
+    }
+
+    /// Check whether a single file or directory name is excluded
+    pub fn is_excluded_name(&self, name: &OsStr) -> bool {
+        self.literals.contains(name) || self.globs.is_match_candidate(&Candidate::new(name))
+    }
+
+    /// Check whether any component of a path is excluded
+    pub fn is_excluded_path(&self, path: &Path) -> bool {
+        path.components().any(|component| match component {
+            Component::Normal(name) => self.is_excluded_name(name),
+            _ => false,
+        })
+    }
+}
+
+impl Default for ExcludeMatcher {
+    fn default() -> Self {
+        Self::new(&[])
+    }
+}
+
+/// An `ExcludeMatcher` shared with the watcher that can be replaced when the
+/// configuration changes
+///
+/// Callers take the current matcher and keep using it for as long as they
+/// need; a replacement only applies to matchers taken afterwards.
+#[derive(Debug, Default)]
+pub struct SharedExcludeMatcher {
+    current: RwLock<Arc<ExcludeMatcher>>,
+}
+
+impl SharedExcludeMatcher {
+    pub fn new(matcher: ExcludeMatcher) -> Self {
+        SharedExcludeMatcher { current: RwLock::new(Arc::new(matcher)) }
+    }
+
+    /// The matcher currently in effect
+    pub fn current(&self) -> Arc<ExcludeMatcher> {
+        Arc::clone(&self.current.read().unwrap())
+    }
+
+    /// Put `matcher` in effect for every later lookup
+    pub fn replace(&self, matcher: ExcludeMatcher) {
+        *self.current.write().unwrap() = Arc::new(matcher);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn matcher(patterns: &[&str]) -> ExcludeMatcher {
+        ExcludeMatcher::new(&patterns.iter().map(|p| p.to_string()).collect::<Vec<_>>())
+    }
+
+    #[test]
+    fn test_literal_patterns() {
+        let matcher = matcher(&["node_modules", "target"]);
+        assert!(matcher.is_excluded_name(OsStr::new("node_modules")));
+        assert!(matcher.is_excluded_name(OsStr::new("target")));
+        assert!(!matcher.is_excluded_name(OsStr::new("node_modules2")));
+        assert!(!matcher.is_excluded_name(OsStr::new("src")));
+    }
+
+    #[test]
+    fn test_glob_patterns() {
+        let matcher = matcher(&[".*", "*.pyc", "build-[0-9]", "cache?"]);
+        assert!(matcher.is_excluded_name(OsStr::new(".git")));
+        assert!(matcher.is_excluded_name(OsStr::new(".hidden.txt")));
+        assert!(matcher.is_excluded_name(OsStr::new("module.pyc")));
+        assert!(matcher.is_excluded_name(OsStr::new("build-3")));
+        assert!(matcher.is_excluded_name(OsStr::new("cache1")));
+        assert!(!matcher.is_excluded_name(OsStr::new("visible.txt")));
+        assert!(!matcher.is_excluded_name(OsStr::new("build-x")));
+        assert!(!matcher.is_excluded_name(OsStr::new("cache")));
+    }
+
+    #[test]
+    fn test_path_components() {
+        let matcher = matcher(&[".*", "node_modules"]);
+        assert!(matcher.is_excluded_path(Path::new("/home/user/.cache/file.txt")));
+        assert!(matcher.is_excluded_path(Path::new("/home/user/app/node_modules/pkg/index.js")));
+        assert!(!matcher.is_excluded_path(Path::new("/home/user/docs/file.txt")));
+        assert!(!matcher.is_excluded_path(Path::new("/")));
+    }
+
+    #[test]
+    fn test_shared_matcher_replace() {
+        let shared = SharedExcludeMatcher::new(matcher(&["node_modules"]));
+        let before = shared.current();
+        shared.replace(matcher(&["target"]));
+
+        assert!(before.is_excluded_name(OsStr::new("node_modules")));
+        assert!(!shared.current().is_excluded_name(OsStr::new("node_modules")));
+        assert!(shared.current().is_excluded_name(OsStr::new("target")));
+    }
+
+    #[test]
+    fn test_invalid_patterns_are_skipped() {
+        let matcher = matcher(&["[unclosed", "*.log"]);
+        assert!(matcher.is_excluded_name(OsStr::new("debug.log")));
+        assert!(!matcher.is_excluded_name(OsStr::new("[unclosed")));
+    }
+
+    #[test]
+    fn test_empty_matcher() {
+        let matcher = ExcludeMatcher::default();
+        assert!(!matcher.is_excluded_name(OsStr::new(".git")));
+        assert!(!matcher.is_excluded_path(Path::new("/home/user/.git")));
+    }
+}
@@ -0,0 +1,577 @@
+use crate::exclude::SharedExcludeMatcher;
+use crate::watcher::{FilesystemEvent, WatcherError};
+use std::collections::{HashMap, HashSet};
+use std::ffi::{CString, OsStr};
+use std::fs::File;
+use std::io;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+use std::os::unix::ffi::OsStrExt;
+use std::os::unix::fs::MetadataExt;
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex, RwLock};
+use std::thread::JoinHandle;
+use tokio::sync::mpsc::UnboundedSender;
+
+/// Events marked on every watched filesystem
+///
+/// Writes are reported once per close rather than once per `write()`.
+const EVENT_MASK: u64 = libc::FAN_CREATE
+    | libc::FAN_DELETE
+    | libc::FAN_CLOSE_WRITE
+    | libc::FAN_ATTRIB
+    | libc::FAN_ONDIR;
+
+/// Size of the buffer events are read into
+const READ_BUFFER_SIZE: usize = 64 * 1024;
+
+/// Number of resolved directory handles kept before the cache is reset
+const DIR_CACHE_CAPACITY: usize = 4096;
+
+/// Size of `struct fanotify_event_metadata`
+const METADATA_LEN: usize = 24;
+
+/// Size of the info header and fsid preceding a file handle in a fid record
+const FID_RECORD_HEADER_LEN: usize = 12;
+
+/// Size of the `handle_bytes` and `handle_type` fields of `struct file_handle`
+const FILE_HANDLE_HEADER_LEN: usize = 8;
+
+/// Whole-filesystem watcher built on fanotify
+///
+/// Each filesystem holding a watched path is marked once with
+/// `FAN_MARK_FILESYSTEM`, so setting up a watch costs the same however many
+/// directories it contains. The kernel reports events as a parent directory
+/// handle plus an entry name; a reader thread resolves the handle to a path
+/// and drops events outside the watched paths or matching an exclusion.
+///
+/// Requires `CAP_SYS_ADMIN` to mark filesystems and `CAP_DAC_READ_SEARCH` to
+/// resolve handles.
+pub struct FanotifyWatcher {
+    fanotify: Arc<OwnedFd>,
+    shared: Arc<Shared>,
+    /// Device ids of the filesystems already marked
+    marked: HashSet<u64>,
+    /// Rename events, where supported, or the separate move halves
+    move_mask: Option<u64>,
+    /// Written to on drop to stop the reader thread
+    stop: OwnedFd,
+    reader: Option<JoinHandle<()>>,
+}
+
+/// State shared with the reader thread
+struct Shared {
+    /// Paths whose events are reported
+    roots: RwLock<Vec<PathBuf>>,
+    /// An open directory on each marked filesystem, keyed by fsid, used to
+    /// resolve handles
+    mount_fds: Mutex<Vec<([i32; 2], File)>>,
+}
+
+impl FanotifyWatcher {
+    /// Create a fanotify group and start reading its events into `sender`
+    pub fn new(
+        sender: UnboundedSender<FilesystemEvent>,
+        exclude: Arc<SharedExcludeMatcher>,
+    ) -> Result<Self, WatcherError> {
+        let fd = unsafe {
+            libc::fanotify_init(
+                libc::FAN_CLASS_NOTIF | libc::FAN_CLOEXEC | libc::FAN_REPORT_DFID_NAME,
+                (libc::O_RDONLY | libc::O_LARGEFILE | libc::O_CLOEXEC) as libc::c_uint,
+            )
+        };
+        if fd < 0 {
+            return Err(init_error("fanotify_init", io::Error::last_os_error()));
+        }
+        let fanotify = Arc::new(unsafe { OwnedFd::from_raw_fd(fd) });
+
+        let mut pipe_fds = [0; 2];
+        if unsafe { libc::pipe2(pipe_fds.as_mut_ptr(), libc::O_CLOEXEC) } < 0 {
+            return Err(init_error("pipe2", io::Error::last_os_error()));
+        }
+        let stop_reader = unsafe { OwnedFd::from_raw_fd(pipe_fds[0]) };
+        let stop = unsafe { OwnedFd::from_raw_fd(pipe_fds[1]) };
+
+        let shared = Arc::new(Shared {
+            roots: RwLock::new(Vec::new()),
+            mount_fds: Mutex::new(Vec::new()),
+        });
+
+        let mut reader = EventReader {
+            fanotify: Arc::clone(&fanotify),
+            shared: Arc::clone(&shared),
+            exclude,
+            sender,
+            dir_cache: HashMap::new(),
+        };
+        let reader = std::thread::Builder::new()
+            .name("fanotify-reader".to_string())
+            .spawn(move || reader.run(stop_reader))
+            .map_err(|e| init_error("spawn", e))?;
+
+        Ok(FanotifyWatcher {
+            fanotify,
+            shared,
+            marked: HashSet::new(),
+            move_mask: None,
+            stop,
+            reader: Some(reader),
+        })
+    }
+
+    /// Report events below `path`, marking its filesystem if needed
+    pub fn watch(&mut self, path: &Path) -> Result<(), WatcherError> {
+        let watch_error = |e: io::Error| {
+            WatcherError::WatchError(format!("Failed to watch {:?}: {}", path, e))
+        };
+
+        let device = std::fs::metadata(path).map_err(watch_error)?.dev();
+        if !self.marked.contains(&device) {
+            let c_path = CString::new(path.as_os_str().as_bytes())
+                .map_err(|e| watch_error(io::Error::new(io::ErrorKind::InvalidInput, e)))?;
+            self.mark(&c_path).map_err(watch_error)?;
+
+            let mount_fd = File::open(path).map_err(watch_error)?;
+            let fsid = filesystem_id(&c_path).map_err(watch_error)?;
+            self.shared.mount_fds.lock().unwrap().push((fsid, mount_fd));
+            self.marked.insert(device);
+        }
+
+        self.shared.roots.write().unwrap().push(path.to_path_buf());
+        Ok(())
+    }
+
+    /// Stop reporting events below `path`
+    ///
+    /// The filesystem stays marked, as other roots may be on it; its events
+    /// are dropped unless they fall below another root.
+    pub fn unwatch(&mut self, path: &Path) {
+        self.shared.roots.write().unwrap().retain(|root| root != path);
+    }
+
+    /// Mark the filesystem holding `path`
+    ///
+    /// Rename events (Linux 5.17) report both ends of a move in one event;
+    /// older kernels reject them and get the separate halves instead.
+    fn mark(&mut self, path: &CString) -> io::Result<()> {
+        let candidates = match self.move_mask {
+            Some(mask) => vec![mask],
+            None => vec![libc::FAN_RENAME, libc::FAN_MOVED_FROM | libc::FAN_MOVED_TO],
+        };
+
+        let mut last_error = io::Error::from_raw_os_error(libc::EINVAL);
+        for move_mask in candidates {
+            let result = unsafe {
+                libc::fanotify_mark(
+                    self.fanotify.as_raw_fd(),
+                    libc::FAN_MARK_ADD | libc::FAN_MARK_FILESYSTEM,
+                    EVENT_MASK | move_mask,
+                    libc::AT_FDCWD,
+                    path.as_ptr(),
+                )
+            };
+            if result == 0 {
+                self.move_mask = Some(move_mask);
+                return Ok(());
+            }
+
+            last_error = io::Error::last_os_error();
+            if last_error.raw_os_error() != Some(libc::EINVAL) {
+                break;
+            }
+        }
+        Err(last_error)
+    }
+}
+
+impl Drop for FanotifyWatcher {
+    fn drop(&mut self) {
+        unsafe {
+            libc::write(self.stop.as_raw_fd(), [0u8].as_ptr() as *const libc::c_void, 1);
+        }
+        if let Some(reader) = self.reader.take() {
+            let _ = reader.join();
+        }
+    }
+}
+
+fn init_error(call: &str, e: io::Error) -> WatcherError {
+    WatcherError::InitializationError(format!("{} failed: {}", call, e))
+}
+
+/// Get the fsid fanotify reports for the filesystem holding `path`
+fn filesystem_id(path: &CString) -> io::Result<[i32; 2]> {
+    let mut stat: libc::statfs = unsafe { std::mem::zeroed() };
+    if unsafe { libc::statfs(path.as_ptr(), &mut stat) } < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    // fsid_t is two ints whose fields libc keeps private
+    Ok(unsafe { std::mem::transmute::<libc::fsid_t, [i32; 2]>(stat.f_fsid) })
+}
+
+/// A directory entry named by an event
+#[derive(Debug, Clone, PartialEq)]
+struct EntryRecord {
+    info_type: u8,
+    fsid: [i32; 2],
+    /// `struct file_handle` of the parent directory, header included
+    handle: Vec<u8>,
+    name: Vec<u8>,
+}
+
+/// One event read from the fanotify descriptor
+#[derive(Debug, Clone, PartialEq)]
+struct RawEvent {
+    mask: u64,
+    records: Vec<EntryRecord>,
+}
+
+/// Split a buffer filled by `read()` into events
+///
+/// Truncated or malformed events end the parse; the rest of the buffer is
+/// dropped.
+fn parse_events(buffer: &[u8]) -> Vec<RawEvent> {
+    let u16_at = |b: &[u8], at: usize| u16::from_ne_bytes([b[at], b[at + 1]]);
+    let u32_at = |b: &[u8], at: usize| u32::from_ne_bytes(b[at..at + 4].try_into().unwrap());
+    let i32_at = |b: &[u8], at: usize| i32::from_ne_bytes(b[at..at + 4].try_into().unwrap());
+
+    let mut events = Vec::new();
+    let mut offset = 0;
+
+    while buffer.len() - offset >= METADATA_LEN {
+        let event = &buffer[offset..];
+        let event_len = u32_at(event, 0) as usize;
+        let metadata_len = u16_at(event, 6) as usize;
+        if event_len < METADATA_LEN || event_len > event.len() || metadata_len > event_len {
+            break;
+        }
+        let event = &event[..event_len];
+        let mask = u64::from_ne_bytes(event[8..16].try_into().unwrap());
+
+        // Descriptors are only reported without FAN_REPORT_*FID, but never leak one
+        let fd = i32_at(event, 16);
+        if fd >= 0 {
+            unsafe { libc::close(fd) };
+        }
+
+        let mut records = Vec::new();
+        let mut at = metadata_len;
+        while event_len - at >= FID_RECORD_HEADER_LEN + FILE_HANDLE_HEADER_LEN {
+            let info_type = event[at];
+            let record_len = u16_at(event, at + 2) as usize;
+            if record_len < FID_RECORD_HEADER_LEN + FILE_HANDLE_HEADER_LEN || at + record_len > event_len {
+                break;
+            }
+            let record = &event[at..at + record_len];
+
+            let handle_start = FID_RECORD_HEADER_LEN;
+            let handle_end = handle_start + FILE_HANDLE_HEADER_LEN + u32_at(record, handle_start) as usize;
+            if handle_end <= record.len() {
+                let name = &record[handle_end..];
+                let name = &name[..name.iter().position(|&b| b == 0).unwrap_or(name.len())];
+                records.push(EntryRecord {
+                    info_type,
+                    fsid: [i32_at(record, 4), i32_at(record, 8)],
+                    handle: record[handle_start..handle_end].to_vec(),
+                    name: name.to_vec(),
+                });
+            }
+            at += record_len;
+        }
+
+        events.push(RawEvent { mask, records });
+        offset += event_len;
+    }
+
+    events
+}
+
+/// Turn a decoded event into a `FilesystemEvent`
+///
+/// `resolve` maps a record to the path it names. `is_visible` decides whether
+/// a path is watched and not excluded.
+fn convert_event<R, V>(event: &RawEvent, mut resolve: R, is_visible: V) -> Option<FilesystemEvent>
+where
+    R: FnMut(&EntryRecord) -> Option<PathBuf>,
+    V: Fn(&Path) -> bool,
+{
+    if event.mask & libc::FAN_Q_OVERFLOW != 0 {
+        return Some(FilesystemEvent::Rescan(Vec::new()));
+    }
+
+    if event.mask & libc::FAN_RENAME != 0 {
+        let end = |info_type| event.records.iter().find(|r| r.info_type == info_type);
+        let from = end(libc::FAN_EVENT_INFO_TYPE_OLD_DFID_NAME).and_then(&mut resolve);
+        let to = end(libc::FAN_EVENT_INFO_TYPE_NEW_DFID_NAME).and_then(&mut resolve);
+        return FilesystemEvent::from_move(from.filter(|p| is_visible(p)), to.filter(|p| is_visible(p)));
+    }
+
+    let record = event
+        .records
+        .iter()
+        .find(|r| r.info_type == libc::FAN_EVENT_INFO_TYPE_DFID_NAME)?;
+    let path = resolve(record).filter(|p| is_visible(p))?;
+
+    // The kernel merges queued events for the same entry, so a creation and a
+    // deletion can arrive together; what exists now decides
+    let entry_changes = libc::FAN_CREATE | libc::FAN_DELETE | libc::FAN_MOVED_FROM | libc::FAN_MOVED_TO;
+    if event.mask & entry_changes != 0 {
+        if path.symlink_metadata().is_ok() {
+            Some(FilesystemEvent::Created(path))
+        } else {
+            Some(FilesystemEvent::Deleted(path))
+        }
+    } else {
+        Some(FilesystemEvent::Modified(path))
+    }
+}
+
+/// Reads, resolves and filters events on a dedicated thread
+struct EventReader {
+    fanotify: Arc<OwnedFd>,
+    shared: Arc<Shared>,
+    exclude: Arc<SharedExcludeMatcher>,
+    sender: UnboundedSender<FilesystemEvent>,
+    /// Resolved parent directories, keyed by fsid and handle
+    dir_cache: HashMap<([i32; 2], Vec<u8>), Option<PathBuf>>,
+}
+
+impl EventReader {
+    /// Forward events until the watcher is dropped or the receiver goes away
+    fn run(&mut self, stop: OwnedFd) {
+        let mut buffer = vec![0u8; READ_BUFFER_SIZE];
+        let mut poll_fds = [
+            libc::pollfd { fd: self.fanotify.as_raw_fd(), events: libc::POLLIN, revents: 0 },
+            libc::pollfd { fd: stop.as_raw_fd(), events: libc::POLLIN, revents: 0 },
+        ];
+
+        loop {
+            if unsafe { libc::poll(poll_fds.as_mut_ptr(), 2, -1) } < 0 {
+                if io::Error::last_os_error().kind() == io::ErrorKind::Interrupted {
+                    continue;
+                }
+                eprintln!("Filesystem watch error: poll failed: {}", io::Error::last_os_error());
+                return;
+            }
+            if poll_fds[1].revents != 0 {
+                return;
+            }
+
+            let read = unsafe {
+                libc::read(
+                    self.fanotify.as_raw_fd(),
+                    buffer.as_mut_ptr() as *mut libc::c_void,
+                    buffer.len(),
+                )
+            };
+            if read < 0 {
+                let err = io::Error::last_os_error();
+                if matches!(err.kind(), io::ErrorKind::Interrupted | io::ErrorKind::WouldBlock) {
+                    continue;
+                }
+                eprintln!("Filesystem watch error: read failed: {}", err);
+                return;
+            }
+
+            for event in parse_events(&buffer[..read as usize]) {
+                // Renamed or removed directories invalidate cached paths below them
+                if event.mask & libc::FAN_ONDIR != 0
+                    && event.mask & (libc::FAN_RENAME | libc::FAN_MOVED_FROM | libc::FAN_DELETE) != 0
+                {
+                    self.dir_cache.clear();
+                }
+
+                let roots = self.shared.roots.read().unwrap();
+                let exclude = self.exclude.current();
+                let is_visible = |path: &Path| {
+                    roots.iter().any(|root| path.starts_with(root)) && !exclude.is_excluded_path(path)
+                };
+                let converted = convert_event(
+                    &event,
+                    |record| resolve_entry(&self.shared, &mut self.dir_cache, record),
+                    is_visible,
+                );
+                drop(roots);
+
+                if let Some(converted) = converted {
+                    if self.sender.send(converted).is_err() {
+                        return;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Resolve the path an entry record names: its parent directory's handle,
+/// opened relative to the matching filesystem, joined with the entry name
+fn resolve_entry(
+    shared: &Shared,
+    dir_cache: &mut HashMap<([i32; 2], Vec<u8>), Option<PathBuf>>,
+    record: &EntryRecord,
+) -> Option<PathBuf> {
+    let key = (record.fsid, record.handle.clone());
+    let dir = match dir_cache.get(&key) {
+        Some(dir) => dir.clone(),
+        None => {
+            let dir = open_directory_handle(shared, record.fsid, &record.handle);
+            if dir_cache.len() >= DIR_CACHE_CAPACITY {
+                dir_cache.clear();
+            }
+            dir_cache.insert(key, dir.clone());
+            dir
+        }
+    }?;
+
+    if record.name.is_empty() || record.name == b"." {
+        Some(dir)
+    } else {
+        Some(dir.join(OsStr::from_bytes(&record.name)))
+    }
+}
+
+/// Open a directory by handle and read back its current path
+fn open_directory_handle(shared: &Shared, fsid: [i32; 2], handle: &[u8]) -> Option<PathBuf> {
+    let mount_fds = shared.mount_fds.lock().unwrap();
+    let (_, mount_fd) = mount_fds.iter().find(|(id, _)| *id == fsid)?;
+
+    // struct file_handle needs int alignment
+    let mut aligned = vec![0u32; (handle.len() + 3) / 4];
+    unsafe {
+        std::ptr::copy_nonoverlapping(handle.as_ptr(), aligned.as_mut_ptr() as *mut u8, handle.len());
+    }
+
+    let fd = unsafe {
+        libc::syscall(
+            libc::SYS_open_by_handle_at,
+            mount_fd.as_raw_fd(),
+            aligned.as_mut_ptr(),
+            libc::O_PATH | libc::O_CLOEXEC,
+        )
+    } as libc::c_int;
+    if fd < 0 {
+        // Usually ESTALE: the directory is already gone
+        return None;
+    }
+    let fd = unsafe { OwnedFd::from_raw_fd(fd) };
+
+    let path = std::fs::read_link(format!("/proc/self/fd/{}", fd.as_raw_fd())).ok()?;
+    if path.as_os_str().as_bytes().ends_with(b" (deleted)") {
+        return None;
+    }
+    Some(path)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// Encode an event the way the kernel lays it out
+    fn encode_event(mask: u64, records: &[(u8, &[u8], &str)]) -> Vec<u8> {
+        let mut body = Vec::new();
+        for (info_type, handle, name) in records {
+            let mut record = vec![*info_type, 0, 0, 0];
+            record.extend_from_slice(&1i32.to_ne_bytes());
+            record.extend_from_slice(&2i32.to_ne_bytes());
+            record.extend_from_slice(&(handle.len() as u32).to_ne_bytes());
+            record.extend_from_slice(&1i32.to_ne_bytes());
+            record.extend_from_slice(handle);
+            record.extend_from_slice(name.as_bytes());
+            record.push(0);
+            while record.len() % 4 != 0 {
+                record.push(0);
+            }
+            let len = record.len() as u16;
+            record[2..4].copy_from_slice(&len.to_ne_bytes());
+            body.extend_from_slice(&record);
+        }
+
+        let mut event = Vec::new();
+        event.extend_from_slice(&((METADATA_LEN + body.len()) as u32).to_ne_bytes());
+        event.push(3);
+        event.push(0);
+        event.extend_from_slice(&(METADATA_LEN as u16).to_ne_bytes());
+        event.extend_from_slice(&mask.to_ne_bytes());
+        event.extend_from_slice(&libc::FAN_NOFD.to_ne_bytes());
+        event.extend_from_slice(&0i32.to_ne_bytes());
+        event.extend_from_slice(&body);
+        event
+    }
+
+    /// Resolve records by treating the handle bytes as the directory path
+    fn fake_resolve(record: &EntryRecord) -> Option<PathBuf> {
+        let dir = std::str::from_utf8(&record.handle[FILE_HANDLE_HEADER_LEN..]).ok()?;
+        Some(Path::new(dir).join(OsStr::from_bytes(&record.name)))
+    }
+
+    #[test]
+    fn test_parse_events() {
+        let mut buffer = encode_event(libc::FAN_CREATE, &[
+            (libc::FAN_EVENT_INFO_TYPE_DFID_NAME, b"/home/user", "notes.txt"),
+        ]);
+        buffer.extend(encode_event(libc::FAN_Q_OVERFLOW, &[]));
+
+        let events = parse_events(&buffer);
+        assert_eq!(events.len(), 2);
+        assert_eq!(events[0].mask, libc::FAN_CREATE);
+        assert_eq!(events[0].records.len(), 1);
+        assert_eq!(events[0].records[0].fsid, [1, 2]);
+        assert_eq!(events[0].records[0].name, b"notes.txt");
+        assert_eq!(fake_resolve(&events[0].records[0]), Some(PathBuf::from("/home/user/notes.txt")));
+        assert!(events[1].records.is_empty());
+
+        // A truncated event is dropped
+        assert_eq!(parse_events(&buffer[..buffer.len() - 1]).len(), 1);
+        assert!(parse_events(&buffer[..10]).is_empty());
+    }
+
+    #[test]
+    fn test_convert_events() {
+        let visible = |path: &Path| path.starts_with("/home/user") && !path.starts_with("/home/user/.cache");
+        let convert = |buffer: Vec<u8>| convert_event(&parse_events(&buffer)[0], fake_resolve, visible);
+
+        let modified = encode_event(libc::FAN_CLOSE_WRITE, &[
+            (libc::FAN_EVENT_INFO_TYPE_DFID_NAME, b"/home/user", "notes.txt"),
+        ]);
+        assert!(matches!(
+            convert(modified),
+            Some(FilesystemEvent::Modified(path)) if path == Path::new("/home/user/notes.txt")
+        ));
+
+        // Entries that no longer exist are reported as deleted
+        let created = encode_event(libc::FAN_CREATE, &[
+            (libc::FAN_EVENT_INFO_TYPE_DFID_NAME, b"/home/user", "vanished.txt"),
+        ]);
+        assert!(matches!(convert(created), Some(FilesystemEvent::Deleted(_))));
+
+        // Events outside the watched paths are dropped
+        let outside = encode_event(libc::FAN_CLOSE_WRITE, &[
+            (libc::FAN_EVENT_INFO_TYPE_DFID_NAME, b"/var/log", "syslog"),
+        ]);
+        assert!(convert(outside).is_none());
+
+        let renamed = encode_event(libc::FAN_RENAME | libc::FAN_ONDIR, &[
+            (libc::FAN_EVENT_INFO_TYPE_OLD_DFID_NAME, b"/home/user", "project"),
+            (libc::FAN_EVENT_INFO_TYPE_NEW_DFID_NAME, b"/home/user", "renamed"),
+        ]);
+        assert!(matches!(
+            convert(renamed),
+            Some(FilesystemEvent::Moved { from, to })
+                if from == Path::new("/home/user/project") && to == Path::new("/home/user/renamed")
+        ));
+
+        // Moving into an excluded location removes the source
+        let hidden = encode_event(libc::FAN_RENAME, &[
+            (libc::FAN_EVENT_INFO_TYPE_OLD_DFID_NAME, b"/home/user", "file"),
+            (libc::FAN_EVENT_INFO_TYPE_NEW_DFID_NAME, b"/home/user/.cache", "file"),
+        ]);
+        assert!(matches!(
+            convert(hidden),
+            Some(FilesystemEvent::Deleted(path)) if path == Path::new("/home/user/file")
+        ));
+
+        assert!(matches!(
+            convert(encode_event(libc::FAN_Q_OVERFLOW, &[])),
+            Some(FilesystemEvent::Rescan(paths)) if paths.is_empty()
+        ));
+    }
+}
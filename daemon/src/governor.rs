@@ -0,0 +1,339 @@
+//! Enforcement of the `max_cpu_percent` and `max_memory_mb` budgets
+//!
+//! The governor samples the process's CPU time and resident size, and the
+//! CPU time the rest of the machine uses. Scanner workers call `pace` before
+//! each directory; while other work competes for the CPUs and the daemon is
+//! over its CPU budget, they all sleep until the average falls back within
+//! it. On an otherwise idle machine nothing is slowed down.
+
+use crate::config::PerformanceConfig;
+use crate::metrics::METRICS;
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+
+/// Time between samples of the process and system CPU time
+const SAMPLE_INTERVAL: Duration = Duration::from_millis(250);
+
+/// Longest pause imposed at once, so a spike is paid back gradually
+const MAX_PAUSE: Duration = Duration::from_secs(1);
+
+/// Pause of scanner workers while the process is over its memory budget,
+/// giving the writer time to drain queued batches
+const MEMORY_PAUSE: Duration = Duration::from_millis(100);
+
+/// CPUs other processes must keep busy before the CPU budget is enforced
+const CONTENDED_CPUS: f64 = 0.5;
+
+/// `ioprio_set` arguments, see linux/ioprio.h
+const IOPRIO_WHO_PROCESS: libc::c_int = 1;
+const IOPRIO_CLASS_IDLE: libc::c_int = 3;
+const IOPRIO_CLASS_SHIFT: libc::c_int = 13;
+
+/// CPU and memory readings taken at one point in time
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub struct Sample {
+    /// CPU time used by this process
+    pub process_cpu: Duration,
+    /// CPU time used by every process, if the kernel reports it
+    pub system_cpu: Option<Duration>,
+    /// Resident set size in bytes
+    pub rss: u64,
+}
+
+impl Sample {
+    /// Read the current values for this process
+    pub fn now() -> Self {
+        Sample {
+            process_cpu: process_cpu_time(),
+            system_cpu: std::fs::read_to_string("/proc/stat")
+                .ok()
+                .and_then(|stat| parse_system_cpu(&stat, clock_ticks_per_second())),
+            rss: std::fs::read_to_string("/proc/self/statm")
+                .ok()
+                .and_then(|statm| parse_rss(&statm, page_size()))
+                .unwrap_or(0),
+        }
+    }
+}
+
+/// Throttles indexing work to the configured CPU and memory budgets
+pub struct Governor {
+    /// CPU time allowed per second of wall time, in CPUs
+    cpu_budget: f64,
+    memory_budget: u64,
+    state: Mutex<GovernorState>,
+}
+
+/// Readings at the start of the current sampling window, and the decision
+/// made at its end
+#[derive(Debug)]
+struct GovernorState {
+    window_start: Instant,
+    window_sample: Sample,
+    /// Work waits until this instant
+    pause_until: Option<Instant>,
+    /// The last window was over the CPU budget while the machine was busy
+    throttling: bool,
+    over_memory: bool,
+}
+
+impl Governor {
+    /// Create a governor for the budgets in `config`
+    pub fn new(config: &PerformanceConfig) -> Self {
+        let cpus = std::thread::available_parallelism().map_or(1, |n| n.get());
+        Self::with_budget(
+            cpus as f64 * config.max_cpu_percent as f64 / 100.0,
+            config.max_memory_mb * 1024 * 1024,
+            Sample::now(),
+        )
+    }
+
+    /// Create a governor allowing `cpu_budget` CPUs and `memory_budget`
+    /// bytes, starting from `sample`
+    fn with_budget(cpu_budget: f64, memory_budget: u64, sample: Sample) -> Self {
+        Governor {
+            cpu_budget,
+            memory_budget,
+            state: Mutex::new(GovernorState {
+                window_start: Instant::now(),
+                window_sample: sample,
+                pause_until: None,
+                throttling: false,
+                over_memory: false,
+            }),
+        }
+    }
+
+    /// Sleep if the process is over budget
+    ///
+    /// Called by every scanner worker before each directory; all of them
+    /// sleep until the same instant, which stretches the wall time of the
+    /// scan just enough to bring its CPU use back within budget.
+    pub fn pace(&self) {
+        let pause_until = {
+            let mut state = self.state.lock().unwrap();
+            self.update_locked(&mut state, Instant::now());
+            state.pause_until
+        };
+
+        if let Some(pause_until) = pause_until {
+            let now = Instant::now();
+            if pause_until > now {
+                std::thread::sleep(pause_until - now);
+            }
+        }
+    }
+
+    /// Take a new sample if the current window is over
+    pub fn update(&self) {
+        let mut state = self.state.lock().unwrap();
+        self.update_locked(&mut state, Instant::now());
+    }
+
+    /// Whether the last window went over the CPU budget while other
+    /// processes needed the CPUs
+    pub fn is_throttling(&self) -> bool {
+        self.state.lock().unwrap().throttling
+    }
+
+    /// Whether the process was over its memory budget at the last sample
+    pub fn is_over_memory(&self) -> bool {
+        self.state.lock().unwrap().over_memory
+    }
+
+    fn update_locked(&self, state: &mut GovernorState, now: Instant) {
+        if now.duration_since(state.window_start) >= SAMPLE_INTERVAL {
+            self.end_window(state, now, Sample::now());
+        }
+    }
+
+    /// Decide on a pause from the CPU and memory used since the window began
+    fn end_window(&self, state: &mut GovernorState, now: Instant, sample: Sample) {
+        let wall = now.duration_since(state.window_start);
+        let process = sample.process_cpu.saturating_sub(state.window_sample.process_cpu);
+        let others = match (sample.system_cpu, state.window_sample.system_cpu) {
+            (Some(current), Some(previous)) => current.saturating_sub(previous).saturating_sub(process),
+            // Without system figures, assume the CPUs are always contended
+            _ => Duration::MAX,
+        };
+
+        let contended = others.as_secs_f64() >= CONTENDED_CPUS * wall.as_secs_f64();
+        let pause = if contended { cpu_pause(process, wall, self.cpu_budget) } else { Duration::ZERO };
+        state.throttling = !pause.is_zero();
+
+        state.over_memory = sample.rss > self.memory_budget;
+        let pause = if state.over_memory { pause.max(MEMORY_PAUSE) } else { pause };
+
+        METRICS.rss_bytes.set(sample.rss);
+        if !pause.is_zero() {
+            METRICS.governor_pauses.incr();
+            METRICS.governor_pause_time.add(pause.as_micros() as u64);
+        }
+
+        state.pause_until = Some(now + pause).filter(|_| !pause.is_zero());
+        state.window_start = now;
+        state.window_sample = sample;
+    }
+}
+
+/// Sleep needed after using `process` CPU time in `wall` time to average
+/// `budget` CPUs
+fn cpu_pause(process: Duration, wall: Duration, budget: f64) -> Duration {
+    if budget <= 0.0 {
+        return MAX_PAUSE;
+    }
+    let allowed_wall = process.as_secs_f64() / budget;
+    Duration::from_secs_f64((allowed_wall - wall.as_secs_f64()).clamp(0.0, MAX_PAUSE.as_secs_f64()))
+}
+
+/// User and system CPU time of this process, all threads included
+fn process_cpu_time() -> Duration {
+    let mut usage: libc::rusage = unsafe { std::mem::zeroed() };
+    if unsafe { libc::getrusage(libc::RUSAGE_SELF, &mut usage) } < 0 {
+        return Duration::ZERO;
+    }
+    let timeval = |tv: libc::timeval| Duration::new(tv.tv_sec as u64, tv.tv_usec as u32 * 1000);
+    timeval(usage.ru_utime) + timeval(usage.ru_stime)
+}
+
+fn clock_ticks_per_second() -> u64 {
+    match unsafe { libc::sysconf(libc::_SC_CLK_TCK) } {
+        ticks if ticks > 0 => ticks as u64,
+        _ => 100,
+    }
+}
+
+fn page_size() -> u64 {
+    match unsafe { libc::sysconf(libc::_SC_PAGESIZE) } {
+        size if size > 0 => size as u64,
+        _ => 4096,
+    }
+}
+
+/// Busy CPU time of all CPUs from the first line of `/proc/stat`
+///
+/// The fields are user, nice, system, idle, iowait, irq, softirq and steal,
+/// in clock ticks; idle and iowait are not busy.
+fn parse_system_cpu(stat: &str, ticks_per_second: u64) -> Option<Duration> {
+    let line = stat.lines().next()?;
+    let mut fields = line.split_whitespace();
+    if fields.next()? != "cpu" {
+        return None;
+    }
+    let ticks: Vec<u64> = fields.take(8).map(|field| field.parse().ok()).collect::<Option<_>>()?;
+    if ticks.len() < 4 {
+        return None;
+    }
+    let busy: u64 = ticks
+        .iter()
+        .enumerate()
+        .filter(|&(i, _)| i != 3 && i != 4)
+        .map(|(_, &t)| t)
+        .sum();
+    Some(Duration::from_secs_f64(busy as f64 / ticks_per_second as f64))
+}
+
+/// Resident size in bytes from `/proc/self/statm`, whose second field is
+/// the resident page count
+fn parse_rss(statm: &str, page_size: u64) -> Option<u64> {
+    let pages: u64 = statm.split_whitespace().nth(1)?.parse().ok()?;
+    Some(pages * page_size)
+}
+
+/// Gives the calling thread idle I/O priority until dropped
+///
+/// Scans then only read the disk when no other process wants it. Writes to
+/// the index stay on the main thread at normal priority.
+pub struct IdleIoPriority {
+    previous: Option<libc::c_long>,
+}
+
+impl IdleIoPriority {
+    pub fn enter() -> Self {
+        let previous = unsafe { libc::syscall(libc::SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0) };
+        let idle = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+        let set = unsafe { libc::syscall(libc::SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, idle) };
+        IdleIoPriority {
+            previous: Some(previous).filter(|&previous| previous >= 0 && set == 0),
+        }
+    }
+}
+
+impl Drop for IdleIoPriority {
+    fn drop(&mut self) {
+        if let Some(previous) = self.previous {
+            unsafe { libc::syscall(libc::SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, previous) };
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn sample(process_ms: u64, system_ms: u64, rss: u64) -> Sample {
+        Sample {
+            process_cpu: Duration::from_millis(process_ms),
+            system_cpu: Some(Duration::from_millis(system_ms)),
+            rss,
+        }
+    }
+
+    #[test]
+    fn test_cpu_pause() {
+        let second = Duration::from_secs(1);
+        assert_eq!(cpu_pause(Duration::from_millis(500), second, 1.0), Duration::ZERO);
+        assert_eq!(cpu_pause(Duration::from_millis(500), second, 0.25), second);
+        assert_eq!(cpu_pause(Duration::from_millis(300), second, 0.2), Duration::from_millis(500));
+        assert_eq!(cpu_pause(Duration::from_secs(60), second, 0.1), MAX_PAUSE);
+    }
+
+    #[test]
+    fn test_throttles_only_when_contended() {
+        let governor = Governor::with_budget(0.1, 1 << 30, sample(0, 0, 0));
+        let start = governor.state.lock().unwrap().window_start;
+        let mut state = governor.state.lock().unwrap();
+
+        // Over budget on an idle machine: only this process was busy
+        let now = start + Duration::from_secs(1);
+        governor.end_window(&mut state, now, sample(500, 500, 0));
+        assert!(!state.throttling);
+        assert_eq!(state.pause_until, None);
+
+        // Over budget while others keep two CPUs busy
+        let now = now + Duration::from_secs(1);
+        governor.end_window(&mut state, now, sample(700, 2700, 0));
+        assert!(state.throttling);
+        assert_eq!(state.pause_until, Some(now + MAX_PAUSE));
+
+        // Within budget despite the contention
+        let now = now + Duration::from_secs(1);
+        governor.end_window(&mut state, now, sample(750, 4750, 0));
+        assert!(!state.throttling);
+        assert_eq!(state.pause_until, None);
+    }
+
+    #[test]
+    fn test_pauses_over_memory_budget() {
+        let governor = Governor::with_budget(1.0, 1000, sample(0, 0, 0));
+        let mut state = governor.state.lock().unwrap();
+        let now = state.window_start + SAMPLE_INTERVAL;
+
+        governor.end_window(&mut state, now, sample(0, 0, 2000));
+        assert!(state.over_memory);
+        assert_eq!(state.pause_until, Some(now + MEMORY_PAUSE));
+    }
+
+    #[test]
+    fn test_parse_proc_files() {
+        let stat = "cpu  100 20 30 1000 50 5 5 0 0 0\ncpu0 50 10 15 500 25 2 3 0 0 0\n";
+        assert_eq!(parse_system_cpu(stat, 100), Some(Duration::from_millis(1600)));
+        assert_eq!(parse_system_cpu("intr 1 2 3\n", 100), None);
+        assert_eq!(parse_rss("2048 300 100 10 0 200 0\n", 4096), Some(300 * 4096));
+        assert_eq!(parse_rss("", 4096), None);
+
+        let sample = Sample::now();
+        assert!(sample.rss > 0);
+        assert!(sample.system_cpu.is_some());
+    }
+}
@@ -4,3 +4,10 @@ pub mod models;
 pub mod config;
 pub mod watcher;
 pub mod scanner;
+pub mod exclude;
+pub mod fanotify;
+pub mod query_server;
+pub mod snapshot;
+pub mod desktop;
+pub mod metrics;
+pub mod governor;
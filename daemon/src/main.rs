@@ -4,18 +4,34 @@ mod models;
 mod config;
 mod watcher;
 mod scanner;
+mod exclude;
+mod fanotify;
+mod query_server;
+mod snapshot;
+mod desktop;
+mod metrics;
+mod governor;
 
 use clap::{Parser, Subcommand};
+use std::os::unix::fs::PermissionsExt;
 use std::path::PathBuf;
-use std::sync::Arc;
-use tokio::sync::Mutex;
-use tokio::time::{interval, Duration};
-use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::{Arc, RwLock};
+use std::sync::mpsc::SyncSender;
+use tokio::sync::mpsc::{unbounded_channel, UnboundedReceiver};
+use tokio::sync::{Mutex, Notify};
+use tokio::time::{Duration, Instant};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
 
-use config::{Config, ConfigWatcher};
+use config::{Config, ConfigWatcher, IndexingChanges};
 use database::Database;
+use exclude::{ExcludeMatcher, SharedExcludeMatcher};
+use governor::Governor;
 use watcher::{FilesystemWatcher, EventProcessor};
-use scanner::Scanner;
+use scanner::{DirectorySnapshot, ScanPriorities, Scanner};
+use models::IndexOperation;
+use metrics::METRICS;
+use query_server::{HotIndex, QueryServer};
+use snapshot::Snapshot;
 
 /// NovaSearch Indexing Daemon
 #[derive(Parser)]
@@ -38,6 +54,12 @@ enum Commands {
     Status,
     /// Force a full re-index
     Reindex,
+    /// Build the application index shared by all users (run as root)
+    SystemIndex {
+        /// Path of the system index to write
+        #[arg(long, value_name = "FILE")]
+        database: Option<PathBuf>,
+    },
     /// Show version information
     Version,
     /// Show about information
@@ -49,10 +71,110 @@ enum Commands {
 /// Main daemon structure
 struct IndexingDaemon {
     db: Arc<Database>,
+    /// In-memory copy of the index served to the panel
+    index: Arc<RwLock<HotIndex>>,
+    socket_path: PathBuf,
+    /// Image of `index` that the panel maps, rewritten after changes
+    snapshot_path: PathBuf,
+    /// Index generation the snapshot on disk was taken at
+    snapshot_generation: AtomicU64,
     watcher: Arc<Mutex<FilesystemWatcher>>,
-    config: Config,
+    /// Exclusion patterns in effect, shared with the watcher
+    exclude: Arc<SharedExcludeMatcher>,
+    /// Keeps scans and writes within the configured CPU and memory budgets
+    governor: Arc<Governor>,
+    /// Configuration in effect, replaced when the file changes
+    config: RwLock<Config>,
+    /// Application directories scanned and watched besides the include paths
+    app_dirs: Vec<PathBuf>,
+    /// Directories served from the attached system index, if there is one
+    system_roots: Option<Vec<PathBuf>>,
     event_processor: Arc<Mutex<EventProcessor>>,
     running: Arc<AtomicBool>,
+    shutdown_requested: Arc<Notify>,
+}
+
+/// Maximum number of watcher events moved into the event processor per lock
+const EVENT_BATCH_SIZE: usize = 1024;
+
+/// Recently launched files whose directories the initial scan lists first
+const PRIORITY_LAUNCHES: usize = 256;
+
+/// Factor by which flushes are spaced out while the governor is throttling
+const THROTTLED_FLUSH_FACTOR: u32 = 4;
+
+/// Delay between losing events and rescanning, so that a burst settles first
+const RESCAN_DELAY: Duration = Duration::from_secs(2);
+
+/// Delay between a configuration reload and applying it, so that the file is
+/// read once an editor has finished writing it
+const CONFIG_SETTLE_DELAY: Duration = Duration::from_millis(500);
+
+/// Delay between the first change written to the index and rewriting the
+/// snapshot, so that one snapshot covers a burst of batches
+const SNAPSHOT_DELAY: Duration = Duration::from_secs(30);
+
+/// Attach the system index to `db`, returning whether there is one
+fn attach_system_index(db: &Database) -> bool {
+    match db.attach_system_index(&paths::get_system_database_path()) {
+        Ok(attached) => attached,
+        Err(e) => {
+            eprintln!("Warning: System index not used: {}", e);
+            false
+        }
+    }
+}
+
+/// Application directories a user's daemon scans itself
+///
+/// The system ones are left to the system index when one is attached.
+fn application_directories(system_index: bool) -> Vec<PathBuf> {
+    if system_index {
+        paths::get_user_application_directories()
+    } else {
+        paths::get_application_directories()
+    }
+}
+
+/// Take up to `limit` queued operations from the processor
+fn drain_operations(processor: &mut EventProcessor, limit: usize) -> Vec<IndexOperation> {
+    let mut operations = Vec::new();
+    while operations.len() < limit {
+        match processor.dequeue_operation() {
+            Some(operation) => operations.push(operation),
+            None => break,
+        }
+    }
+    operations
+}
+
+/// Pass configuration reloads to the event loop from a thread of their own
+///
+/// Saving the file can take several writes, the first of which may leave it
+/// truncated, so each reload waits for `CONFIG_SETTLE_DELAY` and then passes
+/// on the configuration as last loaded.
+fn forward_config_reloads(mut config_watcher: ConfigWatcher) -> std::io::Result<UnboundedReceiver<Config>> {
+    let (sender, receiver) = unbounded_channel();
+    std::thread::Builder::new()
+        .name("config-watcher".to_string())
+        .spawn(move || {
+            while config_watcher.wait_for_reload_blocking().is_some() {
+                std::thread::sleep(CONFIG_SETTLE_DELAY);
+                while config_watcher.try_recv_reload().is_some() {}
+                if sender.send(config_watcher.get_config()).is_err() {
+                    break;
+                }
+            }
+        })?;
+    Ok(receiver)
+}
+
+/// Sleep until `deadline`, or forever when there is none
+async fn sleep_until_deadline(deadline: Option<Instant>) {
+    match deadline {
+        Some(deadline) => tokio::time::sleep_until(deadline).await,
+        None => std::future::pending().await,
+    }
 }
 
 impl IndexingDaemon {
@@ -63,61 +185,152 @@ impl IndexingDaemon {
         if let Some(parent) = db_path.parent() {
             std::fs::create_dir_all(parent)?;
         }
-        let db = Arc::new(Database::open(&db_path)?);
+        let db = Arc::new(Database::open_with_config(&db_path, &config.database)?);
+
+        // Applications installed system-wide are indexed once for all users
+        let system_index = attach_system_index(&db);
+        let system_roots = system_index.then(paths::get_system_application_directories);
+        if system_index {
+            println!("Using system application index at {}", paths::get_system_database_path().display());
+        }
+
+        // Serve queries from memory; every batch written below is applied to
+        // the copy as well
+        let snapshot_path = paths::get_snapshot_path();
+        let index = Arc::new(RwLock::new(HotIndex::load_with_snapshot(&db, &snapshot_path)?));
+        METRICS.mark_started();
+        METRICS.indexed_entries.set(index.read().unwrap().len() as u64);
+        let socket_path = paths::get_query_socket_path();
+        match QueryServer::bind(&socket_path) {
+            Ok(listener) => {
+                let server_db = Database::open_read_only(&db_path, &config.database)?;
+                let server_roots = if system_index && attach_system_index(&server_db) {
+                    system_roots.clone()
+                } else {
+                    None
+                };
+                let server = Arc::new(QueryServer::new(Arc::clone(&index), server_db, server_roots));
+                tokio::spawn(server.serve(listener));
+                println!("Serving queries for {} entries on {}", index.read().unwrap().len(), socket_path.display());
+            }
+            Err(e) => eprintln!("Warning: Query server not started: {}", e),
+        }
+
+        // Metrics are always collected; the endpoint only serves them
+        let prometheus_address = &config.metrics.prometheus_address;
+        if !prometheus_address.is_empty() {
+            match tokio::net::TcpListener::bind(prometheus_address).await {
+                Ok(listener) => {
+                    tokio::spawn(metrics::serve_prometheus(listener));
+                    println!("Serving metrics on http://{}/metrics", prometheus_address);
+                }
+                Err(e) => eprintln!("Warning: Metrics endpoint not started: {}", e),
+            }
+        }
+
+        // Compile the exclusion patterns once for the scanner and the watcher
+        let exclude = Arc::new(SharedExcludeMatcher::new(ExcludeMatcher::from_config(&config)));
 
         // Create filesystem watcher
-        let watcher = Arc::new(Mutex::new(FilesystemWatcher::new(&config)?));
+        let watcher = Arc::new(Mutex::new(FilesystemWatcher::with_exclude_matcher(
+            &config,
+            Arc::clone(&exclude),
+        )?));
 
         // Create event processor
         let debounce_duration = Duration::from_millis(200);
-        let max_queue_size = 10000;
+        let max_queue_size = config.performance.max_queue_size;
         let event_processor = Arc::new(Mutex::new(EventProcessor::new(
             debounce_duration,
             max_queue_size,
         )));
 
         let running = Arc::new(AtomicBool::new(true));
+        let shutdown_requested = Arc::new(Notify::new());
 
         Ok(IndexingDaemon {
             db,
+            index,
+            socket_path,
+            snapshot_generation: AtomicU64::new(
+                Snapshot::open(&snapshot_path).map_or(u64::MAX, |snapshot| snapshot.generation()),
+            ),
+            snapshot_path,
             watcher,
-            config,
+            exclude,
+            governor: Arc::new(Governor::new(&config.performance)),
+            config: RwLock::new(config),
+            app_dirs: application_directories(system_index),
+            system_roots,
             event_processor,
             running,
+            shutdown_requested,
         })
     }
 
+    /// The configuration currently in effect
+    fn config(&self) -> Config {
+        self.config.read().unwrap().clone()
+    }
+
     /// Initialize the daemon (perform initial scan and start watching)
     async fn initialize(&mut self) -> Result<(), Box<dyn std::error::Error>> {
         println!("Initializing NovaSearch daemon...");
+        let config = self.config();
+
+        if let Some(roots) = &self.system_roots {
+            self.hand_over_to_system_index(&config, roots)?;
+        }
 
-        // Perform initial filesystem scan
-        println!("Performing initial filesystem scan...");
-        let scanner = Scanner::new(self.config.clone());
-        let entries = scanner.scan();
-        println!("Found {} files/directories", entries.len());
-
-        // Batch insert entries into database
-        println!("Indexing files...");
-        let batch_size = self.config.performance.batch_size;
-        for chunk in entries.chunks(batch_size) {
-            let operations: Vec<_> = chunk
-                .iter()
-                .map(|entry| models::IndexOperation::Add(entry.clone()))
+        // Unchanged directories are not listed again below, so entries that
+        // patterns added while the daemon was stopped exclude are deleted
+        // first. Roots inside a deleted tree lose their recorded times with
+        // it and are listed in full.
+        let exclude = self.exclude.current();
+        if config.indexing.startup_reconcile {
+            let roots: Vec<PathBuf> = config.expand_paths().into_iter().chain(self.app_dirs.iter().cloned()).collect();
+            let operations: Vec<IndexOperation> = self
+                .excluded_trees(&roots, &exclude)
+                .into_iter()
+                .map(IndexOperation::DeleteTree)
                 .collect();
-            self.db.execute_batch(&operations)?;
+            for batch in operations.chunks(config.performance.batch_size) {
+                self.apply_batch(batch)?;
+            }
+            if !operations.is_empty() {
+                println!("Removed {} excluded trees from the index", operations.len());
+            }
+        }
+
+        // Perform initial filesystem scan, writing batches as they are produced.
+        // Directories unchanged since the last run are not listed again.
+        let snapshot = if config.indexing.startup_reconcile {
+            DirectorySnapshot::new(self.db.load_directory_times()?, self.db.load_indexed_directories()?)
+        } else {
+            DirectorySnapshot::default()
+        };
+
+        if snapshot.len() > 0 {
+            println!("Reconciling index with filesystem ({} known directories)...", snapshot.len());
+        } else {
+            println!("Performing initial filesystem scan...");
         }
+        let priorities = ScanPriorities::new(self.db.load_recent_launches(PRIORITY_LAUNCHES)?);
+        let indexed = index_filesystem(&config, &exclude, &self.governor, &self.app_dirs, priorities, &snapshot, |operations| {
+            self.apply_batch(operations)
+        })?;
+        println!("Applied {} index operations", indexed);
+        self.write_snapshot();
         println!("Initial indexing complete");
 
         // Start watching configured paths
         println!("Starting filesystem monitoring...");
-        let mut paths = self.config.expand_paths();
+        let mut paths = config.expand_paths();
         
         // Always add application directories to watch list
-        let app_dirs = self.get_application_directories();
-        for app_dir in app_dirs {
-            if app_dir.exists() && !paths.contains(&app_dir) {
-                paths.push(app_dir);
+        for app_dir in &self.app_dirs {
+            if app_dir.exists() && !paths.contains(app_dir) {
+                paths.push(app_dir.clone());
             }
         }
         
@@ -134,71 +347,201 @@ impl IndexingDaemon {
         Ok(())
     }
 
+    /// Stop indexing the system application directories the system index
+    /// covers
+    ///
+    /// Their launches move to `system_usage` so that the system entries keep
+    /// their ranking, and their entries are dropped from this index and
+    /// replaced in memory by those of the system index. Directories below an
+    /// include path stay indexed here as well.
+    fn hand_over_to_system_index(&self, config: &Config, roots: &[PathBuf]) -> Result<(), rusqlite::Error> {
+        let include_paths = config.expand_paths();
+        let roots: Vec<PathBuf> = roots
+            .iter()
+            .filter(|root| !include_paths.iter().any(|path| root.starts_with(path)))
+            .cloned()
+            .collect();
+
+        let indexed = self.db.copy_usage_to_system(&roots)?;
+        let operations: Vec<IndexOperation> = indexed.into_iter().map(IndexOperation::DeleteTree).collect();
+        for batch in operations.chunks(config.performance.batch_size) {
+            self.apply_batch(batch)?;
+        }
+        if !operations.is_empty() {
+            println!("Moved {} application directories to the system index", operations.len());
+        }
+
+        let mut index = self.index.write().unwrap();
+        index.load_system(&self.db, &roots)?;
+        METRICS.indexed_entries.set(index.len() as u64);
+        Ok(())
+    }
+
     /// Run the main event loop
-    async fn run(&self) -> Result<(), Box<dyn std::error::Error>> {
+    ///
+    /// The loop sleeps until a filesystem event arrives, the earliest pending
+    /// event finishes debouncing, queued operations are due to be flushed, lost
+    /// events call for a rescan, the configuration file changes, or shutdown
+    /// is requested. Nothing is scheduled while the daemon is idle.
+    async fn run(&self, mut config_reloads: UnboundedReceiver<Config>) -> Result<(), Box<dyn std::error::Error>> {
         println!("NovaSearch daemon running");
 
-        // Set up flush interval
-        let flush_interval_duration = self.config.flush_interval();
-        let mut flush_timer = interval(flush_interval_duration);
+        let mut flush_interval = self.config().flush_interval();
+        let mut batch_size = self.config().performance.batch_size;
+        let mut watching_config = true;
+        let mut flush_deadline: Option<Instant> = None;
+        let mut rescan_deadline: Option<Instant> = None;
+        let mut snapshot_deadline: Option<Instant> = None;
+
+        // The loop is the only consumer of watcher events
+        let mut watcher = self.watcher.lock().await;
+        let mut events = Vec::with_capacity(EVENT_BATCH_SIZE);
 
-        // Clone Arc references for tasks
-        let watcher = Arc::clone(&self.watcher);
-        let event_processor = Arc::clone(&self.event_processor);
-        let db = Arc::clone(&self.db);
-        let running = Arc::clone(&self.running);
-        let batch_size = self.config.performance.batch_size;
+        while self.running.load(Ordering::Relaxed) {
+            let debounce_deadline = {
+                let mut processor = self.event_processor.lock().await;
+                METRICS.pending_events.set(processor.pending_event_count() as u64);
+                METRICS.queue_depth.set(processor.queued_operation_count() as u64);
+                processor.next_deadline().map(Instant::from_std)
+            };
 
-        // Main event loop
-        while running.load(Ordering::Relaxed) {
             tokio::select! {
-                // Process filesystem events
-                _ = tokio::time::sleep(Duration::from_millis(50)) => {
-                    // Receive filesystem events from watcher
-                    let watcher = watcher.lock().await;
-                    while let Some(event) = watcher.try_recv_event() {
-                        let mut processor = event_processor.lock().await;
-                        processor.add_event(event);
+                // Drain every event already delivered under a single lock
+                received = watcher.recv_events(&mut events, EVENT_BATCH_SIZE) => {
+                    if received == 0 {
+                        eprintln!("Filesystem watcher stopped delivering events");
+                        break;
+                    }
+                    METRICS.events_received.add(received as u64);
+                    let mut processor = self.event_processor.lock().await;
+                    processor.add_events(events.drain(..));
+
+                    if rescan_deadline.is_none() && processor.has_dirty_dirs() {
+                        eprintln!("Warning: Filesystem events were lost; scheduling a rescan");
+                        rescan_deadline = Some(Instant::now() + RESCAN_DELAY);
                     }
-                    drop(watcher);
+                }
 
-                    // Process pending events
-                    let mut processor = event_processor.lock().await;
+                // Convert events that finished debouncing into queued operations
+                _ = sleep_until_deadline(debounce_deadline), if debounce_deadline.is_some() => {
+                    let mut processor = self.event_processor.lock().await;
                     let operations = processor.process_pending();
-                    
-                    // Enqueue operations
+
+                    // Operations that do not fit are recovered by rescanning
+                    let mut overflowed = 0;
                     for operation in operations {
-                        if let Err(e) = processor.enqueue_operation(operation) {
-                            eprintln!("Warning: Failed to enqueue operation: {}", e);
+                        if !processor.enqueue_or_mark_dirty(operation) {
+                            overflowed += 1;
                         }
                     }
+                    if overflowed > 0 {
+                        METRICS.events_dropped.add(overflowed);
+                        eprintln!(
+                            "Warning: Operation queue full; {} changes will be picked up by a rescan",
+                            overflowed,
+                        );
+                    }
+
+                    if flush_deadline.is_none() && processor.queued_operation_count() > 0 {
+                        flush_deadline = Some(Instant::now() + flush_interval);
+                    }
+                    if rescan_deadline.is_none() && processor.has_dirty_dirs() {
+                        rescan_deadline = Some(Instant::now() + RESCAN_DELAY);
+                    }
                 }
 
-                // Flush operations to database periodically
-                _ = flush_timer.tick() => {
-                    let mut processor = event_processor.lock().await;
-                    let mut operations = Vec::new();
-                    
-                    // Dequeue up to batch_size operations
-                    for _ in 0..batch_size {
-                        if let Some(op) = processor.dequeue_operation() {
-                            operations.push(op);
-                        } else {
-                            break;
+                // Flush queued operations to the database
+                _ = sleep_until_deadline(flush_deadline), if flush_deadline.is_some() => {
+                    let mut processor = self.event_processor.lock().await;
+                    let limit = processor.flush_size(batch_size);
+                    let operations = drain_operations(&mut processor, limit);
+
+                    // Write a large backlog back to back, a small one after
+                    // the usual batching interval. While other processes need
+                    // the CPUs and the daemon is over budget, writes are spaced
+                    // out further.
+                    self.governor.update();
+                    let throttling = self.governor.is_throttling();
+                    flush_deadline = match processor.queued_operation_count() {
+                        0 => None,
+                        queued if queued >= batch_size && !throttling => Some(Instant::now()),
+                        _ if throttling => Some(Instant::now() + flush_interval * THROTTLED_FLUSH_FACTOR),
+                        _ => Some(Instant::now() + flush_interval),
+                    };
+                    drop(processor);
+
+                    if !operations.is_empty() {
+                        if let Err(e) = self.apply_batch(&operations) {
+                            eprintln!("Error executing batch: {}", e);
+                        }
+                        if self.governor.is_over_memory() {
+                            self.db.release_memory();
                         }
+                        snapshot_deadline.get_or_insert_with(|| Instant::now() + SNAPSHOT_DELAY);
                     }
-                    
+                }
+
+                // Rescan directories whose changes were lost
+                _ = sleep_until_deadline(rescan_deadline), if rescan_deadline.is_some() => {
+                    rescan_deadline = None;
+                    let mut processor = self.event_processor.lock().await;
+
+                    // Queued operations predate the rescan and must not
+                    // overwrite its results
+                    let operations = drain_operations(&mut processor, usize::MAX);
+                    flush_deadline = None;
+                    let roots = processor.take_dirty_dirs(watcher.watched_paths());
+                    drop(processor);
+
                     if !operations.is_empty() {
-                        match db.execute_batch(&operations) {
-                            Ok(()) => {
-                                // Success
-                            }
-                            Err(e) => {
-                                eprintln!("Error executing batch: {}", e);
-                            }
+                        if let Err(e) = self.apply_batch(&operations) {
+                            eprintln!("Error executing batch: {}", e);
                         }
                     }
+
+                    // Runs on this task: new events wait in the watcher's channel
+                    if let Err(e) = self.rescan(&roots) {
+                        eprintln!("Error rescanning directories: {}", e);
+                    }
+                    snapshot_deadline.get_or_insert_with(|| Instant::now() + SNAPSHOT_DELAY);
                 }
+
+                // Follow a changed configuration without restarting
+                reloaded = config_reloads.recv(), if watching_config => {
+                    let Some(config) = reloaded else {
+                        watching_config = false;
+                        continue;
+                    };
+
+                    // Queued operations were filtered with the old patterns;
+                    // writing them first lets the new ones remove what they
+                    // no longer admit
+                    let mut processor = self.event_processor.lock().await;
+                    let operations = drain_operations(&mut processor, usize::MAX);
+                    flush_deadline = None;
+                    drop(processor);
+
+                    if !operations.is_empty() {
+                        if let Err(e) = self.apply_batch(&operations) {
+                            eprintln!("Error executing batch: {}", e);
+                        }
+                    }
+
+                    flush_interval = config.flush_interval();
+                    batch_size = config.performance.batch_size;
+                    if let Err(e) = self.reconfigure(&mut watcher, config) {
+                        eprintln!("Error applying configuration: {}", e);
+                    }
+                    snapshot_deadline.get_or_insert_with(|| Instant::now() + SNAPSHOT_DELAY);
+                }
+
+                // Rewrite the snapshot once a burst of changes has been written
+                _ = sleep_until_deadline(snapshot_deadline), if snapshot_deadline.is_some() => {
+                    snapshot_deadline = None;
+                    self.write_snapshot();
+                }
+
+                _ = self.shutdown_requested.notified() => {}
             }
         }
 
@@ -206,6 +549,189 @@ impl IndexingDaemon {
         Ok(())
     }
 
+    /// Reconcile the index with the given directory trees
+    ///
+    /// Each root is listed again; directories below it are skipped if their
+    /// modification time matches the index.
+    fn rescan(&self, roots: &[PathBuf]) -> Result<(), rusqlite::Error> {
+        println!("Rescanning {} directories...", roots.len());
+
+        let mut snapshot = DirectorySnapshot::new(self.db.load_directory_times()?, self.db.load_indexed_directories()?);
+        for root in roots {
+            snapshot.invalidate(root);
+        }
+
+        let config = self.config();
+        let indexed = rescan_filesystem(&config, &self.exclude.current(), &self.governor, &self.app_dirs, roots, &snapshot, |operations| {
+            self.apply_batch(operations)
+        })?;
+        println!("Rescan applied {} index operations", indexed);
+        Ok(())
+    }
+
+    /// Bring the index and the watcher in line with a changed configuration
+    ///
+    /// Only what changed is scanned. Newly included paths are reconciled with
+    /// the index, and trees that are no longer included or that new patterns
+    /// exclude are deleted in bulk; anything still included below them is
+    /// scanned again. Nothing records where removed patterns used to match,
+    /// so removing one lists every included path again, though without the
+    /// rebuild a re-index does. Queries are answered from the in-memory index
+    /// throughout. Settings other than the indexed paths, patterns, flush
+    /// interval and batch size take effect on restart.
+    fn reconfigure(&self, watcher: &mut FilesystemWatcher, config: Config) -> Result<(), rusqlite::Error> {
+        let changes = IndexingChanges::between(&self.config(), &config);
+        *self.config.write().unwrap() = config.clone();
+        if changes.is_empty() {
+            println!("Configuration reloaded");
+            return Ok(());
+        }
+        println!(
+            "Configuration reloaded: {} paths added, {} removed; {} exclude patterns added, {} removed",
+            changes.added_paths.len(),
+            changes.removed_paths.len(),
+            changes.added_patterns.len(),
+            changes.removed_patterns.len(),
+        );
+
+        // Events from here on are filtered with the new patterns
+        self.exclude.replace(ExcludeMatcher::from_config(&config));
+        let include_paths = config.expand_paths();
+        let app_dirs = &self.app_dirs;
+
+        for path in &changes.removed_paths {
+            if watcher.watched_paths().contains(path) && !app_dirs.contains(path) {
+                if let Err(e) = watcher.unwatch_path(path) {
+                    eprintln!("Warning: {}", e);
+                }
+            }
+        }
+        let unwatched: Vec<PathBuf> = changes.added_paths
+            .iter()
+            .filter(|path| !watcher.watched_paths().contains(path))
+            .cloned()
+            .collect();
+        watcher.watch_paths(&unwatched);
+
+        // Removed paths still covered by another include path keep their rows
+        let mut deleted: Vec<PathBuf> = changes.removed_paths
+            .iter()
+            .filter(|path| !include_paths.iter().any(|root| path.starts_with(root)))
+            .cloned()
+            .collect();
+        if !changes.added_patterns.is_empty() {
+            // Everything indexed passed the old patterns, so only the added
+            // ones can exclude it now
+            let added = ExcludeMatcher::new(&changes.added_patterns);
+            let roots: Vec<PathBuf> = include_paths.iter().chain(app_dirs).cloned().collect();
+            deleted.extend(self.excluded_trees(&roots, &added));
+        }
+
+        let operations: Vec<IndexOperation> = deleted.iter().cloned().map(IndexOperation::DeleteTree).collect();
+        for batch in operations.chunks(config.performance.batch_size) {
+            self.apply_batch(batch)?;
+        }
+        if !operations.is_empty() {
+            println!("Removed {} trees from the index", operations.len());
+        }
+
+        // Include paths and application directories inside a deleted tree
+        // are still indexed on their own
+        let mut roots: Vec<PathBuf> = include_paths
+            .iter()
+            .chain(app_dirs)
+            .filter(|path| deleted.iter().any(|tree| path.starts_with(tree)))
+            .chain(&changes.added_paths)
+            .cloned()
+            .collect();
+
+        let snapshot = if changes.removed_patterns.is_empty() {
+            let mut snapshot = DirectorySnapshot::new(self.db.load_directory_times()?, self.db.load_indexed_directories()?);
+            for root in &roots {
+                snapshot.invalidate(root);
+            }
+            snapshot
+        } else {
+            roots.extend(include_paths.iter().cloned());
+            DirectorySnapshot::default()
+        };
+        roots.sort();
+        roots.dedup();
+        if roots.is_empty() {
+            return Ok(());
+        }
+
+        println!("Scanning {} paths...", roots.len());
+        let indexed = rescan_filesystem(&config, &self.exclude.current(), &self.governor, app_dirs, &roots, &snapshot, |operations| {
+            self.apply_batch(operations)
+        })?;
+        println!("Configuration change applied {} index operations", indexed);
+        Ok(())
+    }
+
+    /// Indexed trees below `roots` that `exclude` matches
+    ///
+    /// Each entry is matched against the innermost root it lies in, and the
+    /// entries of the system index are left alone.
+    fn excluded_trees(&self, roots: &[PathBuf], exclude: &ExcludeMatcher) -> Vec<PathBuf> {
+        let mut skipped = roots.to_vec();
+        skipped.extend(self.system_roots.iter().flatten().cloned());
+
+        let index = self.index.read().unwrap();
+        let mut trees: Vec<PathBuf> = roots
+            .iter()
+            .flat_map(|root| index.excluded_trees(root, exclude, &skipped))
+            .collect();
+        trees.sort();
+        trees.dedup();
+        trees
+    }
+
+    /// Write a batch of operations to the database and the in-memory copy
+    ///
+    /// A batch that fails to commit is rolled back, so it is not applied in
+    /// memory either.
+    fn apply_batch(&self, operations: &[IndexOperation]) -> Result<(), rusqlite::Error> {
+        self.index.read().unwrap().begin_write();
+        let committed = self.db.execute_batch(operations);
+        let mut index = self.index.write().unwrap();
+        if let Ok(generation) = committed {
+            index.apply_committed(operations, generation);
+        }
+        index.end_write();
+        METRICS.indexed_entries.set(index.len() as u64);
+        committed.map(|_| ())
+    }
+
+    /// Rewrite the snapshot if the index changed since it was last written
+    ///
+    /// The entries are reloaded first if the system index has been rebuilt or
+    /// the user's index was rewritten by `reindex`, and the snapshot is
+    /// stamped with the generations the entries reflect.
+    fn write_snapshot(&self) {
+        if let Some(roots) = &self.system_roots {
+            if let Err(e) = self.index.write().unwrap().refresh_system(&self.db, roots) {
+                eprintln!("Error reloading system index: {}", e);
+            }
+        }
+        if let Err(e) = HotIndex::refresh_user(&self.index, &self.db) {
+            eprintln!("Error reloading the index: {}", e);
+        }
+        let generation = {
+            let index = self.index.read().unwrap();
+            query_server::snapshot_generation(index.index_generation(), index.system_generation())
+        };
+        if self.snapshot_generation.load(Ordering::Relaxed) == generation {
+            return;
+        }
+
+        let result = self.index.read().unwrap().write_snapshot(&self.snapshot_path, generation);
+        match result {
+            Ok(()) => self.snapshot_generation.store(generation, Ordering::Relaxed),
+            Err(e) => eprintln!("Error writing index snapshot: {}", e),
+        }
+    }
+
     /// Gracefully shutdown the daemon
     async fn shutdown(&self) {
         println!("Shutting down gracefully...");
@@ -213,63 +739,112 @@ impl IndexingDaemon {
 
         // Flush remaining operations
         let mut processor = self.event_processor.lock().await;
-        let mut operations = Vec::new();
-        while let Some(op) = processor.dequeue_operation() {
-            operations.push(op);
-        }
+        let operations = drain_operations(&mut processor, usize::MAX);
 
         if !operations.is_empty() {
             println!("Flushing {} pending operations...", operations.len());
-            if let Err(e) = self.db.execute_batch(&operations) {
+            if let Err(e) = self.apply_batch(&operations) {
                 eprintln!("Error flushing operations: {}", e);
             }
         }
 
+        self.write_snapshot();
+        query_server::remove_socket(&self.socket_path);
+
         println!("Shutdown complete");
     }
+}
 
-    /// Get standard application directories that contain .desktop files
-    fn get_application_directories(&self) -> Vec<PathBuf> {
-        let mut app_dirs = Vec::new();
-        
-        // System application directories
-        app_dirs.push(PathBuf::from("/usr/share/applications"));
-        app_dirs.push(PathBuf::from("/usr/local/share/applications"));
-        
-        // User application directory
-        if let Ok(home) = std::env::var("HOME") {
-            let home_path = PathBuf::from(&home);
-            app_dirs.push(home_path.join(".local/share/applications"));
-        }
-        
-        // Snap applications
-        app_dirs.push(PathBuf::from("/var/lib/snapd/desktop/applications"));
-        if let Ok(home) = std::env::var("HOME") {
-            let home_path = PathBuf::from(&home);
-            app_dirs.push(home_path.join("snap"));
-        }
-        
-        // Flatpak applications
-        app_dirs.push(PathBuf::from("/var/lib/flatpak/exports/share/applications"));
-        if let Ok(home) = std::env::var("HOME") {
-            let home_path = PathBuf::from(&home);
-            app_dirs.push(home_path.join(".local/share/flatpak/exports/share/applications"));
+/// Scan all configured paths and write the results to the database
+///
+/// The scanner runs on its own thread and hands batches to this thread through a
+/// bounded channel sized from `max_memory_mb`, where `apply` writes them out.
+/// Filesystem I/O therefore overlaps with SQLite writes, and memory use stays
+/// constant however large the tree is. If a write fails the channel is dropped,
+/// which stops the scanner.
+///
+/// Directories whose modification time matches `snapshot` are not listed again;
+/// pass an empty snapshot for a full scan. `governor` paces the scanner to the
+/// CPU and memory budgets and lowers its I/O priority; `priorities` decides
+/// which directories are listed first. `app_dirs` are scanned for
+/// applications besides the include paths.
+fn index_filesystem<F>(
+    config: &Config,
+    exclude: &Arc<ExcludeMatcher>,
+    governor: &Arc<Governor>,
+    app_dirs: &[PathBuf],
+    priorities: ScanPriorities,
+    snapshot: &DirectorySnapshot,
+    apply: F,
+) -> Result<usize, rusqlite::Error>
+where
+    F: FnMut(&[IndexOperation]) -> Result<(), rusqlite::Error>,
+{
+    run_scan(config, exclude, governor, app_dirs, priorities, apply, |scanner, batch_size, sender| {
+        scanner.reconcile_batches(batch_size, sender, snapshot)
+    })
+}
+
+/// Rescan the given directory trees and write the results to the database
+///
+/// Works like `index_filesystem`, but only touches `roots`.
+fn rescan_filesystem<F>(
+    config: &Config,
+    exclude: &Arc<ExcludeMatcher>,
+    governor: &Arc<Governor>,
+    app_dirs: &[PathBuf],
+    roots: &[PathBuf],
+    snapshot: &DirectorySnapshot,
+    apply: F,
+) -> Result<usize, rusqlite::Error>
+where
+    F: FnMut(&[IndexOperation]) -> Result<(), rusqlite::Error>,
+{
+    run_scan(config, exclude, governor, app_dirs, ScanPriorities::default(), apply, |scanner, batch_size, sender| {
+        scanner.rescan_batches(roots, batch_size, sender, snapshot)
+    })
+}
+
+/// Run `scan` on a scanner thread and pass its batches to `apply`
+fn run_scan<F, S>(
+    config: &Config,
+    exclude: &Arc<ExcludeMatcher>,
+    governor: &Arc<Governor>,
+    app_dirs: &[PathBuf],
+    priorities: ScanPriorities,
+    mut apply: F,
+    scan: S,
+) -> Result<usize, rusqlite::Error>
+where
+    F: FnMut(&[IndexOperation]) -> Result<(), rusqlite::Error>,
+    S: FnOnce(&Scanner, usize, SyncSender<Vec<IndexOperation>>) + Send,
+{
+    let scanner = Scanner::with_exclude_matcher(config.clone(), Arc::clone(exclude))
+        .with_governor(Arc::clone(governor))
+        .with_application_directories(app_dirs.to_vec())
+        .with_priorities(priorities);
+    let batch_size = config.performance.batch_size;
+    let (sender, receiver) = std::sync::mpsc::sync_channel(config.scan_pipeline_depth());
+
+    let start = std::time::Instant::now();
+    let indexed = std::thread::scope(|scope| {
+        scope.spawn(|| scan(&scanner, batch_size, sender));
+
+        let mut indexed = 0;
+        for operations in receiver {
+            apply(&operations)?;
+            indexed += operations.len();
         }
-        
-        // AppImage applications (common locations)
-        if let Ok(home) = std::env::var("HOME") {
-            let home_path = PathBuf::from(&home);
-            app_dirs.push(home_path.join("Applications"));
-            app_dirs.push(home_path.join(".local/bin"));
-            app_dirs.push(home_path.join("AppImages"));
-        }
-        app_dirs.push(PathBuf::from("/opt"));
-        
-        app_dirs
-    }
+        Ok(indexed)
+    })?;
+    METRICS.record_scan(indexed as u64, start.elapsed());
+    Ok(indexed)
 }
 
 /// Query and display indexing status
+///
+/// A running daemon reports its metrics over the query socket; otherwise
+/// only the database is inspected.
 async fn show_status() -> Result<(), Box<dyn std::error::Error>> {
     let db_path = paths::get_database_path();
     
@@ -285,7 +860,17 @@ async fn show_status() -> Result<(), Box<dyn std::error::Error>> {
     println!("===========================");
     println!("Database: {}", db_path.display());
     println!("Indexed files: {}", file_count);
-    println!("Status: Running");
+
+    match query_server::request_status(&paths::get_query_socket_path()) {
+        Ok(report) => {
+            println!("Status: Running");
+            println!();
+            print!("{}", report);
+        }
+        Err(e) if e.kind() == std::io::ErrorKind::NotFound
+            || e.kind() == std::io::ErrorKind::ConnectionRefused => println!("Status: Not running"),
+        Err(e) => println!("Status: Unknown ({})", e),
+    }
 
     Ok(())
 }
@@ -295,33 +880,68 @@ async fn reindex(config: Config) -> Result<(), Box<dyn std::error::Error>> {
     println!("Starting full re-index...");
 
     let db_path = paths::get_database_path();
-    let db = Database::open(&db_path)?;
+    let db = Database::open_with_config(&db_path, &config.database)?;
 
-    // Clear existing index
-    println!("Clearing existing index...");
-    db.connection().execute("DELETE FROM files", [])?;
+    // Entries the system index covers are not indexed again, but their
+    // launches are kept
+    let system_index = attach_system_index(&db);
+    if system_index {
+        db.copy_usage_to_system(&paths::get_system_application_directories())?;
+    }
 
-    // Perform scan
-    println!("Scanning filesystem...");
-    let scanner = Scanner::new(config.clone());
-    let entries = scanner.scan();
-    println!("Found {} files/directories", entries.len());
+    // Build the new index next to the live one, which stays searchable
+    println!("Scanning and indexing filesystem...");
+    let rebuild = db.begin_rebuild()?;
+    let exclude = Arc::new(ExcludeMatcher::from_config(&config));
+    let governor = Arc::new(Governor::new(&config.performance));
+    let priorities = ScanPriorities::new(db.load_recent_launches(PRIORITY_LAUNCHES)?);
+    let app_dirs = application_directories(system_index);
+    let indexed = index_filesystem(&config, &exclude, &governor, &app_dirs, priorities, &DirectorySnapshot::default(), |operations| {
+        rebuild.execute_batch(operations)
+    })?;
+    println!("Applied {} index operations", indexed);
 
-    // Batch insert
-    println!("Indexing files...");
-    let batch_size = config.performance.batch_size;
-    for chunk in entries.chunks(batch_size) {
-        let operations: Vec<_> = chunk
-            .iter()
-            .map(|entry| models::IndexOperation::Add(entry.clone()))
-            .collect();
-        db.execute_batch(&operations)?;
-    }
+    println!("Building indexes and swapping in the new index...");
+    rebuild.finish()?;
 
     println!("Re-index complete");
     Ok(())
 }
 
+/// Build the system application index
+///
+/// Run as root from `novasearch-system-index.service`. Only the system
+/// application directories are indexed; the include paths of `config` are
+/// left to each user's daemon. The index uses a rollback journal rather than
+/// WAL, so that users can read it without write access to its directory,
+/// and is rebuilt beside the live copy, which users keep reading meanwhile.
+async fn build_system_index(mut config: Config, database: Option<PathBuf>) -> Result<(), Box<dyn std::error::Error>> {
+    let db_path = database.unwrap_or_else(paths::get_system_database_path);
+    if let Some(parent) = db_path.parent() {
+        std::fs::create_dir_all(parent)?;
+    }
+    println!("Building system application index at {}...", db_path.display());
+
+    config.database.wal = false;
+    config.indexing.include_paths.clear();
+    let db = Database::open_with_config(&db_path, &config.database)?;
+
+    let rebuild = db.begin_rebuild()?;
+    let exclude = Arc::new(ExcludeMatcher::from_config(&config));
+    let governor = Arc::new(Governor::new(&config.performance));
+    let app_dirs = paths::get_system_application_directories();
+    let indexed = index_filesystem(&config, &exclude, &governor, &app_dirs, ScanPriorities::default(), &DirectorySnapshot::default(), |operations| {
+        rebuild.execute_batch(operations)
+    })?;
+    rebuild.finish()?;
+
+    // Readable by every user, writable by root only
+    std::fs::set_permissions(&db_path, std::fs::Permissions::from_mode(0o644))?;
+
+    println!("Indexed {} system entries", indexed);
+    Ok(())
+}
+
 /// Show version information
 fn show_version() {
     println!("NovaSearch Daemon");
@@ -385,22 +1005,39 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
         Commands::Start => {
             // Set up signal handlers for graceful shutdown
             let running = Arc::new(AtomicBool::new(true));
+            let shutdown_requested = Arc::new(Notify::new());
             let r = running.clone();
+            let s = shutdown_requested.clone();
 
             ctrlc::set_handler(move || {
                 println!("\nReceived shutdown signal");
                 r.store(false, Ordering::Relaxed);
+                // Wake the event loop, which otherwise sleeps until the next event
+                s.notify_one();
             })?;
 
             // Create and initialize daemon
             let mut daemon = IndexingDaemon::new(config.clone()).await?;
             daemon.initialize().await?;
 
-            // Set the daemon's running flag to match our signal handler
+            // Apply edits to the configuration file while running
+            let config_reloads = match ConfigWatcher::new(config_path.clone())
+                .map_err(|e| e.to_string())
+                .and_then(|config_watcher| forward_config_reloads(config_watcher).map_err(|e| e.to_string()))
+            {
+                Ok(config_reloads) => config_reloads,
+                Err(e) => {
+                    eprintln!("Warning: Configuration changes will apply on restart: {}", e);
+                    unbounded_channel().1
+                }
+            };
+
+            // Share the signal handler's running flag and wakeup with the daemon
             daemon.running = running;
+            daemon.shutdown_requested = shutdown_requested;
 
             // Run the daemon
-            daemon.run().await?;
+            daemon.run(config_reloads).await?;
 
             // Shutdown
             daemon.shutdown().await;
@@ -411,6 +1048,9 @@ async fn main() -> Result<(), Box<dyn std::error::Error>> {
         Commands::Reindex => {
             reindex(config).await?;
         }
+        Commands::SystemIndex { database } => {
+            build_system_index(config, database).await?;
+        }
         Commands::Version => {
             show_version();
         }
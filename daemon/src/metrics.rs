@@ -0,0 +1,515 @@
+//! Runtime counters and latency histograms for the daemon's hot paths
+//!
+//! Everything is recorded into the process-wide `METRICS` with relaxed
+//! atomics, so instrumenting a path costs a few uncontended increments.
+//! `novasearch-daemon status` fetches a report over the query socket; the
+//! optional Prometheus endpoint serves the same values as text.
+
+use std::fmt::Write as _;
+use std::io;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::OnceLock;
+use std::time::{Duration, Instant};
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::{TcpListener, TcpStream};
+
+/// Number of histogram buckets; the last one is open-ended
+const BUCKETS: usize = 32;
+
+/// Largest HTTP request header read from a Prometheus scraper
+const MAX_HTTP_REQUEST_LEN: usize = 8 * 1024;
+
+/// Metrics of the running daemon
+pub static METRICS: Metrics = Metrics::new();
+
+/// A monotonically increasing count
+#[derive(Debug)]
+pub struct Counter(AtomicU64);
+
+impl Counter {
+    pub const fn new() -> Self {
+        Counter(AtomicU64::new(0))
+    }
+
+    pub fn incr(&self) {
+        self.add(1);
+    }
+
+    pub fn add(&self, n: u64) {
+        self.0.fetch_add(n, Ordering::Relaxed);
+    }
+
+    pub fn get(&self) -> u64 {
+        self.0.load(Ordering::Relaxed)
+    }
+}
+
+/// A value that is overwritten with the latest reading
+#[derive(Debug)]
+pub struct Gauge(AtomicU64);
+
+impl Gauge {
+    pub const fn new() -> Self {
+        Gauge(AtomicU64::new(0))
+    }
+
+    pub fn set(&self, value: u64) {
+        self.0.store(value, Ordering::Relaxed);
+    }
+
+    pub fn get(&self) -> u64 {
+        self.0.load(Ordering::Relaxed)
+    }
+}
+
+/// Distribution of recorded values over power-of-two buckets
+///
+/// Bucket `i` counts values up to `2^i`, so quantiles are exact to within a
+/// factor of two, which is enough to tell where time goes. Durations are
+/// recorded in microseconds.
+#[derive(Debug)]
+pub struct Histogram {
+    buckets: [AtomicU64; BUCKETS],
+    count: AtomicU64,
+    sum: AtomicU64,
+}
+
+impl Histogram {
+    pub const fn new() -> Self {
+        const ZERO: AtomicU64 = AtomicU64::new(0);
+        Histogram {
+            buckets: [ZERO; BUCKETS],
+            count: AtomicU64::new(0),
+            sum: AtomicU64::new(0),
+        }
+    }
+
+    /// Record one value
+    pub fn record(&self, value: u64) {
+        self.buckets[bucket_index(value)].fetch_add(1, Ordering::Relaxed);
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.sum.fetch_add(value, Ordering::Relaxed);
+    }
+
+    /// Record a duration in microseconds
+    pub fn record_duration(&self, duration: Duration) {
+        self.record(duration.as_micros().min(u64::MAX as u128) as u64);
+    }
+
+    /// Record the time elapsed since `start`
+    pub fn record_since(&self, start: Instant) {
+        self.record_duration(start.elapsed());
+    }
+
+    /// Copy the current counts
+    ///
+    /// Values recorded meanwhile may be missing from some fields, which
+    /// skews a report by at most those few values.
+    pub fn snapshot(&self) -> HistogramSnapshot {
+        HistogramSnapshot {
+            buckets: std::array::from_fn(|i| self.buckets[i].load(Ordering::Relaxed)),
+            count: self.count.load(Ordering::Relaxed),
+            sum: self.sum.load(Ordering::Relaxed),
+        }
+    }
+}
+
+/// Index of the bucket holding `value`: the smallest `i` with `value <= 2^i`
+fn bucket_index(value: u64) -> usize {
+    let index = match value {
+        0 | 1 => 0,
+        v => (64 - (v - 1).leading_zeros()) as usize,
+    };
+    index.min(BUCKETS - 1)
+}
+
+/// Upper bound of bucket `i`
+fn bucket_bound(i: usize) -> u64 {
+    1u64 << i
+}
+
+/// Point-in-time copy of a histogram
+#[derive(Debug, Clone, PartialEq)]
+pub struct HistogramSnapshot {
+    pub buckets: [u64; BUCKETS],
+    pub count: u64,
+    pub sum: u64,
+}
+
+impl HistogramSnapshot {
+    /// Upper bound of the bucket holding the `q` quantile, or 0 if empty
+    pub fn quantile(&self, q: f64) -> u64 {
+        if self.count == 0 {
+            return 0;
+        }
+        let rank = ((q * self.count as f64).ceil() as u64).clamp(1, self.count);
+        let mut seen = 0;
+        for (i, &n) in self.buckets.iter().enumerate() {
+            seen += n;
+            if seen >= rank {
+                return bucket_bound(i);
+            }
+        }
+        bucket_bound(BUCKETS - 1)
+    }
+
+    /// Mean of the recorded values, or 0 if empty
+    pub fn mean(&self) -> f64 {
+        if self.count == 0 {
+            0.0
+        } else {
+            self.sum as f64 / self.count as f64
+        }
+    }
+}
+
+/// Everything the daemon measures
+#[derive(Debug)]
+pub struct Metrics {
+    started: OnceLock<Instant>,
+
+    /// Filesystem events delivered by the watcher
+    pub events_received: Counter,
+    /// Events merged into one already pending for the same path
+    pub events_coalesced: Counter,
+    /// Operations that found the queue full; their directories are rescanned
+    pub events_dropped: Counter,
+    /// Times the watcher lost events and asked for a rescan
+    pub events_lost: Counter,
+    /// Events waiting out the debounce delay
+    pub pending_events: Gauge,
+    /// Operations queued for the next database write
+    pub queue_depth: Gauge,
+
+    /// Operations per `execute_batch` call
+    pub batch_size: Histogram,
+    /// Duration of `execute_batch` calls, retries included
+    pub batch_duration: Histogram,
+    /// Writes repeated because the database was busy or locked
+    pub batch_retries: Counter,
+    /// Batches that failed to commit
+    pub batch_errors: Counter,
+
+    /// Scans and rescans completed
+    pub scans: Counter,
+    /// Operations produced by all scans
+    pub scan_operations: Counter,
+    /// Operations produced by the last scan
+    pub last_scan_operations: Gauge,
+    /// Duration of the last scan in microseconds
+    pub last_scan_duration: Gauge,
+
+    /// Duration of queries answered from the hot index
+    pub query_duration: Histogram,
+    /// Entries in the hot index
+    pub indexed_entries: Gauge,
+
+    /// Pauses imposed on scans to stay within the CPU or memory budget
+    pub governor_pauses: Counter,
+    /// Total length of those pauses in microseconds
+    pub governor_pause_time: Counter,
+    /// Resident set size at the governor's last sample
+    pub rss_bytes: Gauge,
+}
+
+impl Metrics {
+    pub const fn new() -> Self {
+        Metrics {
+            started: OnceLock::new(),
+            events_received: Counter::new(),
+            events_coalesced: Counter::new(),
+            events_dropped: Counter::new(),
+            events_lost: Counter::new(),
+            pending_events: Gauge::new(),
+            queue_depth: Gauge::new(),
+            batch_size: Histogram::new(),
+            batch_duration: Histogram::new(),
+            batch_retries: Counter::new(),
+            batch_errors: Counter::new(),
+            scans: Counter::new(),
+            scan_operations: Counter::new(),
+            last_scan_operations: Gauge::new(),
+            last_scan_duration: Gauge::new(),
+            query_duration: Histogram::new(),
+            indexed_entries: Gauge::new(),
+            governor_pauses: Counter::new(),
+            governor_pause_time: Counter::new(),
+            rss_bytes: Gauge::new(),
+        }
+    }
+
+    /// Start counting uptime; later calls have no effect
+    pub fn mark_started(&self) {
+        self.started.get_or_init(Instant::now);
+    }
+
+    /// Time since `mark_started`
+    pub fn uptime(&self) -> Duration {
+        self.started.get().map_or(Duration::ZERO, |started| started.elapsed())
+    }
+
+    /// Record a finished scan that produced `operations` in `duration`
+    pub fn record_scan(&self, operations: u64, duration: Duration) {
+        self.scans.incr();
+        self.scan_operations.add(operations);
+        self.last_scan_operations.set(operations);
+        self.last_scan_duration.set(duration.as_micros().min(u64::MAX as u128) as u64);
+    }
+
+    /// Operations per second of the last scan
+    pub fn last_scan_rate(&self) -> f64 {
+        let micros = self.last_scan_duration.get();
+        if micros == 0 {
+            0.0
+        } else {
+            self.last_scan_operations.get() as f64 * 1_000_000.0 / micros as f64
+        }
+    }
+
+    /// Counters in Prometheus naming, with their help text
+    fn counters(&self) -> [(&'static str, &'static str, u64); 10] {
+        [
+            ("novasearch_events_received_total", "Filesystem events delivered by the watcher", self.events_received.get()),
+            ("novasearch_events_coalesced_total", "Events merged into one pending for the same path", self.events_coalesced.get()),
+            ("novasearch_events_dropped_total", "Operations dropped because the queue was full", self.events_dropped.get()),
+            ("novasearch_events_lost_total", "Times the watcher lost events", self.events_lost.get()),
+            ("novasearch_batch_retries_total", "Database writes retried while busy", self.batch_retries.get()),
+            ("novasearch_batch_errors_total", "Batches that failed to commit", self.batch_errors.get()),
+            ("novasearch_scans_total", "Scans and rescans completed", self.scans.get()),
+            ("novasearch_scan_operations_total", "Index operations produced by scans", self.scan_operations.get()),
+            ("novasearch_governor_pauses_total", "Scan pauses imposed by the resource budgets", self.governor_pauses.get()),
+            ("novasearch_governor_pause_microseconds_total", "Total length of scan pauses", self.governor_pause_time.get()),
+        ]
+    }
+
+    /// Gauges in Prometheus naming, with their help text
+    fn gauges(&self) -> [(&'static str, &'static str, f64); 7] {
+        [
+            ("novasearch_uptime_seconds", "Time since the daemon started", self.uptime().as_secs_f64()),
+            ("novasearch_pending_events", "Events waiting out the debounce delay", self.pending_events.get() as f64),
+            ("novasearch_queue_depth", "Operations queued for writing", self.queue_depth.get() as f64),
+            ("novasearch_indexed_entries", "Entries in the in-memory index", self.indexed_entries.get() as f64),
+            ("novasearch_last_scan_operations", "Index operations produced by the last scan", self.last_scan_operations.get() as f64),
+            ("novasearch_last_scan_seconds", "Duration of the last scan", self.last_scan_duration.get() as f64 / 1e6),
+            ("novasearch_resident_bytes", "Resident set size", self.rss_bytes.get() as f64),
+        ]
+    }
+
+    /// Render every metric in the Prometheus text exposition format
+    pub fn render_prometheus(&self) -> String {
+        let mut out = String::new();
+        for (name, help, value) in self.counters() {
+            let _ = writeln!(out, "# HELP {} {}\n# TYPE {} counter\n{} {}", name, help, name, name, value);
+        }
+        for (name, help, value) in self.gauges() {
+            let _ = writeln!(out, "# HELP {} {}\n# TYPE {} gauge\n{} {}", name, help, name, name, value);
+        }
+
+        // Durations are recorded in microseconds but exposed in seconds
+        let histograms = [
+            ("novasearch_batch_size", "Operations per database write", &self.batch_size, 1.0),
+            ("novasearch_batch_duration_seconds", "Duration of database writes", &self.batch_duration, 1e6),
+            ("novasearch_query_duration_seconds", "Duration of queries", &self.query_duration, 1e6),
+        ];
+        for (name, help, histogram, scale) in histograms {
+            let snapshot = histogram.snapshot();
+            let _ = writeln!(out, "# HELP {} {}\n# TYPE {} histogram", name, help, name);
+            let mut cumulative = 0;
+            for (i, &n) in snapshot.buckets[..BUCKETS - 1].iter().enumerate() {
+                cumulative += n;
+                let _ = writeln!(out, "{}_bucket{{le=\"{}\"}} {}", name, bucket_bound(i) as f64 / scale, cumulative);
+            }
+            let _ = writeln!(out, "{}_bucket{{le=\"+Inf\"}} {}", name, snapshot.count);
+            let _ = writeln!(out, "{}_sum {}", name, snapshot.sum as f64 / scale);
+            let _ = writeln!(out, "{}_count {}", name, snapshot.count);
+        }
+        out
+    }
+
+    /// Render a report for `novasearch-daemon status`
+    pub fn render_report(&self) -> String {
+        let mut out = String::new();
+        let batch_size = self.batch_size.snapshot();
+        let batch_duration = self.batch_duration.snapshot();
+        let query_duration = self.query_duration.snapshot();
+
+        let _ = writeln!(out, "Uptime: {}", format_uptime(self.uptime()));
+        let _ = writeln!(out, "Indexed entries: {}", self.indexed_entries.get());
+        let _ = writeln!(out);
+        let _ = writeln!(out, "Events");
+        let _ = writeln!(out, "  Received: {}", self.events_received.get());
+        let _ = writeln!(out, "  Coalesced: {}", self.events_coalesced.get());
+        let _ = writeln!(out, "  Dropped (queue full): {}", self.events_dropped.get());
+        let _ = writeln!(out, "  Lost (rescans scheduled): {}", self.events_lost.get());
+        let _ = writeln!(out, "  Pending: {}", self.pending_events.get());
+        let _ = writeln!(out, "  Queued operations: {}", self.queue_depth.get());
+        let _ = writeln!(out);
+        let _ = writeln!(out, "Database writes");
+        let _ = writeln!(out, "  Batches: {} ({} retries, {} failed)", batch_size.count, self.batch_retries.get(), self.batch_errors.get());
+        let _ = writeln!(
+            out,
+            "  Batch size: mean {:.0}, p50 <= {}, p99 <= {}",
+            batch_size.mean(),
+            batch_size.quantile(0.5),
+            batch_size.quantile(0.99),
+        );
+        let _ = writeln!(out, "  execute_batch: {}", format_latency(&batch_duration));
+        let _ = writeln!(out);
+        let _ = writeln!(out, "Scans");
+        let _ = writeln!(out, "  Completed: {} ({} operations)", self.scans.get(), self.scan_operations.get());
+        let _ = writeln!(
+            out,
+            "  Last: {} operations in {:.1} s ({:.0} per second)",
+            self.last_scan_operations.get(),
+            self.last_scan_duration.get() as f64 / 1e6,
+            self.last_scan_rate(),
+        );
+        let _ = writeln!(
+            out,
+            "  Throttled: {} pauses, {:.1} s",
+            self.governor_pauses.get(),
+            self.governor_pause_time.get() as f64 / 1e6,
+        );
+        let _ = writeln!(out, "  Resident memory: {:.1} MiB", self.rss_bytes.get() as f64 / (1024.0 * 1024.0));
+        let _ = writeln!(out);
+        let _ = writeln!(out, "Queries");
+        let _ = writeln!(out, "  Served: {}", query_duration.count);
+        let _ = writeln!(out, "  Latency: {}", format_latency(&query_duration));
+        out
+    }
+}
+
+/// Format microsecond quantiles for the status report
+fn format_latency(snapshot: &HistogramSnapshot) -> String {
+    let ms = |micros: u64| micros as f64 / 1000.0;
+    format!(
+        "mean {:.2} ms, p50 <= {:.2} ms, p90 <= {:.2} ms, p99 <= {:.2} ms",
+        snapshot.mean() / 1000.0,
+        ms(snapshot.quantile(0.5)),
+        ms(snapshot.quantile(0.9)),
+        ms(snapshot.quantile(0.99)),
+    )
+}
+
+/// Format an uptime as hours, minutes and seconds
+fn format_uptime(uptime: Duration) -> String {
+    let secs = uptime.as_secs();
+    format!("{}h {}m {}s", secs / 3600, secs / 60 % 60, secs % 60)
+}
+
+/// Serve `METRICS` to Prometheus scrapers until the listener fails
+///
+/// Any `GET` is answered with the metrics and the connection is closed;
+/// nothing else a scraper might send is needed.
+pub async fn serve_prometheus(listener: TcpListener) {
+    loop {
+        match listener.accept().await {
+            Ok((stream, _)) => {
+                tokio::spawn(async move {
+                    if let Err(e) = answer_scrape(stream).await {
+                        eprintln!("Metrics connection error: {}", e);
+                    }
+                });
+            }
+            Err(e) => {
+                eprintln!("Metrics endpoint stopped: {}", e);
+                return;
+            }
+        }
+    }
+}
+
+/// Read one HTTP request and answer it
+async fn answer_scrape(mut stream: TcpStream) -> io::Result<()> {
+    let mut request = Vec::new();
+    let mut buffer = [0u8; 1024];
+    while !request.windows(4).any(|w| w == b"\r\n\r\n") {
+        let n = stream.read(&mut buffer).await?;
+        if n == 0 {
+            return Ok(());
+        }
+        request.extend_from_slice(&buffer[..n]);
+        if request.len() > MAX_HTTP_REQUEST_LEN {
+            return Err(io::Error::new(io::ErrorKind::InvalidData, "request too large"));
+        }
+    }
+
+    let (status, body) = if request.starts_with(b"GET ") {
+        ("200 OK", METRICS.render_prometheus())
+    } else {
+        ("405 Method Not Allowed", String::new())
+    };
+    let response = format!(
+        "HTTP/1.1 {}\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {}\r\nConnection: close\r\n\r\n{}",
+        status,
+        body.len(),
+        body,
+    );
+    stream.write_all(response.as_bytes()).await?;
+    stream.shutdown().await
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_histogram_buckets() {
+        assert_eq!(bucket_index(0), 0);
+        assert_eq!(bucket_index(1), 0);
+        assert_eq!(bucket_index(2), 1);
+        assert_eq!(bucket_index(3), 2);
+        assert_eq!(bucket_index(4), 2);
+        assert_eq!(bucket_index(5), 3);
+        assert_eq!(bucket_index(u64::MAX), BUCKETS - 1);
+
+        let histogram = Histogram::new();
+        for value in 1..=100 {
+            histogram.record(value);
+        }
+        let snapshot = histogram.snapshot();
+        assert_eq!(snapshot.count, 100);
+        assert_eq!(snapshot.sum, 5050);
+        assert_eq!(snapshot.quantile(0.5), 64);
+        assert_eq!(snapshot.quantile(0.1), 16);
+        assert_eq!(snapshot.quantile(1.0), 128);
+        assert_eq!(Histogram::new().snapshot().quantile(0.5), 0);
+    }
+
+    #[test]
+    fn test_render_prometheus() {
+        let metrics = Metrics::new();
+        metrics.events_received.add(3);
+        metrics.queue_depth.set(7);
+        metrics.batch_size.record(100);
+        metrics.batch_duration.record_duration(Duration::from_millis(3));
+
+        let text = metrics.render_prometheus();
+        assert!(text.contains("# TYPE novasearch_events_received_total counter\nnovasearch_events_received_total 3\n"));
+        assert!(text.contains("novasearch_queue_depth 7\n"));
+        assert!(text.contains("novasearch_batch_size_bucket{le=\"64\"} 0\n"));
+        assert!(text.contains("novasearch_batch_size_bucket{le=\"128\"} 1\n"));
+        assert!(text.contains("novasearch_batch_size_bucket{le=\"+Inf\"} 1\n"));
+        assert!(text.contains("novasearch_batch_duration_seconds_bucket{le=\"0.004096\"} 1\n"));
+        assert!(text.contains("novasearch_batch_duration_seconds_sum 0.003\n"));
+        assert!(text.contains("novasearch_query_duration_seconds_count 0\n"));
+
+        // Every sample line is a name, optional labels and a number
+        for line in text.lines().filter(|line| !line.starts_with('#')) {
+            let (_, value) = line.rsplit_once(' ').unwrap();
+            assert!(value.parse::<f64>().is_ok(), "{}", line);
+        }
+    }
+
+    #[test]
+    fn test_scan_rate() {
+        let metrics = Metrics::new();
+        assert_eq!(metrics.last_scan_rate(), 0.0);
+        metrics.record_scan(5000, Duration::from_millis(500));
+        metrics.record_scan(1000, Duration::from_millis(400));
+        assert_eq!(metrics.scans.get(), 2);
+        assert_eq!(metrics.scan_operations.get(), 6000);
+        assert_eq!(metrics.last_scan_rate(), 2500.0);
+        assert!(metrics.render_report().contains("Last: 1000 operations in 0.4 s (2500 per second)"));
+    }
+}
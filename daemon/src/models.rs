@@ -1,3 +1,4 @@
+use std::collections::HashSet;
 use std::path::PathBuf;
 use std::time::SystemTime;
 
@@ -28,6 +29,35 @@ impl FileType {
             _ => FileType::Other,
         }
     }
+
+    /// Compact code stored in the database and in binary formats
+    pub fn as_code(&self) -> u8 {
+        match self {
+            FileType::Regular => 0,
+            FileType::Directory => 1,
+            FileType::Symlink => 2,
+            FileType::Other => 3,
+        }
+    }
+
+    pub fn from_code(code: u8) -> Self {
+        match code {
+            0 => FileType::Regular,
+            1 => FileType::Directory,
+            2 => FileType::Symlink,
+            _ => FileType::Other,
+        }
+    }
+}
+
+/// Launcher metadata of a `.desktop` file, stored in `app_metadata`
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct AppMetadata {
+    pub name: String,
+    pub icon: String,
+    pub exec: String,
+    /// `;`-separated, as written in the file
+    pub keywords: String,
 }
 
 /// Represents a file entry in the index
@@ -40,6 +70,8 @@ pub struct FileEntry {
     pub modified_time: SystemTime,
     pub file_type: FileType,
     pub indexed_time: SystemTime,
+    /// Set for `.desktop` files whose metadata was read
+    pub app: Option<AppMetadata>,
 }
 
 impl FileEntry {
@@ -59,6 +91,7 @@ impl FileEntry {
             modified_time,
             file_type,
             indexed_time: SystemTime::now(),
+            app: None,
         }
     }
 }
@@ -70,4 +103,12 @@ pub enum IndexOperation {
     Update(FileEntry),
     Delete(PathBuf),
     Move { from: PathBuf, to: PathBuf },
+    /// Record the modification time of a directory whose listing has been indexed
+    ConfirmDir { path: PathBuf, modified_time: SystemTime },
+    /// Remove indexed children of a directory whose names are not in `keep`
+    PruneDir { path: PathBuf, keep: HashSet<String> },
+    /// Remove a directory and everything indexed beneath it
+    DeleteTree(PathBuf),
+    /// Move a directory and everything indexed beneath it
+    MoveTree { from: PathBuf, to: PathBuf },
 }
@@ -14,6 +14,66 @@ pub fn get_database_path() -> PathBuf {
     get_database_dir().join("index.db")
 }
 
+/// Get the query socket path: ~/.local/share/novasearch/query.sock
+///
+/// The panel looks for the socket next to the database it would otherwise open.
+pub fn get_query_socket_path() -> PathBuf {
+    get_database_dir().join("query.sock")
+}
+
+/// Get the index snapshot path: ~/.local/share/novasearch/index.snap
+pub fn get_snapshot_path() -> PathBuf {
+    get_database_dir().join("index.snap")
+}
+
+/// Get the system index path: /var/lib/novasearch/system.db
+///
+/// Built by `novasearch-daemon system-index` for the applications installed
+/// system-wide; every user's daemon and panel read it alongside their own index.
+pub fn get_system_database_path() -> PathBuf {
+    PathBuf::from("/var/lib/novasearch/system.db")
+}
+
+/// Get the application directories shared by every user
+pub fn get_system_application_directories() -> Vec<PathBuf> {
+    vec![
+        PathBuf::from("/usr/share/applications"),
+        PathBuf::from("/usr/local/share/applications"),
+        // Snap applications
+        PathBuf::from("/var/lib/snapd/desktop/applications"),
+        // Flatpak applications
+        PathBuf::from("/var/lib/flatpak/exports/share/applications"),
+        // AppImages and other self-contained installs
+        PathBuf::from("/opt"),
+    ]
+}
+
+/// Get the application directories in the user's home
+///
+/// Empty when HOME is not set.
+pub fn get_user_application_directories() -> Vec<PathBuf> {
+    let Ok(home) = std::env::var("HOME") else {
+        return Vec::new();
+    };
+    let home = PathBuf::from(home);
+    vec![
+        home.join(".local/share/applications"),
+        home.join("snap"),
+        home.join(".local/share/flatpak/exports/share/applications"),
+        // AppImage applications (common locations)
+        home.join("Applications"),
+        home.join(".local/bin"),
+        home.join("AppImages"),
+    ]
+}
+
+/// Get every standard directory that contains .desktop files or AppImages
+pub fn get_application_directories() -> Vec<PathBuf> {
+    let mut app_dirs = get_system_application_directories();
+    app_dirs.extend(get_user_application_directories());
+    app_dirs
+}
+
 /// Get the config directory path: ~/.config/novasearch/
 pub fn get_config_dir() -> PathBuf {
     let home = std::env::var("HOME").expect("HOME environment variable not set");
@@ -55,6 +115,21 @@ mod tests {
         assert!(db_path.to_string_lossy().contains(".local/share/novasearch/index.db"));
     }
 
+    #[test]
+    fn test_query_socket_path() {
+        let socket_path = get_query_socket_path();
+        assert_eq!(socket_path.parent(), get_database_path().parent());
+    }
+
+    #[test]
+    fn test_application_directories() {
+        let app_dirs = get_application_directories();
+        let system = get_system_application_directories();
+        assert!(system.iter().all(|dir| app_dirs.contains(dir)));
+        assert!(get_user_application_directories().iter().all(|dir| !system.contains(dir)));
+        assert!(app_dirs.contains(&PathBuf::from("/usr/share/applications")));
+    }
+
     #[test]
     fn test_config_path() {
         let config_path = get_config_path();
@@ -0,0 +1,1110 @@
+use crate::database::{directory_key, system_time_to_timestamp, Database};
+use crate::exclude::ExcludeMatcher;
+use crate::metrics::METRICS;
+use crate::models::{AppMetadata, FileEntry, FileType, IndexOperation};
+use crate::snapshot::{write_snapshot, Snapshot, SnapshotEntry};
+use rusqlite::Result as SqliteResult;
+use std::cmp::Reverse;
+use std::collections::{BTreeMap, HashMap, HashSet};
+use std::io;
+use std::ops::Bound;
+use std::os::unix::fs::PermissionsExt;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{Arc, Mutex, RwLock};
+use std::time::{Duration, Instant};
+use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::net::{UnixListener, UnixStream};
+
+/// Request opcode: search filenames
+///
+/// Requests and responses are framed as a little-endian `u32` payload length
+/// followed by the payload. A query payload is the opcode, the maximum number
+/// of results as a `u32`, then the UTF-8 query filling the rest.
+pub const OP_QUERY: u8 = 1;
+
+/// Request opcode: report the daemon's metrics
+///
+/// The payload is the opcode alone; the response holds the report as UTF-8
+/// text after the status.
+pub const OP_STATUS: u8 = 2;
+
+/// Response status: the rest of the payload holds results
+///
+/// Results are a `u32` count followed by, for each result, `size` and
+/// `modified_time` as `i64`, then `filename`, `path`, `file_type` and the
+/// application's name, icon and exec line, each a `u32` length and the bytes.
+/// The application fields are empty for entries that are not launchers.
+pub const STATUS_OK: u8 = 0;
+
+/// Response status: the request was not understood
+pub const STATUS_ERROR: u8 = 1;
+
+/// Largest request payload accepted
+const MAX_REQUEST_LEN: usize = 64 * 1024;
+
+/// Result count used when a request asks for none, matching the panel
+const DEFAULT_MAX_RESULTS: usize = 50;
+
+/// Largest result count served for one request, matching the panel
+const MAX_RESULTS_LIMIT: usize = 1000;
+
+/// How long `request_status` waits for the daemon
+const STATUS_TIMEOUT: Duration = Duration::from_secs(2);
+
+/// An indexed entry as held in memory
+#[derive(Debug, Clone)]
+struct HotEntry {
+    path: Arc<str>,
+    filename: String,
+    /// `filename` with ASCII letters lowercased, as SQLite's LIKE compares them
+    folded: String,
+    file_type: FileType,
+    size: u64,
+    modified_time: i64,
+    /// Launcher metadata, boxed as few entries have any
+    app: Option<Box<HotApp>>,
+}
+
+/// Launcher metadata of an application entry, with the searched fields folded
+#[derive(Debug, Clone)]
+struct HotApp {
+    metadata: AppMetadata,
+    folded_name: String,
+    folded_keywords: String,
+}
+
+impl From<&AppMetadata> for HotApp {
+    fn from(metadata: &AppMetadata) -> Self {
+        HotApp {
+            folded_name: metadata.name.to_ascii_lowercase(),
+            folded_keywords: metadata.keywords.to_ascii_lowercase(),
+            metadata: metadata.clone(),
+        }
+    }
+}
+
+impl From<&FileEntry> for HotEntry {
+    fn from(entry: &FileEntry) -> Self {
+        HotEntry {
+            path: Arc::from(entry.path.to_string_lossy().as_ref()),
+            folded: entry.filename.to_ascii_lowercase(),
+            filename: entry.filename.clone(),
+            file_type: entry.file_type.clone(),
+            size: entry.size,
+            modified_time: system_time_to_timestamp(entry.modified_time),
+            app: entry.app.as_ref().map(|app| Box::new(HotApp::from(app))),
+        }
+    }
+}
+
+/// Generation stamped on a snapshot of an index holding the entries of a
+/// user index and a system index at the given generations
+///
+/// It changes whenever either of them does.
+pub fn snapshot_generation(index_generation: u64, system_generation: u64) -> u64 {
+    index_generation.wrapping_add(system_generation << 32)
+}
+
+/// A query result borrowed from the index
+#[derive(Debug, Clone, PartialEq)]
+pub struct HotResult<'a> {
+    pub filename: &'a str,
+    pub path: &'a str,
+    pub file_type: &'a FileType,
+    pub size: u64,
+    pub modified_time: i64,
+    pub app: Option<&'a AppMetadata>,
+}
+
+/// In-memory copy of the `files` table, answering queries without SQLite
+///
+/// Entries live in slots that keep their number across renames and moves, and
+/// are keyed by path in a B-tree, so a directory's subtree is one contiguous
+/// range, as it is in the `path` index. Each slot is posted under the
+/// trigrams of its folded filename and application name and keywords, as in
+/// the snapshot, so a query only checks the entries holding its rarest
+/// trigram; shorter queries scan the slots. The daemon applies every
+/// batch it commits, keeping the copy in step with the database. Batches
+/// committed by another process, such as `reindex`, are picked up by
+/// reloading once the index generation moves on without the daemon.
+#[derive(Debug, Default)]
+pub struct HotIndex {
+    /// Slot of each entry by path
+    paths: BTreeMap<Arc<str>, u32>,
+    slots: Vec<Option<HotEntry>>,
+    /// Slots emptied by removals, reused before adding new ones
+    free_slots: Vec<u32>,
+    /// Slots of the entries holding each trigram
+    postings: HashMap<[u8; 3], HashSet<u32>>,
+    /// Frecency scores of launched files by path, reloaded from `files`
+    frecencies: HashMap<String, i64>,
+    /// Generation of the system index the system entries were loaded at
+    system_generation: u64,
+    /// Generation of the user's index the entries reflect
+    index_generation: u64,
+    /// Batches the daemon is committing but has not applied yet
+    writes_in_flight: AtomicUsize,
+}
+
+impl HotIndex {
+    /// Load the whole index from the database and its attached system index
+    ///
+    /// The generations are read first, so a batch committed while loading
+    /// leaves them behind rather than ahead.
+    pub fn load(db: &Database) -> SqliteResult<Self> {
+        let mut index = HotIndex {
+            index_generation: db.index_generation()?,
+            system_generation: db.system_generation()?,
+            ..HotIndex::default()
+        };
+        for entry in db.load_system_files()?.iter().chain(&db.load_files()?) {
+            index.insert(entry);
+        }
+        index.frecencies = db.load_frecencies()?;
+        Ok(index)
+    }
+
+    /// Load the index from the snapshot at `snapshot_path` if it was taken at
+    /// the database's current generation, or from the database otherwise
+    ///
+    /// Frecency scores always come from the database, as the panel records
+    /// launches there without changing the generation.
+    pub fn load_with_snapshot(db: &Database, snapshot_path: &Path) -> SqliteResult<Self> {
+        let index_generation = db.index_generation()?;
+        let system_generation = db.system_generation()?;
+        let generation = snapshot_generation(index_generation, system_generation);
+        let entries = Snapshot::open(snapshot_path).and_then(|snapshot| {
+            if snapshot.generation() == generation {
+                snapshot.entries()
+            } else {
+                Err(io::Error::new(io::ErrorKind::InvalidData, "snapshot is out of date"))
+            }
+        });
+
+        match entries {
+            Ok(entries) => {
+                let mut index = HotIndex { index_generation, system_generation, ..HotIndex::default() };
+                for (entry, _) in &entries {
+                    index.insert(entry);
+                }
+                index.frecencies = db.load_frecencies()?;
+                Ok(index)
+            }
+            Err(e) => {
+                if e.kind() != io::ErrorKind::NotFound {
+                    eprintln!("Not using index snapshot: {}", e);
+                }
+                Self::load(db)
+            }
+        }
+    }
+
+    /// Replace the entries below `roots` with those of the system index
+    /// attached to `db`
+    ///
+    /// `roots` are the directories the system index covers. Entries of the
+    /// user's own index below them are replaced as well.
+    pub fn load_system(&mut self, db: &Database, roots: &[PathBuf]) -> SqliteResult<()> {
+        let entries = db.load_system_files()?;
+        for root in roots {
+            self.delete_tree(&root.to_string_lossy());
+        }
+        for entry in &entries {
+            self.insert(entry);
+        }
+        self.system_generation = db.system_generation()?;
+        Ok(())
+    }
+
+    /// Generation of the system index the system entries were loaded at
+    pub fn system_generation(&self) -> u64 {
+        self.system_generation
+    }
+
+    /// Reload the system entries if the system index has been rebuilt since
+    /// they were loaded
+    ///
+    /// Returns true if they were reloaded.
+    pub fn refresh_system(&mut self, db: &Database, roots: &[PathBuf]) -> SqliteResult<bool> {
+        if db.system_generation()? == self.system_generation {
+            return Ok(false);
+        }
+        self.load_system(db, roots)?;
+        Ok(true)
+    }
+
+    /// Generation of the user's index the entries reflect
+    pub fn index_generation(&self) -> u64 {
+        self.index_generation
+    }
+
+    /// Note that the daemon is committing a batch it will apply with
+    /// `apply_committed`, so `refresh_user` does not mistake it for a write by
+    /// another process
+    pub fn begin_write(&self) {
+        self.writes_in_flight.fetch_add(1, Ordering::SeqCst);
+    }
+
+    /// Note that a batch announced with `begin_write` was applied or failed
+    pub fn end_write(&self) {
+        self.writes_in_flight.fetch_sub(1, Ordering::SeqCst);
+    }
+
+    /// Reload the whole index if another process, such as `reindex`, has
+    /// committed to the user's index since the entries were loaded
+    ///
+    /// Returns true if it was reloaded.
+    pub fn refresh_user(index: &RwLock<HotIndex>, db: &Database) -> SqliteResult<bool> {
+        let generation = db.index_generation()?;
+        {
+            let current = index.read().unwrap();
+            if current.writes_in_flight.load(Ordering::SeqCst) > 0 || current.index_generation == generation {
+                return Ok(false);
+            }
+        }
+
+        // Batches of the daemon's own that commit during the reload are
+        // applied on top, as their generation follows the one loaded
+        let mut current = index.write().unwrap();
+        if current.writes_in_flight.load(Ordering::SeqCst) > 0 {
+            return Ok(false);
+        }
+        // No batch is in flight, and none can start while the lock is held
+        *current = HotIndex::load(db)?;
+        Ok(true)
+    }
+
+    /// Write the index as a snapshot taken at `generation`
+    pub fn write_snapshot(&self, path: &Path, generation: u64) -> io::Result<()> {
+        let entries = self.paths.values().map(|&slot| self.entry(slot)).map(|entry| SnapshotEntry {
+            path: &entry.path,
+            filename: &entry.filename,
+            file_type: &entry.file_type,
+            size: entry.size,
+            modified_time: entry.modified_time,
+            frecency: self.frecencies.get(&*entry.path).copied().unwrap_or(0).clamp(0, u32::MAX as i64) as u32,
+            app: entry.app.as_ref().map(|app| &app.metadata),
+        });
+        write_snapshot(path, generation, entries)
+    }
+
+    /// Number of entries held
+    pub fn len(&self) -> usize {
+        self.paths.len()
+    }
+
+    /// Replace the frecency scores used for ranking
+    pub fn set_frecencies(&mut self, frecencies: HashMap<String, i64>) {
+        self.frecencies = frecencies;
+    }
+
+    /// Apply a batch the daemon committed to the database at `generation`
+    ///
+    /// The entries only count as current at `generation` if no other process
+    /// committed in between; otherwise `refresh_user` reloads them.
+    pub fn apply_committed(&mut self, operations: &[IndexOperation], generation: u64) {
+        self.apply(operations);
+        if generation == self.index_generation + 1 {
+            self.index_generation = generation;
+        }
+    }
+
+    /// Apply a batch of operations already committed to the database
+    pub fn apply(&mut self, operations: &[IndexOperation]) {
+        for operation in operations {
+            match operation {
+                IndexOperation::Add(entry) | IndexOperation::Update(entry) => self.insert(entry),
+                IndexOperation::Delete(path) => self.remove(&path.to_string_lossy()),
+                IndexOperation::Move { from, to } => self.move_entry(&from.to_string_lossy(), to),
+                IndexOperation::ConfirmDir { .. } => {}
+                IndexOperation::PruneDir { path, keep } => {
+                    let key = directory_key(path);
+                    let stale: Vec<String> = self
+                        .subtree(&key)
+                        .filter(|(child, entry)| {
+                            child.len() == key.len() + 1 + entry.filename.len()
+                                && !keep.contains(&entry.filename)
+                        })
+                        .map(|(child, _)| child.to_string())
+                        .collect();
+                    for child in stale {
+                        self.delete_tree(&child);
+                    }
+                }
+                IndexOperation::DeleteTree(path) => self.delete_tree(&path.to_string_lossy()),
+                IndexOperation::MoveTree { from, to } => self.move_tree(from, to),
+            }
+        }
+    }
+
+    /// Topmost entries below `root` with a name that `exclude` matches
+    ///
+    /// Only the components below `root` are matched, as the scanner does.
+    /// Entries below another of the scanned `roots` nested in `root` are
+    /// matched against that root by its own call instead. Deleting the
+    /// returned trees removes every excluded entry.
+    pub fn excluded_trees(&self, root: &Path, exclude: &ExcludeMatcher, roots: &[PathBuf]) -> Vec<PathBuf> {
+        let nested: Vec<&PathBuf> = roots
+            .iter()
+            .filter(|nested| nested.as_path() != root && nested.starts_with(root))
+            .collect();
+
+        let mut trees: Vec<PathBuf> = Vec::new();
+        for (path, _) in self.subtree(&directory_key(root)) {
+            let path = Path::new(path);
+            if trees.last().map_or(false, |tree| path.starts_with(tree)) {
+                continue;
+            }
+            if nested.iter().any(|nested| path.starts_with(nested)) {
+                continue;
+            }
+            let Ok(relative) = path.strip_prefix(root) else {
+                continue;
+            };
+
+            let mut tree = root.to_path_buf();
+            for component in relative.components() {
+                tree.push(component);
+                if exclude.is_excluded_name(component.as_os_str()) {
+                    trees.push(tree);
+                    break;
+                }
+            }
+        }
+
+        // Siblings sorting between a tree and its children can repeat it
+        trees.sort();
+        trees.dedup();
+        trees
+    }
+
+    /// Find up to `limit` entries whose filename, or application name or
+    /// keywords, contains `query`, ranked as `Database::query_files` ranks them
+    ///
+    /// Exact matches of the filename or application name come first, then
+    /// prefix matches, then the rest; within each, higher frecency first,
+    /// then by filename ignoring case.
+    pub fn query(&self, query: &str, limit: usize) -> Vec<HotResult<'_>> {
+        if query.is_empty() || limit == 0 {
+            return Vec::new();
+        }
+        let folded_query = query.to_ascii_lowercase();
+
+        // An entry containing the query holds each of its trigrams, so only
+        // those posted under the rarest one are candidates
+        let rarest = trigrams(&folded_query)
+            .map(|trigram| self.postings.get(&trigram))
+            .min_by_key(|slots| slots.map_or(0, HashSet::len));
+        let (posted, all) = match rarest {
+            Some(Some(slots)) => (Some(slots), None),
+            Some(None) => return Vec::new(),
+            None => (None, Some(&self.slots)),
+        };
+        let candidates = posted
+            .into_iter()
+            .flatten()
+            .map(|&slot| self.entry(slot))
+            .chain(all.into_iter().flatten().flatten());
+
+        let mut matches: Vec<_> = candidates
+            .filter(|entry| {
+                entry.folded.contains(&folded_query)
+                    || entry.app.as_ref().map_or(false, |app| {
+                        app.folded_name.contains(&folded_query)
+                            || app.folded_keywords.contains(&folded_query)
+                    })
+            })
+            .map(|entry| {
+                let app = entry.app.as_deref();
+                let rank = if entry.filename == query
+                    || app.map_or(false, |app| app.metadata.name == query)
+                {
+                    0
+                } else if entry.folded.starts_with(&folded_query)
+                    || app.map_or(false, |app| app.folded_name.starts_with(&folded_query))
+                {
+                    1
+                } else {
+                    2
+                };
+                let frecency = self.frecencies.get(&*entry.path).copied().unwrap_or(0);
+                ((rank, Reverse(frecency), entry.folded.as_str(), &*entry.path), entry)
+            })
+            .collect();
+
+        // Only the best `limit` matches need to be in order
+        if matches.len() > limit {
+            matches.select_nth_unstable_by(limit - 1, |a, b| a.0.cmp(&b.0));
+            matches.truncate(limit);
+        }
+        matches.sort_unstable_by(|a, b| a.0.cmp(&b.0));
+
+        matches
+            .into_iter()
+            .map(|(_, entry)| HotResult {
+                filename: &entry.filename,
+                path: &entry.path,
+                file_type: &entry.file_type,
+                size: entry.size,
+                modified_time: entry.modified_time,
+                app: entry.app.as_ref().map(|app| &app.metadata),
+            })
+            .collect()
+    }
+
+    fn insert(&mut self, entry: &FileEntry) {
+        let entry = HotEntry::from(entry);
+        let slot = match self.free_slots.pop() {
+            Some(slot) => slot,
+            None => {
+                self.slots.push(None);
+                (self.slots.len() - 1) as u32
+            }
+        };
+        post(&mut self.postings, slot, &entry);
+        let path = entry.path.clone();
+        self.slots[slot as usize] = Some(entry);
+        self.place(path, slot);
+    }
+
+    /// The entry in an occupied slot
+    fn entry(&self, slot: u32) -> &HotEntry {
+        self.slots[slot as usize].as_ref().expect("slot holds an entry")
+    }
+
+    /// Key the entry in `slot` by `path`, replacing any entry already there
+    fn place(&mut self, path: Arc<str>, slot: u32) {
+        if let Some(entry) = self.slots[slot as usize].as_mut() {
+            entry.path = path.clone();
+        }
+        if let Some(replaced) = self.paths.insert(path, slot) {
+            if replaced != slot {
+                self.release(replaced);
+            }
+        }
+    }
+
+    /// Empty a slot no path refers to any more
+    fn release(&mut self, slot: u32) {
+        if let Some(entry) = self.slots[slot as usize].take() {
+            unpost(&mut self.postings, slot, &entry);
+            self.free_slots.push(slot);
+        }
+    }
+
+    fn remove(&mut self, path: &str) {
+        if let Some(slot) = self.paths.remove(path) {
+            self.release(slot);
+        }
+    }
+
+    /// Move a single entry, giving it the filename of its new path
+    fn move_entry(&mut self, from: &str, to: &Path) {
+        let Some(slot) = self.paths.remove(from) else {
+            return;
+        };
+        if let Some(entry) = self.slots[slot as usize].as_mut() {
+            unpost(&mut self.postings, slot, entry);
+            rename_entry(entry, to);
+            post(&mut self.postings, slot, entry);
+        }
+        self.place(Arc::from(to.to_string_lossy().as_ref()), slot);
+    }
+
+    /// Entries strictly below the directory keyed `key`
+    fn subtree<'a>(&'a self, key: &str) -> impl Iterator<Item = (&'a str, &'a HotEntry)> + 'a {
+        let (start, end) = (format!("{}/", key), format!("{}0", key));
+        self.paths
+            .range::<str, _>((Bound::Included(start.as_str()), Bound::Excluded(end.as_str())))
+            .map(|(path, &slot)| (&**path, self.entry(slot)))
+    }
+    /// Remove an entry and everything beneath it, like `delete_tree`
+    fn delete_tree(&mut self, path: &str) {
+        self.remove(path);
+        let key = directory_key(Path::new(path));
+        let below: Vec<String> = self.subtree(&key).map(|(child, _)| child.to_string()).collect();
+        for child in below {
+            self.remove(&child);
+        }
+    }
+
+    /// Move an entry and everything beneath it, like `move_tree`
+    ///
+    /// Entries below keep their filenames, so only their paths change.
+    fn move_tree(&mut self, from: &Path, to: &Path) {
+        if from == to {
+            return;
+        }
+        self.delete_tree(&to.to_string_lossy());
+        self.move_entry(&from.to_string_lossy(), to);
+
+        let from_key = directory_key(from);
+        let to_key = directory_key(to);
+        let below: Vec<String> = self.subtree(&from_key).map(|(child, _)| child.to_string()).collect();
+        for child in below {
+            if let Some(slot) = self.paths.remove(child.as_str()) {
+                self.place(Arc::from(format!("{}{}", to_key, &child[from_key.len()..])), slot);
+            }
+        }
+    }
+}
+
+/// Trigrams of a folded text, as posted in the snapshot
+fn trigrams(text: &str) -> impl Iterator<Item = [u8; 3]> + '_ {
+    text.as_bytes().windows(3).map(|window| [window[0], window[1], window[2]])
+}
+
+/// Texts an entry is matched on
+fn searched_texts(entry: &HotEntry) -> impl Iterator<Item = &str> {
+    let app = entry.app.as_deref();
+    std::iter::once(entry.folded.as_str())
+        .chain(app.map(|app| app.folded_name.as_str()))
+        .chain(app.map(|app| app.folded_keywords.as_str()))
+}
+
+/// Post `slot` under the trigrams of its entry
+fn post(postings: &mut HashMap<[u8; 3], HashSet<u32>>, slot: u32, entry: &HotEntry) {
+    for trigram in searched_texts(entry).flat_map(trigrams) {
+        postings.entry(trigram).or_default().insert(slot);
+    }
+}
+
+/// Undo `post`, dropping trigrams no entry holds any more
+fn unpost(postings: &mut HashMap<[u8; 3], HashSet<u32>>, slot: u32, entry: &HotEntry) {
+    for trigram in searched_texts(entry).flat_map(trigrams) {
+        if let Some(slots) = postings.get_mut(&trigram) {
+            slots.remove(&slot);
+            if slots.is_empty() {
+                postings.remove(&trigram);
+            }
+        }
+    }
+}
+
+/// Give an entry the filename of its new path
+fn rename_entry(entry: &mut HotEntry, to: &Path) {
+    entry.filename = to
+        .file_name()
+        .map(|n| n.to_string_lossy().to_string())
+        .unwrap_or_default();
+    entry.folded = entry.filename.to_ascii_lowercase();
+}
+
+/// Answer a request payload, returning the framed response
+pub fn handle_request(index: &HotIndex, request: &[u8]) -> Vec<u8> {
+    let mut response = vec![0u8; 4];
+
+    if request == [OP_STATUS] {
+        response.push(STATUS_OK);
+        response.extend_from_slice(METRICS.render_report().as_bytes());
+    } else if let Some((query, max_results)) = parse_query(request) {
+        let start = Instant::now();
+        let results = index.query(query, max_results);
+        METRICS.query_duration.record_since(start);
+        response.push(STATUS_OK);
+        response.extend_from_slice(&(results.len() as u32).to_le_bytes());
+        for result in results {
+            response.extend_from_slice(&(result.size as i64).to_le_bytes());
+            response.extend_from_slice(&result.modified_time.to_le_bytes());
+            let app = result.app;
+            let app_fields = [
+                app.map_or("", |app| app.name.as_str()),
+                app.map_or("", |app| app.icon.as_str()),
+                app.map_or("", |app| app.exec.as_str()),
+            ];
+            let fields = [result.filename, result.path, result.file_type.as_str()];
+            for field in fields.into_iter().chain(app_fields) {
+                response.extend_from_slice(&(field.len() as u32).to_le_bytes());
+                response.extend_from_slice(field.as_bytes());
+            }
+        }
+    } else {
+        response.push(STATUS_ERROR);
+    }
+
+    let payload_len = (response.len() - 4) as u32;
+    response[..4].copy_from_slice(&payload_len.to_le_bytes());
+    response
+}
+
+/// Decode a query request into the query and the number of results wanted
+fn parse_query(request: &[u8]) -> Option<(&str, usize)> {
+    let (&opcode, rest) = request.split_first()?;
+    if opcode != OP_QUERY || rest.len() < 4 {
+        return None;
+    }
+    let max_results = u32::from_le_bytes(rest[..4].try_into().unwrap()) as usize;
+    let query = std::str::from_utf8(&rest[4..]).ok()?;
+
+    let max_results = match max_results {
+        0 => DEFAULT_MAX_RESULTS,
+        n => n.min(MAX_RESULTS_LIMIT),
+    };
+    Some((query, max_results))
+}
+
+/// Serves queries from the hot index over a Unix domain socket
+pub struct QueryServer {
+    index: Arc<RwLock<HotIndex>>,
+    /// Read-only connection watching for launches recorded by the panel and
+    /// for rebuilds of the system index
+    usage: Mutex<UsageSource>,
+}
+
+/// Tracks when the frecency scores or system entries need reloading
+struct UsageSource {
+    db: Database,
+    data_version: i64,
+    /// Directories covered by the system index attached to `db`, if any
+    system_roots: Option<Vec<PathBuf>>,
+}
+
+impl QueryServer {
+    /// Create a server for `index`, reading frecency scores through `db`
+    ///
+    /// `system_roots` are the directories of the system index attached to
+    /// `db`; its entries are reloaded whenever it is rebuilt.
+    pub fn new(index: Arc<RwLock<HotIndex>>, db: Database, system_roots: Option<Vec<PathBuf>>) -> Self {
+        let data_version = db.data_version().unwrap_or(-1);
+        QueryServer {
+            index,
+            usage: Mutex::new(UsageSource { db, data_version, system_roots }),
+        }
+    }
+
+    /// Bind the socket at `path`, owner-only
+    ///
+    /// A socket left behind by a daemon that did not shut down cleanly is
+    /// replaced; one that still accepts connections belongs to a running
+    /// daemon and is left alone.
+    pub fn bind(path: &Path) -> io::Result<UnixListener> {
+        if path.exists() {
+            if std::os::unix::net::UnixStream::connect(path).is_ok() {
+                return Err(io::Error::new(
+                    io::ErrorKind::AddrInUse,
+                    format!("{:?} is served by another daemon", path),
+                ));
+            }
+            std::fs::remove_file(path)?;
+        }
+
+        let listener = UnixListener::bind(path)?;
+        std::fs::set_permissions(path, std::fs::Permissions::from_mode(0o600))?;
+        Ok(listener)
+    }
+
+    /// Accept connections until the listener fails
+    pub async fn serve(self: Arc<Self>, listener: UnixListener) {
+        loop {
+            match listener.accept().await {
+                Ok((stream, _)) => {
+                    let server = Arc::clone(&self);
+                    tokio::spawn(async move {
+                        if let Err(e) = server.handle_connection(stream).await {
+                            eprintln!("Query connection error: {}", e);
+                        }
+                    });
+                }
+                Err(e) => {
+                    eprintln!("Query server stopped: {}", e);
+                    return;
+                }
+            }
+        }
+    }
+
+    /// Answer requests on one connection until the client closes it
+    async fn handle_connection(&self, mut stream: UnixStream) -> io::Result<()> {
+        loop {
+            let mut length = [0u8; 4];
+            match stream.read_exact(&mut length).await {
+                Ok(_) => {}
+                Err(e) if e.kind() == io::ErrorKind::UnexpectedEof => return Ok(()),
+                Err(e) => return Err(e),
+            }
+
+            let length = u32::from_le_bytes(length) as usize;
+            if length > MAX_REQUEST_LEN {
+                return Err(io::Error::new(io::ErrorKind::InvalidData, "request too large"));
+            }
+            let mut request = vec![0u8; length];
+            stream.read_exact(&mut request).await?;
+
+            self.refresh_frecencies();
+            let response = handle_request(&self.index.read().unwrap(), &request);
+            stream.write_all(&response).await?;
+        }
+    }
+
+    /// Reload frecency scores if another connection has committed since the
+    /// last check
+    ///
+    /// The panel records launches directly in the database. Every commit
+    /// changes the data version, but reloading only touches launched files.
+    ///
+    /// The system index is rebuilt by another process as well; its entries
+    /// are replaced once its generation moves on. So is the user's index by
+    /// `reindex`, which reloads everything.
+    fn refresh_frecencies(&self) {
+        let mut usage = self.usage.lock().unwrap();
+        if let Some(roots) = &usage.system_roots {
+            let rebuilt = usage.db.system_generation().map_or(false, |generation| {
+                generation != self.index.read().unwrap().system_generation()
+            });
+            if rebuilt {
+                if let Err(e) = self.index.write().unwrap().load_system(&usage.db, roots) {
+                    eprintln!("Error loading the system index: {}", e);
+                }
+            }
+        }
+
+        let Ok(version) = usage.db.data_version() else {
+            return;
+        };
+        if version == usage.data_version {
+            return;
+        }
+
+        match HotIndex::refresh_user(&self.index, &usage.db) {
+            Ok(true) => {
+                usage.data_version = version;
+                return;
+            }
+            Ok(false) => {}
+            Err(e) => eprintln!("Error reloading the index: {}", e),
+        }
+        match usage.db.load_frecencies() {
+            Ok(frecencies) => {
+                self.index.write().unwrap().set_frecencies(frecencies);
+                usage.data_version = version;
+            }
+            Err(e) => eprintln!("Error loading frecency scores: {}", e),
+        }
+    }
+}
+
+/// Ask the daemon serving the socket at `path` for its metrics report
+pub fn request_status(path: &Path) -> io::Result<String> {
+    use std::io::{Read, Write};
+
+    let mut stream = std::os::unix::net::UnixStream::connect(path)?;
+    stream.set_read_timeout(Some(STATUS_TIMEOUT))?;
+    stream.set_write_timeout(Some(STATUS_TIMEOUT))?;
+
+    let mut request = 1u32.to_le_bytes().to_vec();
+    request.push(OP_STATUS);
+    stream.write_all(&request)?;
+
+    let mut length = [0u8; 4];
+    stream.read_exact(&mut length)?;
+    let mut payload = vec![0u8; u32::from_le_bytes(length) as usize];
+    stream.read_exact(&mut payload)?;
+
+    match payload.split_first() {
+        Some((&STATUS_OK, report)) => Ok(String::from_utf8_lossy(report).into_owned()),
+        _ => Err(io::Error::new(io::ErrorKind::InvalidData, "daemon does not report status")),
+    }
+}
+
+/// Remove the socket file on shutdown
+pub fn remove_socket(path: &Path) {
+    if let Err(e) = std::fs::remove_file(path) {
+        if e.kind() != io::ErrorKind::NotFound {
+            eprintln!("Error removing query socket: {}", e);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::collections::HashSet;
+    use std::time::{Duration, UNIX_EPOCH};
+
+    fn entry(path: &str, file_type: FileType) -> FileEntry {
+        let path = PathBuf::from(path);
+        let filename = path.file_name().unwrap().to_string_lossy().to_string();
+        FileEntry::new(filename, path, 1024, UNIX_EPOCH + Duration::from_secs(1_700_000_000), file_type)
+    }
+
+    fn index_with(paths: &[&str]) -> HotIndex {
+        let mut index = HotIndex::default();
+        let operations: Vec<_> = paths
+            .iter()
+            .map(|path| IndexOperation::Add(entry(path, FileType::Regular)))
+            .collect();
+        index.apply(&operations);
+        index
+    }
+
+    fn paths(index: &HotIndex) -> Vec<&str> {
+        index.paths.keys().map(|path| &**path).collect()
+    }
+
+    fn query_paths<'a>(index: &'a HotIndex, query: &str) -> Vec<&'a str> {
+        index.query(query, 10).into_iter().map(|r| r.path).collect()
+    }
+
+    #[test]
+    fn test_query_ranking() {
+        let mut index = index_with(&[
+            "/home/user/my_document.doc",
+            "/home/user/Document.pdf",
+            "/home/user/documents",
+            "/home/user/document",
+            "/home/user/image.png",
+        ]);
+        index.set_frecencies(HashMap::from([("/home/user/documents".to_string(), 3)]));
+
+        // Exact, then prefix (by frecency, then by name ignoring case), then substring
+        assert_eq!(query_paths(&index, "document"), vec![
+            "/home/user/document",
+            "/home/user/documents",
+            "/home/user/Document.pdf",
+            "/home/user/my_document.doc",
+        ]);
+        assert_eq!(query_paths(&index, "DOC").len(), 4);
+        assert!(query_paths(&index, "").is_empty());
+        assert!(query_paths(&index, "missing").is_empty());
+
+        // Only the best results are returned
+        let best: Vec<_> = index.query("document", 2).into_iter().map(|r| r.path).collect();
+        assert_eq!(best, vec!["/home/user/document", "/home/user/documents"]);
+    }
+
+    #[test]
+    fn test_query_matches_application_metadata() {
+        let mut launcher = entry("/usr/share/applications/org.mozilla.firefox.desktop", FileType::Regular);
+        launcher.app = Some(AppMetadata {
+            name: "Firefox".to_string(),
+            icon: "firefox".to_string(),
+            exec: "firefox %u".to_string(),
+            keywords: "web;browser;".to_string(),
+        });
+        let mut index = index_with(&["/home/user/firefox-notes.txt"]);
+        index.apply(&[IndexOperation::Add(launcher)]);
+
+        // The application's name matches exactly, ahead of the filename prefix
+        let results = index.query("Firefox", 10);
+        assert_eq!(results.len(), 2);
+        assert_eq!(results[0].app.unwrap().icon, "firefox");
+        assert!(results[1].app.is_none());
+
+        assert_eq!(query_paths(&index, "BROWSER"), vec!["/usr/share/applications/org.mozilla.firefox.desktop"]);
+
+        // Launcher metadata follows a rename
+        index.apply(&[IndexOperation::Move {
+            from: PathBuf::from("/usr/share/applications/org.mozilla.firefox.desktop"),
+            to: PathBuf::from("/usr/share/applications/firefox.desktop"),
+        }]);
+        assert_eq!(query_paths(&index, "browser"), vec!["/usr/share/applications/firefox.desktop"]);
+    }
+
+    #[test]
+    fn test_apply_follows_database_operations() {
+        let mut index = index_with(&[
+            "/home/user/project",
+            "/home/user/project/a.txt",
+            "/home/user/project/src",
+            "/home/user/project/src/main.rs",
+            "/home/user/project-notes.txt",
+            "/home/user/old.txt",
+        ]);
+
+        index.apply(&[
+            IndexOperation::Move {
+                from: PathBuf::from("/home/user/old.txt"),
+                to: PathBuf::from("/home/user/new.txt"),
+            },
+            IndexOperation::MoveTree {
+                from: PathBuf::from("/home/user/project"),
+                to: PathBuf::from("/home/user/renamed"),
+            },
+        ]);
+        assert_eq!(paths(&index), vec![
+            "/home/user/new.txt",
+            "/home/user/project-notes.txt",
+            "/home/user/renamed",
+            "/home/user/renamed/a.txt",
+            "/home/user/renamed/src",
+            "/home/user/renamed/src/main.rs",
+        ]);
+        assert_eq!(query_paths(&index, "new"), vec!["/home/user/new.txt"]);
+        assert_eq!(query_paths(&index, "renamed"), vec!["/home/user/renamed"]);
+
+        index.apply(&[IndexOperation::PruneDir {
+            path: PathBuf::from("/home/user/renamed"),
+            keep: HashSet::from(["a.txt".to_string()]),
+        }]);
+        assert_eq!(paths(&index), vec![
+            "/home/user/new.txt",
+            "/home/user/project-notes.txt",
+            "/home/user/renamed",
+            "/home/user/renamed/a.txt",
+        ]);
+
+        index.apply(&[
+            IndexOperation::DeleteTree(PathBuf::from("/home/user/renamed")),
+            IndexOperation::Delete(PathBuf::from("/home/user/new.txt")),
+        ]);
+        assert_eq!(paths(&index), vec!["/home/user/project-notes.txt"]);
+    }
+
+    #[test]
+    fn test_postings_follow_changes() {
+        let mut index = index_with(&["/home/user/report.txt", "/home/user/notes", "/home/user/notes/todo.md"]);
+
+        index.apply(&[
+            IndexOperation::Move {
+                from: PathBuf::from("/home/user/report.txt"),
+                to: PathBuf::from("/home/user/summary.txt"),
+            },
+            IndexOperation::MoveTree {
+                from: PathBuf::from("/home/user/notes"),
+                to: PathBuf::from("/home/user/archive"),
+            },
+        ]);
+        assert!(query_paths(&index, "report").is_empty());
+        assert_eq!(query_paths(&index, "summ"), vec!["/home/user/summary.txt"]);
+        assert!(query_paths(&index, "notes").is_empty());
+        assert_eq!(query_paths(&index, "todo"), vec!["/home/user/archive/todo.md"]);
+
+        // Queries shorter than a trigram scan every entry
+        assert_eq!(query_paths(&index, "md"), vec!["/home/user/archive/todo.md"]);
+
+        // Removed entries leave no postings behind, and their slots are reused
+        index.apply(&[
+            IndexOperation::DeleteTree(PathBuf::from("/home/user/archive")),
+            IndexOperation::Delete(PathBuf::from("/home/user/summary.txt")),
+        ]);
+        assert!(index.postings.is_empty());
+        index.apply(&[IndexOperation::Add(entry("/home/user/new.txt", FileType::Regular))]);
+        assert_eq!(index.slots.len(), 3);
+        assert_eq!(query_paths(&index, "new"), vec!["/home/user/new.txt"]);
+    }
+
+    #[test]
+    fn test_apply_committed_tracks_generation() {
+        let mut index = index_with(&["/home/user/a.txt"]);
+        index.apply_committed(&[IndexOperation::Add(entry("/home/user/b.txt", FileType::Regular))], 1);
+        assert_eq!(index.index_generation(), 1);
+
+        // A generation skipped by another process leaves the entries behind
+        index.apply_committed(&[IndexOperation::Add(entry("/home/user/c.txt", FileType::Regular))], 3);
+        assert_eq!(index.index_generation(), 1);
+        assert_eq!(paths(&index), vec!["/home/user/a.txt", "/home/user/b.txt", "/home/user/c.txt"]);
+    }
+
+    #[test]
+    fn test_refresh_user_reloads_after_reindex() {
+        let temp_file = tempfile::NamedTempFile::new().unwrap();
+        let db = Database::open(temp_file.path()).unwrap();
+        let generation = db.execute_batch(&[IndexOperation::Add(entry("/home/user/old.txt", FileType::Regular))]).unwrap();
+
+        let index = RwLock::new(HotIndex::load(&db).unwrap());
+        assert_eq!(index.read().unwrap().index_generation(), generation);
+        assert!(!HotIndex::refresh_user(&index, &db).unwrap());
+
+        // Not while a batch of the daemon's own is being committed
+        let rebuild = db.begin_rebuild().unwrap();
+        rebuild.execute_batch(&[IndexOperation::Add(entry("/home/user/new.txt", FileType::Regular))]).unwrap();
+        rebuild.finish().unwrap();
+        index.read().unwrap().begin_write();
+        assert!(!HotIndex::refresh_user(&index, &db).unwrap());
+        index.read().unwrap().end_write();
+
+        assert!(HotIndex::refresh_user(&index, &db).unwrap());
+        let index = index.read().unwrap();
+        assert_eq!(paths(&index), vec!["/home/user/new.txt"]);
+        assert_eq!(index.index_generation(), db.index_generation().unwrap());
+    }
+
+    #[test]
+    fn test_excluded_trees() {
+        let index = index_with(&[
+            "/home/user/.config",
+            "/home/user/.config/app.toml",
+            "/home/user/project",
+            "/home/user/project/node_modules",
+            "/home/user/project/node_modules/pkg/index.js",
+            "/home/user/project/node_modules-notes.txt",
+            "/home/user/project/src/main.rs",
+            "/home/other/node_modules",
+        ]);
+        let exclude = ExcludeMatcher::new(&[".*".to_string(), "node_modules".to_string()]);
+
+        assert_eq!(index.excluded_trees(Path::new("/home/user"), &exclude, &[]), vec![
+            PathBuf::from("/home/user/.config"),
+            PathBuf::from("/home/user/project/node_modules"),
+        ]);
+
+        // Components of the root itself never count
+        assert_eq!(
+            index.excluded_trees(Path::new("/home/user/.config"), &exclude, &[]),
+            Vec::<PathBuf>::new(),
+        );
+
+        // Nor do those of another root nested in it
+        let roots = [PathBuf::from("/home/user"), PathBuf::from("/home/user/.config")];
+        assert_eq!(index.excluded_trees(Path::new("/home/user"), &exclude, &roots), vec![
+            PathBuf::from("/home/user/project/node_modules"),
+        ]);
+    }
+
+    #[test]
+    fn test_handle_request() {
+        let index = index_with(&["/home/user/notes.txt"]);
+
+        let mut request = vec![OP_QUERY];
+        request.extend_from_slice(&10u32.to_le_bytes());
+        request.extend_from_slice(b"note");
+        let response = handle_request(&index, &request);
+
+        assert_eq!(u32::from_le_bytes(response[..4].try_into().unwrap()) as usize, response.len() - 4);
+        assert_eq!(response[4], STATUS_OK);
+        assert_eq!(u32::from_le_bytes(response[5..9].try_into().unwrap()), 1);
+        assert_eq!(i64::from_le_bytes(response[9..17].try_into().unwrap()), 1024);
+        assert_eq!(i64::from_le_bytes(response[17..25].try_into().unwrap()), 1_700_000_000);
+        assert_eq!(u32::from_le_bytes(response[25..29].try_into().unwrap()), 9);
+        assert_eq!(&response[29..38], b"notes.txt");
+        // Followed by empty application name, icon and exec
+        assert!(response.ends_with(b"regular\0\0\0\0\0\0\0\0\0\0\0\0"));
+
+        // Unknown opcodes and truncated requests are rejected
+        assert_eq!(handle_request(&index, &[7, 0, 0, 0, 0])[4], STATUS_ERROR);
+        assert_eq!(handle_request(&index, &[OP_QUERY, 1])[4], STATUS_ERROR);
+        assert_eq!(handle_request(&index, &[])[4], STATUS_ERROR);
+
+        // A status request is answered with the metrics report
+        let response = handle_request(&index, &[OP_STATUS]);
+        assert_eq!(response[4], STATUS_OK);
+        assert!(std::str::from_utf8(&response[5..]).unwrap().contains("Queries"));
+    }
+
+    #[test]
+    fn test_request_status() {
+        use std::io::{Read, Write};
+
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("query.sock");
+        let listener = std::os::unix::net::UnixListener::bind(&path).unwrap();
+
+        // Answer one request the way a connection handler does
+        let server = std::thread::spawn(move || {
+            let (mut stream, _) = listener.accept().unwrap();
+            let mut length = [0u8; 4];
+            stream.read_exact(&mut length).unwrap();
+            let mut request = vec![0u8; u32::from_le_bytes(length) as usize];
+            stream.read_exact(&mut request).unwrap();
+            stream.write_all(&handle_request(&HotIndex::default(), &request)).unwrap();
+        });
+
+        let report = request_status(&path).unwrap();
+        server.join().unwrap();
+        assert!(report.contains("Database writes"));
+
+        drop(dir);
+        assert!(request_status(&path).is_err());
+    }
+}
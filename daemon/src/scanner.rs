@@ -1,10 +1,28 @@
+use std::collections::{BinaryHeap, HashMap, HashSet};
+use std::ffi::OsString;
+use std::fs::Metadata;
 use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::sync::mpsc::{self, SyncSender};
 use std::sync::{Arc, Mutex};
-use std::time::SystemTime;
+use std::time::{Duration, SystemTime};
 use walkdir::{WalkDir, DirEntry};
-use glob::Pattern;
-use crate::models::{FileEntry, FileType};
+use crate::models::{FileEntry, FileType, IndexOperation};
 use crate::config::Config;
+use crate::exclude::ExcludeMatcher;
+use crate::governor::{Governor, IdleIoPriority};
+use crate::database::system_time_to_nanos;
+use crate::desktop::read_app_metadata;
+use crate::paths;
+
+/// Batch size used when `scan` collects entries in memory
+const COLLECT_BATCH_SIZE: usize = 1024;
+
+/// Number of in-flight batches when `scan` collects entries in memory
+const COLLECT_CHANNEL_DEPTH: usize = 4;
+
+/// Size of the first batch a scan sends
+const INITIAL_BATCH_SIZE: usize = 16;
 
 /// Progress tracking for filesystem scanning
 #[derive(Debug, Clone)]
@@ -26,35 +44,465 @@ impl ScanProgress {
     }
 }
 
+/// Progress counters shared by all scanner threads
+struct ProgressCounters {
+    files_scanned: AtomicUsize,
+    directories_scanned: AtomicUsize,
+    errors_encountered: AtomicUsize,
+    current_path: Mutex<Option<PathBuf>>,
+}
+
+impl ProgressCounters {
+    fn new() -> Self {
+        ProgressCounters {
+            files_scanned: AtomicUsize::new(0),
+            directories_scanned: AtomicUsize::new(0),
+            errors_encountered: AtomicUsize::new(0),
+            current_path: Mutex::new(None),
+        }
+    }
+
+    /// Count one entry and, for directories, record it as the current path
+    fn record_entry(&self, path: &Path, is_dir: bool) {
+        if is_dir {
+            self.directories_scanned.fetch_add(1, Ordering::Relaxed);
+            *self.current_path.lock().unwrap() = Some(path.to_path_buf());
+        } else {
+            self.files_scanned.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+
+    fn set_current_path(&self, path: &Path) {
+        *self.current_path.lock().unwrap() = Some(path.to_path_buf());
+    }
+
+    fn record_error(&self) {
+        self.errors_encountered.fetch_add(1, Ordering::Relaxed);
+    }
+}
+
+/// Accumulates scanned entries and forwards them downstream in batches
+///
+/// Entries are moved into `IndexOperation::Add` as they are found, so nothing is
+/// cloned between the scanner and the database writer. The first batch holds
+/// `INITIAL_BATCH_SIZE` operations and each one after doubles up to
+/// `batch_size`, so the first results are committed within moments of the
+/// scan starting.
+struct BatchSender {
+    sender: SyncSender<Vec<IndexOperation>>,
+    batch_size: usize,
+    /// Size of the batch being filled
+    limit: usize,
+    batch: Vec<IndexOperation>,
+}
+
+impl BatchSender {
+    fn new(sender: SyncSender<Vec<IndexOperation>>, batch_size: usize) -> Self {
+        let batch_size = batch_size.max(1);
+        let limit = batch_size.min(INITIAL_BATCH_SIZE);
+        BatchSender {
+            sender,
+            batch_size,
+            limit,
+            batch: Vec::with_capacity(limit),
+        }
+    }
+
+    /// Create another sender feeding the same channel (for worker threads)
+    fn fork(&self) -> Self {
+        BatchSender::new(self.sender.clone(), self.batch_size)
+    }
+
+    /// Queue an entry; returns false once the receiving side has gone away
+    fn push(&mut self, entry: FileEntry) -> bool {
+        self.push_operation(IndexOperation::Add(entry))
+    }
+
+    /// Queue an operation; returns false once the receiving side has gone away
+    fn push_operation(&mut self, operation: IndexOperation) -> bool {
+        self.batch.push(operation);
+        if self.batch.len() >= self.limit {
+            self.flush()
+        } else {
+            true
+        }
+    }
+
+    /// Send any partially filled batch, blocking while the channel is full
+    fn flush(&mut self) -> bool {
+        if self.batch.is_empty() {
+            return true;
+        }
+        self.limit = (self.limit * 2).min(self.batch_size);
+        let batch = std::mem::replace(&mut self.batch, Vec::with_capacity(self.limit));
+        self.sender.send(batch).is_ok()
+    }
+}
+
+/// Directory state recorded by the previous scan
+struct SnapshotDir {
+    modified_time_ns: i64,
+    /// Names of the subdirectories indexed as entries of this directory
+    subdirs: Vec<OsString>,
+    /// Set once this scan has reached the directory
+    visited: AtomicBool,
+}
+
+/// Modification times of the directories indexed by the previous scan
+///
+/// A directory whose modification time is unchanged still has the same set of
+/// entries, so its listing can be skipped and only its known subdirectories need
+/// to be checked. Changes to the contents or metadata of existing files do not
+/// touch the directory's modification time and are not picked up this way.
+///
+/// The subdirectories are those indexed as entries, not those with a recorded
+/// time: a scan interrupted after listing a directory but before reaching its
+/// subdirectories leaves them without one, and they are listed next time.
+#[derive(Default)]
+pub struct DirectorySnapshot {
+    dirs: HashMap<PathBuf, SnapshotDir>,
+}
+
+impl DirectorySnapshot {
+    /// Build a snapshot from recorded directory modification times (in
+    /// nanoseconds) and the paths of the directories indexed as entries
+    pub fn new<I: IntoIterator<Item = PathBuf>>(modified_times: HashMap<PathBuf, i64>, indexed_dirs: I) -> Self {
+        let mut dirs: HashMap<PathBuf, SnapshotDir> = modified_times
+            .into_iter()
+            .map(|(path, modified_time_ns)| {
+                (path, SnapshotDir {
+                    modified_time_ns,
+                    subdirs: Vec::new(),
+                    visited: AtomicBool::new(false),
+                })
+            })
+            .collect();
+
+        for path in indexed_dirs {
+            let (Some(parent), Some(name)) = (path.parent(), path.file_name()) else {
+                continue;
+            };
+            if let Some(dir) = dirs.get_mut(parent) {
+                dir.subdirs.push(name.to_owned());
+            }
+        }
+
+        DirectorySnapshot { dirs }
+    }
+
+    /// Forget a directory's recorded state, so it is listed again
+    pub fn invalidate(&mut self, path: &Path) {
+        self.dirs.remove(path);
+    }
+
+    /// Number of directories in the snapshot
+    pub fn len(&self) -> usize {
+        self.dirs.len()
+    }
+
+    /// Mark a directory as reached and return its recorded state
+    fn visit(&self, path: &Path) -> Option<&SnapshotDir> {
+        let dir = self.dirs.get(path)?;
+        dir.visited.store(true, Ordering::Relaxed);
+        Some(dir)
+    }
+
+    /// Mark a directory and all recorded subdirectories as reached
+    ///
+    /// Used when a directory cannot be read, so that its existing rows are kept.
+    fn keep_subtree(&self, path: &Path) {
+        let mut stack = vec![path.to_path_buf()];
+        while let Some(path) = stack.pop() {
+            if let Some(dir) = self.visit(&path) {
+                stack.extend(dir.subdirs.iter().map(|name| path.join(name)));
+            }
+        }
+    }
+
+    /// Get directories that were not reached, excluding those below another one
+    fn unvisited_roots(&self) -> Vec<PathBuf> {
+        let is_unvisited = |path: &Path| {
+            self.dirs
+                .get(path)
+                .map_or(false, |dir| !dir.visited.load(Ordering::Relaxed))
+        };
+
+        self.dirs
+            .keys()
+            .filter(|path| is_unvisited(path))
+            .filter(|path| !path.parent().map_or(false, is_unvisited))
+            .cloned()
+            .collect()
+    }
+}
+
+/// Recently launched files and the current time, used to rank directories
+///
+/// The scan frontier lists the highest-ranked directory next, so a walk of a
+/// large tree reaches the places a search is most likely to look for early.
+#[derive(Debug, Clone)]
+pub struct ScanPriorities {
+    /// Directories holding recently launched files, and all their ancestors
+    hot_dirs: HashSet<PathBuf>,
+    now: SystemTime,
+}
+
+impl Default for ScanPriorities {
+    fn default() -> Self {
+        ScanPriorities::new(std::iter::empty())
+    }
+}
+
+impl ScanPriorities {
+    /// Rank directories holding any of `launched` paths first
+    pub fn new<I: IntoIterator<Item = PathBuf>>(launched: I) -> Self {
+        let mut hot_dirs = HashSet::new();
+        for path in launched {
+            for dir in path.ancestors().skip(1) {
+                if !hot_dirs.insert(dir.to_path_buf()) {
+                    break;
+                }
+            }
+        }
+        ScanPriorities {
+            hot_dirs,
+            now: SystemTime::now(),
+        }
+    }
+
+    /// Rank of a directory `depth` levels below the scan root
+    ///
+    /// The way to a recently launched file outranks everything else. Recent
+    /// modification and shallowness come next; below `SHALLOW_DEPTH` depth no
+    /// longer counts, so deep regions are walked depth-first and the frontier
+    /// stays small.
+    fn rank(&self, path: &Path, depth: usize, modified_time: Option<SystemTime>) -> i64 {
+        let mut rank = -DEPTH_WEIGHT * depth.min(SHALLOW_DEPTH) as i64;
+        if self.hot_dirs.contains(path) {
+            rank += HOT_DIR_WEIGHT;
+        }
+
+        // Times in the future count as just modified
+        let age = modified_time.map(|time| self.now.duration_since(time).unwrap_or_default());
+        rank += RECENT_WEIGHTS
+            .iter()
+            .find(|&&(max_age, _)| age.map_or(false, |age| age <= max_age))
+            .map_or(0, |&(_, weight)| weight);
+        rank
+    }
+}
+
+/// Rank added to directories on the way to a recently launched file
+const HOT_DIR_WEIGHT: i64 = 1000;
+
+/// Rank added to directories modified within each age, most recent first
+const RECENT_WEIGHTS: [(Duration, i64); 3] = [
+    (Duration::from_secs(24 * 60 * 60), 30),
+    (Duration::from_secs(7 * 24 * 60 * 60), 20),
+    (Duration::from_secs(30 * 24 * 60 * 60), 10),
+];
+
+/// Rank taken from a directory for each level below the scan root
+const DEPTH_WEIGHT: i64 = 10;
+
+/// Depth beyond which directories are not ranked any lower
+const SHALLOW_DEPTH: usize = 4;
+
+/// Directory waiting in the frontier
+#[derive(Debug, PartialEq, Eq)]
+struct QueuedDir {
+    rank: i64,
+    /// Order of queueing; among equals the newest goes first, depth-first
+    sequence: u64,
+    depth: usize,
+    path: PathBuf,
+}
+
+impl Ord for QueuedDir {
+    fn cmp(&self, other: &Self) -> std::cmp::Ordering {
+        (self.rank, self.sequence).cmp(&(other.rank, other.sequence))
+    }
+}
+
+impl PartialOrd for QueuedDir {
+    fn partial_cmp(&self, other: &Self) -> Option<std::cmp::Ordering> {
+        Some(self.cmp(other))
+    }
+}
+
+/// Directories waiting to be read by the scan workers, highest rank first
+///
+/// All workers share one heap. Reading a directory takes far longer than the
+/// lock, and a shared order means every worker is always on the best
+/// directory known.
+struct ScanFrontier {
+    heap: Mutex<BinaryHeap<QueuedDir>>,
+    next_sequence: AtomicU64,
+    /// Directories queued or being read; the scan is finished when this reaches zero
+    pending: AtomicUsize,
+    /// Set when the consumer of the scan has gone away
+    aborted: AtomicBool,
+}
+
+impl ScanFrontier {
+    fn new() -> Self {
+        ScanFrontier {
+            heap: Mutex::new(BinaryHeap::new()),
+            next_sequence: AtomicU64::new(0),
+            pending: AtomicUsize::new(0),
+            aborted: AtomicBool::new(false),
+        }
+    }
+
+    fn push(&self, path: PathBuf, depth: usize, rank: i64) {
+        self.pending.fetch_add(1, Ordering::SeqCst);
+        let sequence = self.next_sequence.fetch_add(1, Ordering::Relaxed);
+        self.heap.lock().unwrap().push(QueuedDir { rank, sequence, depth, path });
+    }
+
+    /// Take the highest-ranked directory and its depth
+    fn pop(&self) -> Option<(PathBuf, usize)> {
+        self.heap.lock().unwrap().pop().map(|dir| (dir.path, dir.depth))
+    }
+
+    /// Mark a directory taken with `pop` as fully processed
+    fn finish(&self) {
+        self.pending.fetch_sub(1, Ordering::SeqCst);
+    }
+
+    fn is_done(&self) -> bool {
+        self.pending.load(Ordering::SeqCst) == 0 || self.is_aborted()
+    }
+
+    fn abort(&self) {
+        self.aborted.store(true, Ordering::SeqCst);
+    }
+
+    fn is_aborted(&self) -> bool {
+        self.aborted.load(Ordering::SeqCst)
+    }
+}
+
 /// Filesystem scanner for initial indexing
 pub struct Scanner {
     config: Config,
-    progress: Arc<Mutex<ScanProgress>>,
+    exclude: Arc<ExcludeMatcher>,
+    progress: Arc<ProgressCounters>,
+    /// Paces the walk to the resource budgets; scans run unthrottled without one
+    governor: Option<Arc<Governor>>,
+    /// Ranks directories for the order of the walk
+    priorities: ScanPriorities,
+    /// Directories scanned for applications, regardless of the include paths
+    app_dirs: Vec<PathBuf>,
 }
 
 impl Scanner {
     /// Create a new scanner with the given configuration
     pub fn new(config: Config) -> Self {
+        let exclude = Arc::new(ExcludeMatcher::from_config(&config));
+        Self::with_exclude_matcher(config, exclude)
+    }
+
+    /// Create a new scanner that shares an already compiled exclusion matcher
+    pub fn with_exclude_matcher(config: Config, exclude: Arc<ExcludeMatcher>) -> Self {
         Scanner {
             config,
-            progress: Arc::new(Mutex::new(ScanProgress::new())),
+            exclude,
+            progress: Arc::new(ProgressCounters::new()),
+            governor: None,
+            priorities: ScanPriorities::default(),
+            app_dirs: paths::get_application_directories(),
         }
     }
 
-    /// Get a clone of the current progress
+    /// Scan `app_dirs` for applications instead of every standard directory
+    pub fn with_application_directories(mut self, app_dirs: Vec<PathBuf>) -> Self {
+        self.app_dirs = app_dirs;
+        self
+    }
+
+    /// Walk the directories ranked by `priorities` first
+    pub fn with_priorities(mut self, priorities: ScanPriorities) -> Self {
+        self.priorities = priorities;
+        self
+    }
+
+    /// Pace scans with `governor`, reading the disk at idle I/O priority
+    pub fn with_governor(mut self, governor: Arc<Governor>) -> Self {
+        self.governor = Some(governor);
+        self
+    }
+
+    /// Wait if the governor asks for a pause
+    fn pace(&self) {
+        if let Some(governor) = &self.governor {
+            governor.pace();
+        }
+    }
+
+    /// Lower the calling thread's I/O priority while the guard lives, if governed
+    fn idle_io_priority(&self) -> Option<IdleIoPriority> {
+        self.governor.as_ref().map(|_| IdleIoPriority::enter())
+    }
+
+    /// Get a snapshot of the current progress
     pub fn get_progress(&self) -> ScanProgress {
-        self.progress.lock().unwrap().clone()
+        ScanProgress {
+            files_scanned: self.progress.files_scanned.load(Ordering::Relaxed),
+            directories_scanned: self.progress.directories_scanned.load(Ordering::Relaxed),
+            errors_encountered: self.progress.errors_encountered.load(Ordering::Relaxed),
+            current_path: self.progress.current_path.lock().unwrap().clone(),
+        }
     }
 
     /// Scan all configured directories and return file entries
+    ///
+    /// Collects the whole scan in memory; indexing should use `scan_batches` instead.
     pub fn scan(&self) -> Vec<FileEntry> {
-        let mut entries = Vec::new();
+        let (sender, receiver) = mpsc::sync_channel(COLLECT_CHANNEL_DEPTH);
+
+        std::thread::scope(|scope| {
+            scope.spawn(move || self.scan_batches(COLLECT_BATCH_SIZE, sender));
+
+            receiver
+                .into_iter()
+                .flatten()
+                .filter_map(|operation| match operation {
+                    IndexOperation::Add(entry) => Some(entry),
+                    _ => None,
+                })
+                .collect()
+        })
+    }
+
+    /// Scan all configured directories, streaming index operations in batches
+    ///
+    /// Blocks whenever `sender`'s channel is full, so a bounded channel caps the
+    /// number of entries held in memory. Stops early if the receiver is dropped.
+    pub fn scan_batches(&self, batch_size: usize, sender: SyncSender<Vec<IndexOperation>>) {
+        self.reconcile_batches(batch_size, sender, &DirectorySnapshot::default());
+    }
+
+    /// Scan all configured directories, skipping listings unchanged since `snapshot`
+    ///
+    /// Every listed directory produces `Add` operations for its entries, a `PruneDir`
+    /// removing children that disappeared, and a `ConfirmDir` recording its
+    /// modification time. Directories in the snapshot that were not reached (removed,
+    /// newly excluded or outside the include paths) are removed with `DeleteTree`.
+    /// With an empty snapshot this is a full scan.
+    pub fn reconcile_batches(
+        &self,
+        batch_size: usize,
+        sender: SyncSender<Vec<IndexOperation>>,
+        snapshot: &DirectorySnapshot,
+    ) {
+        let mut out = BatchSender::new(sender, batch_size);
+        let _io_priority = self.idle_io_priority();
         
         // Always scan application directories first (regardless of user config)
-        let app_dirs = self.get_application_directories();
-        for path in app_dirs {
-            if path.exists() {
-                entries.extend(self.scan_application_directory(&path));
+        for path in &self.app_dirs {
+            if path.exists() && !self.scan_application_directory(path, &mut out) {
+                return;
             }
         }
         
@@ -62,59 +510,69 @@ impl Scanner {
         let include_paths = self.config.expand_paths();
         for path in include_paths {
             if path.exists() {
-                entries.extend(self.scan_directory(&path));
+                if !self.scan_directory(&path, snapshot, &mut out) {
+                    return;
+                }
             } else {
+                // Keep the rows of unmounted or temporarily missing paths
                 eprintln!("Warning: Include path does not exist: {}", path.display());
+                snapshot.keep_subtree(&path);
+            }
+        }
+
+        for path in snapshot.unvisited_roots() {
+            if !out.push_operation(IndexOperation::DeleteTree(path)) {
+                return;
             }
         }
 
-        entries
+        out.flush();
     }
 
-    /// Get standard application directories that contain .desktop files
-    fn get_application_directories(&self) -> Vec<PathBuf> {
-        let mut app_dirs = Vec::new();
-        
-        // System application directories
-        app_dirs.push(PathBuf::from("/usr/share/applications"));
-        app_dirs.push(PathBuf::from("/usr/local/share/applications"));
-        
-        // User application directory
-        if let Ok(home) = std::env::var("HOME") {
-            let home_path = PathBuf::from(&home);
-            app_dirs.push(home_path.join(".local/share/applications"));
-        }
-        
-        // Snap applications
-        app_dirs.push(PathBuf::from("/var/lib/snapd/desktop/applications"));
-        if let Ok(home) = std::env::var("HOME") {
-            let home_path = PathBuf::from(&home);
-            app_dirs.push(home_path.join("snap"));
-        }
-        
-        // Flatpak applications
-        app_dirs.push(PathBuf::from("/var/lib/flatpak/exports/share/applications"));
-        if let Ok(home) = std::env::var("HOME") {
-            let home_path = PathBuf::from(&home);
-            app_dirs.push(home_path.join(".local/share/flatpak/exports/share/applications"));
+    /// Rescan specific directory trees, skipping listings unchanged since `snapshot`
+    ///
+    /// Used to recover from lost events. Trees below an application directory
+    /// are rescanned for applications only, trees below an include path are
+    /// reconciled like a scan of that path, and anything else is ignored. A
+    /// tree that no longer exists is removed with `DeleteTree`. Unlike
+    /// `reconcile_batches`, directories outside `roots` are left alone.
+    pub fn rescan_batches(
+        &self,
+        roots: &[PathBuf],
+        batch_size: usize,
+        sender: SyncSender<Vec<IndexOperation>>,
+        snapshot: &DirectorySnapshot,
+    ) {
+        let mut out = BatchSender::new(sender, batch_size);
+        let _io_priority = self.idle_io_priority();
+        let include_paths = self.config.expand_paths();
+
+        for root in roots {
+            let indexed = if self.app_dirs.iter().any(|dir| root.starts_with(dir)) {
+                !root.exists() || self.scan_application_directory(root, &mut out)
+            } else if include_paths.iter().any(|path| root.starts_with(path)) {
+                !root.is_dir() || self.scan_directory(root, snapshot, &mut out)
+            } else {
+                continue;
+            };
+            if !indexed {
+                return;
+            }
+
+            if std::fs::symlink_metadata(root).is_err()
+                && !out.push_operation(IndexOperation::DeleteTree(root.clone()))
+            {
+                return;
+            }
         }
-        
-        // AppImage applications (common locations)
-        if let Ok(home) = std::env::var("HOME") {
-            let home_path = PathBuf::from(&home);
-            app_dirs.push(home_path.join("Applications"));
-            app_dirs.push(home_path.join(".local/bin"));
-            app_dirs.push(home_path.join("AppImages"));
-        }
-        app_dirs.push(PathBuf::from("/opt"));
-        
-        app_dirs
+
+        out.flush();
     }
 
     /// Scan application directory specifically for .desktop files and AppImages
-    fn scan_application_directory(&self, path: &Path) -> Vec<FileEntry> {
-        let mut entries = Vec::new();
-        
+    ///
+    /// Returns false if the receiver has gone away.
+    fn scan_application_directory(&self, path: &Path, out: &mut BatchSender) -> bool {
         for entry_result in WalkDir::new(path)
             .follow_links(false)
             .into_iter()
@@ -124,15 +582,9 @@ impl Scanner {
                     let entry_path = entry.path();
                     
                     // Update progress
-                    {
-                        let mut progress = self.progress.lock().unwrap();
-                        progress.current_path = Some(entry_path.to_path_buf());
-                        
-                        if entry.file_type().is_dir() {
-                            progress.directories_scanned += 1;
-                        } else {
-                            progress.files_scanned += 1;
-                        }
+                    self.progress.record_entry(entry_path, entry.file_type().is_dir());
+                    if entry.file_type().is_dir() {
+                        self.pace();
                     }
 
                     // Check if this is a .desktop file or AppImage
@@ -156,7 +608,9 @@ impl Scanner {
 
                     if should_include {
                         if let Some(file_entry) = self.extract_file_entry(&entry) {
-                            entries.push(file_entry);
+                            if !out.push(file_entry) {
+                                return false;
+                            }
                         }
                     }
                 }
@@ -165,13 +619,12 @@ impl Scanner {
                     if !err.to_string().contains("Permission denied") {
                         eprintln!("Warning: Failed to access application path: {}", err);
                     }
-                    let mut progress = self.progress.lock().unwrap();
-                    progress.errors_encountered += 1;
+                    self.progress.record_error();
                 }
             }
         }
 
-        entries
+        true
     }
 
     /// Check if a file is an AppImage by examining its content
@@ -191,79 +644,222 @@ impl Scanner {
     }
 
     /// Scan a single directory recursively
-    fn scan_directory(&self, path: &Path) -> Vec<FileEntry> {
-        let mut entries = Vec::new();
-        
-        // Create glob patterns for exclusion
-        let exclude_patterns: Vec<Pattern> = self.config.indexing.exclude_patterns
-            .iter()
-            .filter_map(|pattern| {
-                Pattern::new(pattern).ok()
-            })
-            .collect();
+    ///
+    /// Returns false if the receiver has gone away.
+    fn scan_directory(&self, path: &Path, snapshot: &DirectorySnapshot, out: &mut BatchSender) -> bool {
+        let threads = self.config.scan_threads();
+        self.walk_directory(path, &self.exclude, threads, snapshot, out)
+    }
 
-        let root_path = path.to_path_buf();
+    /// Walk a directory tree with one or more threads sharing a ranked frontier
+    ///
+    /// Directories are listed in order of `ScanPriorities::rank`; with several
+    /// threads the entries are produced in no particular order. Symlinks are
+    /// recorded but never followed. Returns false if the receiver has gone away.
+    fn walk_directory(
+        &self,
+        path: &Path,
+        exclude: &ExcludeMatcher,
+        threads: usize,
+        snapshot: &DirectorySnapshot,
+        out: &mut BatchSender,
+    ) -> bool {
+        // The root itself is always included
+        let root_metadata = match std::fs::symlink_metadata(path) {
+            Ok(m) => m,
+            Err(err) => {
+                eprintln!("Warning: Failed to access path: {}: {}", path.display(), err);
+                self.progress.record_error();
+                snapshot.keep_subtree(path);
+                return true;
+            }
+        };
 
-        for entry_result in WalkDir::new(path)
-            .follow_links(false)
-            .into_iter()
-            .filter_entry(|e| self.should_include_entry(e, &exclude_patterns, &root_path))
-        {
-            match entry_result {
-                Ok(entry) => {
-                    // Update progress
-                    {
-                        let mut progress = self.progress.lock().unwrap();
-                        progress.current_path = Some(entry.path().to_path_buf());
-                        
-                        if entry.file_type().is_dir() {
-                            progress.directories_scanned += 1;
-                        } else {
-                            progress.files_scanned += 1;
-                        }
-                    }
+        self.progress.record_entry(path, root_metadata.is_dir());
+        if let Some(filename) = path.file_name() {
+            let root_entry = build_file_entry(
+                filename.to_string_lossy().to_string(),
+                path.to_path_buf(),
+                &root_metadata,
+            );
+            if !out.push(root_entry) {
+                return false;
+            }
+        }
 
-                    // Extract file entry
-                    if let Some(file_entry) = self.extract_file_entry(&entry) {
-                        entries.push(file_entry);
-                    }
+        if !root_metadata.is_dir() {
+            return true;
+        }
+
+        let threads = threads.max(1);
+        let frontier = ScanFrontier::new();
+        frontier.push(path.to_path_buf(), 0, 0);
+
+        if threads == 1 {
+            self.scan_worker(&frontier, exclude, snapshot, out);
+            return !frontier.is_aborted();
+        }
+
+        std::thread::scope(|scope| {
+            let workers: Vec<_> = (0..threads)
+                .map(|_| {
+                    let frontier = &frontier;
+                    let mut worker_out = out.fork();
+                    scope.spawn(move || {
+                        let _io_priority = self.idle_io_priority();
+                        self.scan_worker(frontier, exclude, snapshot, &mut worker_out)
+                    })
+                })
+                .collect();
+
+            for handle in workers {
+                if handle.join().is_err() {
+                    eprintln!("Warning: Scanner thread panicked");
+                    self.progress.record_error();
                 }
-                Err(err) => {
-                    // Handle permission errors and other issues gracefully
-                    eprintln!("Warning: Failed to access path: {}", err);
-                    let mut progress = self.progress.lock().unwrap();
-                    progress.errors_encountered += 1;
+            }
+        });
+
+        !frontier.is_aborted()
+    }
+
+    /// Worker loop for the directory walk
+    fn scan_worker(
+        &self,
+        frontier: &ScanFrontier,
+        exclude: &ExcludeMatcher,
+        snapshot: &DirectorySnapshot,
+        out: &mut BatchSender,
+    ) {
+        loop {
+            let (dir, depth) = match frontier.pop() {
+                Some(dir) => dir,
+                None if frontier.is_done() => break,
+                None => {
+                    // Other workers are still reading directories that may yield more work
+                    std::thread::sleep(Duration::from_millis(1));
+                    continue;
                 }
+            };
+
+            self.pace();
+            let delivered = self.scan_single_directory(&dir, depth, frontier, exclude, snapshot, out);
+            frontier.finish();
+
+            if !delivered {
+                frontier.abort();
+                return;
             }
         }
 
-        entries
+        if !out.flush() {
+            frontier.abort();
+        }
     }
 
-    /// Check if an entry should be included based on exclude patterns
-    fn should_include_entry(&self, entry: &DirEntry, exclude_patterns: &[Pattern], root_path: &Path) -> bool {
-        let path = entry.path();
-        
-        // Always include the root directory itself
-        if path == root_path {
-            return true;
+    /// Visit one directory: list it if it changed, otherwise only queue its subdirectories
+    ///
+    /// Returns false if the receiver has gone away.
+    fn scan_single_directory(
+        &self,
+        dir: &Path,
+        depth: usize,
+        frontier: &ScanFrontier,
+        exclude: &ExcludeMatcher,
+        snapshot: &DirectorySnapshot,
+        out: &mut BatchSender,
+    ) -> bool {
+        // Read the modification time before listing, so that a change made while
+        // listing is detected by the next scan
+        let modified_time = match std::fs::symlink_metadata(dir) {
+            Ok(metadata) => metadata.modified().ok(),
+            Err(err) => {
+                if err.kind() != std::io::ErrorKind::NotFound {
+                    eprintln!("Warning: Failed to access path: {}: {}", dir.display(), err);
+                    self.progress.record_error();
+                    snapshot.keep_subtree(dir);
+                }
+                return true;
+            }
+        };
+
+        if let Some(known) = snapshot.visit(dir) {
+            if modified_time.map(system_time_to_nanos) == Some(known.modified_time_ns) {
+                // Same entries as last time: only the subdirectories need checking
+                self.progress.set_current_path(dir);
+                for name in &known.subdirs {
+                    if !exclude.is_excluded_name(name) {
+                        let subdir = dir.join(name);
+                        let rank = self.priorities.rank(&subdir, depth + 1, None);
+                        frontier.push(subdir, depth + 1, rank);
+                    }
+                }
+                return true;
+            }
         }
-        
-        // Get the file/directory name
-        let name = match path.file_name() {
-            Some(n) => n.to_string_lossy(),
-            None => return true,
+
+        let read_dir = match std::fs::read_dir(dir) {
+            Ok(read_dir) => read_dir,
+            Err(err) => {
+                eprintln!("Warning: Failed to access path: {}: {}", dir.display(), err);
+                self.progress.record_error();
+                snapshot.keep_subtree(dir);
+                return true;
+            }
         };
 
-        // Check against exclude patterns
-        for pattern in exclude_patterns {
-            // Check if the name matches the pattern
-            if pattern.matches(&name) {
+        let mut keep = HashSet::new();
+        for dir_entry in read_dir {
+            let dir_entry = match dir_entry {
+                Ok(entry) => entry,
+                Err(err) => {
+                    eprintln!("Warning: Failed to access path: {}: {}", dir.display(), err);
+                    self.progress.record_error();
+                    continue;
+                }
+            };
+
+            let name = dir_entry.file_name();
+            if exclude.is_excluded_name(&name) {
+                continue;
+            }
+            let filename = name.to_string_lossy().to_string();
+            keep.insert(filename.clone());
+
+            // DirEntry::metadata does not traverse symlinks
+            let entry_path = dir_entry.path();
+            let metadata = match dir_entry.metadata() {
+                Ok(m) => m,
+                Err(err) => {
+                    eprintln!("Warning: Failed to get metadata for {}: {}", entry_path.display(), err);
+                    self.progress.record_error();
+                    continue;
+                }
+            };
+
+            self.progress.record_entry(&entry_path, metadata.is_dir());
+            if metadata.is_dir() {
+                let rank = self.priorities.rank(&entry_path, depth + 1, metadata.modified().ok());
+                frontier.push(entry_path.clone(), depth + 1, rank);
+            }
+
+            if !out.push(build_file_entry(filename, entry_path, &metadata)) {
                 return false;
             }
         }
 
-        true
+        // Drop children that disappeared or became excluded, then record the listing
+        if !out.push_operation(IndexOperation::PruneDir { path: dir.to_path_buf(), keep }) {
+            return false;
+        }
+
+        match modified_time {
+            Some(modified_time) => out.push_operation(IndexOperation::ConfirmDir {
+                path: dir.to_path_buf(),
+                modified_time,
+            }),
+            None => true,
+        }
     }
 
     /// Extract file entry from a directory entry
@@ -282,31 +878,41 @@ impl Scanner {
             }
         };
 
-        // Get file size
-        let size = metadata.len();
+        Some(build_file_entry(filename, path.to_path_buf(), &metadata))
+    }
+}
+
+/// Build a file entry from already-fetched metadata
+///
+/// `metadata` should not follow symlinks, or links are indexed as their targets.
+pub fn build_file_entry(filename: String, path: PathBuf, metadata: &Metadata) -> FileEntry {
+    // Get file size
+    let size = metadata.len();
 
-        // Get modification time
-        let modified_time = metadata.modified().unwrap_or_else(|_| SystemTime::now());
+    // Get modification time
+    let modified_time = metadata.modified().unwrap_or_else(|_| SystemTime::now());
 
-        // Determine file type
-        let file_type = if metadata.is_dir() {
-            FileType::Directory
-        } else if metadata.is_symlink() {
-            FileType::Symlink
-        } else if metadata.is_file() {
-            FileType::Regular
-        } else {
-            FileType::Other
-        };
+    // Determine file type
+    let file_type = if metadata.is_dir() {
+        FileType::Directory
+    } else if metadata.is_symlink() {
+        FileType::Symlink
+    } else if metadata.is_file() {
+        FileType::Regular
+    } else {
+        FileType::Other
+    };
 
-        Some(FileEntry::new(
-            filename,
-            path.to_path_buf(),
-            size,
-            modified_time,
-            file_type,
-        ))
-    }
+    let app = read_app_metadata(&path, &file_type);
+    let mut entry = FileEntry::new(
+        filename,
+        path,
+        size,
+        modified_time,
+        file_type,
+    );
+    entry.app = app;
+    entry
 }
 
 #[cfg(test)]
@@ -487,4 +1093,430 @@ mod tests {
         assert!(!filenames.contains(&"file.log".to_string()));
         assert!(!filenames.contains(&"file.tmp".to_string()));
     }
+
+    fn parallel_test_setup(path: &Path) -> (Scanner, ExcludeMatcher) {
+        let mut config = Config::default();
+        config.indexing.include_paths = vec![path.to_string_lossy().to_string()];
+        config.indexing.exclude_patterns = vec![".*".to_string(), "node_modules".to_string()];
+        config.performance.scan_threads = 1;
+
+        let patterns = ExcludeMatcher::from_config(&config);
+        (Scanner::new(config), patterns)
+    }
+
+    /// Run a scan function against a channel and collect every operation it sends
+    fn collect_operations<F>(scan: F) -> Vec<IndexOperation>
+    where
+        F: FnOnce(&mut BatchSender) + Send,
+    {
+        let (sender, receiver) = mpsc::sync_channel(2);
+        std::thread::scope(|scope| {
+            scope.spawn(move || {
+                let mut out = BatchSender::new(sender, 8);
+                scan(&mut out);
+                out.flush();
+            });
+
+            receiver.into_iter().flatten().collect()
+        })
+    }
+
+    /// Run a scan function against a channel and collect the sorted entry paths
+    fn collect_paths<F>(scan: F) -> Vec<PathBuf>
+    where
+        F: FnOnce(&mut BatchSender) + Send,
+    {
+        let mut paths: Vec<PathBuf> = collect_operations(scan)
+            .into_iter()
+            .filter_map(|operation| match operation {
+                IndexOperation::Add(entry) => Some(entry.path),
+                _ => None,
+            })
+            .collect();
+        paths.sort();
+        paths
+    }
+
+    /// Build the snapshot a later scan would load from the recorded directory
+    /// times and indexed directories
+    fn snapshot_from(operations: &[IndexOperation]) -> DirectorySnapshot {
+        let dirs: Vec<PathBuf> = operations
+            .iter()
+            .filter_map(|operation| match operation {
+                IndexOperation::Add(entry) if entry.file_type == FileType::Directory => Some(entry.path.clone()),
+                _ => None,
+            })
+            .collect();
+        let times = operations
+            .iter()
+            .filter_map(|operation| match operation {
+                IndexOperation::ConfirmDir { path, modified_time } => {
+                    Some((path.clone(), system_time_to_nanos(*modified_time)))
+                }
+                _ => None,
+            })
+            .collect();
+        DirectorySnapshot::new(times, dirs)
+    }
+
+    #[test]
+    fn test_parallel_scan_matches_sequential() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+        for i in 0..20 {
+            let dir = temp_dir.path().join(format!("dir{}/nested", i));
+            fs::create_dir_all(&dir).unwrap();
+            fs::write(dir.join("file.txt"), "content").unwrap();
+        }
+
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+        let snapshot = DirectorySnapshot::default();
+
+        let expected = collect_paths(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 1, &snapshot, out);
+        });
+        let actual = collect_paths(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 4, &snapshot, out);
+        });
+
+        assert_eq!(actual, expected);
+        assert!(actual.contains(&temp_dir.path().to_path_buf()));
+        assert!(actual.contains(&temp_dir.path().join("dir7/nested/file.txt")));
+        assert!(!actual.contains(&temp_dir.path().join(".hidden/secret.txt")));
+        assert!(!actual.contains(&temp_dir.path().join("node_modules/package/index.js")));
+    }
+
+    #[test]
+    fn test_governed_scan_matches_ungoverned() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+        let governor = Arc::new(Governor::new(&Config::default().performance));
+        let governed = Scanner::new(scanner.config.clone()).with_governor(governor);
+        let snapshot = DirectorySnapshot::default();
+
+        let expected = collect_paths(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 4, &snapshot, out);
+        });
+        let actual = collect_paths(|out| {
+            governed.walk_directory(temp_dir.path(), &patterns, 4, &snapshot, out);
+        });
+        assert_eq!(actual, expected);
+    }
+
+    #[test]
+    fn test_walk_lists_ranked_directories_first() {
+        let temp_dir = TempDir::new().unwrap();
+        let root = temp_dir.path();
+        for name in ["a", "b", "c"] {
+            fs::create_dir_all(root.join(name).join("sub")).unwrap();
+            fs::write(root.join(name).join("sub/file.txt"), "content").unwrap();
+        }
+        fs::create_dir_all(root.join("z/deep/hot")).unwrap();
+        fs::write(root.join("z/deep/hot/launched.txt"), "content").unwrap();
+
+        let (scanner, patterns) = parallel_test_setup(root);
+        let scanner = scanner.with_priorities(ScanPriorities::new([root.join("z/deep/hot/launched.txt")]));
+        let operations = collect_operations(|out| {
+            scanner.walk_directory(root, &patterns, 1, &DirectorySnapshot::default(), out);
+        });
+
+        // Directories are confirmed in the order they were listed
+        let listed: Vec<PathBuf> = operations
+            .into_iter()
+            .filter_map(|operation| match operation {
+                IndexOperation::ConfirmDir { path, .. } => Some(path),
+                _ => None,
+            })
+            .collect();
+        let position = |path: PathBuf| listed.iter().position(|p| *p == path).unwrap();
+        assert_eq!(listed[..4], [root.to_path_buf(), root.join("z"), root.join("z/deep"), root.join("z/deep/hot")]);
+
+        // Then shallow before deep
+        assert!(position(root.join("c")) < position(root.join("a/sub")));
+    }
+
+    #[test]
+    fn test_scan_priorities_rank() {
+        let priorities = ScanPriorities::new([PathBuf::from("/home/user/docs/notes.txt")]);
+        let now = SystemTime::now();
+        let old = Some(now - Duration::from_secs(365 * 24 * 60 * 60));
+
+        let hot = priorities.rank(Path::new("/home/user/docs"), 2, old);
+        let ancestor = priorities.rank(Path::new("/home/user"), 1, old);
+        let recent = priorities.rank(Path::new("/home/user/src"), 2, Some(now));
+        let shallow = priorities.rank(Path::new("/home/user/music"), 1, old);
+        let deep = priorities.rank(Path::new("/home/user/music/a/b/c"), 4, old);
+        let deeper = priorities.rank(Path::new("/home/user/music/a/b/c/d/e"), 6, None);
+
+        assert!(hot > recent && ancestor > recent);
+        assert!(recent > shallow);
+        assert!(shallow > deep);
+        assert_eq!(deep, deeper);
+    }
+
+    #[test]
+    fn test_batches_grow_to_batch_size() {
+        let (sender, receiver) = mpsc::sync_channel(16);
+        let mut out = BatchSender::new(sender, 100);
+        for i in 0..400 {
+            out.push_operation(IndexOperation::Delete(PathBuf::from(format!("/f{}", i))));
+        }
+        out.flush();
+        drop(out);
+
+        let sizes: Vec<usize> = receiver.into_iter().map(|batch| batch.len()).collect();
+        assert_eq!(sizes, [16, 32, 64, 100, 100, 88]);
+    }
+
+    #[test]
+    fn test_parallel_scan_progress() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+        let snapshot = DirectorySnapshot::default();
+        let paths = collect_paths(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 4, &snapshot, out);
+        });
+
+        let progress = scanner.get_progress();
+        assert_eq!(progress.files_scanned + progress.directories_scanned, paths.len());
+        assert_eq!(progress.errors_encountered, 0);
+        assert!(progress.current_path.is_some());
+    }
+
+    #[test]
+    fn test_scan_batches_respects_batch_size() {
+        let temp_dir = TempDir::new().unwrap();
+        for i in 0..25 {
+            fs::write(temp_dir.path().join(format!("file{}.txt", i)), "content").unwrap();
+        }
+
+        let (scanner, _) = parallel_test_setup(temp_dir.path());
+        let (sender, receiver) = mpsc::sync_channel(1);
+
+        let batches: Vec<Vec<IndexOperation>> = std::thread::scope(|scope| {
+            scope.spawn(|| scanner.scan_batches(10, sender));
+            receiver.into_iter().collect()
+        });
+
+        assert!(batches.iter().all(|batch| !batch.is_empty() && batch.len() <= 10));
+
+        let added = batches
+            .iter()
+            .flatten()
+            .filter(|op| matches!(op, IndexOperation::Add(_)))
+            .count();
+        assert!(added >= 26); // 25 files plus the root, plus any application entries
+    }
+
+    #[test]
+    fn test_scan_batches_stops_when_receiver_dropped() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+        let snapshot = DirectorySnapshot::default();
+
+        for threads in [1, 4] {
+            let (sender, receiver) = mpsc::sync_channel(1);
+            drop(receiver);
+
+            let mut out = BatchSender::new(sender, 1);
+            assert!(!scanner.walk_directory(temp_dir.path(), &patterns, threads, &snapshot, &mut out));
+        }
+    }
+
+    #[test]
+    fn test_full_scan_records_directories() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+        let operations = collect_operations(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 1, &DirectorySnapshot::default(), out);
+        });
+
+        let snapshot = snapshot_from(&operations);
+        assert_eq!(snapshot.len(), 4); // root, documents, projects, projects/rust
+        assert!(snapshot.dirs.contains_key(&temp_dir.path().join("projects/rust")));
+        assert!(!snapshot.dirs.contains_key(&temp_dir.path().join("node_modules")));
+
+        // Every listed directory is pruned before its modification time is recorded
+        let prune = operations.iter().position(|op| {
+            matches!(op, IndexOperation::PruneDir { path, .. } if path == &temp_dir.path().join("documents"))
+        });
+        let confirm = operations.iter().position(|op| {
+            matches!(op, IndexOperation::ConfirmDir { path, .. } if path == &temp_dir.path().join("documents"))
+        });
+        assert!(prune.unwrap() < confirm.unwrap());
+    }
+
+    #[test]
+    fn test_reconcile_skips_unchanged_directories() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+        let first = collect_operations(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 1, &DirectorySnapshot::default(), out);
+        });
+        let snapshot = snapshot_from(&first);
+
+        let second = collect_operations(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 1, &snapshot, out);
+        });
+
+        // Only the root entry is re-emitted; nothing was listed
+        assert_eq!(second.len(), 1);
+        assert!(matches!(&second[0], IndexOperation::Add(entry) if entry.path == temp_dir.path()));
+        assert!(snapshot.unvisited_roots().is_empty());
+    }
+
+    #[test]
+    fn test_reconcile_after_interrupted_scan() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+
+        // The index stops receiving right after the root's listing is recorded
+        let root = temp_dir.path().to_path_buf();
+        let (sender, receiver) = mpsc::sync_channel(0);
+        let first: Vec<IndexOperation> = std::thread::scope(|scope| {
+            let handle = scope.spawn(|| {
+                let mut out = BatchSender::new(sender, 1);
+                scanner.walk_directory(&root, &patterns, 1, &DirectorySnapshot::default(), &mut out)
+            });
+
+            let mut received = Vec::new();
+            for batch in receiver.iter() {
+                let done = batch.iter().any(|op| matches!(op, IndexOperation::ConfirmDir { path, .. } if *path == root));
+                received.extend(batch);
+                if done {
+                    break;
+                }
+            }
+            drop(receiver);
+            assert!(!handle.join().unwrap());
+            received
+        });
+        let snapshot = snapshot_from(&first);
+        assert_eq!(snapshot.len(), 1);
+
+        // Subdirectories the scan never listed are listed now, though the root is unchanged
+        let added: Vec<PathBuf> = collect_paths(|out| {
+            scanner.walk_directory(&root, &patterns, 1, &snapshot, out);
+        });
+        assert!(added.contains(&root.join("projects/rust/main.rs")));
+        assert!(added.contains(&root.join("documents/file1.txt")));
+        assert!(!added.contains(&root.join("readme.txt")));
+    }
+
+    #[test]
+    fn test_reconcile_detects_changes() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+        let first = collect_operations(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 1, &DirectorySnapshot::default(), out);
+        });
+        let snapshot = snapshot_from(&first);
+
+        fs::write(temp_dir.path().join("documents/file3.txt"), "content 3").unwrap();
+        fs::remove_dir_all(temp_dir.path().join("projects/rust")).unwrap();
+
+        let operations = collect_operations(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 4, &snapshot, out);
+        });
+
+        let added: Vec<&Path> = operations
+            .iter()
+            .filter_map(|op| match op {
+                IndexOperation::Add(entry) => Some(entry.path.as_path()),
+                _ => None,
+            })
+            .collect();
+        assert!(added.contains(&temp_dir.path().join("documents/file3.txt").as_path()));
+        assert!(!added.contains(&temp_dir.path().join("readme.txt").as_path()));
+
+        let pruned_projects = operations.iter().any(|op| match op {
+            IndexOperation::PruneDir { path, keep } => {
+                path == &temp_dir.path().join("projects") && !keep.contains("rust")
+            }
+            _ => false,
+        });
+        assert!(pruned_projects);
+
+        // The removed directory was never reached and is reported as stale
+        assert_eq!(snapshot.unvisited_roots(), vec![temp_dir.path().join("projects/rust")]);
+    }
+
+    #[test]
+    fn test_reconcile_removes_newly_excluded_directories() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+        let first = collect_operations(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 1, &DirectorySnapshot::default(), out);
+        });
+        let snapshot = snapshot_from(&first);
+
+        let patterns = ExcludeMatcher::new(&[
+            ".*".to_string(),
+            "node_modules".to_string(),
+            "projects".to_string(),
+        ]);
+        collect_operations(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 1, &snapshot, out);
+        });
+
+        assert_eq!(snapshot.unvisited_roots(), vec![temp_dir.path().join("projects")]);
+    }
+
+    #[test]
+    fn test_rescan_lists_dirty_directories_again() {
+        let temp_dir = TempDir::new().unwrap();
+        create_test_directory_structure(temp_dir.path());
+
+        let (scanner, patterns) = parallel_test_setup(temp_dir.path());
+        let first = collect_operations(|out| {
+            scanner.walk_directory(temp_dir.path(), &patterns, 1, &DirectorySnapshot::default(), out);
+        });
+        let mut snapshot = snapshot_from(&first);
+
+        // Rewriting a file leaves its directory's modification time alone
+        let documents = temp_dir.path().join("documents");
+        let missing = temp_dir.path().join("projects/gone");
+        fs::write(documents.join("file1.txt"), "rewritten").unwrap();
+        snapshot.invalidate(&documents);
+
+        let roots = vec![documents.clone(), missing.clone(), PathBuf::from("/outside/include")];
+        let (sender, receiver) = mpsc::sync_channel(2);
+        let operations: Vec<IndexOperation> = std::thread::scope(|scope| {
+            scope.spawn(|| scanner.rescan_batches(&roots, 8, sender, &snapshot));
+            receiver.into_iter().flatten().collect()
+        });
+
+        let added: Vec<&Path> = operations
+            .iter()
+            .filter_map(|op| match op {
+                IndexOperation::Add(entry) => Some(entry.path.as_path()),
+                _ => None,
+            })
+            .collect();
+        assert!(added.contains(&documents.join("file1.txt").as_path()));
+        assert!(added.iter().all(|path| path.starts_with(&documents)));
+
+        assert!(operations.iter().any(|op| {
+            matches!(op, IndexOperation::ConfirmDir { path, .. } if *path == documents)
+        }));
+        assert!(operations.iter().any(|op| {
+            matches!(op, IndexOperation::DeleteTree(path) if *path == missing)
+        }));
+        assert!(!operations.iter().any(|op| matches!(op, IndexOperation::DeleteTree(path) if path.starts_with("/outside"))));
+    }
 }
@@ -0,0 +1,587 @@
+use crate::models::{AppMetadata, FileEntry, FileType};
+use std::collections::HashMap;
+use std::fs::File;
+use std::io::{self, BufWriter, Write};
+use std::os::fd::AsRawFd;
+use std::path::{Path, PathBuf};
+use std::time::{Duration, UNIX_EPOCH};
+
+/// File magic; the trailing digits are the format version
+///
+/// A snapshot is a read-only image of the index that readers `mmap` and
+/// query in place. All integers are little-endian and every section starts
+/// on an 8-byte boundary:
+///
+/// - header (`HEADER_LEN` bytes, layout below)
+/// - string pool: filenames in entry order, then directory names, then
+///   launcher fields; not NUL-terminated, addressed by offset and length
+/// - directories (`DIR_RECORD_LEN` each): parent index (`NO_PARENT` for the
+///   root), name offset, name length. Parents precede their children; the
+///   root has an empty name, so a path is its ancestors' names joined by `/`.
+/// - entries (`ENTRY_RECORD_LEN` each), sorted by filename with ASCII case
+///   folded, so the pool is sorted too and equal neighbours share their bytes
+/// - trigrams (`TRIGRAM_RECORD_LEN` each), sorted by key: three folded bytes
+///   as `b0 << 16 | b1 << 8 | b2`, first posting, posting count. Launchers
+///   are posted under the trigrams of their name and keywords as well.
+/// - postings: ascending `u32` entry indices for each trigram
+/// - launchers (`APP_RECORD_LEN` each), sorted by entry: the metadata of
+///   entries that are applications
+///
+/// The panel reads this format in panel/src/snapshot.c.
+pub const MAGIC: &[u8; 8] = b"NSSNAP02";
+
+/// Header layout:
+///
+/// | offset | field                                |
+/// |--------|--------------------------------------|
+/// | 0      | magic                                |
+/// | 8      | index generation (`u64`)             |
+/// | 16     | entry, directory, trigram and posting counts (`u32` each) |
+/// | 32     | pool offset, pool size (`u64` each)  |
+/// | 48     | directory, entry, trigram and posting section offsets (`u64` each) |
+/// | 80     | total file size (`u64`)              |
+/// | 88     | launcher count (`u32`), padding      |
+/// | 96     | launcher section offset (`u64`)      |
+pub const HEADER_LEN: usize = 104;
+
+pub const DIR_RECORD_LEN: usize = 12;
+
+/// Entry layout: directory index (`u32`), name offset (`u32`), name length
+/// (`u16`), file type code (`u8`), padding, frecency (`u32`), size
+/// (`u64`), modification time in seconds (`i64`)
+pub const ENTRY_RECORD_LEN: usize = 32;
+
+pub const TRIGRAM_RECORD_LEN: usize = 12;
+
+/// Launcher layout: entry index (`u32`), then offset and length (`u32`
+/// each) of the name, icon, exec line and keywords
+pub const APP_RECORD_LEN: usize = 36;
+
+/// Parent index of the root directory
+pub const NO_PARENT: u32 = u32::MAX;
+
+/// An entry to be written to a snapshot
+#[derive(Debug, Clone)]
+pub struct SnapshotEntry<'a> {
+    pub path: &'a str,
+    pub filename: &'a str,
+    pub file_type: &'a FileType,
+    pub size: u64,
+    pub modified_time: i64,
+    pub frecency: u32,
+    pub app: Option<&'a AppMetadata>,
+}
+
+/// Write a snapshot of `entries` to `path`
+///
+/// The file is written next to `path` and renamed over it, so readers that
+/// have the previous snapshot mapped keep a consistent view. Entries whose
+/// path does not end in `/` and their filename are skipped.
+pub fn write_snapshot<'a, I>(path: &Path, generation: u64, entries: I) -> io::Result<()>
+where
+    I: IntoIterator<Item = SnapshotEntry<'a>>,
+{
+    let mut entries: Vec<(String, SnapshotEntry<'a>)> = entries
+        .into_iter()
+        .filter(|entry| entry_directory(entry).is_some() && entry.filename.len() <= u16::MAX as usize)
+        .map(|entry| (entry.filename.to_ascii_lowercase(), entry))
+        .collect();
+    entries.sort_unstable_by(|a, b| {
+        (a.0.as_str(), a.1.filename, a.1.path).cmp(&(b.0.as_str(), b.1.filename, b.1.path))
+    });
+
+    // Filenames in entry order, sharing the bytes of equal neighbours
+    let mut pool = Vec::new();
+    let mut name_refs = Vec::with_capacity(entries.len());
+    let mut previous: Option<&str> = None;
+    let mut name_offset = 0u32;
+    for (_, entry) in &entries {
+        if previous != Some(entry.filename) {
+            name_offset = pool.len() as u32;
+            pool.extend_from_slice(entry.filename.as_bytes());
+            previous = Some(entry.filename);
+        }
+        name_refs.push((name_offset, entry.filename.len() as u16));
+    }
+
+    // Directories, each after its parent
+    let mut dirs: Vec<(u32, u32, u32)> = Vec::new();
+    let mut dir_ids: HashMap<&str, u32> = HashMap::new();
+    let mut entry_dirs = Vec::with_capacity(entries.len());
+    for (_, entry) in &entries {
+        let dir = entry_directory(entry).unwrap();
+        entry_dirs.push(intern_directory(dir, &mut dir_ids, &mut dirs, &mut pool));
+    }
+
+    // Launchers in entry order, each field a pool reference
+    let mut apps: Vec<(u32, [(u32, u32); 4])> = Vec::new();
+    for (index, (_, entry)) in entries.iter().enumerate() {
+        if let Some(app) = entry.app {
+            let mut fields = [(0, 0); 4];
+            for (field, text) in fields.iter_mut().zip([&app.name, &app.icon, &app.exec, &app.keywords]) {
+                *field = (pool.len() as u32, text.len() as u32);
+                pool.extend_from_slice(text.as_bytes());
+            }
+            apps.push((index as u32, fields));
+        }
+    }
+
+    // Postings are pushed in entry order, so each list is ascending
+    let mut postings_by_key: HashMap<u32, Vec<u32>> = HashMap::new();
+    for (index, (folded, entry)) in entries.iter().enumerate() {
+        let launcher = entry.app.map(|app| [app.name.to_ascii_lowercase(), app.keywords.to_ascii_lowercase()]);
+        let texts = std::iter::once(folded.as_str()).chain(launcher.iter().flatten().map(String::as_str));
+        for text in texts {
+            for window in text.as_bytes().windows(3) {
+                let key = (window[0] as u32) << 16 | (window[1] as u32) << 8 | window[2] as u32;
+                let postings = postings_by_key.entry(key).or_default();
+                if postings.last() != Some(&(index as u32)) {
+                    postings.push(index as u32);
+                }
+            }
+        }
+    }
+    let mut keys: Vec<u32> = postings_by_key.keys().copied().collect();
+    keys.sort_unstable();
+    let posting_count: usize = postings_by_key.values().map(Vec::len).sum();
+
+    let pool_offset = HEADER_LEN;
+    let dirs_offset = align(pool_offset + pool.len());
+    let entries_offset = align(dirs_offset + dirs.len() * DIR_RECORD_LEN);
+    let trigrams_offset = align(entries_offset + entries.len() * ENTRY_RECORD_LEN);
+    let postings_offset = align(trigrams_offset + keys.len() * TRIGRAM_RECORD_LEN);
+    let apps_offset = align(postings_offset + posting_count * 4);
+    let file_size = apps_offset + apps.len() * APP_RECORD_LEN;
+
+    let temp_path = temp_path_for(path);
+    let mut out = BufWriter::new(File::create(&temp_path)?);
+
+    out.write_all(MAGIC)?;
+    out.write_all(&generation.to_le_bytes())?;
+    for count in [entries.len(), dirs.len(), keys.len(), posting_count] {
+        out.write_all(&(count as u32).to_le_bytes())?;
+    }
+    for value in [pool_offset, pool.len(), dirs_offset, entries_offset, trigrams_offset, postings_offset, file_size] {
+        out.write_all(&(value as u64).to_le_bytes())?;
+    }
+    out.write_all(&(apps.len() as u32).to_le_bytes())?;
+    pad_to(&mut out, 92, 96)?;
+    out.write_all(&(apps_offset as u64).to_le_bytes())?;
+
+    out.write_all(&pool)?;
+    pad_to(&mut out, pool_offset + pool.len(), dirs_offset)?;
+
+    for &(parent, name_offset, name_len) in &dirs {
+        for value in [parent, name_offset, name_len] {
+            out.write_all(&value.to_le_bytes())?;
+        }
+    }
+    pad_to(&mut out, dirs_offset + dirs.len() * DIR_RECORD_LEN, entries_offset)?;
+
+    for (((_, entry), &(name_offset, name_len)), &dir) in entries.iter().zip(&name_refs).zip(&entry_dirs) {
+        out.write_all(&dir.to_le_bytes())?;
+        out.write_all(&name_offset.to_le_bytes())?;
+        out.write_all(&name_len.to_le_bytes())?;
+        out.write_all(&[entry.file_type.as_code(), 0])?;
+        out.write_all(&entry.frecency.to_le_bytes())?;
+        out.write_all(&entry.size.to_le_bytes())?;
+        out.write_all(&entry.modified_time.to_le_bytes())?;
+    }
+    pad_to(&mut out, entries_offset + entries.len() * ENTRY_RECORD_LEN, trigrams_offset)?;
+
+    let mut first_posting = 0u32;
+    for key in &keys {
+        let count = postings_by_key[key].len() as u32;
+        for value in [*key, first_posting, count] {
+            out.write_all(&value.to_le_bytes())?;
+        }
+        first_posting += count;
+    }
+    pad_to(&mut out, trigrams_offset + keys.len() * TRIGRAM_RECORD_LEN, postings_offset)?;
+
+    for key in &keys {
+        for index in &postings_by_key[key] {
+            out.write_all(&index.to_le_bytes())?;
+        }
+    }
+    pad_to(&mut out, postings_offset + posting_count * 4, apps_offset)?;
+
+    for (index, fields) in &apps {
+        out.write_all(&index.to_le_bytes())?;
+        for (offset, len) in fields {
+            out.write_all(&offset.to_le_bytes())?;
+            out.write_all(&len.to_le_bytes())?;
+        }
+    }
+
+    out.into_inner().map_err(|e| e.into_error())?;
+    std::fs::rename(&temp_path, path)
+}
+
+/// Get the directory part of an entry's path, `""` for the root
+fn entry_directory<'a>(entry: &SnapshotEntry<'a>) -> Option<&'a str> {
+    let dir = entry.path.strip_suffix(entry.filename)?.strip_suffix('/')?;
+    if entry.filename.is_empty() || entry.filename.contains('/') || (!dir.is_empty() && !dir.starts_with('/')) {
+        return None;
+    }
+    Some(dir)
+}
+
+/// Get the index of a directory, adding it and any missing ancestors
+fn intern_directory<'a>(
+    dir: &'a str,
+    dir_ids: &mut HashMap<&'a str, u32>,
+    dirs: &mut Vec<(u32, u32, u32)>,
+    pool: &mut Vec<u8>,
+) -> u32 {
+    if let Some(&id) = dir_ids.get(dir) {
+        return id;
+    }
+
+    // Walk up to the closest known ancestor, then add the missing ones
+    let mut missing = vec![dir];
+    let mut parent = NO_PARENT;
+    let mut current = dir;
+    while !current.is_empty() {
+        current = &current[..current.rfind('/').unwrap()];
+        match dir_ids.get(current) {
+            Some(&id) => {
+                parent = id;
+                break;
+            }
+            None => missing.push(current),
+        }
+    }
+
+    for dir in missing.into_iter().rev() {
+        let name = &dir[dir.rfind('/').map(|i| i + 1).unwrap_or(0)..];
+        let id = dirs.len() as u32;
+        dirs.push((parent, pool.len() as u32, name.len() as u32));
+        pool.extend_from_slice(name.as_bytes());
+        dir_ids.insert(dir, id);
+        parent = id;
+    }
+    parent
+}
+
+fn align(offset: usize) -> usize {
+    (offset + 7) & !7
+}
+
+fn pad_to<W: Write>(out: &mut W, from: usize, to: usize) -> io::Result<()> {
+    out.write_all(&vec![0u8; to - from])
+}
+
+fn temp_path_for(path: &Path) -> PathBuf {
+    let mut name = path.file_name().unwrap_or_default().to_os_string();
+    name.push(".tmp");
+    path.with_file_name(name)
+}
+
+/// A snapshot mapped read-only into memory
+pub struct Snapshot {
+    data: *const u8,
+    len: usize,
+    generation: u64,
+    entry_count: usize,
+    dir_count: usize,
+    app_count: usize,
+    pool: (usize, usize),
+    dirs_offset: usize,
+    entries_offset: usize,
+    apps_offset: usize,
+}
+
+// The mapping is private and never written to
+unsafe impl Send for Snapshot {}
+unsafe impl Sync for Snapshot {}
+
+impl Snapshot {
+    /// Map a snapshot and check that its sections fit the file
+    pub fn open(path: &Path) -> io::Result<Self> {
+        let file = File::open(path)?;
+        let len = file.metadata()?.len() as usize;
+        if len < HEADER_LEN {
+            return Err(invalid("file too short"));
+        }
+
+        let data = unsafe {
+            libc::mmap(std::ptr::null_mut(), len, libc::PROT_READ, libc::MAP_PRIVATE, file.as_raw_fd(), 0)
+        };
+        if data == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+
+        let mut snapshot = Snapshot {
+            data: data as *const u8,
+            len,
+            generation: 0,
+            entry_count: 0,
+            dir_count: 0,
+            app_count: 0,
+            pool: (0, 0),
+            dirs_offset: 0,
+            entries_offset: 0,
+            apps_offset: 0,
+        };
+        snapshot.read_header()?;
+        Ok(snapshot)
+    }
+
+    fn bytes(&self) -> &[u8] {
+        unsafe { std::slice::from_raw_parts(self.data, self.len) }
+    }
+
+    fn read_header(&mut self) -> io::Result<()> {
+        let bytes = self.bytes();
+        if &bytes[..8] != MAGIC {
+            return Err(invalid("not a snapshot of this version"));
+        }
+        let u32_at = |at: usize| u32::from_le_bytes(bytes[at..at + 4].try_into().unwrap()) as usize;
+        let u64_at = |at: usize| u64::from_le_bytes(bytes[at..at + 8].try_into().unwrap());
+
+        let (entry_count, dir_count) = (u32_at(16), u32_at(20));
+        let (pool_offset, pool_size) = (u64_at(32) as usize, u64_at(40) as usize);
+        let (dirs_offset, entries_offset) = (u64_at(48) as usize, u64_at(56) as usize);
+        let (app_count, apps_offset) = (u32_at(88), u64_at(96) as usize);
+
+        let fits = |offset: usize, len: usize| offset.checked_add(len).map_or(false, |end| end <= bytes.len());
+        if u64_at(80) as usize != bytes.len()
+            || !fits(pool_offset, pool_size)
+            || !fits(dirs_offset, dir_count * DIR_RECORD_LEN)
+            || !fits(entries_offset, entry_count * ENTRY_RECORD_LEN)
+            || !fits(apps_offset, app_count * APP_RECORD_LEN)
+        {
+            return Err(invalid("section out of bounds"));
+        }
+
+        self.generation = u64_at(8);
+        self.entry_count = entry_count;
+        self.dir_count = dir_count;
+        self.app_count = app_count;
+        self.pool = (pool_offset, pool_size);
+        self.dirs_offset = dirs_offset;
+        self.entries_offset = entries_offset;
+        self.apps_offset = apps_offset;
+        Ok(())
+    }
+
+    /// Generation of the index the snapshot was taken at
+    pub fn generation(&self) -> u64 {
+        self.generation
+    }
+
+    /// Number of entries held
+    pub fn len(&self) -> usize {
+        self.entry_count
+    }
+
+    fn pool_str(&self, offset: usize, len: usize) -> io::Result<&str> {
+        let (pool_offset, pool_size) = self.pool;
+        if offset.checked_add(len).map_or(true, |end| end > pool_size) {
+            return Err(invalid("name out of bounds"));
+        }
+        let start = pool_offset + offset;
+        std::str::from_utf8(&self.bytes()[start..start + len]).map_err(|_| invalid("name is not UTF-8"))
+    }
+
+    /// Decode every entry, with its full path, launcher metadata and frecency
+    pub fn entries(&self) -> io::Result<Vec<(FileEntry, u32)>> {
+        let bytes = self.bytes();
+        let u32_at = |at: usize| u32::from_le_bytes(bytes[at..at + 4].try_into().unwrap());
+
+        // Parents come first, so each directory's path extends a known one
+        let mut dir_paths: Vec<String> = Vec::with_capacity(self.dir_count);
+        for index in 0..self.dir_count {
+            let record = self.dirs_offset + index * DIR_RECORD_LEN;
+            let name = self.pool_str(u32_at(record + 4) as usize, u32_at(record + 8) as usize)?;
+            let path = match u32_at(record) {
+                NO_PARENT => name.to_string(),
+                parent if (parent as usize) < index => format!("{}/{}", dir_paths[parent as usize], name),
+                _ => return Err(invalid("directory precedes its parent")),
+            };
+            dir_paths.push(path);
+        }
+
+        let mut entries = Vec::with_capacity(self.entry_count);
+        for index in 0..self.entry_count {
+            let record = &bytes[self.entries_offset + index * ENTRY_RECORD_LEN..][..ENTRY_RECORD_LEN];
+            let field = |at: usize| u32::from_le_bytes(record[at..at + 4].try_into().unwrap()) as usize;
+            let dir = dir_paths.get(field(0)).ok_or_else(|| invalid("directory out of bounds"))?;
+            let name_len = u16::from_le_bytes([record[8], record[9]]) as usize;
+            let filename = self.pool_str(field(4), name_len)?;
+            let size = u64::from_le_bytes(record[16..24].try_into().unwrap());
+            let modified_time = i64::from_le_bytes(record[24..32].try_into().unwrap());
+
+            let mut entry = FileEntry::new(
+                filename.to_string(),
+                PathBuf::from(format!("{}/{}", dir, filename)),
+                size,
+                UNIX_EPOCH + Duration::from_secs(modified_time.max(0) as u64),
+                FileType::from_code(record[10]),
+            );
+            entry.indexed_time = entry.modified_time;
+            entries.push((entry, field(12) as u32));
+        }
+
+        for index in 0..self.app_count {
+            let record = self.apps_offset + index * APP_RECORD_LEN;
+            let text = |field: usize| {
+                let at = record + 4 + field * 8;
+                self.pool_str(u32_at(at) as usize, u32_at(at + 4) as usize).map(str::to_string)
+            };
+            let (entry, _) = entries
+                .get_mut(u32_at(record) as usize)
+                .ok_or_else(|| invalid("launcher out of bounds"))?;
+            entry.app = Some(AppMetadata { name: text(0)?, icon: text(1)?, exec: text(2)?, keywords: text(3)? });
+        }
+        Ok(entries)
+    }
+}
+
+impl Drop for Snapshot {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.data as *mut libc::c_void, self.len);
+        }
+    }
+}
+
+fn invalid(message: &str) -> io::Error {
+    io::Error::new(io::ErrorKind::InvalidData, message)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tempfile::TempDir;
+
+    fn entry<'a>(path: &'a str, file_type: &'a FileType, frecency: u32) -> SnapshotEntry<'a> {
+        SnapshotEntry {
+            path,
+            filename: &path[path.rfind('/').unwrap() + 1..],
+            file_type,
+            size: path.len() as u64,
+            modified_time: 1_700_000_000,
+            frecency,
+            app: None,
+        }
+    }
+
+    #[test]
+    fn test_snapshot_round_trip() {
+        let dir = TempDir::new().unwrap();
+        let path = dir.path().join("index.snap");
+        let regular = FileType::Regular;
+        let directory = FileType::Directory;
+
+        write_snapshot(&path, 42, [
+            entry("/home/user/notes.txt", &regular, 3),
+            entry("/home/user/projects", &directory, 0),
+            entry("/home/user/projects/Notes.txt", &regular, 0),
+            entry("/top-level", &regular, 0),
+            entry("relative/skipped", &regular, 0),
+        ]).unwrap();
+        assert!(!dir.path().join("index.snap.tmp").exists());
+
+        let snapshot = Snapshot::open(&path).unwrap();
+        assert_eq!(snapshot.generation(), 42);
+        assert_eq!(snapshot.len(), 4);
+
+        let entries = snapshot.entries().unwrap();
+        let decoded: Vec<(&str, &str, FileType, u32)> = entries
+            .iter()
+            .map(|(e, frecency)| (e.path.to_str().unwrap(), e.filename.as_str(), e.file_type.clone(), *frecency))
+            .collect();
+
+        // Sorted by folded filename, then filename, then path
+        assert_eq!(decoded, vec![
+            ("/home/user/projects/Notes.txt", "Notes.txt", FileType::Regular, 0),
+            ("/home/user/notes.txt", "notes.txt", FileType::Regular, 3),
+            ("/home/user/projects", "projects", FileType::Directory, 0),
+            ("/top-level", "top-level", FileType::Regular, 0),
+        ]);
+        assert_eq!(entries[1].0.size, "/home/user/notes.txt".len() as u64);
+        assert_eq!(entries[1].0.modified_time, UNIX_EPOCH + Duration::from_secs(1_700_000_000));
+        assert!(entries.iter().all(|(e, _)| e.app.is_none()));
+    }
+
+    #[test]
+    fn test_snapshot_launchers() {
+        let dir = TempDir::new().unwrap();
+        let path = dir.path().join("index.snap");
+        let regular = FileType::Regular;
+        let firefox = AppMetadata {
+            name: "Firefox".to_string(),
+            icon: "firefox".to_string(),
+            exec: "firefox %u".to_string(),
+            keywords: "web;browser;".to_string(),
+        };
+        let mut launcher = entry("/usr/share/applications/firefox.desktop", &regular, 0);
+        launcher.app = Some(&firefox);
+        write_snapshot(&path, 1, [launcher, entry("/home/user/notes.txt", &regular, 0)]).unwrap();
+
+        let snapshot = Snapshot::open(&path).unwrap();
+        let entries = snapshot.entries().unwrap();
+        assert_eq!(entries[0].0.app.as_ref(), Some(&firefox));
+        assert!(entries[1].0.app.is_none());
+
+        // The launcher is posted under the trigrams of its keywords
+        let bytes = std::fs::read(&path).unwrap();
+        let u32_at = |at: usize| u32::from_le_bytes(bytes[at..at + 4].try_into().unwrap());
+        let u64_at = |at: usize| u64::from_le_bytes(bytes[at..at + 8].try_into().unwrap()) as usize;
+        let key = (b'b' as u32) << 16 | (b'r' as u32) << 8 | b'o' as u32;
+        let trigrams = u64_at(64);
+        let record = (0..u32_at(24) as usize)
+            .map(|i| trigrams + i * TRIGRAM_RECORD_LEN)
+            .find(|&record| u32_at(record) == key)
+            .unwrap();
+        assert_eq!(u32_at(record + 8), 1);
+        assert_eq!(u32_at(u64_at(72) + u32_at(record + 4) as usize * 4), 0);
+    }
+
+    #[test]
+    fn test_snapshot_trigrams() {
+        let dir = TempDir::new().unwrap();
+        let path = dir.path().join("index.snap");
+        let regular = FileType::Regular;
+        write_snapshot(&path, 1, [
+            entry("/a/abcd", &regular, 0),
+            entry("/a/xbcd", &regular, 0),
+        ]).unwrap();
+
+        let bytes = std::fs::read(&path).unwrap();
+        let u32_at = |at: usize| u32::from_le_bytes(bytes[at..at + 4].try_into().unwrap());
+        let u64_at = |at: usize| u64::from_le_bytes(bytes[at..at + 8].try_into().unwrap()) as usize;
+
+        // abc, bcd, xbc; bcd is shared by both entries
+        assert_eq!(u32_at(24), 3);
+        assert_eq!(u32_at(28), 4);
+        let trigrams = u64_at(64);
+        let postings = u64_at(72);
+        let key = |s: &[u8]| (s[0] as u32) << 16 | (s[1] as u32) << 8 | s[2] as u32;
+        assert_eq!(u32_at(trigrams), key(b"abc"));
+        assert_eq!(u32_at(trigrams + 12), key(b"bcd"));
+        assert_eq!((u32_at(trigrams + 16), u32_at(trigrams + 20)), (1, 2));
+        assert_eq!((u32_at(postings + 4), u32_at(postings + 8)), (0, 1));
+        assert_eq!(bytes.len(), postings + 16);
+    }
+
+    #[test]
+    fn test_snapshot_rejects_invalid_files() {
+        let dir = TempDir::new().unwrap();
+        let path = dir.path().join("index.snap");
+
+        std::fs::write(&path, b"NSSNAP00").unwrap();
+        assert!(Snapshot::open(&path).is_err());
+
+        let mut header = vec![0u8; HEADER_LEN];
+        header[..8].copy_from_slice(MAGIC);
+        header[16..20].copy_from_slice(&10u32.to_le_bytes());
+        header[80..88].copy_from_slice(&(HEADER_LEN as u64).to_le_bytes());
+        std::fs::write(&path, &header).unwrap();
+        assert!(Snapshot::open(&path).is_err());
+
+        assert!(Snapshot::open(&dir.path().join("missing.snap")).is_err());
+    }
+}
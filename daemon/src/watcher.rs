@@ -1,16 +1,22 @@
 use crate::config::Config;
+use crate::exclude::{ExcludeMatcher, SharedExcludeMatcher};
+use crate::fanotify::FanotifyWatcher;
+use crate::metrics::METRICS;
 use crate::models::{FileEntry, FileType, IndexOperation};
+use crate::scanner::build_file_entry;
+use notify::event::{ModifyKind, RenameMode};
 use notify::{Event, EventKind, RecommendedWatcher, RecursiveMode, Watcher};
-use std::collections::{HashMap, VecDeque};
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, HashMap, HashSet, VecDeque};
 use std::path::{Path, PathBuf};
-use std::sync::mpsc::{channel, Receiver, Sender};
-use std::time::{Duration, Instant, SystemTime};
-use glob::Pattern;
+use std::sync::Arc;
+use std::time::{Duration, Instant};
+use tokio::sync::mpsc::{unbounded_channel, UnboundedReceiver, UnboundedSender};
 
 /// Filesystem watcher that monitors directories for changes
 pub struct FilesystemWatcher {
-    watcher: RecommendedWatcher,
-    event_receiver: Receiver<FilesystemEvent>,
+    backend: WatchBackend,
+    event_receiver: UnboundedReceiver<FilesystemEvent>,
     watched_paths: Vec<PathBuf>,
 }
 
@@ -21,18 +27,64 @@ pub enum FilesystemEvent {
     Modified(PathBuf),
     Deleted(PathBuf),
     Moved { from: PathBuf, to: PathBuf },
+    /// Events were lost (e.g. the kernel queue overflowed) and these paths,
+    /// or every watched path when empty, must be rescanned
+    Rescan(Vec<PathBuf>),
+}
+
+impl FilesystemEvent {
+    /// Classify a rename given each end, or `None` for an end that is
+    /// excluded or outside the watched paths
+    ///
+    /// Moving into or out of an ignored location is a deletion or a creation.
+    pub(crate) fn from_move(from: Option<PathBuf>, to: Option<PathBuf>) -> Option<Self> {
+        match (from, to) {
+            (Some(from), Some(to)) => Some(FilesystemEvent::Moved { from, to }),
+            (Some(from), None) => Some(FilesystemEvent::Deleted(from)),
+            (None, Some(to)) => Some(FilesystemEvent::Created(to)),
+            (None, None) => None,
+        }
+    }
+}
+
+/// Source of filesystem events
+enum WatchBackend {
+    /// Recursive inotify watches through notify
+    Notify(RecommendedWatcher),
+    /// Whole-filesystem fanotify marks
+    Fanotify(FanotifyWatcher),
 }
 
 impl FilesystemWatcher {
     /// Create a new filesystem watcher
     pub fn new(config: &Config) -> Result<Self, WatcherError> {
-        let (event_sender, event_receiver) = channel();
+        let exclude = SharedExcludeMatcher::new(ExcludeMatcher::from_config(config));
+        Self::with_exclude_matcher(config, Arc::new(exclude))
+    }
+
+    /// Create a new filesystem watcher that shares an already compiled exclusion matcher
+    ///
+    /// Every event is filtered with the matcher current at the time, so
+    /// replacing it takes effect without watching again. The backend follows
+    /// `indexing.watch_backend`; "auto" falls back to notify when fanotify is
+    /// unavailable or not permitted.
+    pub fn with_exclude_matcher(config: &Config, exclude: Arc<SharedExcludeMatcher>) -> Result<Self, WatcherError> {
+        let (event_sender, event_receiver) = unbounded_channel();
         
-        // Create the notify watcher with event handler
-        let watcher = Self::create_watcher(event_sender, config)?;
+        let backend = match config.indexing.watch_backend.to_lowercase().as_str() {
+            "fanotify" => WatchBackend::Fanotify(FanotifyWatcher::new(event_sender, exclude)?),
+            "auto" => match FanotifyWatcher::new(event_sender.clone(), Arc::clone(&exclude)) {
+                Ok(watcher) => WatchBackend::Fanotify(watcher),
+                Err(e) => {
+                    eprintln!("fanotify unavailable ({}), watching with notify", e);
+                    WatchBackend::Notify(Self::create_watcher(event_sender, exclude)?)
+                }
+            },
+            _ => WatchBackend::Notify(Self::create_watcher(event_sender, exclude)?),
+        };
         
         Ok(FilesystemWatcher {
-            watcher,
+            backend,
             event_receiver,
             watched_paths: Vec::new(),
         })
@@ -40,16 +92,14 @@ impl FilesystemWatcher {
     
     /// Create the underlying notify watcher
     fn create_watcher(
-        event_sender: Sender<FilesystemEvent>,
-        config: &Config,
+        event_sender: UnboundedSender<FilesystemEvent>,
+        exclude: Arc<SharedExcludeMatcher>,
     ) -> Result<RecommendedWatcher, WatcherError> {
-        let exclude_patterns = config.indexing.exclude_patterns.clone();
-        
         let watcher = notify::recommended_watcher(move |res: Result<Event, notify::Error>| {
             match res {
                 Ok(event) => {
                     // Convert notify events to our FilesystemEvent type
-                    if let Some(fs_event) = Self::convert_event(event, &exclude_patterns) {
+                    if let Some(fs_event) = Self::convert_event(event, &exclude.current()) {
                         let _ = event_sender.send(fs_event);
                     }
                 }
@@ -64,78 +114,82 @@ impl FilesystemWatcher {
     }
     
     /// Convert notify Event to FilesystemEvent, applying filters
-    fn convert_event(event: Event, exclude_patterns: &[String]) -> Option<FilesystemEvent> {
+    fn convert_event(event: Event, exclude: &ExcludeMatcher) -> Option<FilesystemEvent> {
+        if event.need_rescan() {
+            return Some(FilesystemEvent::Rescan(event.paths));
+        }
+        
+        // A rename reports both ends; moving into or out of an excluded
+        // location is a deletion or a creation
+        if let EventKind::Modify(ModifyKind::Name(RenameMode::Both)) = event.kind {
+            let [from, to] = <[PathBuf; 2]>::try_from(event.paths).ok()?;
+            let visible = |path: PathBuf| Some(path).filter(|p| !Self::should_exclude(p, exclude));
+            return FilesystemEvent::from_move(visible(from), visible(to));
+        }
+        
         // Filter out events for excluded paths
-        for path in &event.paths {
-            if Self::should_exclude(path, exclude_patterns) {
-                return None;
-            }
+        if event.paths.iter().any(|path| Self::should_exclude(path, exclude)) {
+            return None;
         }
         
+        let path = event.paths.into_iter().next()?;
         match event.kind {
-            EventKind::Create(_) => {
-                if let Some(path) = event.paths.first() {
-                    Some(FilesystemEvent::Created(path.clone()))
-                } else {
-                    None
-                }
-            }
-            EventKind::Modify(_) => {
-                if let Some(path) = event.paths.first() {
-                    Some(FilesystemEvent::Modified(path.clone()))
-                } else {
-                    None
-                }
-            }
-            EventKind::Remove(_) => {
-                if let Some(path) = event.paths.first() {
-                    Some(FilesystemEvent::Deleted(path.clone()))
+            EventKind::Create(_) => Some(FilesystemEvent::Created(path)),
+            // Each half of a rename is reported first on its own. Until the
+            // other half arrives the source looks deleted and the destination
+            // created; the paired event then turns them into one move.
+            EventKind::Modify(ModifyKind::Name(RenameMode::From)) => Some(FilesystemEvent::Deleted(path)),
+            EventKind::Modify(ModifyKind::Name(RenameMode::To)) => Some(FilesystemEvent::Created(path)),
+            EventKind::Modify(ModifyKind::Name(_)) => {
+                // Backends that cannot tell which end this is
+                if path.symlink_metadata().is_ok() {
+                    Some(FilesystemEvent::Created(path))
                 } else {
-                    None
+                    Some(FilesystemEvent::Deleted(path))
                 }
             }
+            EventKind::Modify(_) => Some(FilesystemEvent::Modified(path)),
+            EventKind::Remove(_) => Some(FilesystemEvent::Deleted(path)),
             EventKind::Access(_) => None, // Ignore access events
             EventKind::Any | EventKind::Other => None,
         }
     }
     
-    /// Check if a path should be excluded based on patterns
-    fn should_exclude(path: &Path, exclude_patterns: &[String]) -> bool {
-        for pattern_str in exclude_patterns {
-            // Check if any component of the path matches the pattern
-            for component in path.components() {
-                let component_str = component.as_os_str().to_string_lossy();
-                
-                // Try glob pattern matching
-                if let Ok(pattern) = Pattern::new(pattern_str) {
-                    if pattern.matches(&component_str) {
-                        return true;
-                    }
-                }
-                
-                // Also do simple string matching for patterns like ".*" (hidden files)
-                if pattern_str.starts_with(".*") && component_str.starts_with('.') {
-                    return true;
-                }
-            }
-        }
-        
-        false
+    /// Check if any component of a path matches an exclusion pattern
+    fn should_exclude(path: &Path, exclude: &ExcludeMatcher) -> bool {
+        exclude.is_excluded_path(path)
     }
     
     /// Watch a directory recursively
     pub fn watch_path<P: AsRef<Path>>(&mut self, path: P) -> Result<(), WatcherError> {
         let path = path.as_ref();
         
-        self.watcher
-            .watch(path, RecursiveMode::Recursive)
-            .map_err(|e| WatcherError::WatchError(format!("Failed to watch {:?}: {}", path, e)))?;
+        match &mut self.backend {
+            WatchBackend::Notify(watcher) => watcher
+                .watch(path, RecursiveMode::Recursive)
+                .map_err(|e| WatcherError::WatchError(format!("Failed to watch {:?}: {}", path, e)))?,
+            WatchBackend::Fanotify(watcher) => watcher.watch(path)?,
+        }
         
         self.watched_paths.push(path.to_path_buf());
         
         Ok(())
     }
     
+    /// Stop reporting events below a path passed to `watch_path`
+    pub fn unwatch_path(&mut self, path: &Path) -> Result<(), WatcherError> {
+        match &mut self.backend {
+            WatchBackend::Notify(watcher) => watcher
+                .unwatch(path)
+                .map_err(|e| WatcherError::WatchError(format!("Failed to unwatch {:?}: {}", path, e)))?,
+            WatchBackend::Fanotify(watcher) => watcher.unwatch(path),
+        }
+
+        self.watched_paths.retain(|watched| watched != path);
+
+        Ok(())
+    }
+    
     /// Watch multiple directories
     pub fn watch_paths(&mut self, paths: &[PathBuf]) -> Vec<WatcherError> {
         let mut errors = Vec::new();
@@ -151,13 +205,39 @@ impl FilesystemWatcher {
     }
     
     /// Receive the next filesystem event (non-blocking)
-    pub fn try_recv_event(&self) -> Option<FilesystemEvent> {
+    pub fn try_recv_event(&mut self) -> Option<FilesystemEvent> {
         self.event_receiver.try_recv().ok()
     }
     
-    /// Receive the next filesystem event (blocking)
-    pub fn recv_event(&self) -> Option<FilesystemEvent> {
-        self.event_receiver.recv().ok()
+    /// Wait for the next filesystem event
+    ///
+    /// Returns `None` once the underlying watcher has shut down.
+    pub async fn recv_event(&mut self) -> Option<FilesystemEvent> {
+        self.event_receiver.recv().await
+    }
+    
+    /// Wait for at least one filesystem event, then take every event already
+    /// queued behind it, up to `limit` in total
+    ///
+    /// Returns the number of events appended to `events`; 0 means the
+    /// underlying watcher has shut down.
+    pub async fn recv_events(&mut self, events: &mut Vec<FilesystemEvent>, limit: usize) -> usize {
+        let Some(first) = self.event_receiver.recv().await else {
+            return 0;
+        };
+        events.push(first);
+        
+        let mut received = 1;
+        while received < limit {
+            match self.event_receiver.try_recv() {
+                Ok(event) => {
+                    events.push(event);
+                    received += 1;
+                }
+                Err(_) => break,
+            }
+        }
+        received
     }
     
     /// Get list of watched paths
@@ -167,11 +247,28 @@ impl FilesystemWatcher {
 }
 
 /// Event processor that handles debouncing and converts events to IndexOperations
+///
+/// Each path has at most one pending event, which becomes ready once no new
+/// event has arrived for it within the debounce duration. Deadlines are kept
+/// in a min-heap; an entry whose sequence number no longer matches the
+/// pending event was superseded and is skipped when it reaches the top.
 pub struct EventProcessor {
-    pending_events: HashMap<PathBuf, (FilesystemEvent, Instant)>,
+    pending_events: HashMap<PathBuf, PendingEvent>,
+    deadlines: BinaryHeap<Reverse<(Instant, u64, PathBuf)>>,
+    next_sequence: u64,
     debounce_duration: Duration,
     operation_queue: VecDeque<IndexOperation>,
     max_queue_size: usize,
+    /// Directories whose changes could not be queued and must be rescanned
+    dirty_dirs: HashSet<PathBuf>,
+    /// Set when events were lost without knowing where
+    rescan_all: bool,
+}
+
+/// The coalesced event waiting for a path
+struct PendingEvent {
+    event: FilesystemEvent,
+    sequence: u64,
 }
 
 impl EventProcessor {
@@ -179,42 +276,167 @@ impl EventProcessor {
     pub fn new(debounce_duration: Duration, max_queue_size: usize) -> Self {
         EventProcessor {
             pending_events: HashMap::new(),
+            deadlines: BinaryHeap::new(),
+            next_sequence: 0,
             debounce_duration,
             operation_queue: VecDeque::new(),
             max_queue_size,
+            dirty_dirs: HashSet::new(),
+            rescan_all: false,
         }
     }
     
     /// Add a filesystem event for processing
     pub fn add_event(&mut self, event: FilesystemEvent) {
+        if let FilesystemEvent::Rescan(paths) = event {
+            METRICS.events_lost.incr();
+            if paths.is_empty() {
+                self.rescan_all = true;
+            }
+            self.dirty_dirs.extend(paths);
+            return;
+        }
+        
+        // A move supersedes the deletion reported for its source. A file
+        // created and then moved before it was indexed is simply created at
+        // its new location.
+        let event = match event {
+            FilesystemEvent::Moved { from, to } => {
+                match self.pending_events.get(&from).map(|p| &p.event) {
+                    Some(FilesystemEvent::Created(_)) => {
+                        self.pending_events.remove(&from);
+                        FilesystemEvent::Created(to)
+                    }
+                    Some(FilesystemEvent::Deleted(_)) => {
+                        self.pending_events.remove(&from);
+                        FilesystemEvent::Moved { from, to }
+                    }
+                    _ => FilesystemEvent::Moved { from, to },
+                }
+            }
+            event => event,
+        };
+        
         let path = match &event {
             FilesystemEvent::Created(p) => p.clone(),
             FilesystemEvent::Modified(p) => p.clone(),
             FilesystemEvent::Deleted(p) => p.clone(),
             FilesystemEvent::Moved { to, .. } => to.clone(),
+            FilesystemEvent::Rescan(_) => unreachable!("rescans are not debounced"),
+        };
+        
+        let previous = self.pending_events.remove(&path);
+        if previous.is_some() {
+            METRICS.events_coalesced.incr();
+        }
+        let event = match previous {
+            Some(previous) => {
+                let sequence = previous.sequence;
+                match Self::coalesce(previous.event, event) {
+                    Some(FilesystemEvent::Deleted(from)) if from != path => {
+                        // A move whose destination was deleted: the source is
+                        // removed under its own path, and the destination still
+                        // goes too, as it may have been indexed before the move
+                        self.add_event(FilesystemEvent::Deleted(from));
+                        FilesystemEvent::Deleted(path.clone())
+                    }
+                    // A move keeps its deadline, so that it is still applied
+                    // before any later event for a new file at its source
+                    Some(event @ FilesystemEvent::Moved { .. }) => {
+                        self.pending_events.insert(path, PendingEvent { event, sequence });
+                        return;
+                    }
+                    Some(event) => event,
+                    None => return,
+                }
+            }
+            None => event,
         };
         
-        // Store event with current timestamp for debouncing
-        self.pending_events.insert(path, (event, Instant::now()));
+        // Store event with a fresh deadline; any earlier heap entry is now stale
+        let sequence = self.next_sequence;
+        self.next_sequence += 1;
+        self.deadlines.push(Reverse((Instant::now() + self.debounce_duration, sequence, path.clone())));
+        self.pending_events.insert(path, PendingEvent { event, sequence });
+        
+        // Drop stale entries when repeated events for the same paths pile up
+        if self.deadlines.len() > 2 * self.pending_events.len() + 64 {
+            let pending = &self.pending_events;
+            self.deadlines.retain(|Reverse((_, sequence, path))| {
+                pending.get(path).map_or(false, |p| p.sequence == *sequence)
+            });
+        }
+    }
+    
+    /// Add a batch of filesystem events for processing
+    pub fn add_events<I: IntoIterator<Item = FilesystemEvent>>(&mut self, events: I) {
+        for event in events {
+            self.add_event(event);
+        }
+    }
+    
+    /// Merge a new event for a path into the one already pending for it
+    ///
+    /// Returns `None` when the two cancel out.
+    fn coalesce(previous: FilesystemEvent, next: FilesystemEvent) -> Option<FilesystemEvent> {
+        use FilesystemEvent::*;
+        
+        match (previous, next) {
+            // Still new to the index, whatever happened to it since
+            (Created(path), Created(_)) | (Created(path), Modified(_)) => Some(Created(path)),
+            // Created and gone again before it was ever indexed
+            (Created(_), Deleted(_)) => None,
+            // Deleted and recreated: the indexed entry is replaced
+            (Deleted(_), Created(path)) | (Deleted(_), Modified(path)) => Some(Modified(path)),
+            // The move still has to be applied to the source's entry
+            (Moved { from, to }, Created(_)) | (Moved { from, to }, Modified(_)) => Some(Moved { from, to }),
+            // Both ends go; `add_event` queues the destination's deletion
+            (Moved { from, .. }, Deleted(_)) => Some(Deleted(from)),
+            // Otherwise the latest event describes the path
+            (_, next) => Some(next),
+        }
+    }
+    
+    /// Drop superseded entries from the top of the deadline heap
+    fn skip_stale_deadlines(&mut self) {
+        while let Some(Reverse((_, sequence, path))) = self.deadlines.peek() {
+            if self.pending_events.get(path).map_or(false, |p| p.sequence == *sequence) {
+                break;
+            }
+            self.deadlines.pop();
+        }
+    }
+    
+    /// Get the earliest time at which a pending event becomes ready, if any
+    pub fn next_deadline(&mut self) -> Option<Instant> {
+        self.skip_stale_deadlines();
+        self.deadlines.peek().map(|Reverse((deadline, _, _))| *deadline)
     }
     
     /// Process pending events and convert to IndexOperations
+    ///
+    /// Only events that are due are touched.
     pub fn process_pending(&mut self) -> Vec<IndexOperation> {
         let now = Instant::now();
         let mut operations = Vec::new();
         
-        // Find events that have been pending long enough
-        let ready_paths: Vec<PathBuf> = self.pending_events
-            .iter()
-            .filter(|(_, (_, timestamp))| now.duration_since(*timestamp) >= self.debounce_duration)
-            .map(|(path, _)| path.clone())
-            .collect();
-        
-        // Convert ready events to operations
-        for path in ready_paths {
-            if let Some((event, _)) = self.pending_events.remove(&path) {
-                if let Some(operation) = self.event_to_operation(event) {
-                    operations.push(operation);
+        loop {
+            self.skip_stale_deadlines();
+            match self.deadlines.peek() {
+                Some(Reverse((deadline, _, _))) if *deadline <= now => {}
+                _ => break,
+            }
+            
+            let Reverse((_, _, path)) = self.deadlines.pop().unwrap();
+            if let Some(pending) = self.pending_events.remove(&path) {
+                self.event_to_operations(pending.event, &mut operations);
+                
+                // A directory moved in from an unwatched location arrives as a
+                // single creation; its contents are only found by listing it
+                if let Some(IndexOperation::Add(entry)) = operations.last() {
+                    if entry.file_type == FileType::Directory {
+                        self.dirty_dirs.insert(entry.path.clone());
+                    }
                 }
             }
         }
@@ -222,58 +444,39 @@ impl EventProcessor {
         operations
     }
     
-    /// Convert a FilesystemEvent to an IndexOperation
-    fn event_to_operation(&self, event: FilesystemEvent) -> Option<IndexOperation> {
+    /// Convert a FilesystemEvent to IndexOperations
+    fn event_to_operations(&self, event: FilesystemEvent, operations: &mut Vec<IndexOperation>) {
         match event {
             FilesystemEvent::Created(path) => {
-                Self::create_file_entry(&path).map(IndexOperation::Add)
+                operations.extend(Self::create_file_entry(path).map(IndexOperation::Add));
             }
             FilesystemEvent::Modified(path) => {
-                Self::create_file_entry(&path).map(IndexOperation::Update)
+                operations.extend(Self::create_file_entry(path).map(IndexOperation::Update));
             }
+            // The path is gone, so it may have been a directory: remove
+            // anything indexed beneath it too
             FilesystemEvent::Deleted(path) => {
-                Some(IndexOperation::Delete(path))
+                operations.push(IndexOperation::DeleteTree(path));
             }
+            // One range update moves the whole subtree. The destination entry
+            // is refreshed as well, in case the source was never indexed.
             FilesystemEvent::Moved { from, to } => {
-                Some(IndexOperation::Move { from, to })
+                let entry = Self::create_file_entry(to.clone());
+                operations.push(IndexOperation::MoveTree { from, to });
+                operations.extend(entry.map(IndexOperation::Update));
             }
+            FilesystemEvent::Rescan(_) => {}
         }
     }
     
-    /// Create a FileEntry from a path
-    fn create_file_entry(path: &Path) -> Option<FileEntry> {
-        // Check if file exists
-        if !path.exists() {
-            return None;
-        }
-        
-        // Get metadata
-        let metadata = std::fs::metadata(path).ok()?;
-        
-        // Extract filename
-        let filename = path.file_name()?.to_string_lossy().to_string();
-        
-        // Determine file type
-        let file_type = if metadata.is_dir() {
-            FileType::Directory
-        } else if metadata.is_symlink() {
-            FileType::Symlink
-        } else if metadata.is_file() {
-            FileType::Regular
-        } else {
-            FileType::Other
-        };
-        
-        // Get modification time
-        let modified_time = metadata.modified().unwrap_or_else(|_| SystemTime::now());
-        
-        Some(FileEntry::new(
-            filename,
-            path.to_path_buf(),
-            metadata.len(),
-            modified_time,
-            file_type,
-        ))
+    /// Create a FileEntry from a path, taking ownership of it
+    ///
+    /// A single `lstat` both checks that the path still exists and describes
+    /// it. Symlinks are indexed as themselves, as the scanner indexes them.
+    fn create_file_entry(path: PathBuf) -> Option<FileEntry> {
+        let metadata = std::fs::symlink_metadata(&path).ok()?;
+        let filename = path.file_name()?.to_string_lossy().into_owned();
+        Some(build_file_entry(filename, path, &metadata))
     }
     
     /// Add an operation to the queue
@@ -286,6 +489,70 @@ impl EventProcessor {
         Ok(())
     }
     
+    /// Add an operation to the queue, or mark the directories it affects for
+    /// rescanning when the queue is full
+    ///
+    /// Returns false if the operation was not queued.
+    pub fn enqueue_or_mark_dirty(&mut self, operation: IndexOperation) -> bool {
+        if self.operation_queue.len() < self.max_queue_size {
+            self.operation_queue.push_back(operation);
+            return true;
+        }
+        
+        // Listing the parent again recovers whatever the operation would
+        // have written
+        let parent = |path: &Path| path.parent().unwrap_or(path).to_path_buf();
+        match operation {
+            IndexOperation::Add(entry) | IndexOperation::Update(entry) => {
+                self.dirty_dirs.insert(parent(&entry.path));
+            }
+            IndexOperation::Delete(path) | IndexOperation::DeleteTree(path) => {
+                self.dirty_dirs.insert(parent(&path));
+            }
+            IndexOperation::Move { from, to } | IndexOperation::MoveTree { from, to } => {
+                self.dirty_dirs.insert(parent(&from));
+                self.dirty_dirs.insert(parent(&to));
+            }
+            IndexOperation::ConfirmDir { path, .. } | IndexOperation::PruneDir { path, .. } => {
+                self.dirty_dirs.insert(path);
+            }
+        }
+        false
+    }
+    
+    /// Check whether any directory is waiting to be rescanned
+    pub fn has_dirty_dirs(&self) -> bool {
+        self.rescan_all || !self.dirty_dirs.is_empty()
+    }
+    
+    /// Take the directories to rescan, without those below another one
+    ///
+    /// `roots` stands in for the unknown locations of lost events.
+    pub fn take_dirty_dirs(&mut self, roots: &[PathBuf]) -> Vec<PathBuf> {
+        let mut dirs: Vec<PathBuf> = self.dirty_dirs.drain().collect();
+        if std::mem::take(&mut self.rescan_all) {
+            dirs.extend(roots.iter().cloned());
+        }
+        
+        // Paths sort by component, so descendants directly follow their ancestor
+        dirs.sort();
+        let mut roots: Vec<PathBuf> = Vec::new();
+        for dir in dirs {
+            if !roots.last().map_or(false, |root| dir.starts_with(root)) {
+                roots.push(dir);
+            }
+        }
+        roots
+    }
+    
+    /// Get the number of operations the next flush should write
+    ///
+    /// Grows past `batch_size` with the backlog, so a deep queue drains in a
+    /// few larger transactions rather than one small batch per interval.
+    pub fn flush_size(&self, batch_size: usize) -> usize {
+        batch_size.max(self.operation_queue.len() / 4)
+    }
+    
     /// Get the next operation from the queue
     pub fn dequeue_operation(&mut self) -> Option<IndexOperation> {
         self.operation_queue.pop_front()
@@ -304,6 +571,9 @@ impl EventProcessor {
     /// Clear all pending events and queued operations
     pub fn clear(&mut self) {
         self.pending_events.clear();
+        self.deadlines.clear();
+        self.dirty_dirs.clear();
+        self.rescan_all = false;
         self.operation_queue.clear();
     }
 }
@@ -350,51 +620,51 @@ mod tests {
     
     #[test]
     fn test_should_exclude_hidden_files() {
-        let exclude_patterns = vec![".*".to_string()];
+        let exclude = ExcludeMatcher::new(&vec![".*".to_string()]);
         
         assert!(FilesystemWatcher::should_exclude(
             Path::new("/home/user/.hidden"),
-            &exclude_patterns
+            &exclude
         ));
         
         assert!(!FilesystemWatcher::should_exclude(
             Path::new("/home/user/visible"),
-            &exclude_patterns
+            &exclude
         ));
     }
     
     #[test]
     fn test_should_exclude_node_modules() {
-        let exclude_patterns = vec!["node_modules".to_string()];
+        let exclude = ExcludeMatcher::new(&vec!["node_modules".to_string()]);
         
         assert!(FilesystemWatcher::should_exclude(
             Path::new("/home/user/project/node_modules/package"),
-            &exclude_patterns
+            &exclude
         ));
         
         assert!(!FilesystemWatcher::should_exclude(
             Path::new("/home/user/project/src"),
-            &exclude_patterns
+            &exclude
         ));
     }
     
     #[test]
     fn test_should_exclude_glob_patterns() {
-        let exclude_patterns = vec!["*.log".to_string(), "*.tmp".to_string()];
+        let exclude = ExcludeMatcher::new(&vec!["*.log".to_string(), "*.tmp".to_string()]);
         
         assert!(FilesystemWatcher::should_exclude(
             Path::new("/home/user/file.log"),
-            &exclude_patterns
+            &exclude
         ));
         
         assert!(FilesystemWatcher::should_exclude(
             Path::new("/home/user/temp.tmp"),
-            &exclude_patterns
+            &exclude
         ));
         
         assert!(!FilesystemWatcher::should_exclude(
             Path::new("/home/user/file.txt"),
-            &exclude_patterns
+            &exclude
         ));
     }
     
@@ -423,6 +693,26 @@ mod tests {
         assert_eq!(processor.pending_event_count(), 0);
     }
     
+    #[test]
+    fn test_event_processor_next_deadline() {
+        let mut processor = EventProcessor::new(Duration::from_millis(100), 1000);
+        assert!(processor.next_deadline().is_none());
+        
+        let before = Instant::now();
+        processor.add_events(vec![
+            FilesystemEvent::Deleted(PathBuf::from("/test/file1.txt")),
+            FilesystemEvent::Deleted(PathBuf::from("/test/file2.txt")),
+        ]);
+        assert_eq!(processor.pending_event_count(), 2);
+        
+        let deadline = processor.next_deadline().unwrap();
+        assert!(deadline >= before + Duration::from_millis(100));
+        assert!(deadline <= Instant::now() + Duration::from_millis(100));
+        
+        processor.clear();
+        assert!(processor.next_deadline().is_none());
+    }
+    
     #[test]
     fn test_event_processor_queue() {
         let mut processor = EventProcessor::new(Duration::from_millis(50), 2);
@@ -450,7 +740,7 @@ mod tests {
         let file_path = temp_dir.path().join("test.txt");
         fs::write(&file_path, "test content").unwrap();
         
-        let entry = EventProcessor::create_file_entry(&file_path);
+        let entry = EventProcessor::create_file_entry(file_path.clone());
         assert!(entry.is_some());
         
         let entry = entry.unwrap();
@@ -466,7 +756,7 @@ mod tests {
         let dir_path = temp_dir.path().join("testdir");
         fs::create_dir(&dir_path).unwrap();
         
-        let entry = EventProcessor::create_file_entry(&dir_path);
+        let entry = EventProcessor::create_file_entry(dir_path);
         assert!(entry.is_some());
         
         let entry = entry.unwrap();
@@ -476,45 +766,142 @@ mod tests {
     
     #[test]
     fn test_create_file_entry_nonexistent() {
-        let entry = EventProcessor::create_file_entry(Path::new("/nonexistent/file.txt"));
+        let entry = EventProcessor::create_file_entry(PathBuf::from("/nonexistent/file.txt"));
         assert!(entry.is_none());
     }
     
     #[test]
-    fn test_event_to_operation() {
+    fn test_event_to_operations() {
         let temp_dir = TempDir::new().unwrap();
         let file_path = temp_dir.path().join("test.txt");
         fs::write(&file_path, "test").unwrap();
         
         let processor = EventProcessor::new(Duration::from_millis(50), 100);
+        let convert = |event| {
+            let mut operations = Vec::new();
+            processor.event_to_operations(event, &mut operations);
+            operations
+        };
         
         // Test Created event
-        let event = FilesystemEvent::Created(file_path.clone());
-        let op = processor.event_to_operation(event);
-        assert!(op.is_some());
-        assert!(matches!(op.unwrap(), IndexOperation::Add(_)));
+        let ops = convert(FilesystemEvent::Created(file_path.clone()));
+        assert_eq!(ops.len(), 1);
+        assert!(matches!(ops[0], IndexOperation::Add(_)));
         
         // Test Modified event
-        let event = FilesystemEvent::Modified(file_path.clone());
-        let op = processor.event_to_operation(event);
-        assert!(op.is_some());
-        assert!(matches!(op.unwrap(), IndexOperation::Update(_)));
+        let ops = convert(FilesystemEvent::Modified(file_path.clone()));
+        assert_eq!(ops.len(), 1);
+        assert!(matches!(ops[0], IndexOperation::Update(_)));
         
         // Test Deleted event
-        let event = FilesystemEvent::Deleted(file_path.clone());
-        let op = processor.event_to_operation(event);
-        assert!(op.is_some());
-        assert!(matches!(op.unwrap(), IndexOperation::Delete(_)));
+        let ops = convert(FilesystemEvent::Deleted(file_path.clone()));
+        assert_eq!(ops.len(), 1);
+        assert!(matches!(ops[0], IndexOperation::DeleteTree(_)));
         
-        // Test Moved event
+        // Test Moved event: the subtree moves and the destination is refreshed
         let to_path = temp_dir.path().join("moved.txt");
-        let event = FilesystemEvent::Moved {
+        fs::rename(&file_path, &to_path).unwrap();
+        let ops = convert(FilesystemEvent::Moved {
             from: file_path.clone(),
             to: to_path.clone(),
-        };
-        let op = processor.event_to_operation(event);
-        assert!(op.is_some());
-        assert!(matches!(op.unwrap(), IndexOperation::Move { .. }));
+        });
+        assert_eq!(ops.len(), 2);
+        assert!(matches!(ops[0], IndexOperation::MoveTree { .. }));
+        assert!(matches!(&ops[1], IndexOperation::Update(entry) if entry.path == to_path));
+    }
+    
+    #[test]
+    fn test_event_on_symlink_describes_link() {
+        let temp_dir = TempDir::new().unwrap();
+        let target = temp_dir.path().join("target");
+        fs::create_dir(&target).unwrap();
+        let link = temp_dir.path().join("link");
+        std::os::unix::fs::symlink(&target, &link).unwrap();
+        let dangling = temp_dir.path().join("dangling");
+        std::os::unix::fs::symlink(temp_dir.path().join("missing"), &dangling).unwrap();
+        
+        let processor = EventProcessor::new(Duration::from_millis(50), 100);
+        let mut operations = Vec::new();
+        processor.event_to_operations(FilesystemEvent::Created(link.clone()), &mut operations);
+        processor.event_to_operations(FilesystemEvent::Created(dangling.clone()), &mut operations);
+        processor.event_to_operations(FilesystemEvent::Created(temp_dir.path().join("gone")), &mut operations);
+        
+        // Links are not followed, so they are neither directories to list
+        // nor skipped when their target is missing
+        assert_eq!(operations.len(), 2);
+        assert!(matches!(&operations[0], IndexOperation::Add(entry)
+            if entry.path == link && entry.filename == "link" && entry.file_type == FileType::Symlink));
+        assert!(matches!(&operations[1], IndexOperation::Add(entry)
+            if entry.path == dangling && entry.file_type == FileType::Symlink));
+    }
+    
+    fn rename_event(mode: RenameMode, paths: &[&str]) -> Event {
+        paths.iter().fold(
+            Event::new(EventKind::Modify(ModifyKind::Name(mode))),
+            |event, path| event.add_path(PathBuf::from(path)),
+        )
+    }
+    
+    #[test]
+    fn test_convert_rename_events() {
+        let exclude = ExcludeMatcher::new(&[".*".to_string()]);
+        
+        let event = rename_event(RenameMode::Both, &["/home/user/a", "/home/user/b"]);
+        assert!(matches!(
+            FilesystemWatcher::convert_event(event, &exclude),
+            Some(FilesystemEvent::Moved { from, to })
+                if from == Path::new("/home/user/a") && to == Path::new("/home/user/b")
+        ));
+        
+        // Moving into an excluded directory removes the source
+        let event = rename_event(RenameMode::Both, &["/home/user/a", "/home/user/.trash/a"]);
+        assert!(matches!(
+            FilesystemWatcher::convert_event(event, &exclude),
+            Some(FilesystemEvent::Deleted(path)) if path == Path::new("/home/user/a")
+        ));
+        
+        // Moving out of one creates the destination
+        let event = rename_event(RenameMode::Both, &["/home/user/.trash/a", "/home/user/a"]);
+        assert!(matches!(
+            FilesystemWatcher::convert_event(event, &exclude),
+            Some(FilesystemEvent::Created(path)) if path == Path::new("/home/user/a")
+        ));
+        
+        let event = rename_event(RenameMode::From, &["/home/user/a"]);
+        assert!(matches!(
+            FilesystemWatcher::convert_event(event, &exclude),
+            Some(FilesystemEvent::Deleted(_))
+        ));
+        let event = rename_event(RenameMode::To, &["/home/user/b"]);
+        assert!(matches!(
+            FilesystemWatcher::convert_event(event, &exclude),
+            Some(FilesystemEvent::Created(_))
+        ));
+    }
+    
+    #[test]
+    fn test_event_processor_pairs_rename_halves() {
+        let temp_dir = TempDir::new().unwrap();
+        let from = temp_dir.path().join("project");
+        let to = temp_dir.path().join("renamed");
+        fs::create_dir(&to).unwrap();
+        
+        // The halves of a rename arrive before the paired event
+        let mut processor = EventProcessor::new(Duration::ZERO, 100);
+        processor.add_events(vec![
+            FilesystemEvent::Deleted(from.clone()),
+            FilesystemEvent::Created(to.clone()),
+            FilesystemEvent::Moved { from: from.clone(), to: to.clone() },
+        ]);
+        assert_eq!(processor.pending_event_count(), 1);
+        
+        let operations = processor.process_pending();
+        assert_eq!(operations.len(), 2);
+        assert!(matches!(
+            &operations[0],
+            IndexOperation::MoveTree { from: f, to: t } if *f == from && *t == to
+        ));
+        assert!(matches!(&operations[1], IndexOperation::Update(entry) if entry.path == to));
     }
     
     #[test]
@@ -577,4 +964,218 @@ mod tests {
         assert_eq!(processor.pending_event_count(), 0);
         assert_eq!(processor.queued_operation_count(), 0);
     }
+    
+    #[test]
+    fn test_event_processor_coalesces_created_and_modified() {
+        let temp_dir = TempDir::new().unwrap();
+        let file_path = temp_dir.path().join("new.txt");
+        fs::write(&file_path, "test").unwrap();
+        
+        let mut processor = EventProcessor::new(Duration::ZERO, 100);
+        processor.add_event(FilesystemEvent::Created(file_path.clone()));
+        processor.add_event(FilesystemEvent::Modified(file_path.clone()));
+        processor.add_event(FilesystemEvent::Modified(file_path.clone()));
+        assert_eq!(processor.pending_event_count(), 1);
+        
+        let operations = processor.process_pending();
+        assert_eq!(operations.len(), 1);
+        assert!(matches!(&operations[0], IndexOperation::Add(entry) if entry.path == file_path));
+        assert!(processor.next_deadline().is_none());
+    }
+    
+    #[test]
+    fn test_event_processor_created_then_deleted_cancels() {
+        let mut processor = EventProcessor::new(Duration::ZERO, 100);
+        processor.add_event(FilesystemEvent::Created(PathBuf::from("/test/temp.txt")));
+        processor.add_event(FilesystemEvent::Deleted(PathBuf::from("/test/temp.txt")));
+        
+        assert_eq!(processor.pending_event_count(), 0);
+        assert!(processor.next_deadline().is_none());
+        assert!(processor.process_pending().is_empty());
+    }
+    
+    #[test]
+    fn test_event_processor_deleted_then_created_updates() {
+        let temp_dir = TempDir::new().unwrap();
+        let file_path = temp_dir.path().join("replaced.txt");
+        fs::write(&file_path, "test").unwrap();
+        
+        let mut processor = EventProcessor::new(Duration::ZERO, 100);
+        processor.add_event(FilesystemEvent::Deleted(file_path.clone()));
+        processor.add_event(FilesystemEvent::Created(file_path.clone()));
+        
+        let operations = processor.process_pending();
+        assert_eq!(operations.len(), 1);
+        assert!(matches!(&operations[0], IndexOperation::Update(entry) if entry.path == file_path));
+        
+        // Deleting it again before the flush leaves just the delete
+        processor.add_event(FilesystemEvent::Deleted(file_path.clone()));
+        processor.add_event(FilesystemEvent::Created(file_path.clone()));
+        processor.add_event(FilesystemEvent::Deleted(file_path.clone()));
+        let operations = processor.process_pending();
+        assert_eq!(operations.len(), 1);
+        assert!(matches!(&operations[0], IndexOperation::DeleteTree(path) if *path == file_path));
+    }
+    
+    #[test]
+    fn test_event_processor_coalesces_moves() {
+        let temp_dir = TempDir::new().unwrap();
+        let moved_path = temp_dir.path().join("moved.txt");
+        fs::write(&moved_path, "test").unwrap();
+        
+        // A file created and moved before indexing is added at its destination
+        let mut processor = EventProcessor::new(Duration::ZERO, 100);
+        processor.add_event(FilesystemEvent::Created(temp_dir.path().join("draft.txt")));
+        processor.add_event(FilesystemEvent::Moved {
+            from: temp_dir.path().join("draft.txt"),
+            to: moved_path.clone(),
+        });
+        assert_eq!(processor.pending_event_count(), 1);
+        let operations = processor.process_pending();
+        assert_eq!(operations.len(), 1);
+        assert!(matches!(&operations[0], IndexOperation::Add(entry) if entry.path == moved_path));
+        
+    }
+    
+    #[test]
+    fn test_event_processor_move_onto_indexed_path_then_delete() {
+        // `mv a b; rm b` where b was indexed before the move
+        let mut processor = EventProcessor::new(Duration::ZERO, 100);
+        processor.add_event(FilesystemEvent::Moved {
+            from: PathBuf::from("/test/a"),
+            to: PathBuf::from("/test/b"),
+        });
+        processor.add_event(FilesystemEvent::Deleted(PathBuf::from("/test/b")));
+        assert_eq!(processor.pending_event_count(), 2);
+        
+        // Both the source and the old destination subtree are removed
+        let mut deleted: Vec<PathBuf> = processor
+            .process_pending()
+            .into_iter()
+            .map(|operation| match operation {
+                IndexOperation::DeleteTree(path) => path,
+                operation => panic!("unexpected operation {:?}", operation),
+            })
+            .collect();
+        deleted.sort();
+        assert_eq!(deleted, vec![PathBuf::from("/test/a"), PathBuf::from("/test/b")]);
+    }
+    
+    #[test]
+    fn test_event_processor_move_keeps_deadline() {
+        // `mv a b; touch a; echo x >> b`
+        let temp_dir = TempDir::new().unwrap();
+        let a = temp_dir.path().join("a");
+        let b = temp_dir.path().join("b");
+        fs::write(&a, "new").unwrap();
+        fs::write(&b, "moved").unwrap();
+        
+        let mut processor = EventProcessor::new(Duration::ZERO, 100);
+        processor.add_event(FilesystemEvent::Moved { from: a.clone(), to: b.clone() });
+        processor.add_event(FilesystemEvent::Created(a.clone()));
+        processor.add_event(FilesystemEvent::Modified(b.clone()));
+        assert_eq!(processor.pending_event_count(), 2);
+        
+        // The move is applied before the new file at its source is added
+        let operations = processor.process_pending();
+        let moved = operations
+            .iter()
+            .position(|operation| matches!(operation, IndexOperation::MoveTree { from, .. } if *from == a))
+            .unwrap();
+        let added = operations
+            .iter()
+            .position(|operation| matches!(operation, IndexOperation::Add(entry) if entry.path == a))
+            .unwrap();
+        assert!(moved < added);
+    }
+    
+    #[test]
+    fn test_event_processor_superseded_deadlines() {
+        let mut processor = EventProcessor::new(Duration::from_millis(100), 100);
+        let path = PathBuf::from("/test/busy.txt");
+        
+        processor.add_event(FilesystemEvent::Deleted(path.clone()));
+        let first_deadline = processor.next_deadline().unwrap();
+        std::thread::sleep(Duration::from_millis(10));
+        
+        // Every new event pushes the deadline back; stale heap entries are skipped
+        for _ in 0..1000 {
+            processor.add_event(FilesystemEvent::Deleted(path.clone()));
+        }
+        assert_eq!(processor.pending_event_count(), 1);
+        assert!(processor.deadlines.len() <= 2 + 64);
+        assert!(processor.next_deadline().unwrap() > first_deadline);
+        
+        std::thread::sleep(Duration::from_millis(150));
+        let operations = processor.process_pending();
+        assert_eq!(operations.len(), 1);
+        assert!(processor.deadlines.is_empty());
+    }
+    
+    #[test]
+    fn test_event_processor_overflow_marks_dirty() {
+        let mut processor = EventProcessor::new(Duration::ZERO, 1);
+        assert!(!processor.has_dirty_dirs());
+        
+        assert!(processor.enqueue_or_mark_dirty(IndexOperation::DeleteTree(PathBuf::from("/home/user/a/x"))));
+        assert!(!processor.enqueue_or_mark_dirty(IndexOperation::DeleteTree(PathBuf::from("/home/user/a/y"))));
+        assert!(!processor.enqueue_or_mark_dirty(IndexOperation::MoveTree {
+            from: PathBuf::from("/home/user/a/b/c"),
+            to: PathBuf::from("/home/user/d/c"),
+        }));
+        assert_eq!(processor.queued_operation_count(), 1);
+        assert!(processor.has_dirty_dirs());
+        
+        // Directories below another dirty one are covered by its rescan
+        assert_eq!(processor.take_dirty_dirs(&[]), vec![
+            PathBuf::from("/home/user/a"),
+            PathBuf::from("/home/user/d"),
+        ]);
+        assert!(!processor.has_dirty_dirs());
+    }
+    
+    #[test]
+    fn test_event_processor_rescan_events() {
+        let mut processor = EventProcessor::new(Duration::ZERO, 100);
+        let roots = vec![PathBuf::from("/home/user"), PathBuf::from("/opt")];
+        
+        processor.add_event(FilesystemEvent::Rescan(vec![PathBuf::from("/srv/data")]));
+        assert_eq!(processor.pending_event_count(), 0);
+        assert_eq!(processor.take_dirty_dirs(&roots), vec![PathBuf::from("/srv/data")]);
+        
+        // Lost events of unknown location rescan every root
+        processor.add_event(FilesystemEvent::Rescan(Vec::new()));
+        processor.add_event(FilesystemEvent::Rescan(vec![PathBuf::from("/home/user/docs")]));
+        assert_eq!(processor.take_dirty_dirs(&roots), roots);
+        assert!(!processor.has_dirty_dirs());
+        
+        let overflow = Event::new(EventKind::Other).set_flag(notify::event::Flag::Rescan);
+        assert!(matches!(
+            FilesystemWatcher::convert_event(overflow, &ExcludeMatcher::default()),
+            Some(FilesystemEvent::Rescan(paths)) if paths.is_empty()
+        ));
+    }
+    
+    #[test]
+    fn test_event_processor_created_directory_is_listed() {
+        let temp_dir = TempDir::new().unwrap();
+        let dir_path = temp_dir.path().join("moved-in");
+        fs::create_dir(&dir_path).unwrap();
+        
+        let mut processor = EventProcessor::new(Duration::ZERO, 100);
+        processor.add_event(FilesystemEvent::Created(dir_path.clone()));
+        assert_eq!(processor.process_pending().len(), 1);
+        assert_eq!(processor.take_dirty_dirs(&[]), vec![dir_path]);
+    }
+    
+    #[test]
+    fn test_event_processor_flush_size() {
+        let mut processor = EventProcessor::new(Duration::ZERO, 10000);
+        assert_eq!(processor.flush_size(100), 100);
+        
+        for i in 0..2000 {
+            processor.enqueue_operation(IndexOperation::Delete(PathBuf::from(format!("/test/{}", i)))).unwrap();
+        }
+        assert_eq!(processor.flush_size(100), 500);
+    }
 }
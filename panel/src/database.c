@@ -1,9 +1,15 @@
 /* NovaSearch Panel - Database Interface Implementation */
 
 #include "database.h"
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <time.h>
 
@@ -12,6 +18,175 @@
 #define INITIAL_RETRY_DELAY_MS 100
 #define MAX_RETRY_DELAY_MS 1600
 
+/* How long a statement waits on a lock held by the daemon before failing.
+ * The daemon runs in WAL mode, so reads only wait while it checkpoints or
+ * swaps in a rebuilt index. */
+#define BUSY_TIMEOUT_MS 2000
+
+/* Virtual machine instructions between cancellation checks */
+#define QUERY_PROGRESS_OPS 1000
+
+/* Minimum query length (in characters) that can use the trigram index */
+#define MIN_TRIGRAM_QUERY_CHARS 3
+
+/* Query server protocol, as defined in daemon/src/query_server.rs. Each
+ * message is a little-endian u32 payload length followed by the payload. */
+#define QUERY_SOCKET_NAME "query.sock"
+#define SERVER_OP_QUERY 1
+#define SERVER_STATUS_OK 0
+#define SERVER_MAX_REQUEST (64 * 1024)
+#define SERVER_MAX_RESPONSE (16 * 1024 * 1024)
+
+/* How long a request may take before the panel falls back to SQLite, and
+ * how long to wait before trying an unreachable daemon again */
+#define SERVER_TIMEOUT_MS 1000
+#define SERVER_RETRY_INTERVAL_S 5
+
+/* Frecency scoring, as defined in daemon/src/database.rs */
+#define FRECENCY_HALF_LIFE_SECS (30.0 * 24 * 60 * 60)
+#define FRECENCY_SCALE 1024.0
+
+/* Ranking shared by both query variants, matching Database::query_files in
+ * the daemon. ?1 is the query, ?2 the limit. Applications also match on the
+ * name and keywords the daemon extracted from their .desktop files. Queries
+ * yield only the ids of the best matches, followed by the tier, frecency and
+ * filename they are ordered by; the rows themselves are fetched by id, a
+ * page at a time. */
+#define QUERY_TIER_SQL \
+    "CASE " \
+    "  WHEN f.filename = ?1 OR a.name = ?1 THEN 0 "                     /* Exact match */ \
+    "  WHEN f.filename LIKE ?1 || '%' OR a.name LIKE ?1 || '%' THEN 1 " /* Prefix match */ \
+    "  ELSE 2 "                                                         /* Substring match */ \
+    "END"
+
+#define QUERY_SELECT_SQL \
+    "SELECT f.id AS id, " QUERY_TIER_SQL " AS tier, f.frecency AS frecency, " \
+    "       f.filename AS filename " \
+    "FROM files f " \
+    "LEFT JOIN app_metadata a ON f.id = a.file_id "
+
+#define QUERY_ORDER_SQL \
+    "ORDER BY tier, frecency DESC, filename COLLATE NOCASE LIMIT ?2"
+
+/* Substring lookup through the FTS5 trigram index maintained by the daemon */
+#define QUERY_FTS_FILTER_SQL \
+    "WHERE f.id IN (SELECT rowid FROM files_fts WHERE filename LIKE '%' || ?1 || '%') " \
+    "   OR f.id IN (SELECT file_id FROM app_metadata " \
+    "               WHERE name LIKE '%' || ?1 || '%' OR keywords LIKE '%' || ?1 || '%') "
+
+/* Lookup for queries too short for the trigram index. Files
+ * are walked in frecency order through idx_frecency; a result after the
+ * first ?2 prefix or substring matches would rank behind all of them. */
+#define QUERY_SCAN_FILTER_SQL \
+    "WHERE f.id IN (" \
+    "    SELECT id FROM files WHERE filename = ?1 COLLATE NOCASE " \
+    "    UNION ALL " \
+    "    SELECT * FROM (SELECT id FROM files WHERE filename LIKE ?1 || '%' " \
+    "                   ORDER BY frecency DESC, filename COLLATE NOCASE LIMIT ?2) " \
+    "    UNION ALL " \
+    "    SELECT * FROM (SELECT id FROM files WHERE filename LIKE '%' || ?1 || '%' " \
+    "                   ORDER BY frecency DESC, filename COLLATE NOCASE LIMIT ?2) " \
+    "    UNION ALL " \
+    "    SELECT file_id FROM app_metadata " \
+    "    WHERE name LIKE '%' || ?1 || '%' OR keywords LIKE '%' || ?1 || '%') "
+
+/* Entries of the system index, by their negated ids, ranked by the launches
+ * recorded in the user's system_usage. Directories the user indexes as well
+ * are left to the user's index. The system index holds only applications,
+ * so it is scanned. */
+#define SYSTEM_QUERY_SQL \
+    "SELECT -f.id AS id, " QUERY_TIER_SQL " AS tier, COALESCE(u.frecency, 0) AS frecency, " \
+    "       f.filename AS filename " \
+    "FROM system.file_paths f " \
+    "JOIN system.dirs d ON d.id = f.dir_id " \
+    "LEFT JOIN system.app_metadata a ON f.id = a.file_id " \
+    "LEFT JOIN main.system_usage u ON u.path = f.path " \
+    "WHERE d.path NOT IN (SELECT path FROM main.dirs) " \
+    "  AND (f.filename LIKE '%' || ?1 || '%' OR a.name LIKE '%' || ?1 || '%' " \
+    "       OR a.keywords LIKE '%' || ?1 || '%') " \
+    QUERY_ORDER_SQL
+
+/* The best ?2 results of a user query and of the system index together */
+#define WITH_SYSTEM_SQL(user_query) \
+    "SELECT * FROM (" user_query ") " \
+    "UNION ALL " \
+    "SELECT * FROM (" SYSTEM_QUERY_SQL ") " \
+    QUERY_ORDER_SQL
+
+static const char *QUERY_FTS_SQL = QUERY_SELECT_SQL QUERY_FTS_FILTER_SQL QUERY_ORDER_SQL;
+static const char *QUERY_SCAN_SQL = QUERY_SELECT_SQL QUERY_SCAN_FILTER_SQL QUERY_ORDER_SQL;
+static const char *QUERY_FTS_SYSTEM_SQL =
+    WITH_SYSTEM_SQL(QUERY_SELECT_SQL QUERY_FTS_FILTER_SQL QUERY_ORDER_SQL);
+static const char *QUERY_SCAN_SYSTEM_SQL =
+    WITH_SYSTEM_SQL(QUERY_SELECT_SQL QUERY_SCAN_FILTER_SQL QUERY_ORDER_SQL);
+
+/* Result lookup for ranked file ids */
+static const char *FETCH_SQL =
+    "SELECT f.filename, f.path, f.file_type, f.size, f.modified_time, "
+    "       a.name, a.icon, a.exec "
+    "FROM file_paths f LEFT JOIN app_metadata a ON f.id = a.file_id "
+    "WHERE f.id = ?";
+
+static const char *FETCH_SYSTEM_SQL =
+    "SELECT f.filename, f.path, f.file_type, f.size, f.modified_time, "
+    "       a.name, a.icon, a.exec "
+    "FROM system.file_paths f LEFT JOIN system.app_metadata a ON f.id = a.file_id "
+    "WHERE f.id = ?";
+
+/* Changes whenever another connection commits to the database */
+static const char *DATA_VERSION_SQL = "PRAGMA data_version";
+static const char *SYSTEM_VERSION_SQL = "PRAGMA system.data_version";
+
+/* Batches the daemon has committed to each index, which it stamps on the
+ * index snapshot as in daemon/src/database.rs */
+static const char *INDEX_GENERATION_SQL =
+    "SELECT CAST(value AS INTEGER) FROM main.metadata WHERE key = 'index_generation'";
+static const char *SYSTEM_GENERATION_SQL =
+    "SELECT CAST(value AS INTEGER) FROM system.metadata WHERE key = 'index_generation'";
+
+/* Launched entries with their frecency, as Database::load_frecencies reads
+ * them */
+#define FRECENCIES_SQL "SELECT path, frecency FROM file_paths WHERE frecency > 0"
+
+static const char *FRECENCIES_SYSTEM_SQL =
+    FRECENCIES_SQL " UNION ALL SELECT path, frecency FROM main.system_usage WHERE frecency > 0";
+
+/* The system index is only searched if it holds an index and the user's
+ * database can record launches of its entries */
+static const char *SYSTEM_ATTACH_SQL = "ATTACH DATABASE ? AS system";
+static const char *SYSTEM_CHECK_SQL =
+    "SELECT EXISTS (SELECT 1 FROM system.sqlite_master WHERE name = 'file_paths') "
+    "   AND EXISTS (SELECT 1 FROM main.sqlite_master WHERE name = 'system_usage')";
+
+/* Usage tracking statements */
+/* Entries are keyed by their directory's path and their own name; full paths
+ * exist only in the file_paths view, which cannot be searched by path */
+static const char *FILE_ID_SQL =
+    "SELECT f.id, f.frecency FROM files f JOIN dirs d ON d.id = f.dir_id "
+    "WHERE d.path = ? AND f.filename = ?";
+
+static const char *USAGE_UPDATE_SQL =
+    "UPDATE usage_stats SET launch_count = launch_count + 1, last_launched = ? "
+    "WHERE file_id = ?";
+
+static const char *USAGE_INSERT_SQL =
+    "INSERT INTO usage_stats (file_id, launch_count, last_launched) VALUES (?, 1, ?)";
+
+static const char *FRECENCY_UPDATE_SQL = "UPDATE files SET frecency = ? WHERE id = ?";
+
+/* Launches of system index entries are kept by path in system_usage */
+static const char *SYSTEM_FILE_SQL =
+    "SELECT COALESCE((SELECT frecency FROM main.system_usage WHERE path = ?3), 0) "
+    "FROM system.files f JOIN system.dirs d ON d.id = f.dir_id "
+    "WHERE d.path = ?1 AND f.filename = ?2";
+
+static const char *SYSTEM_USAGE_UPDATE_SQL =
+    "UPDATE system_usage SET launch_count = launch_count + 1, last_launched = ?, frecency = ? "
+    "WHERE path = ?";
+
+static const char *SYSTEM_USAGE_INSERT_SQL =
+    "INSERT INTO system_usage (path, launch_count, last_launched, frecency) VALUES (?, 1, ?, ?)";
+
 /* Helper function to sleep for milliseconds */
 static void sleep_ms(int milliseconds) {
     struct timespec ts;
@@ -20,6 +195,473 @@ static void sleep_ms(int milliseconds) {
     nanosleep(&ts, NULL);
 }
 
+/* Add a launch at `launched` to a frecency score, as add_launch_to_frecency
+ * does in the daemon. The score is FRECENCY_SCALE * log2 of the sum of
+ * 2^(t / half-life) over the launch times t; 0 means never launched. */
+static int64_t add_launch_to_frecency(int64_t frecency, int64_t launched) {
+    double launch = (double)(launched > 0 ? launched : 0) / FRECENCY_HALF_LIFE_SECS * FRECENCY_SCALE;
+    if (frecency <= 0) {
+        return llround(launch);
+    }
+
+    double high = (double)frecency > launch ? (double)frecency : launch;
+    double low = (double)frecency > launch ? launch : (double)frecency;
+    return llround(high + FRECENCY_SCALE * log2(1.0 + exp2((low - high) / FRECENCY_SCALE)));
+}
+
+/* Get a statement from its cache slot, preparing it on first use.
+ * Returns NULL without reporting if preparation fails. */
+static sqlite3_stmt *prepare_cached(sqlite3 *conn, sqlite3_stmt **slot, const char *sql) {
+    if (!*slot && sqlite3_prepare_v3(conn, sql, -1, SQLITE_PREPARE_PERSISTENT,
+                                     slot, NULL) != SQLITE_OK) {
+        sqlite3_finalize(*slot);
+        *slot = NULL;
+    }
+    return *slot;
+}
+
+/* Reset a cached statement so it is ready for the next use */
+static void release_cached(sqlite3_stmt *stmt) {
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+}
+
+/* Finalize a cached statement and empty its slot */
+static void finalize_cached(sqlite3_stmt **slot) {
+    sqlite3_finalize(*slot);
+    *slot = NULL;
+}
+
+/* Cancellation check installed as the SQLite progress handler */
+typedef struct {
+    NovaSearchCancelFunc is_cancelled;
+    void *user_data;
+} CancelCheck;
+
+static int query_progress_handler(void *data) {
+    CancelCheck *check = data;
+    return check->is_cancelled(check->user_data) ? 1 : 0;
+}
+
+/* Copy a text column, or NULL if it is NULL */
+static char *column_strdup(sqlite3_stmt *stmt, int column) {
+    const unsigned char *text = sqlite3_column_text(stmt, column);
+    return text ? strdup((const char *)text) : NULL;
+}
+
+/* Fill a result from the filename, path, file_type, size, modified_time and
+ * application name, icon and exec columns at the start of the current row */
+static void read_result_row(sqlite3_stmt *stmt, SearchResult *result) {
+    result->filename = column_strdup(stmt, 0);
+    result->path = column_strdup(stmt, 1);
+    result->file_type = column_strdup(stmt, 2);
+    result->size = sqlite3_column_int64(stmt, 3);
+    result->modified_time = sqlite3_column_int64(stmt, 4);
+    result->app_name = column_strdup(stmt, 5);
+    result->app_icon = column_strdup(stmt, 6);
+    result->app_exec = column_strdup(stmt, 7);
+    result->next = NULL;
+}
+
+/* Count UTF-8 characters in a string */
+static size_t utf8_length(const char *str) {
+    size_t length = 0;
+    for (const unsigned char *p = (const unsigned char *)str; *p; p++) {
+        if ((*p & 0xC0) != 0x80) {
+            length++;
+        }
+    }
+    return length;
+}
+
+/* Get the query socket path, which sits next to the database file */
+static char *socket_path_for(const char *db_path) {
+    const char *slash = strrchr(db_path, '/');
+    size_t dir_length = slash ? (size_t)(slash - db_path) + 1 : 0;
+
+    char *path = malloc(dir_length + sizeof(QUERY_SOCKET_NAME));
+    if (!path) {
+        return NULL;
+    }
+    memcpy(path, db_path, dir_length);
+    memcpy(path + dir_length, QUERY_SOCKET_NAME, sizeof(QUERY_SOCKET_NAME));
+    return path;
+}
+
+/* Attach the system index at path read-only as "system". Returns false,
+ * with nothing attached, if there is no usable index there. */
+static bool attach_system_index(sqlite3 *conn, const char *path) {
+    if (!path || access(path, R_OK) != 0) {
+        return false;
+    }
+
+    /* A read-only URI, so even the read-write handle cannot write to it */
+    size_t length = strlen(path);
+    char *uri = malloc(3 * length + sizeof("file:?mode=ro"));
+    if (!uri) {
+        return false;
+    }
+    memcpy(uri, "file:", 5);
+    char *out = uri + 5;
+    for (const char *p = path; *p; p++) {
+        if (*p == '%' || *p == '?' || *p == '#') {
+            out += sprintf(out, "%%%02x", (unsigned char)*p);
+        } else {
+            *out++ = *p;
+        }
+    }
+    strcpy(out, "?mode=ro");
+
+    sqlite3_stmt *stmt = NULL;
+    bool attached = sqlite3_prepare_v2(conn, SYSTEM_ATTACH_SQL, -1, &stmt, NULL) == SQLITE_OK &&
+                    sqlite3_bind_text(stmt, 1, uri, -1, SQLITE_TRANSIENT) == SQLITE_OK &&
+                    sqlite3_step(stmt) == SQLITE_DONE;
+    sqlite3_finalize(stmt);
+    free(uri);
+    if (!attached) {
+        return false;
+    }
+
+    bool usable = false;
+    stmt = NULL;
+    if (sqlite3_prepare_v2(conn, SYSTEM_CHECK_SQL, -1, &stmt, NULL) == SQLITE_OK &&
+        sqlite3_step(stmt) == SQLITE_ROW) {
+        usable = sqlite3_column_int(stmt, 0) != 0;
+    }
+    sqlite3_finalize(stmt);
+
+    if (!usable) {
+        sqlite3_exec(conn, "DETACH DATABASE system", NULL, NULL, NULL);
+    }
+    return usable;
+}
+
+/* Little-endian field encoding used by the query server */
+static void put_u32(unsigned char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t)p[i] << (8 * i);
+    }
+    return value;
+}
+
+static int64_t get_i64(const unsigned char *p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value |= (uint64_t)p[i] << (8 * i);
+    }
+    return (int64_t)value;
+}
+
+/* Cursor over a response payload */
+typedef struct {
+    const unsigned char *data;
+    size_t remaining;
+} ResponseReader;
+
+static bool reader_take(ResponseReader *reader, size_t length, const unsigned char **out) {
+    if (reader->remaining < length) {
+        return false;
+    }
+    *out = reader->data;
+    reader->data += length;
+    reader->remaining -= length;
+    return true;
+}
+
+/* Blocking socket I/O that survives signals; false on error, timeout or EOF */
+static bool server_send_all(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+static bool server_recv_all(int fd, unsigned char *data, size_t length) {
+    while (length > 0) {
+        ssize_t received = recv(fd, data, length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        data += received;
+        length -= (size_t)received;
+    }
+    return true;
+}
+
+static void server_disconnect(NovaSearchDB *db) {
+    if (db->server_fd >= 0) {
+        close(db->server_fd);
+        db->server_fd = -1;
+    }
+}
+
+/* Connect to the daemon's query server unless connected already. A failed
+ * attempt is not repeated for SERVER_RETRY_INTERVAL_S seconds. */
+static bool server_connect(NovaSearchDB *db) {
+    if (db->server_fd >= 0) {
+        return true;
+    }
+
+    if (!db->socket_path || time(NULL) < db->server_retry_at) {
+        return false;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(db->socket_path) >= sizeof(addr.sun_path)) {
+        /* Cannot be addressed; never try again */
+        free(db->socket_path);
+        db->socket_path = NULL;
+        return false;
+    }
+    strcpy(addr.sun_path, db->socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        db->server_retry_at = time(NULL) + SERVER_RETRY_INTERVAL_S;
+        return false;
+    }
+
+    struct timeval timeout = {
+        .tv_sec = SERVER_TIMEOUT_MS / 1000,
+        .tv_usec = (SERVER_TIMEOUT_MS % 1000) * 1000,
+    };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        db->server_retry_at = time(NULL) + SERVER_RETRY_INTERVAL_S;
+        return false;
+    }
+
+    db->server_fd = fd;
+    return true;
+}
+
+/* A validated query server response, read from the next result on */
+typedef struct {
+    unsigned char *payload;
+    ResponseReader reader;
+} ServerResponse;
+
+/* Read a length-prefixed string into a NUL-terminated copy, kept in a
+ * page's arena if given and malloc'd otherwise. With no out, the string is
+ * only skipped. */
+static bool reader_string(ResponseReader *reader, SearchResultPage *page, char **out) {
+    const unsigned char *field;
+    if (!reader_take(reader, 4, &field)) {
+        return false;
+    }
+    uint32_t length = get_u32(field);
+    if (!reader_take(reader, length, &field)) {
+        return false;
+    }
+    if (!out) {
+        return true;
+    }
+
+    *out = page ? nova_search_result_page_strndup(page, (const char *)field, length)
+                : strndup((const char *)field, length);
+    return *out != NULL;
+}
+
+/* Read one result of a response, with its strings as reader_string keeps
+ * them. With no result it is only checked to be well formed. */
+static bool read_server_result(ResponseReader *reader, SearchResultPage *page, SearchResult *result) {
+    const unsigned char *field;
+    if (!reader_take(reader, 16, &field)) {
+        return false;
+    }
+
+    if (!result) {
+        for (int i = 0; i < 6; i++) {
+            if (!reader_string(reader, NULL, NULL)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    result->size = get_i64(field);
+    result->modified_time = get_i64(field + 8);
+    if (!reader_string(reader, page, &result->filename) ||
+        !reader_string(reader, page, &result->path) ||
+        !reader_string(reader, page, &result->file_type) ||
+        !reader_string(reader, page, &result->app_name) ||
+        !reader_string(reader, page, &result->app_icon) ||
+        !reader_string(reader, page, &result->app_exec)) {
+        return false;
+    }
+
+    /* Entries that are not applications carry empty application fields */
+    if (!result->app_name[0] && !result->app_icon[0] && !result->app_exec[0]) {
+        if (!page) {
+            free(result->app_name);
+            free(result->app_icon);
+            free(result->app_exec);
+        }
+        result->app_name = result->app_icon = result->app_exec = NULL;
+    }
+    return true;
+}
+
+/* Send a query to the daemon's query server and check its response, which
+ * then holds *count results. Returns false if the server is unreachable or
+ * fails; *response is only to be freed otherwise. */
+static bool server_query(NovaSearchDB *db, const char *query, int max_results,
+                         ServerResponse *response, uint32_t *count) {
+    if (!db || !query || !server_connect(db)) {
+        return false;
+    }
+
+    size_t query_length = strlen(query);
+    if (query_length > SERVER_MAX_REQUEST - 5) {
+        return false;
+    }
+
+    /* Length, opcode, result limit, then the query itself */
+    size_t request_length = 9 + query_length;
+    unsigned char *request = malloc(request_length);
+    if (!request) {
+        return false;
+    }
+    put_u32(request, (uint32_t)(request_length - 4));
+    request[4] = SERVER_OP_QUERY;
+    put_u32(request + 5, max_results > 0 ? (uint32_t)max_results : 0);
+    memcpy(request + 9, query, query_length);
+
+    bool sent = server_send_all(db->server_fd, request, request_length);
+    free(request);
+
+    unsigned char header[4];
+    if (!sent || !server_recv_all(db->server_fd, header, sizeof(header))) {
+        server_disconnect(db);
+        return false;
+    }
+
+    uint32_t payload_length = get_u32(header);
+    unsigned char *payload = payload_length > 0 && payload_length <= SERVER_MAX_RESPONSE
+                             ? malloc(payload_length) : NULL;
+    if (!payload || !server_recv_all(db->server_fd, payload, payload_length)) {
+        /* The stream can no longer be kept in step */
+        free(payload);
+        server_disconnect(db);
+        return false;
+    }
+
+    ResponseReader reader = { payload, payload_length };
+    const unsigned char *field;
+    bool ok = reader_take(&reader, 1, &field) && field[0] == SERVER_STATUS_OK &&
+              reader_take(&reader, 4, &field);
+    *count = ok ? get_u32(field) : 0;
+
+    /* Check every result now, so reading them later cannot fail midway */
+    ResponseReader check = reader;
+    for (uint32_t i = 0; ok && i < *count; i++) {
+        ok = read_server_result(&check, NULL, NULL);
+    }
+    if (!ok || *count > INT_MAX) {
+        free(payload);
+        return false;
+    }
+
+    response->payload = payload;
+    response->reader = reader;
+    return true;
+}
+
+static void query_cache_entry_clear(QueryCacheEntry *entry) {
+    free(entry->query);
+    free(entry->ids);
+    entry->query = NULL;
+    entry->ids = NULL;
+    entry->count = 0;
+}
+
+/* Drop every cached result */
+static void query_cache_clear(NovaSearchDB *db) {
+    for (int i = 0; i < QUERY_CACHE_SIZE; i++) {
+        query_cache_entry_clear(&db->query_cache[i]);
+    }
+    db->cache_version = -1;
+}
+
+/* Look up a query answered since the daemon last committed. A hit returns
+ * the cached entry, whose ids may be empty. */
+static QueryCacheEntry *query_cache_lookup(NovaSearchDB *db, const char *query, int max_results) {
+    int64_t version = nova_search_db_data_version(db);
+    if (version < 0 || version != db->cache_version) {
+        query_cache_clear(db);
+        db->cache_version = version;
+        return NULL;
+    }
+
+    for (int i = 0; i < QUERY_CACHE_SIZE; i++) {
+        QueryCacheEntry *entry = &db->query_cache[i];
+        if (entry->query && entry->max_results == max_results && strcmp(entry->query, query) == 0) {
+            entry->last_used = ++db->cache_clock;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Keep a copy of a query's ranked ids, replacing the least recently used */
+static void query_cache_store(NovaSearchDB *db, const char *query, int max_results,
+                              const int64_t *ids, int count) {
+    if (db->cache_version < 0) {
+        return;
+    }
+
+    QueryCacheEntry *slot = &db->query_cache[0];
+    for (int i = 0; i < QUERY_CACHE_SIZE; i++) {
+        QueryCacheEntry *entry = &db->query_cache[i];
+        if (!entry->query) {
+            slot = entry;
+            break;
+        }
+        if (entry->last_used < slot->last_used) {
+            slot = entry;
+        }
+    }
+    query_cache_entry_clear(slot);
+
+    int64_t *copy = malloc(((size_t)count + 1) * sizeof(int64_t));
+    char *key = strdup(query);
+    if (!copy || !key) {
+        free(copy);
+        free(key);
+        return;
+    }
+    memcpy(copy, ids, (size_t)count * sizeof(int64_t));
+
+    slot->query = key;
+    slot->max_results = max_results;
+    slot->ids = copy;
+    slot->count = count;
+    slot->last_used = ++db->cache_clock;
+}
+
 /* Create a new database connection object */
 NovaSearchDB* nova_search_db_new(const char *db_path) {
     if (!db_path) {
@@ -36,13 +678,42 @@ NovaSearchDB* nova_search_db_new(const char *db_path) {
     db->db = NULL;
     db->db_path = strdup(db_path);
     db->is_connected = false;
+    db->query_fts_stmt = NULL;
+    db->query_scan_stmt = NULL;
+    db->fetch_stmt = NULL;
+    db->data_version_stmt = NULL;
+    db->system_db_path = strdup(NOVASEARCH_SYSTEM_DB_PATH);
+    db->system_attached = false;
+    db->fetch_system_stmt = NULL;
+    db->system_version_stmt = NULL;
+    db->index_generation_stmt = NULL;
+    db->system_generation_stmt = NULL;
+    memset(db->query_cache, 0, sizeof(db->query_cache));
+    db->cache_version = -1;
+    db->cache_clock = 0;
+    db->rw_db = NULL;
+    db->file_id_stmt = NULL;
+    db->usage_update_stmt = NULL;
+    db->usage_insert_stmt = NULL;
+    db->frecency_update_stmt = NULL;
+    db->system_file_stmt = NULL;
+    db->system_usage_update_stmt = NULL;
+    db->system_usage_insert_stmt = NULL;
+    db->socket_path = NULL;
+    db->server_fd = -1;
+    db->server_retry_at = 0;
 
-    if (!db->db_path) {
+    if (!db->db_path || !db->system_db_path) {
         fprintf(stderr, "Failed to duplicate database path\n");
+        free(db->db_path);
+        free(db->system_db_path);
         free(db);
         return NULL;
     }
 
+    /* Without a socket path queries always go to SQLite */
+    db->socket_path = socket_path_for(db_path);
+
     return db;
 }
 
@@ -63,11 +734,13 @@ bool nova_search_db_open(NovaSearchDB *db) {
         int rc = sqlite3_open_v2(
             db->db_path,
             &db->db,
-            SQLITE_OPEN_READONLY,
+            SQLITE_OPEN_READONLY | SQLITE_OPEN_URI,
             NULL
         );
 
         if (rc == SQLITE_OK) {
+            sqlite3_busy_timeout(db->db, BUSY_TIMEOUT_MS);
+            db->system_attached = attach_system_index(db->db, db->system_db_path);
             db->is_connected = true;
             return true;
         }
@@ -108,11 +781,36 @@ void nova_search_db_close(NovaSearchDB *db) {
         return;
     }
 
+    finalize_cached(&db->query_fts_stmt);
+    finalize_cached(&db->query_scan_stmt);
+    finalize_cached(&db->fetch_stmt);
+    finalize_cached(&db->data_version_stmt);
+    finalize_cached(&db->fetch_system_stmt);
+    finalize_cached(&db->system_version_stmt);
+    finalize_cached(&db->index_generation_stmt);
+    finalize_cached(&db->system_generation_stmt);
+    finalize_cached(&db->file_id_stmt);
+    finalize_cached(&db->usage_update_stmt);
+    finalize_cached(&db->usage_insert_stmt);
+    finalize_cached(&db->frecency_update_stmt);
+    finalize_cached(&db->system_file_stmt);
+    finalize_cached(&db->system_usage_update_stmt);
+    finalize_cached(&db->system_usage_insert_stmt);
+
+    query_cache_clear(db);
+    server_disconnect(db);
+
+    if (db->rw_db) {
+        sqlite3_close(db->rw_db);
+        db->rw_db = NULL;
+    }
+
     if (db->db) {
         sqlite3_close(db->db);
         db->db = NULL;
     }
 
+    db->system_attached = false;
     db->is_connected = false;
 }
 
@@ -129,172 +827,983 @@ void nova_search_db_free(NovaSearchDB *db) {
         db->db_path = NULL;
     }
 
+    free(db->socket_path);
+    db->socket_path = NULL;
+
+    free(db->system_db_path);
+    db->system_db_path = NULL;
+
     free(db);
 }
 
-/* Execute search query with ranking logic */
-SearchResult* nova_search_db_query(NovaSearchDB *db, const char *query, int max_results) {
-    if (!db || !db->is_connected || !db->db) {
-        fprintf(stderr, "Database is not connected\n");
-        return NULL;
+/* Use the system index at path, or none if path is NULL. Takes effect the
+ * next time the database is opened. */
+void nova_search_db_set_system_index(NovaSearchDB *db, const char *path) {
+    if (!db) {
+        return;
     }
 
-    if (!query || strlen(query) == 0) {
-        /* Empty query returns no results */
+    free(db->system_db_path);
+    db->system_db_path = path ? strdup(path) : NULL;
+}
+
+/* Rank the matches of a query in SQLite. Returns up to max_results ids,
+ * best first and negated for the system index, with their number in *count,
+ * or NULL if the query fails or is cancelled. */
+static int64_t *rank_query(NovaSearchDB *db, const char *query, int max_results,
+                           NovaSearchCancelFunc is_cancelled, void *user_data, int *count) {
+    *count = 0;
+
+    int64_t *ids = malloc(((size_t)max_results + 1) * sizeof(int64_t));
+    if (!ids) {
+        fprintf(stderr, "Failed to allocate search results\n");
         return NULL;
     }
 
-    if (max_results <= 0) {
-        max_results = 50; /* Default limit */
-    }
-
-    /* Prepare SQL query with usage-based ranking logic */
-    const char *sql = 
-        "SELECT f.filename, f.path, f.file_type, f.size, f.modified_time, "
-        "       COALESCE(u.launch_count, 0) as launch_count "
-        "FROM files f "
-        "LEFT JOIN usage_stats u ON f.id = u.file_id "
-        "WHERE f.filename LIKE '%' || ? || '%' "
-        "ORDER BY "
-        "  CASE "
-        "    WHEN f.filename = ? THEN 0 "           /* Exact match */
-        "    WHEN f.filename LIKE ? || '%' THEN 1 " /* Prefix match */
-        "    ELSE 2 "                               /* Substring match */
-        "  END, "
-        "  COALESCE(u.launch_count, 0) DESC, "      /* Usage frequency */
-        "  f.filename COLLATE NOCASE "
-        "LIMIT ?";
+    /* Retyped and backspaced-to queries are answered again unchanged until
+     * the daemon, or a recorded launch, commits to the database */
+    QueryCacheEntry *cached = query_cache_lookup(db, query, max_results);
+    if (cached) {
+        memcpy(ids, cached->ids, (size_t)cached->count * sizeof(int64_t));
+        *count = cached->count;
+        return ids;
+    }
 
-    sqlite3_stmt *stmt = NULL;
-    int rc = sqlite3_prepare_v2(db->db, sql, -1, &stmt, NULL);
+    /* Get the SQL query with usage-based ranking logic. Queries long enough
+     * to be split into trigrams go through the index, shorter ones scan.
+     * Both need the schema the daemon migrates its database to on startup,
+     * and the trigram index needs SQLite 3.34 (see meson.build).
+     * Statements are prepared once and survive schema changes made by the
+     * daemon. */
+    sqlite3_stmt *stmt;
+    int rc;
 
-    if (rc != SQLITE_OK) {
+    if (utf8_length(query) >= MIN_TRIGRAM_QUERY_CHARS) {
+        stmt = prepare_cached(db->db, &db->query_fts_stmt,
+                              db->system_attached ? QUERY_FTS_SYSTEM_SQL : QUERY_FTS_SQL);
+    } else {
+        stmt = prepare_cached(db->db, &db->query_scan_stmt,
+                              db->system_attached ? QUERY_SCAN_SYSTEM_SQL : QUERY_SCAN_SQL);
+    }
+
+    if (!stmt) {
         fprintf(stderr, "Failed to prepare statement: %s\n", sqlite3_errmsg(db->db));
+        free(ids);
         return NULL;
     }
 
     /* Bind parameters */
-    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_TRANSIENT); /* LIKE pattern */
-    sqlite3_bind_text(stmt, 2, query, -1, SQLITE_TRANSIENT); /* Exact match */
-    sqlite3_bind_text(stmt, 3, query, -1, SQLITE_TRANSIENT); /* Prefix match */
-    sqlite3_bind_int(stmt, 4, max_results);
+    sqlite3_bind_text(stmt, 1, query, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 2, max_results);
 
-    /* Execute query and build result list */
-    SearchResult *head = NULL;
-    SearchResult *tail = NULL;
+    CancelCheck check = { is_cancelled, user_data };
+    if (is_cancelled) {
+        sqlite3_progress_handler(db->db, QUERY_PROGRESS_OPS, query_progress_handler, &check);
+    }
 
+    /* The statement runs to completion, so no read transaction is held
+     * while the results are paged through */
     while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        SearchResult *result = nova_search_result_new();
-        if (!result) {
-            fprintf(stderr, "Failed to allocate search result\n");
-            break;
+        if (*count < max_results) {
+            ids[(*count)++] = sqlite3_column_int64(stmt, 0);
         }
+    }
 
-        /* Extract columns */
-        const unsigned char *filename = sqlite3_column_text(stmt, 0);
-        const unsigned char *path = sqlite3_column_text(stmt, 1);
-        const unsigned char *file_type = sqlite3_column_text(stmt, 2);
-        
-        result->filename = filename ? strdup((const char *)filename) : NULL;
-        result->path = path ? strdup((const char *)path) : NULL;
-        result->file_type = file_type ? strdup((const char *)file_type) : NULL;
-        result->size = sqlite3_column_int64(stmt, 3);
-        result->modified_time = sqlite3_column_int64(stmt, 4);
-        result->next = NULL;
-
-        /* Add to linked list */
-        if (!head) {
-            head = result;
-            tail = result;
-        } else {
-            tail->next = result;
-            tail = result;
-        }
+    if (is_cancelled) {
+        sqlite3_progress_handler(db->db, 0, NULL, NULL);
     }
 
-    if (rc != SQLITE_DONE && rc != SQLITE_ROW) {
+    release_cached(stmt);
+
+    if (rc == SQLITE_INTERRUPT) {
+        /* Superseded; the partial ranking is of no use to the caller */
+        free(ids);
+        return NULL;
+    }
+    if (rc != SQLITE_DONE) {
         fprintf(stderr, "Query execution error: %s\n", sqlite3_errmsg(db->db));
+        free(ids);
+        return NULL;
     }
 
-    sqlite3_finalize(stmt);
-    return head;
+    query_cache_store(db, query, max_results, ids, *count);
+    return ids;
 }
 
-/* Record file launch for usage tracking */
-bool nova_search_db_record_launch(NovaSearchDB *db, const char *file_path) {
-    if (!db || !file_path) {
-        return false;
+/* Execute search query with ranking logic */
+SearchResult* nova_search_db_query(NovaSearchDB *db, const char *query, int max_results) {
+    return nova_search_db_query_cancellable(db, query, max_results, NULL, NULL);
+}
+
+/* Execute search query, abandoning it as soon as is_cancelled returns true.
+ * A cancelled query returns NULL. */
+SearchResult* nova_search_db_query_cancellable(NovaSearchDB *db, const char *query, int max_results,
+                                               NovaSearchCancelFunc is_cancelled, void *user_data) {
+    if (!db) {
+        fprintf(stderr, "Database object is NULL\n");
+        return NULL;
     }
 
-    /* We need to open the database in read-write mode for this operation */
-    sqlite3 *rw_db = NULL;
-    int rc = sqlite3_open(db->db_path, &rw_db);
-    
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Failed to open database for writing: %s\n", sqlite3_errmsg(rw_db));
-        if (rw_db) {
-            sqlite3_close(rw_db);
+    if (!query || strlen(query) == 0) {
+        /* Empty query returns no results */
+        return NULL;
+    }
+
+    if (max_results <= 0) {
+        max_results = DEFAULT_MAX_RESULTS;
+    }
+
+    if (is_cancelled && is_cancelled(user_data)) {
+        return NULL;
+    }
+
+    /* A running daemon answers from memory, without touching the database */
+    ServerResponse response;
+    uint32_t served;
+    if (server_query(db, query, max_results, &response, &served)) {
+        SearchResult *head = NULL;
+        SearchResult *tail = NULL;
+        for (uint32_t i = 0; i < served; i++) {
+            SearchResult *result = nova_search_result_new();
+            if (!result || !read_server_result(&response.reader, NULL, result)) {
+                fprintf(stderr, "Failed to allocate search result\n");
+                nova_search_result_free(result);
+                break;
+            }
+
+            if (!head) {
+                head = result;
+            } else {
+                tail->next = result;
+            }
+            tail = result;
+        }
+        free(response.payload);
+        return head;
+    }
+
+    if (!db->is_connected || !db->db) {
+        fprintf(stderr, "Database is not connected\n");
+        return NULL;
+    }
+
+    int count;
+    int64_t *ids = rank_query(db, query, max_results, is_cancelled, user_data, &count);
+    if (!ids) {
+        return NULL;
+    }
+
+    SearchResult *results = NULL;
+    if (!is_cancelled || !is_cancelled(user_data)) {
+        results = nova_search_db_fetch(db, ids, count);
+    }
+    free(ids);
+    return results;
+}
+
+/* Step the fetch statement for a file id to its row. Returns the statement,
+ * to be released once the row is read, or NULL if the id is not indexed. */
+static sqlite3_stmt *fetch_row(NovaSearchDB *db, int64_t id) {
+    bool system = id < 0;
+    if (system && !db->system_attached) {
+        return NULL;
+    }
+
+    sqlite3_stmt *stmt = system
+        ? prepare_cached(db->db, &db->fetch_system_stmt, FETCH_SYSTEM_SQL)
+        : prepare_cached(db->db, &db->fetch_stmt, FETCH_SQL);
+    if (!stmt) {
+        fprintf(stderr, "Failed to prepare fetch statement: %s\n", sqlite3_errmsg(db->db));
+        return NULL;
+    }
+
+    sqlite3_bind_int64(stmt, 1, system ? -id : id);
+
+    if (sqlite3_step(stmt) != SQLITE_ROW) {
+        release_cached(stmt);
+        return NULL;
+    }
+    return stmt;
+}
+
+/* Look up results for file ids, keeping their order. Ids that are no longer
+ * in the index are skipped; negative ids are those of the system index. */
+SearchResult* nova_search_db_fetch(NovaSearchDB *db, const int64_t *ids, int count) {
+    if (!db || !db->is_connected || !db->db) {
+        fprintf(stderr, "Database is not connected\n");
+        return NULL;
+    }
+
+    SearchResult *head = NULL;
+    SearchResult *tail = NULL;
+
+    for (int i = 0; i < count; i++) {
+        sqlite3_stmt *stmt = fetch_row(db, ids[i]);
+        if (!stmt) {
+            continue;
+        }
+
+        SearchResult *result = nova_search_result_new();
+        if (!result) {
+            fprintf(stderr, "Failed to allocate search result\n");
+            release_cached(stmt);
+            break;
+        }
+
+        read_result_row(stmt, result);
+        release_cached(stmt);
+
+        if (!head) {
+            head = result;
+        } else {
+            tail->next = result;
+        }
+        tail = result;
+    }
+
+    return head;
+}
+
+/* Page arenas grow by blocks of this size, or of a larger single string */
+#define RESULT_ARENA_BLOCK_SIZE (16 * 1024)
+
+struct ResultArenaBlock {
+    ResultArenaBlock *next;
+    size_t used;
+    size_t size;
+    unsigned char data[];
+};
+
+/* Cursors walk ranked ids, fetching each page from the database, results
+ * a source builds a page at a time, or a result list built already */
+struct NovaSearchCursor {
+    NovaSearchDB *db;
+    int64_t *ids;
+    int count;
+    int position;
+    NovaSearchCursorSource source;
+    void *source_data;
+    SearchResult *results;
+};
+
+/* Allocate from a page's arena; align must be a power of two */
+static void *arena_alloc(SearchResultPage *page, size_t size, size_t align) {
+    ResultArenaBlock *block = page->blocks;
+    size_t offset = block ? (block->used + align - 1) & ~(align - 1) : 0;
+
+    if (!block || offset + size > block->size) {
+        size_t capacity = size > RESULT_ARENA_BLOCK_SIZE ? size : RESULT_ARENA_BLOCK_SIZE;
+        block = malloc(sizeof(ResultArenaBlock) + capacity);
+        if (!block) {
+            return NULL;
+        }
+        block->next = page->blocks;
+        block->size = capacity;
+        page->blocks = block;
+        offset = 0;
+    }
+
+    block->used = offset + size;
+    return block->data + offset;
+}
+
+/* Allocate a cleared result from a page's arena and append it to the page.
+ * Returns NULL if the arena runs out of memory. */
+SearchResult* nova_search_result_page_add(SearchResultPage *page) {
+    SearchResult *result = arena_alloc(page, sizeof(SearchResult), _Alignof(SearchResult));
+    if (!result) {
+        return NULL;
+    }
+    memset(result, 0, sizeof(SearchResult));
+
+    if (!page->last) {
+        page->results = result;
+    } else {
+        page->last->next = result;
+    }
+    page->last = result;
+    page->count++;
+    return result;
+}
+
+/* Copy length bytes of text into a page's arena as a NUL-terminated
+ * string. Returns NULL if the arena runs out of memory. */
+char* nova_search_result_page_strndup(SearchResultPage *page, const char *text, size_t length) {
+    char *copy = arena_alloc(page, length + 1, 1);
+    if (copy) {
+        memcpy(copy, text, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+/* Copy a text column into a page's arena, or return NULL if it is NULL.
+ * *ok is cleared if the arena runs out of memory. */
+static char *arena_column_text(SearchResultPage *page, sqlite3_stmt *stmt, int column, bool *ok) {
+    const unsigned char *text = sqlite3_column_text(stmt, column);
+    if (!text) {
+        return NULL;
+    }
+
+    size_t length = (size_t)sqlite3_column_bytes(stmt, column);
+    char *copy = nova_search_result_page_strndup(page, (const char *)text, length);
+    if (!copy) {
+        *ok = false;
+    }
+    return copy;
+}
+
+/* Read the current fetch row into a result allocated from a page's arena,
+ * as read_result_row does. Returns NULL if the arena runs out of memory. */
+static SearchResult *arena_read_result_row(SearchResultPage *page, sqlite3_stmt *stmt) {
+    SearchResult *result = arena_alloc(page, sizeof(SearchResult), _Alignof(SearchResult));
+    if (!result) {
+        return NULL;
+    }
+
+    bool ok = true;
+    result->filename = arena_column_text(page, stmt, 0, &ok);
+    result->path = arena_column_text(page, stmt, 1, &ok);
+    result->file_type = arena_column_text(page, stmt, 2, &ok);
+    result->size = sqlite3_column_int64(stmt, 3);
+    result->modified_time = sqlite3_column_int64(stmt, 4);
+    result->app_name = arena_column_text(page, stmt, 5, &ok);
+    result->app_icon = arena_column_text(page, stmt, 6, &ok);
+    result->app_exec = arena_column_text(page, stmt, 7, &ok);
+    result->next = NULL;
+    return ok ? result : NULL;
+}
+
+/* Rank a query in SQLite, without asking the query server, and return a
+ * cursor over its results. Returns NULL for an empty query, or if the query
+ * fails or is cancelled. */
+NovaSearchCursor* nova_search_db_query_cursor(NovaSearchDB *db, const char *query, int max_results,
+                                              NovaSearchCancelFunc is_cancelled, void *user_data) {
+    if (!db || !db->is_connected || !db->db) {
+        fprintf(stderr, "Database is not connected\n");
+        return NULL;
+    }
+
+    if (!query || strlen(query) == 0) {
+        return NULL;
+    }
+
+    if (max_results <= 0) {
+        max_results = DEFAULT_MAX_RESULTS;
+    }
+
+    if (is_cancelled && is_cancelled(user_data)) {
+        return NULL;
+    }
+
+    NovaSearchCursor *cursor = calloc(1, sizeof(NovaSearchCursor));
+    if (!cursor) {
+        fprintf(stderr, "Failed to allocate search cursor\n");
+        return NULL;
+    }
+
+    cursor->db = db;
+    cursor->ids = rank_query(db, query, max_results, is_cancelled, user_data, &cursor->count);
+    if (!cursor->ids) {
+        free(cursor);
+        return NULL;
+    }
+    return cursor;
+}
+
+/* Return a cursor over the results for file ids, as nova_search_db_fetch
+ * would look them up. The ids are copied. */
+NovaSearchCursor* nova_search_db_fetch_cursor(NovaSearchDB *db, const int64_t *ids, int count) {
+    if (!db || count < 0) {
+        return NULL;
+    }
+
+    NovaSearchCursor *cursor = calloc(1, sizeof(NovaSearchCursor));
+    int64_t *copy = malloc(((size_t)count + 1) * sizeof(int64_t));
+    if (!cursor || !copy) {
+        fprintf(stderr, "Failed to allocate search cursor\n");
+        free(cursor);
+        free(copy);
+        return NULL;
+    }
+    memcpy(copy, ids, (size_t)count * sizeof(int64_t));
+
+    cursor->db = db;
+    cursor->ids = copy;
+    cursor->count = count;
+    return cursor;
+}
+
+/* Return a cursor handing out a result list, which it takes over */
+NovaSearchCursor* nova_search_cursor_from_list(SearchResult *results) {
+    NovaSearchCursor *cursor = calloc(1, sizeof(NovaSearchCursor));
+    if (!cursor) {
+        fprintf(stderr, "Failed to allocate search cursor\n");
+        nova_search_result_list_free(results);
+        return NULL;
+    }
+
+    cursor->results = results;
+    return cursor;
+}
+
+/* Return a cursor over count results that a source builds into each page
+ * as it is fetched. The cursor takes over data, releasing it with
+ * source->free. */
+NovaSearchCursor* nova_search_cursor_from_source(const NovaSearchCursorSource *source, void *data,
+                                                 int count) {
+    NovaSearchCursor *cursor = calloc(1, sizeof(NovaSearchCursor));
+    if (!cursor) {
+        fprintf(stderr, "Failed to allocate search cursor\n");
+        source->free(data);
+        return NULL;
+    }
+
+    cursor->source = *source;
+    cursor->source_data = data;
+    cursor->count = count > 0 ? count : 0;
+    return cursor;
+}
+
+/* Have a source cursor's producer build up to page_size further results */
+static SearchResultPage *source_next_page(NovaSearchCursor *cursor, int page_size) {
+    SearchResultPage *page = calloc(1, sizeof(SearchResultPage));
+    if (!page) {
+        return NULL;
+    }
+
+    int wanted = cursor->count - cursor->position;
+    if (wanted > page_size) {
+        wanted = page_size;
+    }
+    cursor->source.fill(cursor->source_data, page, wanted);
+
+    /* A producer that falls short has nothing more to give */
+    cursor->position = page->count < wanted ? cursor->count : cursor->position + page->count;
+    if (page->count == 0) {
+        nova_search_result_page_free(page);
+        return NULL;
+    }
+    return page;
+}
+
+/* Take up to page_size results from a list cursor without copying them */
+static SearchResultPage *list_next_page(NovaSearchCursor *cursor, int page_size) {
+    SearchResultPage *page = calloc(1, sizeof(SearchResultPage));
+    if (!page) {
+        return NULL;
+    }
+
+    page->results = cursor->results;
+    SearchResult *last = cursor->results;
+    page->count = 1;
+    while (page->count < page_size && last->next) {
+        last = last->next;
+        page->count++;
+    }
+
+    cursor->results = last->next;
+    last->next = NULL;
+    return page;
+}
+
+/* Fetch the results for up to page_size further ids of an id cursor */
+static SearchResultPage *ids_next_page(NovaSearchCursor *cursor, int page_size) {
+    NovaSearchDB *db = cursor->db;
+    if (!db->is_connected || !db->db) {
+        fprintf(stderr, "Database is not connected\n");
+        return NULL;
+    }
+
+    SearchResultPage *page = calloc(1, sizeof(SearchResultPage));
+    if (!page) {
+        return NULL;
+    }
+
+    SearchResult *tail = NULL;
+    while (page->count < page_size && cursor->position < cursor->count) {
+        sqlite3_stmt *stmt = fetch_row(db, cursor->ids[cursor->position]);
+        if (!stmt) {
+            /* No longer indexed */
+            cursor->position++;
+            continue;
+        }
+
+        SearchResult *result = arena_read_result_row(page, stmt);
+        release_cached(stmt);
+        if (!result) {
+            fprintf(stderr, "Failed to allocate search result\n");
+            break;
+        }
+        cursor->position++;
+
+        if (!tail) {
+            page->results = result;
+        } else {
+            tail->next = result;
+        }
+        tail = result;
+        page->count++;
+    }
+
+    if (page->count == 0) {
+        nova_search_result_page_free(page);
+        return NULL;
+    }
+    return page;
+}
+
+/* Return the next page of at most page_size results, best first, or NULL
+ * once there are no more. page_size <= 0 takes all remaining results. */
+SearchResultPage* nova_search_cursor_next_page(NovaSearchCursor *cursor, int page_size) {
+    if (!cursor || !nova_search_cursor_has_more(cursor)) {
+        return NULL;
+    }
+
+    if (page_size <= 0) {
+        page_size = INT_MAX;
+    }
+    if (cursor->ids) {
+        return ids_next_page(cursor, page_size);
+    }
+    return cursor->source.fill ? source_next_page(cursor, page_size) : list_next_page(cursor, page_size);
+}
+
+/* Check whether a cursor may have results left to page through */
+bool nova_search_cursor_has_more(const NovaSearchCursor *cursor) {
+    if (!cursor) {
+        return false;
+    }
+    if (cursor->ids || cursor->source.fill) {
+        return cursor->position < cursor->count;
+    }
+    return cursor->results != NULL;
+}
+
+/* Free a cursor along with the results it has not handed out */
+void nova_search_cursor_free(NovaSearchCursor *cursor) {
+    if (!cursor) {
+        return;
+    }
+
+    free(cursor->ids);
+    if (cursor->source.free) {
+        cursor->source.free(cursor->source_data);
+    }
+    nova_search_result_list_free(cursor->results);
+    free(cursor);
+}
+
+/* Free a page and all of its results */
+void nova_search_result_page_free(SearchResultPage *page) {
+    if (!page) {
+        return;
+    }
+
+    if (page->blocks) {
+        while (page->blocks) {
+            ResultArenaBlock *next = page->blocks->next;
+            free(page->blocks);
+            page->blocks = next;
         }
+    } else {
+        nova_search_result_list_free(page->results);
+    }
+    free(page);
+}
+
+/* Read a data version pragma, or -1 on error */
+static int64_t read_data_version(sqlite3 *conn, sqlite3_stmt **slot, const char *sql) {
+    sqlite3_stmt *stmt = prepare_cached(conn, slot, sql);
+    if (!stmt) {
+        return -1;
+    }
+
+    int64_t version = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int64(stmt, 0);
+    }
+
+    release_cached(stmt);
+    return version;
+}
+
+/* Get the data version of the read connection, or -1 on error. The value
+ * changes whenever the daemon commits, or the system index is rebuilt. */
+int64_t nova_search_db_data_version(NovaSearchDB *db) {
+    if (!db || !db->is_connected || !db->db) {
+        return -1;
+    }
+
+    int64_t version = read_data_version(db->db, &db->data_version_stmt, DATA_VERSION_SQL);
+    if (version < 0 || !db->system_attached) {
+        return version;
+    }
+
+    int64_t system_version = read_data_version(db->db, &db->system_version_stmt, SYSTEM_VERSION_SQL);
+    if (system_version < 0) {
+        return -1;
+    }
+    return version + (system_version << 32);
+}
+
+/* Read an index generation, or -1 on error. An index the daemon has not
+ * committed to yet is at generation 0. */
+static int64_t read_generation(sqlite3 *conn, sqlite3_stmt **slot, const char *sql) {
+    sqlite3_stmt *stmt = prepare_cached(conn, slot, sql);
+    if (!stmt) {
+        return -1;
+    }
+
+    int rc = sqlite3_step(stmt);
+    int64_t generation = (rc == SQLITE_ROW) ? sqlite3_column_int64(stmt, 0)
+                                            : (rc == SQLITE_DONE) ? 0 : -1;
+    release_cached(stmt);
+    return generation;
+}
+
+/* Get the generation an index snapshot taken now would be stamped with, as
+ * snapshot_generation in daemon/src/query_server.rs computes it. Returns
+ * false if it cannot be read. */
+bool nova_search_db_snapshot_generation(NovaSearchDB *db, uint64_t *generation) {
+    if (!db || !db->is_connected || !db->db || !generation) {
         return false;
     }
 
-    /* Get current timestamp */
-    time_t current_time = time(NULL);
-    
-    /* First, get the file ID */
-    const char *get_file_id_sql = "SELECT id FROM files WHERE path = ?";
+    int64_t index_generation = read_generation(db->db, &db->index_generation_stmt,
+                                               INDEX_GENERATION_SQL);
+    int64_t system_generation = db->system_attached
+        ? read_generation(db->db, &db->system_generation_stmt, SYSTEM_GENERATION_SQL)
+        : 0;
+    if (index_generation < 0 || system_generation < 0) {
+        return false;
+    }
+
+    *generation = (uint64_t)index_generation + ((uint64_t)system_generation << 32);
+    return true;
+}
+
+/* Load the frecency of every launched entry, with their number in *count.
+ * Returns NULL with *count 0 if there are none, or -1 on error. */
+LaunchFrecency* nova_search_db_load_frecencies(NovaSearchDB *db, int *count) {
+    if (!count) {
+        return NULL;
+    }
+    *count = -1;
+    if (!db || !db->is_connected || !db->db) {
+        return NULL;
+    }
+
     sqlite3_stmt *stmt = NULL;
-    
-    rc = sqlite3_prepare_v2(rw_db, get_file_id_sql, -1, &stmt, NULL);
+    if (sqlite3_prepare_v2(db->db, db->system_attached ? FRECENCIES_SYSTEM_SQL : FRECENCIES_SQL,
+                           -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare frecency query: %s\n", sqlite3_errmsg(db->db));
+        return NULL;
+    }
+
+    LaunchFrecency *frecencies = NULL;
+    int loaded = 0;
+    int capacity = 0;
+    bool ok = true;
+    int rc;
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        if (loaded == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            LaunchFrecency *grown = realloc(frecencies, sizeof(LaunchFrecency) * (size_t)capacity);
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            frecencies = grown;
+        }
+
+        frecencies[loaded].path = column_strdup(stmt, 0);
+        frecencies[loaded].frecency = sqlite3_column_int64(stmt, 1);
+        if (!frecencies[loaded].path) {
+            ok = false;
+            break;
+        }
+        loaded++;
+    }
+
+    if (ok && rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to load frecencies: %s\n", sqlite3_errmsg(db->db));
+        ok = false;
+    }
+    sqlite3_finalize(stmt);
+
+    if (!ok) {
+        nova_search_frecencies_free(frecencies, loaded);
+        return NULL;
+    }
+
+    *count = loaded;
+    return frecencies;
+}
+
+/* Free frecencies returned by nova_search_db_load_frecencies */
+void nova_search_frecencies_free(LaunchFrecency *frecencies, int count) {
+    for (int i = 0; i < count; i++) {
+        free(frecencies[i].path);
+    }
+    free(frecencies);
+}
+
+/* Check whether the daemon's query server can be reached */
+bool nova_search_db_has_server(NovaSearchDB *db) {
+    return db && server_connect(db);
+}
+
+/* Build the next results of a server response into a page */
+static void server_fill_page(void *data, SearchResultPage *page, int count) {
+    ServerResponse *response = data;
+    for (int i = 0; i < count; i++) {
+        /* Appended only once complete */
+        SearchResult parsed = { 0 };
+        SearchResult *result = read_server_result(&response->reader, page, &parsed)
+                               ? nova_search_result_page_add(page) : NULL;
+        if (!result) {
+            fprintf(stderr, "Failed to allocate search result\n");
+            return;
+        }
+        *result = parsed;
+    }
+}
+
+static void server_response_free(void *data) {
+    ServerResponse *response = data;
+    free(response->payload);
+    free(response);
+}
+
+static const NovaSearchCursorSource SERVER_CURSOR_SOURCE = { server_fill_page, server_response_free };
+
+/* Ask the daemon's query server for results. Returns false if the server
+ * is unreachable or fails, in which case the caller should query SQLite;
+ * otherwise *cursor walks the (possibly empty) results, which are built
+ * from the response straight into each page. */
+bool nova_search_db_query_server(NovaSearchDB *db, const char *query, int max_results,
+                                 NovaSearchCursor **cursor) {
+    if (!cursor) {
+        return false;
+    }
+    *cursor = NULL;
+
+    ServerResponse *response = malloc(sizeof(ServerResponse));
+    uint32_t count;
+    if (!response || !server_query(db, query, max_results, response, &count)) {
+        free(response);
+        return false;
+    }
+
+    *cursor = nova_search_cursor_from_source(&SERVER_CURSOR_SOURCE, response, (int)count);
+    return *cursor != NULL;
+}
+
+/* Open the read-write handle used for usage tracking */
+static bool open_rw_db(NovaSearchDB *db) {
+    if (db->rw_db) {
+        return true;
+    }
+
+    int rc = sqlite3_open_v2(db->db_path, &db->rw_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_URI, NULL);
     if (rc != SQLITE_OK) {
-        fprintf(stderr, "Failed to prepare file ID query: %s\n", sqlite3_errmsg(rw_db));
-        sqlite3_close(rw_db);
+        fprintf(stderr, "Failed to open database for writing: %s\n", sqlite3_errmsg(db->rw_db));
+        sqlite3_close(db->rw_db);
+        db->rw_db = NULL;
+        return false;
+    }
+
+    sqlite3_busy_timeout(db->rw_db, BUSY_TIMEOUT_MS);
+
+    /* Launches of system entries are looked up in the system index */
+    if (db->system_attached) {
+        attach_system_index(db->rw_db, db->system_db_path);
+    }
+    return true;
+}
+
+/* Record a launch of an entry of the system index in system_usage. Returns
+ * false if the entry is not in the system index either. */
+static bool record_system_launch_locked(NovaSearchDB *db, const char *file_path,
+                                        const char *filename, time_t current_time) {
+    sqlite3_stmt *stmt = prepare_cached(db->rw_db, &db->system_file_stmt, SYSTEM_FILE_SQL);
+    if (!stmt) {
+        fprintf(stderr, "Failed to prepare system file query: %s\n", sqlite3_errmsg(db->rw_db));
+        return false;
+    }
+
+    sqlite3_bind_text(stmt, 1, file_path, (int)(filename - file_path), SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, filename + 1, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 3, file_path, -1, SQLITE_TRANSIENT);
+
+    bool found = false;
+    int64_t frecency = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        found = true;
+        frecency = sqlite3_column_int64(stmt, 0);
+    }
+
+    release_cached(stmt);
+
+    if (!found) {
+        return false;
+    }
+
+    int64_t updated = add_launch_to_frecency(frecency, current_time);
+    stmt = prepare_cached(db->rw_db, &db->system_usage_update_stmt, SYSTEM_USAGE_UPDATE_SQL);
+    if (!stmt) {
+        fprintf(stderr, "Failed to prepare usage update query: %s\n", sqlite3_errmsg(db->rw_db));
+        return false;
+    }
+
+    sqlite3_bind_int64(stmt, 1, current_time);
+    sqlite3_bind_int64(stmt, 2, updated);
+    sqlite3_bind_text(stmt, 3, file_path, -1, SQLITE_TRANSIENT);
+
+    int rc = sqlite3_step(stmt);
+    release_cached(stmt);
+
+    if (rc == SQLITE_DONE && sqlite3_changes(db->rw_db) == 0) {
+        stmt = prepare_cached(db->rw_db, &db->system_usage_insert_stmt, SYSTEM_USAGE_INSERT_SQL);
+        if (!stmt) {
+            fprintf(stderr, "Failed to prepare usage insert query: %s\n", sqlite3_errmsg(db->rw_db));
+            return false;
+        }
+
+        sqlite3_bind_text(stmt, 1, file_path, -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, current_time);
+        sqlite3_bind_int64(stmt, 3, updated);
+
+        rc = sqlite3_step(stmt);
+        release_cached(stmt);
+    }
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to update usage stats: %s\n", sqlite3_errmsg(db->rw_db));
+        return false;
+    }
+    return true;
+}
+
+/* Record a launch inside the transaction opened by nova_search_db_record_launch */
+static bool record_launch_locked(NovaSearchDB *db, const char *file_path, time_t current_time) {
+    /* First, get the file ID */
+    sqlite3_stmt *stmt = prepare_cached(db->rw_db, &db->file_id_stmt, FILE_ID_SQL);
+    if (!stmt) {
+        fprintf(stderr, "Failed to prepare file ID query: %s\n", sqlite3_errmsg(db->rw_db));
         return false;
     }
     
-    sqlite3_bind_text(stmt, 1, file_path, -1, SQLITE_TRANSIENT);
+    /* The directory key is the path up to its last separator, "" for "/" */
+    const char *filename = strrchr(file_path, '/');
+    if (!filename) {
+        release_cached(stmt);
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, file_path, (int)(filename - file_path), SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, filename + 1, -1, SQLITE_TRANSIENT);
     
     int64_t file_id = -1;
+    int64_t frecency = 0;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
         file_id = sqlite3_column_int64(stmt, 0);
+        frecency = sqlite3_column_int64(stmt, 1);
     }
     
-    sqlite3_finalize(stmt);
+    release_cached(stmt);
     
     if (file_id == -1) {
-        /* File not found in database */
-        sqlite3_close(rw_db);
-        return false;
+        /* File not found in database, though it may be a system entry */
+        return db->system_attached &&
+               record_system_launch_locked(db, file_path, filename, current_time);
     }
     
-    /* Insert or update usage stats */
-    const char *upsert_sql = 
-        "INSERT INTO usage_stats (file_id, launch_count, last_launched) "
-        "VALUES (?, 1, ?) "
-        "ON CONFLICT(file_id) DO UPDATE SET "
-        "  launch_count = launch_count + 1, "
-        "  last_launched = ?";
-    
-    rc = sqlite3_prepare_v2(rw_db, upsert_sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-        fprintf(stderr, "Failed to prepare usage update query: %s\n", sqlite3_errmsg(rw_db));
-        sqlite3_close(rw_db);
+    /* Update the usage stats, creating them on the first launch. Every
+     * launch after the first finds its row, so the update is tried first. */
+    stmt = prepare_cached(db->rw_db, &db->usage_update_stmt, USAGE_UPDATE_SQL);
+    if (!stmt) {
+        fprintf(stderr, "Failed to prepare usage update query: %s\n", sqlite3_errmsg(db->rw_db));
         return false;
     }
     
-    sqlite3_bind_int64(stmt, 1, file_id);
-    sqlite3_bind_int64(stmt, 2, current_time);
-    sqlite3_bind_int64(stmt, 3, current_time);
+    sqlite3_bind_int64(stmt, 1, current_time);
+    sqlite3_bind_int64(stmt, 2, file_id);
     
-    rc = sqlite3_step(stmt);
-    sqlite3_finalize(stmt);
-    sqlite3_close(rw_db);
+    int rc = sqlite3_step(stmt);
+    release_cached(stmt);
+    
+    if (rc == SQLITE_DONE && sqlite3_changes(db->rw_db) == 0) {
+        stmt = prepare_cached(db->rw_db, &db->usage_insert_stmt, USAGE_INSERT_SQL);
+        if (!stmt) {
+            fprintf(stderr, "Failed to prepare usage insert query: %s\n", sqlite3_errmsg(db->rw_db));
+            return false;
+        }
+        
+        sqlite3_bind_int64(stmt, 1, file_id);
+        sqlite3_bind_int64(stmt, 2, current_time);
+        
+        rc = sqlite3_step(stmt);
+        release_cached(stmt);
+    }
     
     if (rc != SQLITE_DONE) {
-        fprintf(stderr, "Failed to update usage stats: %s\n", sqlite3_errmsg(rw_db));
+        fprintf(stderr, "Failed to update usage stats: %s\n", sqlite3_errmsg(db->rw_db));
+        return false;
+    }
+
+    stmt = prepare_cached(db->rw_db, &db->frecency_update_stmt, FRECENCY_UPDATE_SQL);
+    if (!stmt) {
+        fprintf(stderr, "Failed to prepare frecency update query: %s\n", sqlite3_errmsg(db->rw_db));
+        return false;
+    }
+
+    sqlite3_bind_int64(stmt, 1, add_launch_to_frecency(frecency, current_time));
+    sqlite3_bind_int64(stmt, 2, file_id);
+
+    rc = sqlite3_step(stmt);
+    release_cached(stmt);
+
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to update frecency: %s\n", sqlite3_errmsg(db->rw_db));
         return false;
     }
+
+    return true;
+}
+
+/* Record file launch for usage tracking */
+bool nova_search_db_record_launch(NovaSearchDB *db, const char *file_path) {
+    if (!db || !file_path) {
+        return false;
+    }
+
+    /* We need a read-write connection for this operation */
+    if (!open_rw_db(db)) {
+        return false;
+    }
+
+    /* Get current timestamp */
+    time_t current_time = time(NULL);
     
+    /* Reading the score and writing it back must not interleave with a
+     * launch recorded by the daemon */
+    if (sqlite3_exec(db->rw_db, "BEGIN IMMEDIATE", NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to begin usage update: %s\n", sqlite3_errmsg(db->rw_db));
+        return false;
+    }
+
+    if (!record_launch_locked(db, file_path, current_time)) {
+        sqlite3_exec(db->rw_db, "ROLLBACK", NULL, NULL, NULL);
+        return false;
+    }
+
+    if (sqlite3_exec(db->rw_db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to commit usage update: %s\n", sqlite3_errmsg(db->rw_db));
+        sqlite3_exec(db->rw_db, "ROLLBACK", NULL, NULL, NULL);
+        return false;
+    }
     return true;
 }
 
@@ -308,6 +1817,9 @@ SearchResult* nova_search_result_new(void) {
     result->filename = NULL;
     result->path = NULL;
     result->file_type = NULL;
+    result->app_name = NULL;
+    result->app_icon = NULL;
+    result->app_exec = NULL;
     result->size = 0;
     result->modified_time = 0;
     result->next = NULL;
@@ -330,6 +1842,15 @@ void nova_search_result_free(SearchResult *result) {
     if (result->file_type) {
         free(result->file_type);
     }
+    if (result->app_name) {
+        free(result->app_name);
+    }
+    if (result->app_icon) {
+        free(result->app_icon);
+    }
+    if (result->app_exec) {
+        free(result->app_exec);
+    }
 
     free(result);
 }
@@ -5,13 +5,78 @@
 
 #include <sqlite3.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <time.h>
+
+/* Number of SQLite query results kept for repeated queries */
+#define QUERY_CACHE_SIZE 32
+
+/* Result limit used when a query gives none */
+#define DEFAULT_MAX_RESULTS 50
+
+/* Largest result limit, the one the daemon's query server enforces as
+ * MAX_RESULTS_LIMIT in daemon/src/query_server.rs, so every backend gives
+ * the same number of results */
+#define MAX_RESULTS_LIMIT 1000
+
+/* Application index shared by all users, built by novasearch-daemon
+ * system-index as in daemon/src/paths.rs */
+#define NOVASEARCH_SYSTEM_DB_PATH "/var/lib/novasearch/system.db"
+
+/* The ranked ids of a query's results; query is NULL for an unused slot */
+typedef struct {
+    char *query;
+    int max_results;
+    int64_t *ids;
+    int count;
+    uint64_t last_used;
+} QueryCacheEntry;
 
 /* Database connection structure */
 typedef struct {
     sqlite3 *db;
     char *db_path;
     bool is_connected;
+
+    /* Statements prepared on first use and kept until close */
+    sqlite3_stmt *query_fts_stmt;
+    sqlite3_stmt *query_scan_stmt;
+    sqlite3_stmt *fetch_stmt;
+    sqlite3_stmt *data_version_stmt;
+
+    /* System index attached read-only as "system" when it exists. Its
+     * entries are searched alongside the user's own, and the search engine
+     * and fetch know them by their negated ids. */
+    char *system_db_path;
+    bool system_attached;
+    sqlite3_stmt *fetch_system_stmt;
+    sqlite3_stmt *system_version_stmt;
+    sqlite3_stmt *index_generation_stmt;
+    sqlite3_stmt *system_generation_stmt;
+
+    /* Results of recent SQLite queries, least recently used first to go.
+     * They hold while the data version is cache_version. */
+    QueryCacheEntry query_cache[QUERY_CACHE_SIZE];
+    int64_t cache_version;
+    uint64_t cache_clock;
+
+    /* Read-write handle for usage tracking, opened on the first launch */
+    sqlite3 *rw_db;
+    sqlite3_stmt *file_id_stmt;
+    sqlite3_stmt *usage_update_stmt;
+    sqlite3_stmt *usage_insert_stmt;
+    sqlite3_stmt *frecency_update_stmt;
+    sqlite3_stmt *system_file_stmt;
+    sqlite3_stmt *system_usage_update_stmt;
+    sqlite3_stmt *system_usage_insert_stmt;
+
+    /* Connection to the daemon's query server, next to the database file.
+     * server_fd is -1 while disconnected; after a failed connect no new
+     * attempt is made before server_retry_at. */
+    char *socket_path;
+    int server_fd;
+    time_t server_retry_at;
 } NovaSearchDB;
 
 /* Search result structure */
@@ -21,17 +86,87 @@ typedef struct SearchResult {
     char *file_type;
     int64_t size;
     int64_t modified_time;
+    /* Launcher metadata of .desktop files as indexed by the daemon; all NULL
+     * when the entry carries none */
+    char *app_name;
+    char *app_icon;
+    char *app_exec;
     struct SearchResult *next;
 } SearchResult;
 
+/* Launch frecency of an indexed entry */
+typedef struct {
+    char *path;
+    int64_t frecency;
+} LaunchFrecency;
+
+/* Results handed out a page at a time. A page that was built, from the
+ * database or by a cursor source, keeps its results and all their strings
+ * in the blocks of one arena, which are freed together; a page cut from a
+ * result list owns that list instead and has no blocks. */
+typedef struct ResultArenaBlock ResultArenaBlock;
+
+typedef struct {
+    SearchResult *results;
+    int count;
+    ResultArenaBlock *blocks;
+    SearchResult *last;          /* Where nova_search_result_page_add appends */
+} SearchResultPage;
+
+/* Position in the ranked results of a query, read with
+ * nova_search_cursor_next_page. Pages are fetched on the thread that uses
+ * the database; a cursor holds no statements, so it may be freed anywhere. */
+typedef struct NovaSearchCursor NovaSearchCursor;
+
+/* Producer of the results of a cursor made with
+ * nova_search_cursor_from_source. fill builds up to count further results
+ * into the page with nova_search_result_page_add; adding fewer ends the
+ * cursor. free releases data and may be called from any thread. */
+typedef struct {
+    void (*fill)(void *data, SearchResultPage *page, int count);
+    void (*free)(void *data);
+} NovaSearchCursorSource;
+
 /* Database connection functions */
 NovaSearchDB* nova_search_db_new(const char *db_path);
 bool nova_search_db_open(NovaSearchDB *db);
 void nova_search_db_close(NovaSearchDB *db);
 void nova_search_db_free(NovaSearchDB *db);
+void nova_search_db_set_system_index(NovaSearchDB *db, const char *path);
+
+/* Polled while a query runs; returning true abandons the query */
+typedef bool (*NovaSearchCancelFunc)(void *user_data);
 
 /* Query functions */
 SearchResult* nova_search_db_query(NovaSearchDB *db, const char *query, int max_results);
+SearchResult* nova_search_db_query_cancellable(NovaSearchDB *db, const char *query, int max_results,
+                                               NovaSearchCancelFunc is_cancelled, void *user_data);
+SearchResult* nova_search_db_fetch(NovaSearchDB *db, const int64_t *ids, int count);
+int64_t nova_search_db_data_version(NovaSearchDB *db);
+
+/* Index snapshot validation */
+bool nova_search_db_snapshot_generation(NovaSearchDB *db, uint64_t *generation);
+LaunchFrecency* nova_search_db_load_frecencies(NovaSearchDB *db, int *count);
+void nova_search_frecencies_free(LaunchFrecency *frecencies, int count);
+
+/* Paged queries */
+NovaSearchCursor* nova_search_db_query_cursor(NovaSearchDB *db, const char *query, int max_results,
+                                              NovaSearchCancelFunc is_cancelled, void *user_data);
+NovaSearchCursor* nova_search_db_fetch_cursor(NovaSearchDB *db, const int64_t *ids, int count);
+NovaSearchCursor* nova_search_cursor_from_list(SearchResult *results);
+NovaSearchCursor* nova_search_cursor_from_source(const NovaSearchCursorSource *source, void *data,
+                                                 int count);
+SearchResultPage* nova_search_cursor_next_page(NovaSearchCursor *cursor, int page_size);
+bool nova_search_cursor_has_more(const NovaSearchCursor *cursor);
+void nova_search_cursor_free(NovaSearchCursor *cursor);
+void nova_search_result_page_free(SearchResultPage *page);
+SearchResult* nova_search_result_page_add(SearchResultPage *page);
+char* nova_search_result_page_strndup(SearchResultPage *page, const char *text, size_t length);
+
+/* Daemon query server */
+bool nova_search_db_has_server(NovaSearchDB *db);
+bool nova_search_db_query_server(NovaSearchDB *db, const char *query, int max_results,
+                                 NovaSearchCursor **cursor);
 
 /* Usage tracking functions */
 bool nova_search_db_record_launch(NovaSearchDB *db, const char *file_path);
@@ -7,6 +7,8 @@
 #include <gio/gdesktopappinfo.h>
 #include <keybinder.h>
 #include "database.h"
+#include "search_engine.h"
+#include "snapshot.h"
 
 /* Default keyboard shortcut */
 #define DEFAULT_KEYBOARD_SHORTCUT "<Super>space"
@@ -19,12 +21,38 @@ typedef struct {
     GtkWidget *search_entry;
     GtkWidget *results_list;
     GtkWidget *results_scroll;
+    GPtrArray *spare_rows;     /* Result rows taken out of the list, for reuse */
     NovaSearchDB *db;
     guint debounce_timer;
     gchar *keyboard_shortcut;
     gboolean shortcut_registered;
+    GThreadPool *query_pool;   /* Runs queries off the main loop */
+    NovaSearchEngine *engine;  /* Filename snapshot, used by the worker only */
+    NovaSearchSnapshot *index_snapshot; /* Daemon's mapped index, worker only */
+    gint max_results;          /* ui.max_results, read at startup */
+    NovaSearchCursor *cursor;  /* Rest of the results on display */
+    NovaSearchCursor *paging_cursor; /* Cursor a page is being fetched from */
+    gint query_generation;     /* Bumped on every edit; older queries are stale */
+    guint query_jobs;          /* Jobs whose results have not reached the main loop */
+    gboolean freed;            /* Plugin destroyed while jobs were still pending */
 } NovaSearchPlugin;
 
+/* A query handed to the worker thread and back to the main loop, along
+ * with the cursor over its results and their first page. Jobs for more
+ * results borrow the plugin's cursor to fetch its next page. */
+typedef struct {
+    NovaSearchPlugin *ns_plugin;
+    gchar *query;
+    gint generation;
+    gboolean more;
+    NovaSearchCursor *cursor;
+    SearchResultPage *page;
+} NovaSearchQueryJob;
+
+/* Results bound to rows at a time. A page fills the window; the next is
+ * fetched once the list is scrolled to its end. */
+#define RESULT_PAGE_SIZE 20
+
 /* Forward declarations */
 static void nova_search_plugin_construct(XfcePanelPlugin *plugin);
 static NovaSearchPlugin* nova_search_plugin_new(XfcePanelPlugin *plugin);
@@ -39,14 +67,27 @@ static gboolean nova_search_window_focus_out(GtkWidget *widget, GdkEventFocus *e
 static void nova_search_entry_changed(GtkEntry *entry, NovaSearchPlugin *ns_plugin);
 static gboolean nova_search_execute_query_delayed(gpointer user_data);
 static void nova_search_execute_query(NovaSearchPlugin *ns_plugin, const char *query);
+static void nova_search_query_worker(gpointer data, gpointer user_data);
+static void nova_search_refresh_snapshot(NovaSearchPlugin *ns_plugin);
+static gboolean nova_search_query_finished(gpointer data);
+static void nova_search_display_results(NovaSearchPlugin *ns_plugin, SearchResult *results);
+static void nova_search_append_results(NovaSearchPlugin *ns_plugin, SearchResult *results);
 static void nova_search_clear_results(NovaSearchPlugin *ns_plugin);
-static GtkWidget* nova_search_create_result_row(SearchResult *result);
+static void nova_search_set_cursor(NovaSearchPlugin *ns_plugin, NovaSearchCursor *cursor);
+static void nova_search_request_more_results(NovaSearchPlugin *ns_plugin);
+static void nova_search_results_edge_reached(GtkScrolledWindow *scroll, GtkPositionType pos,
+                                             NovaSearchPlugin *ns_plugin);
+static GtkWidget* nova_search_create_result_row(void);
+static void nova_search_bind_result_row(GtkWidget *row, SearchResult *result);
+static void nova_search_release_row(gpointer row, gpointer user_data);
 static const char* nova_search_get_file_icon_name(const char *file_type);
 static void nova_search_open_file(NovaSearchPlugin *ns_plugin, const char *file_path);
 static void nova_search_row_activated(GtkListBox *list_box, GtkListBoxRow *row, NovaSearchPlugin *ns_plugin);
 static gboolean nova_search_row_button_press(GtkWidget *widget, GdkEventButton *event, NovaSearchPlugin *ns_plugin);
 static void nova_search_open_containing_folder(GtkMenuItem *menu_item, gpointer user_data);
+static gchar* nova_search_read_ui_setting_from_config(const gchar *key);
 static gchar* nova_search_read_keyboard_shortcut_from_config(void);
+static gint nova_search_read_max_results_from_config(void);
 static gchar* nova_search_convert_shortcut_format(const gchar *shortcut);
 static gboolean nova_search_register_keyboard_shortcut(NovaSearchPlugin *ns_plugin);
 static void nova_search_unregister_keyboard_shortcut(NovaSearchPlugin *ns_plugin);
@@ -58,7 +99,6 @@ static void nova_search_open_donation_link(GtkButton *button, gpointer user_data
 static void nova_search_save_config_file(GtkButton *button, gpointer user_data);
 static gchar* nova_search_parse_desktop_file_field(const gchar *file_path, const gchar *field);
 static gchar* nova_search_get_desktop_icon(const gchar *file_path);
-static gchar* nova_search_get_desktop_exec(const gchar *file_path);
 static gboolean nova_search_is_desktop_file(const gchar *file_path);
 static void nova_search_launch_desktop_application(const gchar *file_path);
 
@@ -74,9 +114,28 @@ static NovaSearchPlugin* nova_search_plugin_new(XfcePanelPlugin *plugin) {
     ns_plugin->search_entry = NULL;
     ns_plugin->results_list = NULL;
     ns_plugin->results_scroll = NULL;
+    ns_plugin->spare_rows = g_ptr_array_new();
     ns_plugin->debounce_timer = 0;
     ns_plugin->keyboard_shortcut = NULL;
     ns_plugin->shortcut_registered = FALSE;
+    ns_plugin->max_results = nova_search_read_max_results_from_config();
+    ns_plugin->cursor = NULL;
+    ns_plugin->paging_cursor = NULL;
+    ns_plugin->query_generation = 0;
+    ns_plugin->query_jobs = 0;
+    ns_plugin->freed = FALSE;
+    ns_plugin->engine = nova_search_engine_new();
+    
+    char *snapshot_path = g_build_filename(g_get_user_data_dir(),
+                                           "novasearch",
+                                           "index.snap",
+                                           NULL);
+    ns_plugin->index_snapshot = nova_search_snapshot_new(snapshot_path);
+    g_free(snapshot_path);
+    
+    /* A single worker, so queries never share the read connection */
+    ns_plugin->query_pool = g_thread_pool_new(nova_search_query_worker, ns_plugin,
+                                              1, FALSE, NULL);
     
     /* Initialize database connection */
     char *db_path = g_build_filename(g_get_user_data_dir(), 
@@ -134,6 +193,23 @@ static void nova_search_plugin_free(XfcePanelPlugin *plugin, NovaSearchPlugin *n
         gtk_widget_destroy(ns_plugin->search_window);
         ns_plugin->search_window = NULL;
     }
+    g_ptr_array_foreach(ns_plugin->spare_rows, nova_search_release_row, NULL);
+    g_ptr_array_free(ns_plugin->spare_rows, TRUE);
+    ns_plugin->spare_rows = NULL;
+    
+    /* Cancel outstanding queries and wait for the worker to finish with the
+     * database. Queued jobs are drained, each returning immediately. */
+    if (ns_plugin->query_pool) {
+        g_atomic_int_inc(&ns_plugin->query_generation);
+        g_thread_pool_free(ns_plugin->query_pool, FALSE, TRUE);
+        ns_plugin->query_pool = NULL;
+    }
+    nova_search_set_cursor(ns_plugin, NULL);
+    
+    nova_search_engine_free(ns_plugin->engine);
+    ns_plugin->engine = NULL;
+    nova_search_snapshot_free(ns_plugin->index_snapshot);
+    ns_plugin->index_snapshot = NULL;
     
     /* Close database connection */
     if (ns_plugin->db) {
@@ -147,6 +223,13 @@ static void nova_search_plugin_free(XfcePanelPlugin *plugin, NovaSearchPlugin *n
         ns_plugin->keyboard_shortcut = NULL;
     }
     
+    /* Results still queued on the main loop refer to the plugin; the last
+     * of them frees it */
+    if (ns_plugin->query_jobs > 0) {
+        ns_plugin->freed = TRUE;
+        return;
+    }
+    
     g_slice_free(NovaSearchPlugin, ns_plugin);
 }
 
@@ -256,6 +339,10 @@ static void nova_search_create_window(NovaSearchPlugin *ns_plugin) {
     
     gtk_box_pack_start(GTK_BOX(vbox), ns_plugin->results_scroll, TRUE, TRUE, 0);
     
+    /* Further pages of results are fetched as the list is scrolled down */
+    g_signal_connect(G_OBJECT(ns_plugin->results_scroll), "edge-reached",
+                     G_CALLBACK(nova_search_results_edge_reached), ns_plugin);
+    
     /* Create results list box */
     ns_plugin->results_list = gtk_list_box_new();
     gtk_list_box_set_selection_mode(GTK_LIST_BOX(ns_plugin->results_list), 
@@ -385,6 +472,13 @@ static gboolean nova_search_window_key_press(GtkWidget *widget, GdkEventKey *eve
                     if (next_row) {
                         gtk_list_box_select_row(GTK_LIST_BOX(ns_plugin->results_list), next_row);
                     }
+                    /* Have the next page ready before the last row is left */
+                    if (current_index + 1 == num_children - 1) {
+                        nova_search_request_more_results(ns_plugin);
+                    }
+                } else if (nova_search_cursor_has_more(ns_plugin->cursor)) {
+                    /* Stay on the last row until further results arrive */
+                    nova_search_request_more_results(ns_plugin);
                 } else {
                     /* Wrap to first row */
                     GtkListBoxRow *first_row = gtk_list_box_get_row_at_index(
@@ -473,6 +567,9 @@ static void nova_search_show_window(NovaSearchPlugin *ns_plugin) {
     /* Clear search entry */
     gtk_entry_set_text(GTK_ENTRY(ns_plugin->search_entry), "");
     
+    /* Bring the filename snapshot up to date while the user starts typing */
+    nova_search_refresh_snapshot(ns_plugin);
+    
     /* Show window and focus search entry */
     gtk_window_present(GTK_WINDOW(ns_plugin->search_window));
     gtk_widget_grab_focus(ns_plugin->search_entry);
@@ -491,6 +588,24 @@ static void nova_search_hide_window(NovaSearchPlugin *ns_plugin) {
     gtk_widget_hide(ns_plugin->search_window);
 }
 
+/* Destroy a spare result row */
+static void nova_search_release_row(gpointer row, gpointer user_data) {
+    (void)user_data; /* Unused parameter */
+    
+    gtk_widget_destroy(GTK_WIDGET(row));
+    g_object_unref(row);
+}
+
+/* Move rows out of the result list into the spare rows, to be bound to
+ * later results */
+static void nova_search_remove_rows_from(NovaSearchPlugin *ns_plugin, GList *rows) {
+    for (GList *iter = rows; iter != NULL; iter = g_list_next(iter)) {
+        GtkWidget *row = GTK_WIDGET(iter->data);
+        g_ptr_array_add(ns_plugin->spare_rows, g_object_ref(row));
+        gtk_container_remove(GTK_CONTAINER(ns_plugin->results_list), row);
+    }
+}
+
 /* Clear all results from the list */
 static void nova_search_clear_results(NovaSearchPlugin *ns_plugin) {
     if (!ns_plugin || !ns_plugin->results_list) {
@@ -499,10 +614,48 @@ static void nova_search_clear_results(NovaSearchPlugin *ns_plugin) {
     
     /* Remove all children from the list box */
     GList *children = gtk_container_get_children(GTK_CONTAINER(ns_plugin->results_list));
-    for (GList *iter = children; iter != NULL; iter = g_list_next(iter)) {
-        gtk_widget_destroy(GTK_WIDGET(iter->data));
-    }
+    nova_search_remove_rows_from(ns_plugin, children);
     g_list_free(children);
+    
+    nova_search_set_cursor(ns_plugin, NULL);
+}
+
+/* Make cursor the source of further results for the list, freeing the
+ * previous one unless a page is still being fetched from it */
+static void nova_search_set_cursor(NovaSearchPlugin *ns_plugin, NovaSearchCursor *cursor) {
+    if (ns_plugin->cursor != ns_plugin->paging_cursor) {
+        nova_search_cursor_free(ns_plugin->cursor);
+    }
+    ns_plugin->cursor = cursor;
+}
+
+/* Have the worker fetch the next page of the results on display, unless
+ * one is being fetched already */
+static void nova_search_request_more_results(NovaSearchPlugin *ns_plugin) {
+    if (ns_plugin->paging_cursor || !nova_search_cursor_has_more(ns_plugin->cursor)) {
+        return;
+    }
+    
+    NovaSearchQueryJob *job = g_slice_new0(NovaSearchQueryJob);
+    job->ns_plugin = ns_plugin;
+    job->query = NULL;
+    job->generation = g_atomic_int_get(&ns_plugin->query_generation);
+    job->more = TRUE;
+    job->cursor = ns_plugin->cursor;
+    
+    ns_plugin->paging_cursor = ns_plugin->cursor;
+    ns_plugin->query_jobs++;
+    g_thread_pool_push(ns_plugin->query_pool, job, NULL);
+}
+
+/* Fetch more results once the list is scrolled to its end */
+static void nova_search_results_edge_reached(GtkScrolledWindow *scroll, GtkPositionType pos,
+                                             NovaSearchPlugin *ns_plugin) {
+    (void)scroll; /* Unused parameter */
+    
+    if (pos == GTK_POS_BOTTOM) {
+        nova_search_request_more_results(ns_plugin);
+    }
 }
 
 /* Handle search entry text changed */
@@ -517,6 +670,9 @@ static void nova_search_entry_changed(GtkEntry *entry, NovaSearchPlugin *ns_plug
         ns_plugin->debounce_timer = 0;
     }
     
+    /* Any query still running is for outdated text */
+    g_atomic_int_inc(&ns_plugin->query_generation);
+    
     /* Get current query text */
     const gchar *query = gtk_entry_get_text(entry);
     
@@ -552,42 +708,215 @@ static gboolean nova_search_execute_query_delayed(gpointer user_data) {
     return G_SOURCE_REMOVE;
 }
 
-/* Execute search query and update results (placeholder - will be implemented in subtask 9.4) */
+/* Submit a search query to the worker thread */
 static void nova_search_execute_query(NovaSearchPlugin *ns_plugin, const char *query) {
     if (!ns_plugin || !query || strlen(query) == 0) {
         return;
     }
     
-    /* Clear existing results */
-    nova_search_clear_results(ns_plugin);
-    
     /* Check database connection */
     if (!ns_plugin->db || !ns_plugin->db->is_connected) {
         g_warning("Database not connected");
+        nova_search_clear_results(ns_plugin);
         return;
     }
     
-    /* Query database */
-    SearchResult *results = nova_search_db_query(ns_plugin->db, query, 50);
+    NovaSearchQueryJob *job = g_slice_new0(NovaSearchQueryJob);
+    job->ns_plugin = ns_plugin;
+    job->query = g_strdup(query);
+    job->generation = g_atomic_int_add(&ns_plugin->query_generation, 1) + 1;
     
-    if (!results) {
-        /* No results found - list is already cleared */
+    ns_plugin->query_jobs++;
+    g_thread_pool_push(ns_plugin->query_pool, job, NULL);
+}
+
+/* Have the worker load the filename snapshot ahead of the first query */
+static void nova_search_refresh_snapshot(NovaSearchPlugin *ns_plugin) {
+    if (!ns_plugin->db || !ns_plugin->db->is_connected) {
+        return;
+    }
+    
+    NovaSearchQueryJob *job = g_slice_new0(NovaSearchQueryJob);
+    job->ns_plugin = ns_plugin;
+    job->query = NULL;
+    job->generation = g_atomic_int_get(&ns_plugin->query_generation);
+    
+    ns_plugin->query_jobs++;
+    g_thread_pool_push(ns_plugin->query_pool, job, NULL);
+}
+
+/* Check whether a newer query has replaced this one (any thread) */
+static gboolean nova_search_query_is_stale(NovaSearchQueryJob *job) {
+    return job->generation != g_atomic_int_get(&job->ns_plugin->query_generation);
+}
+
+/* Cancellation callback polled by the database while the query runs */
+static bool nova_search_query_cancelled(void *user_data) {
+    return nova_search_query_is_stale((NovaSearchQueryJob *)user_data);
+}
+
+/* Run a query on the worker thread and hand its first page of results to
+ * the main loop */
+static void nova_search_query_worker(gpointer data, gpointer user_data) {
+    NovaSearchQueryJob *job = (NovaSearchQueryJob *)data;
+    NovaSearchPlugin *ns_plugin = (NovaSearchPlugin *)user_data;
+    
+    if (job->more) {
+        /* The next page of the results on display; an edit replaces them */
+        if (!nova_search_query_is_stale(job)) {
+            job->page = nova_search_cursor_next_page(job->cursor, RESULT_PAGE_SIZE);
+        }
+        g_idle_add(nova_search_query_finished, job);
+        return;
+    }
+    
+    /* A running daemon answers from its own in-memory index, so no
+     * snapshot needs to be loaded here */
+    NovaSearchCursor *served_cursor = NULL;
+    gboolean served = job->query
+        ? nova_search_db_query_server(ns_plugin->db, job->query, ns_plugin->max_results, &served_cursor)
+        : nova_search_db_has_server(ns_plugin->db);
+    
+    /* Otherwise search the daemon's index file in place, if it is current;
+     * it is mapped, not loaded, so this is cheap even on the first query */
+    gboolean mapped = !served && nova_search_snapshot_sync(ns_plugin->index_snapshot, ns_plugin->db);
+    NovaSearchCursor *mapped_cursor = NULL;
+    if (mapped && job->query) {
+        /* A file found corrupt while it is searched is dropped */
+        mapped = nova_search_snapshot_query(ns_plugin->index_snapshot, job->query,
+                                            ns_plugin->max_results,
+                                            nova_search_query_cancelled, job, &mapped_cursor);
+    }
+    
+    /* Failing that, reload the filename snapshot whenever the daemon has committed */
+    gboolean have_snapshot = !served && !mapped &&
+        (nova_search_engine_is_current(ns_plugin->engine, ns_plugin->db) ||
+         nova_search_engine_load(ns_plugin->engine, ns_plugin->db));
+    
+    if (!job->query) {
+        /* A snapshot refresh only */
+    } else if (served) {
+        job->cursor = served_cursor;
+    } else if (mapped) {
+        job->cursor = mapped_cursor;
+    } else if (have_snapshot) {
+        int64_t *ids = g_new(int64_t, ns_plugin->max_results);
+        int count = nova_search_engine_query(ns_plugin->engine, job->query,
+                                             ids, ns_plugin->max_results,
+                                             nova_search_query_cancelled, job);
+        if (count > 0) {
+            job->cursor = nova_search_db_fetch_cursor(ns_plugin->db, ids, count);
+        }
+        g_free(ids);
+    } else {
+        /* No snapshot could be loaded; let SQLite rank the matches */
+        job->cursor = nova_search_db_query_cursor(ns_plugin->db, job->query,
+                                                  ns_plugin->max_results,
+                                                  nova_search_query_cancelled, job);
+    }
+    
+    /* Only the first page is read before the results are shown */
+    job->page = nova_search_cursor_next_page(job->cursor, RESULT_PAGE_SIZE);
+    
+    /* Every job goes back to the main loop so query_jobs stays balanced */
+    g_idle_add(nova_search_query_finished, job);
+}
+
+/* Apply a finished query on the main loop, unless it has been superseded */
+static gboolean nova_search_query_finished(gpointer data) {
+    NovaSearchQueryJob *job = (NovaSearchQueryJob *)data;
+    NovaSearchPlugin *ns_plugin = job->ns_plugin;
+    
+    ns_plugin->query_jobs--;
+    
+    if (job->more) {
+        ns_plugin->paging_cursor = NULL;
+        if (job->cursor != ns_plugin->cursor) {
+            /* The results were replaced while the page was fetched */
+            nova_search_cursor_free(job->cursor);
+        } else if (job->page) {
+            nova_search_append_results(ns_plugin, job->page->results);
+        }
+    } else if (!ns_plugin->freed && job->query && !nova_search_query_is_stale(job)) {
+        nova_search_display_results(ns_plugin, job->page ? job->page->results : NULL);
+        nova_search_set_cursor(ns_plugin, job->cursor);
+    } else {
+        nova_search_cursor_free(job->cursor);
+    }
+    
+    /* Rows keep their own copies of what they show */
+    nova_search_result_page_free(job->page);
+    g_free(job->query);
+    g_slice_free(NovaSearchQueryJob, job);
+    
+    if (ns_plugin->freed && ns_plugin->query_jobs == 0) {
+        g_slice_free(NovaSearchPlugin, ns_plugin);
+    }
+    
+    return G_SOURCE_REMOVE;
+}
+
+/* Add a row at the end of the result list, reusing a spare one if any */
+static GtkWidget* nova_search_add_row(NovaSearchPlugin *ns_plugin) {
+    GtkListBox *list_box = GTK_LIST_BOX(ns_plugin->results_list);
+    GtkWidget *row;
+    
+    if (ns_plugin->spare_rows->len > 0) {
+        guint last = ns_plugin->spare_rows->len - 1;
+        row = g_ptr_array_index(ns_plugin->spare_rows, last);
+        g_ptr_array_remove_index(ns_plugin->spare_rows, last);
+        gtk_list_box_insert(list_box, row, -1);
+        g_object_unref(row);
+    } else {
+        row = nova_search_create_result_row();
+        gtk_list_box_insert(list_box, row, -1);
+    }
+    return row;
+}
+
+/* Replace the result list with the given results
+ *
+ * Rows are bound to the new results in place; a row already showing its
+ * result is left untouched, and rows are only built when the list grows
+ * beyond any it has held before. Surplus rows are kept for later queries. */
+static void nova_search_display_results(NovaSearchPlugin *ns_plugin, SearchResult *results) {
+    if (!ns_plugin->results_list) {
         return;
     }
     
+    GtkListBox *list_box = GTK_LIST_BOX(ns_plugin->results_list);
+    GList *children = gtk_container_get_children(GTK_CONTAINER(ns_plugin->results_list));
+    GList *existing = children;
+    
+    /* The previous selection refers to the previous results */
+    gtk_list_box_unselect_all(list_box);
+    
     /* Display results */
-    SearchResult *current = results;
-    while (current) {
-        GtkWidget *row = nova_search_create_result_row(current);
-        if (row) {
-            gtk_list_box_insert(GTK_LIST_BOX(ns_plugin->results_list), row, -1);
-            gtk_widget_show_all(row);
+    for (SearchResult *current = results; current; current = current->next) {
+        GtkWidget *row;
+        if (existing) {
+            row = GTK_WIDGET(existing->data);
+            existing = g_list_next(existing);
+        } else {
+            row = nova_search_add_row(ns_plugin);
         }
-        current = current->next;
+        nova_search_bind_result_row(row, current);
+    }
+    
+    /* Rows left over from a longer result list */
+    nova_search_remove_rows_from(ns_plugin, existing);
+    g_list_free(children);
+}
+
+/* Add a further page of results below those on display */
+static void nova_search_append_results(NovaSearchPlugin *ns_plugin, SearchResult *results) {
+    if (!ns_plugin->results_list) {
+        return;
     }
     
-    /* Free results */
-    nova_search_result_list_free(results);
+    for (SearchResult *current = results; current; current = current->next) {
+        nova_search_bind_result_row(nova_search_add_row(ns_plugin), current);
+    }
 }
 
 /* Get appropriate icon name for file type */
@@ -607,15 +936,37 @@ static const char* nova_search_get_file_icon_name(const char *file_type) {
     }
 }
 
-/* Create a custom list box row for a search result */
-static GtkWidget* nova_search_create_result_row(SearchResult *result) {
-    if (!result) {
-        return NULL;
-    }
+/* Widgets of a result row, kept on the row so it can be bound to another
+ * result without rebuilding it */
+typedef struct {
+    GtkWidget *icon;
+    GtkWidget *name_label;
+    GtkWidget *path_label;
+    /* Result fields the row was last bound to, besides its path */
+    gchar *file_type;
+    gchar *app_name;
+    gchar *app_icon;
+    gchar *app_exec;
+} NovaSearchResultRow;
+
+static void nova_search_result_row_free(gpointer data) {
+    NovaSearchResultRow *widgets = data;
+    
+    g_free(widgets->file_type);
+    g_free(widgets->app_name);
+    g_free(widgets->app_icon);
+    g_free(widgets->app_exec);
+    g_slice_free(NovaSearchResultRow, widgets);
+}
+
+/* Create an empty list box row for search results */
+static GtkWidget* nova_search_create_result_row(void) {
+    NovaSearchResultRow *widgets = g_slice_new0(NovaSearchResultRow);
     
     /* Create list box row */
     GtkWidget *row = gtk_list_box_row_new();
     gtk_widget_set_can_focus(row, TRUE);
+    g_object_set_data_full(G_OBJECT(row), "result-row", widgets, nova_search_result_row_free);
     
     /* Apply CSS class to row */
     GtkStyleContext *row_context = gtk_widget_get_style_context(row);
@@ -627,44 +978,84 @@ static GtkWidget* nova_search_create_result_row(SearchResult *result) {
     gtk_container_add(GTK_CONTAINER(row), hbox);
     
     /* Add file type icon */
-    const char *icon_name = nova_search_get_file_icon_name(result->file_type);
-    GtkWidget *icon = NULL;
-    
-    /* Special handling for .desktop files */
-    if (nova_search_is_desktop_file(result->path)) {
-        gchar *desktop_icon = nova_search_get_desktop_icon(result->path);
-        if (desktop_icon && strlen(desktop_icon) > 0) {
-            /* Try to load the application icon */
-            icon = gtk_image_new_from_icon_name(desktop_icon, GTK_ICON_SIZE_LARGE_TOOLBAR);
-            
-            /* If the icon doesn't exist, fall back to application-x-executable */
-            GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
-            if (!gtk_icon_theme_has_icon(icon_theme, desktop_icon)) {
-                gtk_image_set_from_icon_name(GTK_IMAGE(icon), "application-x-executable", GTK_ICON_SIZE_LARGE_TOOLBAR);
-            }
-            g_free(desktop_icon);
-        } else {
-            /* Fallback to generic application icon */
-            icon = gtk_image_new_from_icon_name("application-x-executable", GTK_ICON_SIZE_LARGE_TOOLBAR);
-        }
-    } else {
-        /* Use regular file type icon */
-        icon = gtk_image_new_from_icon_name(icon_name, GTK_ICON_SIZE_LARGE_TOOLBAR);
-    }
-    
-    gtk_widget_set_margin_end(icon, 4);
-    gtk_box_pack_start(GTK_BOX(hbox), icon, FALSE, FALSE, 0);
+    widgets->icon = gtk_image_new();
+    gtk_widget_set_margin_end(widgets->icon, 4);
+    gtk_box_pack_start(GTK_BOX(hbox), widgets->icon, FALSE, FALSE, 0);
     
     /* Create vertical box for text content */
     GtkWidget *vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 4);
     gtk_box_pack_start(GTK_BOX(hbox), vbox, TRUE, TRUE, 0);
     
     /* Add filename label */
+    widgets->name_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(widgets->name_label), 0.0);
+    gtk_label_set_ellipsize(GTK_LABEL(widgets->name_label), PANGO_ELLIPSIZE_END);
+    gtk_widget_set_hexpand(widgets->name_label, TRUE);
+    
+    /* Apply CSS class to filename */
+    GtkStyleContext *filename_context = gtk_widget_get_style_context(widgets->name_label);
+    gtk_style_context_add_class(filename_context, "novasearch-filename");
+    
+    gtk_box_pack_start(GTK_BOX(vbox), widgets->name_label, FALSE, FALSE, 0);
+    
+    /* Add path label */
+    widgets->path_label = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(widgets->path_label), 0.0);
+    gtk_label_set_ellipsize(GTK_LABEL(widgets->path_label), PANGO_ELLIPSIZE_MIDDLE);
+    gtk_widget_set_hexpand(widgets->path_label, TRUE);
+    
+    /* Apply CSS class to path */
+    GtkStyleContext *path_context = gtk_widget_get_style_context(widgets->path_label);
+    gtk_style_context_add_class(path_context, "novasearch-path");
+    
+    gtk_box_pack_start(GTK_BOX(vbox), widgets->path_label, FALSE, FALSE, 0);
+    
+    gtk_widget_show_all(row);
+    return row;
+}
+
+/* Check whether a row already shows a result */
+static gboolean nova_search_result_row_matches(GtkWidget *row, SearchResult *result) {
+    NovaSearchResultRow *widgets = g_object_get_data(G_OBJECT(row), "result-row");
+    
+    return g_strcmp0(g_object_get_data(G_OBJECT(row), "result-path"), result->path) == 0 &&
+           g_strcmp0(widgets->file_type, result->file_type) == 0 &&
+           g_strcmp0(widgets->app_name, result->app_name) == 0 &&
+           g_strcmp0(widgets->app_icon, result->app_icon) == 0 &&
+           g_strcmp0(widgets->app_exec, result->app_exec) == 0;
+}
+
+/* Show a search result in an existing row */
+static void nova_search_bind_result_row(GtkWidget *row, SearchResult *result) {
+    NovaSearchResultRow *widgets = g_object_get_data(G_OBJECT(row), "result-row");
+    
+    /* Rows showing the same result are left alone, so they are not redrawn */
+    if (nova_search_result_row_matches(row, result)) {
+        return;
+    }
+    
+    const char *icon_name = nova_search_get_file_icon_name(result->file_type);
     gchar *display_name = NULL;
     
-    /* Special handling for .desktop files - show application name */
+    /* Special handling for .desktop files, using the metadata the daemon
+     * indexed and parsing the file only for results that lack it */
     if (nova_search_is_desktop_file(result->path)) {
-        gchar *app_name = nova_search_parse_desktop_file_field(result->path, "Name");
+        gchar *desktop_icon = result->app_name ? g_strdup(result->app_icon)
+                                               : nova_search_get_desktop_icon(result->path);
+        
+        /* Use the application icon if the theme has it, or fall back to
+         * application-x-executable */
+        GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
+        gboolean has_icon = desktop_icon && strlen(desktop_icon) > 0 &&
+                            gtk_icon_theme_has_icon(icon_theme, desktop_icon);
+        gtk_image_set_from_icon_name(GTK_IMAGE(widgets->icon),
+                                     has_icon ? desktop_icon : "application-x-executable",
+                                     GTK_ICON_SIZE_LARGE_TOOLBAR);
+        g_free(desktop_icon);
+        
+        /* Show the application name */
+        gchar *app_name = result->app_name ? g_strdup(result->app_name)
+                                           : nova_search_parse_desktop_file_field(result->path, "Name");
         if (app_name && strlen(app_name) > 0) {
             display_name = app_name;
         } else {
@@ -679,39 +1070,33 @@ static GtkWidget* nova_search_create_result_row(SearchResult *result) {
             if (app_name) g_free(app_name);
         }
     } else {
+        /* Use regular file type icon */
+        gtk_image_set_from_icon_name(GTK_IMAGE(widgets->icon), icon_name,
+                                     GTK_ICON_SIZE_LARGE_TOOLBAR);
         display_name = g_strdup(result->filename);
     }
     
-    GtkWidget *filename_label = gtk_label_new(display_name);
+    gtk_label_set_text(GTK_LABEL(widgets->name_label), display_name);
     g_free(display_name);
     
-    gtk_label_set_xalign(GTK_LABEL(filename_label), 0.0);
-    gtk_label_set_ellipsize(GTK_LABEL(filename_label), PANGO_ELLIPSIZE_END);
-    gtk_widget_set_hexpand(filename_label, TRUE);
-    
-    /* Apply CSS class to filename */
-    GtkStyleContext *filename_context = gtk_widget_get_style_context(filename_label);
-    gtk_style_context_add_class(filename_context, "novasearch-filename");
-    
-    gtk_box_pack_start(GTK_BOX(vbox), filename_label, FALSE, FALSE, 0);
-    
-    /* Add path label */
-    GtkWidget *path_label = gtk_label_new(result->path);
-    gtk_label_set_xalign(GTK_LABEL(path_label), 0.0);
-    gtk_label_set_ellipsize(GTK_LABEL(path_label), PANGO_ELLIPSIZE_MIDDLE);
-    gtk_widget_set_hexpand(path_label, TRUE);
+    gtk_label_set_text(GTK_LABEL(widgets->path_label), result->path);
     
-    /* Apply CSS class to path */
-    GtkStyleContext *path_context = gtk_widget_get_style_context(path_label);
-    gtk_style_context_add_class(path_context, "novasearch-path");
-    
-    gtk_box_pack_start(GTK_BOX(vbox), path_label, FALSE, FALSE, 0);
+    /* Show the command an application runs */
+    gtk_widget_set_tooltip_text(row, result->app_exec && result->app_exec[0]
+                                     ? result->app_exec : NULL);
     
     /* Store result path as data on the row for later retrieval */
     g_object_set_data_full(G_OBJECT(row), "result-path", 
                            g_strdup(result->path), g_free);
     
-    return row;
+    g_free(widgets->file_type);
+    g_free(widgets->app_name);
+    g_free(widgets->app_icon);
+    g_free(widgets->app_exec);
+    widgets->file_type = g_strdup(result->file_type);
+    widgets->app_name = g_strdup(result->app_name);
+    widgets->app_icon = g_strdup(result->app_icon);
+    widgets->app_exec = g_strdup(result->app_exec);
 }
 
 /* Open file with default application */
@@ -910,8 +1295,9 @@ static void nova_search_open_containing_folder(GtkMenuItem *menu_item, gpointer
     g_free(dir_path);
 }
 
-/* Read keyboard shortcut from config file */
-static gchar* nova_search_read_keyboard_shortcut_from_config(void) {
+/* Read a setting of the [ui] section of the config file, with any quotes
+ * removed; NULL if it is not set */
+static gchar* nova_search_read_ui_setting_from_config(const gchar *key) {
     gchar *config_path = g_build_filename(g_get_user_config_dir(),
                                           "novasearch",
                                           "config.toml",
@@ -937,12 +1323,12 @@ static gchar* nova_search_read_keyboard_shortcut_from_config(void) {
     
     g_free(config_path);
     
-    /* Parse TOML to find keyboard_shortcut in [ui] section */
+    /* Parse TOML to find the key in [ui] section */
     gchar **lines = g_strsplit(contents, "\n", -1);
     g_free(contents);
     
     gboolean in_ui_section = FALSE;
-    gchar *shortcut = NULL;
+    gchar *setting = NULL;
     
     for (gint i = 0; lines[i] != NULL; i++) {
         gchar *line = g_strstrip(g_strdup(lines[i]));
@@ -961,29 +1347,55 @@ static gchar* nova_search_read_keyboard_shortcut_from_config(void) {
             continue;
         }
         
-        /* Look for keyboard_shortcut in [ui] section */
-        if (in_ui_section && g_str_has_prefix(line, "keyboard_shortcut")) {
-            gchar **parts = g_strsplit(line, "=", 2);
-            if (parts[0] && parts[1]) {
-                gchar *value = g_strstrip(g_strdup(parts[1]));
-                /* Remove quotes */
-                if (value[0] == '"' && value[strlen(value) - 1] == '"') {
-                    shortcut = g_strndup(value + 1, strlen(value) - 2);
-                } else {
-                    shortcut = g_strdup(value);
-                }
-                g_free(value);
+        /* Look for the key in [ui] section */
+        gchar **parts = in_ui_section ? g_strsplit(line, "=", 2) : NULL;
+        if (parts && parts[0] && parts[1] && g_strcmp0(g_strstrip(parts[0]), key) == 0) {
+            gchar *value = g_strstrip(g_strdup(parts[1]));
+            /* Remove quotes */
+            if (value[0] == '"' && value[strlen(value) - 1] == '"') {
+                setting = g_strndup(value + 1, strlen(value) - 2);
+            } else {
+                setting = g_strdup(value);
             }
+            g_free(value);
             g_strfreev(parts);
             g_free(line);
             break;
         }
         
+        g_strfreev(parts);
         g_free(line);
     }
     
     g_strfreev(lines);
-    return shortcut;
+    return setting;
+}
+
+/* Read keyboard shortcut from config file */
+static gchar* nova_search_read_keyboard_shortcut_from_config(void) {
+    return nova_search_read_ui_setting_from_config("keyboard_shortcut");
+}
+
+/* Read the number of results to show for a query from config file */
+static gint nova_search_read_max_results_from_config(void) {
+    gchar *setting = nova_search_read_ui_setting_from_config("max_results");
+    if (!setting) {
+        return DEFAULT_MAX_RESULTS;
+    }
+    
+    gchar *end = NULL;
+    gint64 max_results = g_ascii_strtoll(setting, &end, 10);
+    if (end == setting || *end != '\0' || max_results <= 0) {
+        g_warning("Invalid max_results in config file: %s", setting);
+        max_results = DEFAULT_MAX_RESULTS;
+    } else if (max_results > MAX_RESULTS_LIMIT) {
+        g_warning("max_results in config file is above %d, using %d: %s",
+                  MAX_RESULTS_LIMIT, MAX_RESULTS_LIMIT, setting);
+        max_results = MAX_RESULTS_LIMIT;
+    }
+    
+    g_free(setting);
+    return (gint)max_results;
 }
 
 /* Convert shortcut format from config (e.g., "Super+Space") to keybinder format (e.g., "<Super>space") */
@@ -1953,11 +2365,6 @@ static gchar* nova_search_get_desktop_icon(const gchar *file_path) {
     return nova_search_parse_desktop_file_field(file_path, "Icon");
 }
 
-/* Get executable command from .desktop file */
-static gchar* nova_search_get_desktop_exec(const gchar *file_path) {
-    return nova_search_parse_desktop_file_field(file_path, "Exec");
-}
-
 /* Launch a desktop application */
 static void nova_search_launch_desktop_application(const gchar *file_path) {
     if (!file_path) {
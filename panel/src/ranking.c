@@ -0,0 +1,117 @@
+/* NovaSearch Panel - Match Ranking Implementation */
+
+#define _GNU_SOURCE /* memmem */
+
+#include "ranking.h"
+#include <string.h>
+
+/* Fold a run of bytes */
+void nova_search_fold(char *dst, const char *src, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        dst[i] = nova_search_fold_char(src[i]);
+    }
+}
+
+/* Compare folded bytes, then length */
+int nova_search_compare_folded(const char *a, size_t a_length, const char *b, size_t b_length) {
+    size_t length = a_length < b_length ? a_length : b_length;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char x = (unsigned char)nova_search_fold_char(a[i]);
+        unsigned char y = (unsigned char)nova_search_fold_char(b[i]);
+        if (x != y) {
+            return x < y ? -1 : 1;
+        }
+    }
+    return (a_length > b_length) - (a_length < b_length);
+}
+
+/* Exact, then prefix, then substring */
+int nova_search_match_tier(const char *name, const char *folded_name, size_t name_length,
+                           const char *query, const char *folded_query, size_t query_length) {
+    if (query_length > name_length) {
+        return -1;
+    }
+    if (name_length == query_length && memcmp(name, query, query_length) == 0) {
+        return TIER_EXACT;
+    }
+    if (memcmp(folded_name, folded_query, query_length) == 0) {
+        return TIER_PREFIX;
+    }
+    if (memmem(folded_name, name_length, folded_query, query_length)) {
+        return TIER_SUBSTRING;
+    }
+    return -1;
+}
+
+/* Find a folded needle in a haystack, folding the haystack as it goes */
+static bool contains_folded(const char *haystack, size_t haystack_length,
+                            const char *folded_needle, size_t needle_length) {
+    if (needle_length > haystack_length) {
+        return false;
+    }
+    for (size_t start = 0; start + needle_length <= haystack_length; start++) {
+        size_t i = 0;
+        while (i < needle_length && nova_search_fold_char(haystack[start + i]) == folded_needle[i]) {
+            i++;
+        }
+        if (i == needle_length) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Launchers are few, so their fields are folded on the fly */
+int nova_search_match_launcher(const char *name, size_t name_length,
+                               const char *keywords, size_t keywords_length,
+                               const char *query, const char *folded_query, size_t query_length) {
+    if (name_length >= query_length) {
+        if (name_length == query_length && memcmp(name, query, query_length) == 0) {
+            return TIER_EXACT;
+        }
+        if (nova_search_compare_folded(name, query_length, folded_query, query_length) == 0) {
+            return TIER_PREFIX;
+        }
+        if (contains_folded(name, name_length, folded_query, query_length)) {
+            return TIER_SUBSTRING;
+        }
+    }
+    return contains_folded(keywords, keywords_length, folded_query, query_length) ? TIER_SUBSTRING : -1;
+}
+
+int nova_search_better_tier(int a, int b) {
+    if (a < 0) {
+        return b;
+    }
+    return (b >= 0 && b < a) ? b : a;
+}
+
+/* Order matches by tier, then frecency, then name, then entry */
+bool nova_search_ranks_before(const RankedMatch *a, const RankedMatch *b) {
+    if (a->tier != b->tier) {
+        return a->tier < b->tier;
+    }
+    if (a->frecency != b->frecency) {
+        return a->frecency > b->frecency;
+    }
+
+    int order = nova_search_compare_folded(a->name, a->name_length, b->name, b->name_length);
+    if (order != 0) {
+        return order < 0;
+    }
+    return a->entry < b->entry;
+}
+
+/* Insertion into a short sorted list; max_results is small */
+void nova_search_offer_match(RankedMatch *top, int *top_count, int max_results, RankedMatch match) {
+    if (*top_count == max_results && !nova_search_ranks_before(&match, &top[*top_count - 1])) {
+        return;
+    }
+
+    int position = (*top_count < max_results) ? (*top_count)++ : max_results - 1;
+    while (position > 0 && nova_search_ranks_before(&match, &top[position - 1])) {
+        top[position] = top[position - 1];
+        position--;
+    }
+    top[position] = match;
+}
@@ -0,0 +1,67 @@
+/* NovaSearch Panel - Match Ranking Header */
+
+#ifndef NOVASEARCH_RANKING_H
+#define NOVASEARCH_RANKING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Ranking shared by the index snapshot and the search engine, matching
+ * Database::query_files in the daemon and the panel's SQLite queries. */
+
+/* Entries scanned between cancellation checks */
+#define CANCEL_CHECK_INTERVAL 4096
+
+/* Match quality, best first. The exact tier compares case-sensitively, as
+ * SQLite's = does; the others ignore ASCII case, as its LIKE does. */
+enum {
+    TIER_EXACT = 0,
+    TIER_PREFIX = 1,
+    TIER_SUBSTRING = 2,
+};
+
+/* A match kept in the top results. Ties in tier and frecency are broken by
+ * the name ignoring case, as COLLATE NOCASE orders it, then by entry. */
+typedef struct {
+    uint32_t entry;
+    int tier;
+    int64_t frecency;
+    const char *name;
+    size_t name_length;
+} RankedMatch;
+
+/* ASCII lowercase, the same folding SQLite's LIKE uses */
+static inline char nova_search_fold_char(char c) {
+    return (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : c;
+}
+
+/* Fold length bytes of src into dst */
+void nova_search_fold(char *dst, const char *src, size_t length);
+
+/* Compare two strings by their folded bytes */
+int nova_search_compare_folded(const char *a, size_t a_length, const char *b, size_t b_length);
+
+/* Classify how a name (and its folded copy) matches the query (and its
+ * folded copy), or return -1 if it does not */
+int nova_search_match_tier(const char *name, const char *folded_name, size_t name_length,
+                           const char *query, const char *folded_query, size_t query_length);
+
+/* Classify how an application's name and keywords match the query, or
+ * return -1. The name ranks like a filename; keywords only ever match as a
+ * substring. */
+int nova_search_match_launcher(const char *name, size_t name_length,
+                               const char *keywords, size_t keywords_length,
+                               const char *query, const char *folded_query, size_t query_length);
+
+/* The better of two tiers, either of which may be -1 for no match */
+int nova_search_better_tier(int a, int b);
+
+/* Check whether match a ranks ahead of match b */
+bool nova_search_ranks_before(const RankedMatch *a, const RankedMatch *b);
+
+/* Insert a match into the sorted top list of up to max_results matches if
+ * it ranks high enough */
+void nova_search_offer_match(RankedMatch *top, int *top_count, int max_results, RankedMatch match);
+
+#endif /* NOVASEARCH_RANKING_H */
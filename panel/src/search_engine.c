@@ -0,0 +1,368 @@
+/* NovaSearch Panel - In-Memory Search Engine Implementation */
+
+#include "search_engine.h"
+#include "ranking.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Initial arena and entry capacities; both grow by doubling */
+#define INITIAL_ARENA_SIZE (64 * 1024)
+#define INITIAL_ENTRY_COUNT 1024
+
+/* All filenames with their launch frecency, and the name and keywords of
+ * applications, which the database query matches as well */
+#define LOAD_USER_SQL \
+    "SELECT f.id, f.filename, f.frecency, a.name, a.keywords FROM files f " \
+    "LEFT JOIN app_metadata a ON f.id = a.file_id"
+
+static const char *LOAD_SQL = LOAD_USER_SQL;
+
+/* The same, plus the entries of the attached system index under their
+ * negated ids, as nova_search_db_fetch expects them */
+static const char *LOAD_SYSTEM_SQL =
+    LOAD_USER_SQL " "
+    "UNION ALL "
+    "SELECT -f.id, f.filename, COALESCE(u.frecency, 0), a.name, a.keywords "
+    "FROM system.file_paths f "
+    "JOIN system.dirs d ON d.id = f.dir_id "
+    "LEFT JOIN system.app_metadata a ON f.id = a.file_id "
+    "LEFT JOIN main.system_usage u ON u.path = f.path "
+    "WHERE d.path NOT IN (SELECT path FROM main.dirs)";
+
+/* Lowercase a string into a new allocation */
+static char* fold_dup(const char *str, size_t length) {
+    char *folded = malloc(length + 1);
+    if (!folded) {
+        return NULL;
+    }
+    nova_search_fold(folded, str, length);
+    folded[length] = '\0';
+    return folded;
+}
+
+/* Release launcher storage */
+static void launchers_free(NovaSearchLaunchers *launchers) {
+    free(launchers->entries);
+    free(launchers->names);
+    free(launchers->keywords);
+    free(launchers->arena);
+    memset(launchers, 0, sizeof(*launchers));
+}
+
+/* Append a launcher's name and keywords, growing the storage by doubling */
+static bool launchers_add(NovaSearchLaunchers *launchers, uint32_t entry,
+                          const char *name, size_t name_length,
+                          const char *keywords, size_t keywords_length) {
+    if (launchers->count == launchers->capacity) {
+        uint32_t capacity = launchers->capacity ? launchers->capacity * 2 : 64;
+        uint32_t *entries = realloc(launchers->entries, sizeof(uint32_t) * capacity);
+        if (entries) {
+            launchers->entries = entries;
+        }
+        uint32_t *names = realloc(launchers->names, sizeof(uint32_t) * capacity);
+        if (names) {
+            launchers->names = names;
+        }
+        uint32_t *keyword_offsets = realloc(launchers->keywords, sizeof(uint32_t) * capacity);
+        if (keyword_offsets) {
+            launchers->keywords = keyword_offsets;
+        }
+        if (!entries || !names || !keyword_offsets) {
+            return false;
+        }
+        launchers->capacity = capacity;
+    }
+
+    size_t needed = launchers->arena_size + name_length + keywords_length + 2;
+    if (needed > launchers->arena_capacity) {
+        size_t capacity = launchers->arena_capacity ? launchers->arena_capacity : INITIAL_ARENA_SIZE;
+        while (needed > capacity) {
+            capacity *= 2;
+        }
+        char *arena = (capacity <= UINT32_MAX) ? realloc(launchers->arena, capacity) : NULL;
+        if (!arena) {
+            return false;
+        }
+        launchers->arena = arena;
+        launchers->arena_capacity = capacity;
+    }
+
+    uint32_t slot = launchers->count++;
+    launchers->entries[slot] = entry;
+    launchers->names[slot] = (uint32_t)launchers->arena_size;
+    memcpy(launchers->arena + launchers->arena_size, name, name_length);
+    launchers->arena[launchers->arena_size + name_length] = '\0';
+    launchers->arena_size += name_length + 1;
+    launchers->keywords[slot] = (uint32_t)launchers->arena_size;
+    memcpy(launchers->arena + launchers->arena_size, keywords, keywords_length);
+    launchers->arena[launchers->arena_size + keywords_length] = '\0';
+    launchers->arena_size += keywords_length + 1;
+    return true;
+}
+
+/* Forget the previous query so the next one scans every entry */
+static void reset_narrowing(NovaSearchEngine *engine) {
+    free(engine->last_query);
+    free(engine->candidates);
+    engine->last_query = NULL;
+    engine->candidates = NULL;
+    engine->candidate_count = 0;
+}
+
+/* Release the snapshot arrays */
+static void clear_snapshot(NovaSearchEngine *engine) {
+    reset_narrowing(engine);
+    free(engine->arena);
+    free(engine->offsets);
+    free(engine->ids);
+    free(engine->frecencies);
+    launchers_free(&engine->launchers);
+    engine->arena = NULL;
+    engine->arena_size = 0;
+    engine->offsets = NULL;
+    engine->ids = NULL;
+    engine->frecencies = NULL;
+    engine->count = 0;
+    engine->data_version = -1;
+}
+
+/* Create an empty engine */
+NovaSearchEngine* nova_search_engine_new(void) {
+    NovaSearchEngine *engine = calloc(1, sizeof(NovaSearchEngine));
+    if (!engine) {
+        fprintf(stderr, "Failed to allocate search engine\n");
+        return NULL;
+    }
+
+    engine->data_version = -1;
+    return engine;
+}
+
+/* Free the engine and its snapshot */
+void nova_search_engine_free(NovaSearchEngine *engine) {
+    if (!engine) {
+        return;
+    }
+
+    clear_snapshot(engine);
+    free(engine);
+}
+
+/* Load a fresh snapshot of all filenames. On failure the previous snapshot
+ * is kept. */
+bool nova_search_engine_load(NovaSearchEngine *engine, NovaSearchDB *db) {
+    if (!engine || !db || !db->is_connected || !db->db) {
+        return false;
+    }
+
+    /* Read the version first: a commit racing with the load only causes an
+     * extra reload later */
+    int64_t data_version = nova_search_db_data_version(db);
+
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_prepare_v2(db->db, db->system_attached ? LOAD_SYSTEM_SQL : LOAD_SQL, -1,
+                           &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Failed to prepare snapshot query: %s\n", sqlite3_errmsg(db->db));
+        return false;
+    }
+
+    size_t arena_capacity = INITIAL_ARENA_SIZE;
+    size_t arena_size = 0;
+    uint32_t entry_capacity = INITIAL_ENTRY_COUNT;
+    uint32_t count = 0;
+
+    char *arena = malloc(arena_capacity);
+    uint32_t *offsets = malloc(sizeof(uint32_t) * (entry_capacity + 1));
+    int64_t *ids = malloc(sizeof(int64_t) * entry_capacity);
+    int32_t *frecencies = malloc(sizeof(int32_t) * entry_capacity);
+    NovaSearchLaunchers launchers = { 0 };
+    bool ok = arena && offsets && ids && frecencies;
+
+    int rc;
+    while (ok && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const char *filename = (const char *)sqlite3_column_text(stmt, 1);
+        size_t length = (size_t)sqlite3_column_bytes(stmt, 1);
+        if (!filename) {
+            continue;
+        }
+
+        /* Grow the arrays; offsets are 32-bit, which bounds the arena */
+        size_t entry_size = 2 * (length + 1);
+        if (arena_size + entry_size > arena_capacity) {
+            while (arena_size + entry_size > arena_capacity) {
+                arena_capacity *= 2;
+            }
+            char *grown = (arena_capacity <= UINT32_MAX) ? realloc(arena, arena_capacity) : NULL;
+            if (!grown) {
+                ok = false;
+                break;
+            }
+            arena = grown;
+        }
+
+        if (count == entry_capacity) {
+            entry_capacity *= 2;
+            uint32_t *grown_offsets = realloc(offsets, sizeof(uint32_t) * (entry_capacity + 1));
+            if (grown_offsets) {
+                offsets = grown_offsets;
+            }
+            int64_t *grown_ids = realloc(ids, sizeof(int64_t) * entry_capacity);
+            if (grown_ids) {
+                ids = grown_ids;
+            }
+            int32_t *grown_frecencies = realloc(frecencies, sizeof(int32_t) * entry_capacity);
+            if (grown_frecencies) {
+                frecencies = grown_frecencies;
+            }
+            if (!grown_offsets || !grown_ids || !grown_frecencies) {
+                ok = false;
+                break;
+            }
+        }
+
+        const char *app_name = (const char *)sqlite3_column_text(stmt, 3);
+        size_t app_name_length = (size_t)sqlite3_column_bytes(stmt, 3);
+        const char *keywords = (const char *)sqlite3_column_text(stmt, 4);
+        size_t keywords_length = (size_t)sqlite3_column_bytes(stmt, 4);
+        if (app_name && !launchers_add(&launchers, count, app_name, app_name_length,
+                                       keywords ? keywords : "", keywords ? keywords_length : 0)) {
+            ok = false;
+            break;
+        }
+
+        offsets[count] = (uint32_t)arena_size;
+        ids[count] = sqlite3_column_int64(stmt, 0);
+        frecencies[count] = sqlite3_column_int(stmt, 2);
+        /* The folded name, then the name as indexed */
+        nova_search_fold(arena + arena_size, filename, length);
+        arena[arena_size + length] = '\0';
+        memcpy(arena + arena_size + length + 1, filename, length + 1);
+        arena_size += entry_size;
+        count++;
+    }
+
+    if (ok && rc != SQLITE_DONE) {
+        fprintf(stderr, "Failed to load filename snapshot: %s\n", sqlite3_errmsg(db->db));
+        ok = false;
+    }
+    sqlite3_finalize(stmt);
+
+    if (!ok) {
+        fprintf(stderr, "Failed to build filename snapshot\n");
+        free(arena);
+        free(offsets);
+        free(ids);
+        free(frecencies);
+        launchers_free(&launchers);
+        return false;
+    }
+
+    clear_snapshot(engine);
+    offsets[count] = (uint32_t)arena_size;
+    engine->arena = arena;
+    engine->arena_size = arena_size;
+    engine->offsets = offsets;
+    engine->ids = ids;
+    engine->frecencies = frecencies;
+    engine->count = count;
+    engine->launchers = launchers;
+    engine->data_version = data_version;
+    return true;
+}
+
+/* Check whether the snapshot still reflects the database */
+bool nova_search_engine_is_current(NovaSearchEngine *engine, NovaSearchDB *db) {
+    if (!engine || !engine->offsets) {
+        return false;
+    }
+
+    int64_t data_version = nova_search_db_data_version(db);
+    return data_version >= 0 && data_version == engine->data_version;
+}
+
+/* Match the query against the snapshot */
+int nova_search_engine_query(NovaSearchEngine *engine, const char *query,
+                             int64_t *ids, int max_results,
+                             NovaSearchCancelFunc is_cancelled, void *user_data) {
+    if (!engine || !engine->offsets || !query || !ids || max_results <= 0) {
+        return 0;
+    }
+
+    size_t needle_length = strlen(query);
+    if (needle_length == 0) {
+        return 0;
+    }
+
+    char *needle = fold_dup(query, needle_length);
+    if (!needle) {
+        return 0;
+    }
+
+    /* Anything containing this query also contains one it extends, so only
+     * the previous candidates need to be scanned */
+    bool narrowing = engine->last_query && strstr(needle, engine->last_query);
+    uint32_t domain = narrowing ? engine->candidate_count : engine->count;
+
+    uint32_t *candidates = malloc(sizeof(uint32_t) * (domain > 0 ? domain : 1));
+    RankedMatch *top = malloc(sizeof(RankedMatch) * (size_t)max_results);
+    if (!candidates || !top) {
+        free(candidates);
+        free(top);
+        free(needle);
+        return 0;
+    }
+
+    uint32_t candidate_count = 0;
+    int top_count = 0;
+    uint32_t launcher = 0;
+
+    for (uint32_t k = 0; k < domain; k++) {
+        if (is_cancelled && k % CANCEL_CHECK_INTERVAL == 0 && is_cancelled(user_data)) {
+            /* The candidate list is incomplete; start over next time */
+            reset_narrowing(engine);
+            free(candidates);
+            free(top);
+            free(needle);
+            return -1;
+        }
+
+        uint32_t entry = narrowing ? engine->candidates[k] : k;
+        const char *folded_name = engine->arena + engine->offsets[entry];
+        size_t name_length = (engine->offsets[entry + 1] - engine->offsets[entry]) / 2 - 1;
+        const char *name = folded_name + name_length + 1;
+
+        int tier = nova_search_match_tier(name, folded_name, name_length, query, needle, needle_length);
+
+        /* Entries are visited in ascending order, as are the launchers */
+        NovaSearchLaunchers *launchers = &engine->launchers;
+        while (launcher < launchers->count && launchers->entries[launcher] < entry) {
+            launcher++;
+        }
+        if (launcher < launchers->count && launchers->entries[launcher] == entry) {
+            const char *app_name = launchers->arena + launchers->names[launcher];
+            const char *keywords = launchers->arena + launchers->keywords[launcher];
+            tier = nova_search_better_tier(tier, nova_search_match_launcher(
+                app_name, strlen(app_name), keywords, strlen(keywords), query, needle, needle_length));
+        }
+        if (tier < 0) {
+            continue;
+        }
+
+        candidates[candidate_count++] = entry;
+        RankedMatch match = { entry, tier, engine->frecencies[entry], name, name_length };
+        nova_search_offer_match(top, &top_count, max_results, match);
+    }
+
+    reset_narrowing(engine);
+    engine->last_query = needle;
+    engine->candidates = candidates;
+    engine->candidate_count = candidate_count;
+
+    for (int i = 0; i < top_count; i++) {
+        ids[i] = engine->ids[top[i].entry];
+    }
+
+    free(top);
+    return top_count;
+}
@@ -0,0 +1,60 @@
+/* NovaSearch Panel - In-Memory Search Engine Header */
+
+#ifndef NOVASEARCH_SEARCH_ENGINE_H
+#define NOVASEARCH_SEARCH_ENGINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "database.h"
+
+/* Name and keywords of the entries that are applications, ascending by
+ * entry. Both are stored as indexed in one arena, each followed by a NUL. */
+typedef struct {
+    uint32_t *entries;
+    uint32_t *names;         /* Offsets into arena */
+    uint32_t *keywords;
+    char *arena;
+    size_t arena_size;
+    size_t arena_capacity;
+    uint32_t count;
+    uint32_t capacity;
+} NovaSearchLaunchers;
+
+/* Snapshot of all indexed filenames, matched without touching SQLite.
+ *
+ * Filenames are stored back to back in one arena, each lowercased and then
+ * as indexed, both followed by a NUL; entry i spans offsets[i] ..
+ * offsets[i + 1] - 1. The candidate list holds the entries matching the
+ * previous query, so a query that extends it only rescans those. */
+typedef struct {
+    char *arena;
+    size_t arena_size;
+    uint32_t *offsets;       /* count + 1 entries */
+    int64_t *ids;            /* files.id of each entry, negated for the system index */
+    int32_t *frecencies;     /* Launch frecency of each entry */
+    uint32_t count;
+    NovaSearchLaunchers launchers;
+    int64_t data_version;    /* Database version the snapshot was loaded at */
+
+    /* Incremental narrowing state */
+    char *last_query;        /* Lowercased; NULL when candidates is unset */
+    uint32_t *candidates;
+    uint32_t candidate_count;
+} NovaSearchEngine;
+
+/* Engine lifecycle */
+NovaSearchEngine* nova_search_engine_new(void);
+void nova_search_engine_free(NovaSearchEngine *engine);
+
+/* Snapshot management */
+bool nova_search_engine_load(NovaSearchEngine *engine, NovaSearchDB *db);
+bool nova_search_engine_is_current(NovaSearchEngine *engine, NovaSearchDB *db);
+
+/* Find up to max_results file ids matching the query, best first. Returns
+ * the number of ids written, or -1 if the query was cancelled. */
+int nova_search_engine_query(NovaSearchEngine *engine, const char *query,
+                             int64_t *ids, int max_results,
+                             NovaSearchCancelFunc is_cancelled, void *user_data);
+
+#endif /* NOVASEARCH_SEARCH_ENGINE_H */
@@ -0,0 +1,699 @@
+/* NovaSearch Panel - Index Snapshot Implementation */
+
+#include "snapshot.h"
+#include "ranking.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Format constants, as defined in daemon/src/snapshot.rs */
+#define SNAPSHOT_MAGIC "NSSNAP02"
+#define SNAPSHOT_HEADER_LEN 104
+#define DIR_RECORD_LEN 12
+#define ENTRY_RECORD_LEN 32
+#define TRIGRAM_RECORD_LEN 12
+#define APP_RECORD_LEN 36
+#define NO_PARENT UINT32_MAX
+
+/* Longest path rebuilt from the directory table */
+#define MAX_PATH_LENGTH 4096
+
+static uint16_t read_u16(const unsigned char *p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_u32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read_u64(const unsigned char *p) {
+    return (uint64_t)read_u32(p) | ((uint64_t)read_u32(p + 4) << 32);
+}
+
+/* Check that a section of count records of record_len bytes fits the file */
+static bool section_fits(size_t file_size, uint64_t offset, uint64_t count, uint64_t record_len) {
+    return offset <= file_size && count <= (file_size - offset) / record_len;
+}
+
+/* Drop the launched entries, returning to the frecency stored in the file */
+static void clear_frecencies(NovaSearchSnapshot *snapshot) {
+    free(snapshot->frecencies.launches);
+    snapshot->frecencies.launches = NULL;
+    snapshot->frecencies.count = 0;
+    snapshot->frecencies.data_version = -1;
+}
+
+static void snapshot_unmap(NovaSearchSnapshot *snapshot) {
+    if (snapshot->data) {
+        munmap((void *)snapshot->data, snapshot->size);
+    }
+    snapshot->data = NULL;
+    snapshot->size = 0;
+    snapshot->device = 0;
+    snapshot->inode = 0;
+}
+
+/* Drop a mapped file found corrupt past its header, so that it is neither
+ * queried nor mapped again */
+static void snapshot_reject(NovaSearchSnapshot *snapshot) {
+    fprintf(stderr, "Ignoring invalid index snapshot %s\n", snapshot->path);
+    snapshot->rejected_device = snapshot->device;
+    snapshot->rejected_inode = snapshot->inode;
+    snapshot_unmap(snapshot);
+    clear_frecencies(snapshot);
+}
+
+/* Read the header of a freshly mapped file */
+static bool snapshot_parse_header(NovaSearchSnapshot *snapshot) {
+    const unsigned char *data = snapshot->data;
+    size_t size = snapshot->size;
+
+    if (size < SNAPSHOT_HEADER_LEN || memcmp(data, SNAPSHOT_MAGIC, 8) != 0 ||
+        read_u64(data + 80) != size) {
+        return false;
+    }
+
+    snapshot->generation = read_u64(data + 8);
+    snapshot->entry_count = read_u32(data + 16);
+    snapshot->dir_count = read_u32(data + 20);
+    snapshot->trigram_count = read_u32(data + 24);
+    snapshot->posting_count = read_u32(data + 28);
+    uint64_t pool_offset = read_u64(data + 32);
+    snapshot->pool_size = read_u64(data + 40);
+    uint64_t dirs_offset = read_u64(data + 48);
+    uint64_t entries_offset = read_u64(data + 56);
+    uint64_t trigrams_offset = read_u64(data + 64);
+    uint64_t postings_offset = read_u64(data + 72);
+    snapshot->app_count = read_u32(data + 88);
+    uint64_t apps_offset = read_u64(data + 96);
+
+    if (!section_fits(size, pool_offset, snapshot->pool_size, 1) ||
+        !section_fits(size, dirs_offset, snapshot->dir_count, DIR_RECORD_LEN) ||
+        !section_fits(size, entries_offset, snapshot->entry_count, ENTRY_RECORD_LEN) ||
+        !section_fits(size, trigrams_offset, snapshot->trigram_count, TRIGRAM_RECORD_LEN) ||
+        !section_fits(size, postings_offset, snapshot->posting_count, 4) ||
+        !section_fits(size, apps_offset, snapshot->app_count, APP_RECORD_LEN)) {
+        return false;
+    }
+
+    snapshot->pool = data + pool_offset;
+    snapshot->dirs = data + dirs_offset;
+    snapshot->entries = data + entries_offset;
+    snapshot->trigrams = data + trigrams_offset;
+    snapshot->postings = data + postings_offset;
+    snapshot->apps = data + apps_offset;
+    return true;
+}
+
+/* Create a snapshot reader; the file is mapped by the first refresh */
+NovaSearchSnapshot* nova_search_snapshot_new(const char *path) {
+    if (!path) {
+        return NULL;
+    }
+
+    NovaSearchSnapshot *snapshot = calloc(1, sizeof(NovaSearchSnapshot));
+    if (!snapshot) {
+        return NULL;
+    }
+
+    snapshot->path = strdup(path);
+    if (!snapshot->path) {
+        free(snapshot);
+        return NULL;
+    }
+    snapshot->frecencies.data_version = -1;
+    return snapshot;
+}
+
+/* Unmap and free a snapshot reader */
+void nova_search_snapshot_free(NovaSearchSnapshot *snapshot) {
+    if (!snapshot) {
+        return;
+    }
+
+    snapshot_unmap(snapshot);
+    clear_frecencies(snapshot);
+    free(snapshot->path);
+    free(snapshot);
+}
+
+/* Map the snapshot file unless the mapped one is still current */
+bool nova_search_snapshot_refresh(NovaSearchSnapshot *snapshot) {
+    if (!snapshot) {
+        return false;
+    }
+
+    struct stat st;
+    if (stat(snapshot->path, &st) != 0) {
+        /* Keep whatever is mapped; the daemon may be replacing the file */
+        return snapshot->data != NULL;
+    }
+
+    if (snapshot->data && st.st_dev == snapshot->device && st.st_ino == snapshot->inode) {
+        return true;
+    }
+    if (st.st_dev == snapshot->rejected_device && st.st_ino == snapshot->rejected_inode) {
+        return snapshot->data != NULL;
+    }
+
+    int fd = open(snapshot->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return snapshot->data != NULL;
+    }
+
+    /* Size and identity of the file actually opened */
+    if (fstat(fd, &st) != 0 || st.st_size < SNAPSHOT_HEADER_LEN) {
+        close(fd);
+        return snapshot->data != NULL;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return snapshot->data != NULL;
+    }
+
+    NovaSearchSnapshot mapped = *snapshot;
+    mapped.data = data;
+    mapped.size = (size_t)st.st_size;
+    mapped.device = st.st_dev;
+    mapped.inode = st.st_ino;
+
+    if (!snapshot_parse_header(&mapped)) {
+        fprintf(stderr, "Ignoring invalid index snapshot %s\n", snapshot->path);
+        munmap(data, (size_t)st.st_size);
+        snapshot->rejected_device = st.st_dev;
+        snapshot->rejected_inode = st.st_ino;
+        return snapshot->data != NULL;
+    }
+
+    /* Launched entries are numbered by the old file */
+    snapshot_unmap(snapshot);
+    clear_frecencies(snapshot);
+    mapped.frecencies = snapshot->frecencies;
+    *snapshot = mapped;
+    return true;
+}
+
+/* Get the bytes of a pool string, or NULL if they fall outside the pool */
+static const char *pool_string(NovaSearchSnapshot *snapshot, uint32_t offset, uint32_t length) {
+    if (offset > snapshot->pool_size || length > snapshot->pool_size - offset) {
+        return NULL;
+    }
+    return (const char *)snapshot->pool + offset;
+}
+
+/* Get the record of an entry index read from the file, or NULL if it is not
+ * one of the file's entries */
+static const unsigned char *entry_record(NovaSearchSnapshot *snapshot, uint32_t entry) {
+    if (entry >= snapshot->entry_count) {
+        return NULL;
+    }
+    const unsigned char *record = snapshot->entries + (size_t)entry * ENTRY_RECORD_LEN;
+    if ((size_t)(record - snapshot->data) > snapshot->size - ENTRY_RECORD_LEN) {
+        return NULL;
+    }
+    return record;
+}
+
+/* Find the postings of a trigram by binary search */
+static bool find_postings(NovaSearchSnapshot *snapshot, uint32_t key,
+                          const unsigned char **postings, uint32_t *count) {
+    uint32_t low = 0;
+    uint32_t high = snapshot->trigram_count;
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        const unsigned char *record = snapshot->trigrams + (size_t)middle * TRIGRAM_RECORD_LEN;
+        uint32_t middle_key = read_u32(record);
+
+        if (middle_key < key) {
+            low = middle + 1;
+        } else if (middle_key > key) {
+            high = middle;
+        } else {
+            uint32_t first = read_u32(record + 4);
+            uint32_t length = read_u32(record + 8);
+            if (first > snapshot->posting_count || length > snapshot->posting_count - first) {
+                return false;
+            }
+            *postings = snapshot->postings + (size_t)first * 4;
+            *count = length;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Build the full path of an entry from its directory chain at the end of
+ * buffer, which holds MAX_PATH_LENGTH bytes. Returns where it starts. */
+static const char *build_entry_path(NovaSearchSnapshot *snapshot, uint32_t dir,
+                                    const char *name, uint32_t name_length, char *buffer) {
+    size_t start = MAX_PATH_LENGTH - 1;
+    buffer[start] = '\0';
+
+    /* Fill from the end: the name, then each ancestor's name. Parents
+     * precede their children, which also rules out cycles. */
+    if (name_length + 1 > start) {
+        return NULL;
+    }
+    start -= name_length;
+    memcpy(buffer + start, name, name_length);
+    buffer[--start] = '/';
+
+    uint32_t limit = snapshot->dir_count;
+    while (dir != NO_PARENT) {
+        if (dir >= limit) {
+            return NULL;
+        }
+        const unsigned char *record = snapshot->dirs + (size_t)dir * DIR_RECORD_LEN;
+        uint32_t parent = read_u32(record);
+        uint32_t dir_name_length = read_u32(record + 8);
+        const char *dir_name = pool_string(snapshot, read_u32(record + 4), dir_name_length);
+        if (!dir_name || dir_name_length + 1 > start) {
+            return NULL;
+        }
+
+        start -= dir_name_length;
+        memcpy(buffer + start, dir_name, dir_name_length);
+        if (parent != NO_PARENT) {
+            buffer[--start] = '/';
+        }
+        limit = dir;
+        dir = parent;
+    }
+
+    return buffer + start;
+}
+
+/* Find the entry with a full path, by binary search on its filename; entries
+ * are sorted by their folded bytes */
+static bool find_entry(NovaSearchSnapshot *snapshot, const char *path, uint32_t *found) {
+    const char *slash = strrchr(path, '/');
+    if (!slash) {
+        return false;
+    }
+    const char *name = slash + 1;
+    size_t name_length = strlen(name);
+
+    uint32_t low = 0;
+    uint32_t high = snapshot->entry_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        const unsigned char *record = snapshot->entries + (size_t)middle * ENTRY_RECORD_LEN;
+        uint16_t length = read_u16(record + 8);
+        const char *middle_name = pool_string(snapshot, read_u32(record + 4), length);
+        if (!middle_name) {
+            return false;
+        }
+        if (nova_search_compare_folded(middle_name, length, name, name_length) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    /* Entries sharing the folded name, one per directory */
+    char buffer[MAX_PATH_LENGTH];
+    for (uint32_t entry = low; entry < snapshot->entry_count; entry++) {
+        const unsigned char *record = snapshot->entries + (size_t)entry * ENTRY_RECORD_LEN;
+        uint16_t length = read_u16(record + 8);
+        const char *entry_name = pool_string(snapshot, read_u32(record + 4), length);
+        if (!entry_name || nova_search_compare_folded(entry_name, length, name, name_length) != 0) {
+            return false;
+        }
+
+        const char *full_path = build_entry_path(snapshot, read_u32(record), entry_name, length, buffer);
+        if (full_path && strcmp(full_path, path) == 0) {
+            *found = entry;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compare_launches(const void *a, const void *b) {
+    const SnapshotLaunch *x = a;
+    const SnapshotLaunch *y = b;
+    return (x->entry > y->entry) - (x->entry < y->entry);
+}
+
+/* Get the frecency an entry ranks by */
+static uint32_t entry_frecency(NovaSearchSnapshot *snapshot, uint32_t entry,
+                               const unsigned char *record) {
+    if (snapshot->frecencies.data_version < 0) {
+        return read_u32(record + 12);
+    }
+
+    SnapshotLaunch key = { entry, 0 };
+    const SnapshotLaunch *launch = snapshot->frecencies.count == 0 ? NULL :
+        bsearch(&key, snapshot->frecencies.launches, snapshot->frecencies.count,
+                sizeof(SnapshotLaunch), compare_launches);
+    return launch ? launch->frecency : 0;
+}
+
+/* Check the snapshot against the database and reload its launched entries
+ * whenever something was committed there */
+bool nova_search_snapshot_sync(NovaSearchSnapshot *snapshot, NovaSearchDB *db) {
+    if (!nova_search_snapshot_refresh(snapshot)) {
+        return false;
+    }
+
+    uint64_t generation;
+    if (!nova_search_db_snapshot_generation(db, &generation) || generation != snapshot->generation) {
+        return false;
+    }
+
+    /* Read the version first: a launch racing with the load only causes an
+     * extra reload later */
+    int64_t data_version = nova_search_db_data_version(db);
+    if (data_version < 0) {
+        return false;
+    }
+    if (data_version == snapshot->frecencies.data_version) {
+        return true;
+    }
+
+    int count;
+    LaunchFrecency *frecencies = nova_search_db_load_frecencies(db, &count);
+    if (count < 0) {
+        return false;
+    }
+
+    SnapshotLaunch *launches = malloc(sizeof(SnapshotLaunch) * (size_t)(count > 0 ? count : 1));
+    if (!launches) {
+        nova_search_frecencies_free(frecencies, count);
+        return false;
+    }
+
+    uint32_t launched = 0;
+    for (int i = 0; i < count; i++) {
+        uint32_t entry;
+        if (find_entry(snapshot, frecencies[i].path, &entry)) {
+            int64_t frecency = frecencies[i].frecency;
+            launches[launched].entry = entry;
+            launches[launched].frecency = frecency > UINT32_MAX ? UINT32_MAX : (uint32_t)frecency;
+            launched++;
+        }
+    }
+    nova_search_frecencies_free(frecencies, count);
+    qsort(launches, launched, sizeof(SnapshotLaunch), compare_launches);
+
+    clear_frecencies(snapshot);
+    snapshot->frecencies.launches = launches;
+    snapshot->frecencies.count = launched;
+    snapshot->frecencies.data_version = data_version;
+    return true;
+}
+
+/* Convert a file type code to the database's name for it */
+static const char *file_type_name(uint8_t code) {
+    switch (code) {
+    case 0: return "regular";
+    case 1: return "directory";
+    case 2: return "symlink";
+    default: return "other";
+    }
+}
+
+/* Launcher metadata fields, in record order */
+enum {
+    APP_NAME = 0,
+    APP_ICON = 1,
+    APP_EXEC = 2,
+    APP_KEYWORDS = 3,
+};
+
+/* Find the launcher record of an entry by binary search, or NULL. Records
+ * before *cursor belong to earlier entries; a scan in entry order passes
+ * the same cursor to every lookup. */
+static const unsigned char *entry_launcher(NovaSearchSnapshot *snapshot, uint32_t entry,
+                                           uint32_t *cursor) {
+    uint32_t low = *cursor;
+    uint32_t high = snapshot->app_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (read_u32(snapshot->apps + (size_t)middle * APP_RECORD_LEN) < entry) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *cursor = low;
+    if (low < snapshot->app_count && read_u32(snapshot->apps + (size_t)low * APP_RECORD_LEN) == entry) {
+        return snapshot->apps + (size_t)low * APP_RECORD_LEN;
+    }
+    return NULL;
+}
+
+/* Get a field of a launcher record, or NULL if it falls outside the pool */
+static const char *launcher_field(NovaSearchSnapshot *snapshot, const unsigned char *launcher,
+                                  int field, uint32_t *length) {
+    const unsigned char *reference = launcher + 4 + field * 8;
+    *length = read_u32(reference + 4);
+    return pool_string(snapshot, read_u32(reference), *length);
+}
+
+/* Classify how an entry, with its launcher record if any, matches the query
+ * (folded copy given), or -1 */
+static int match_entry(NovaSearchSnapshot *snapshot, const unsigned char *record,
+                       const unsigned char *launcher,
+                       const char *query, const char *folded_query, size_t query_length,
+                       char *folded_name) {
+    uint16_t name_length = read_u16(record + 8);
+    const char *name = pool_string(snapshot, read_u32(record + 4), name_length);
+    if (!name) {
+        return -1;
+    }
+
+    int tier = -1;
+    if (name_length >= query_length) {
+        nova_search_fold(folded_name, name, name_length);
+        tier = nova_search_match_tier(name, folded_name, name_length, query, folded_query, query_length);
+    }
+
+    if (launcher) {
+        uint32_t app_name_length;
+        uint32_t keywords_length;
+        const char *app_name = launcher_field(snapshot, launcher, APP_NAME, &app_name_length);
+        const char *keywords = launcher_field(snapshot, launcher, APP_KEYWORDS, &keywords_length);
+        if (app_name && keywords) {
+            tier = nova_search_better_tier(tier, nova_search_match_launcher(
+                app_name, app_name_length, keywords, keywords_length,
+                query, folded_query, query_length));
+        }
+    }
+    return tier;
+}
+
+/* Copy a launcher field into a page's arena */
+static char *launcher_page_strndup(NovaSearchSnapshot *snapshot, SearchResultPage *page,
+                                   const unsigned char *launcher, int field) {
+    uint32_t length;
+    const char *text = launcher_field(snapshot, launcher, field, &length);
+    return text ? nova_search_result_page_strndup(page, text, length) : NULL;
+}
+
+/* Ranked matches of a query, built into each page as it is fetched. The
+ * entries only mean anything in the file they were ranked in. */
+typedef struct {
+    NovaSearchSnapshot *snapshot;
+    dev_t device;
+    ino_t inode;
+    uint32_t *entries;
+    int count;
+    int position;
+} SnapshotResults;
+
+/* Read an entry, with its launcher record if any, into a result whose
+ * strings are kept in a page's arena. Returns false if it cannot be read. */
+static bool read_entry(NovaSearchSnapshot *snapshot, SearchResultPage *page, uint32_t entry,
+                       const unsigned char *record, SearchResult *result) {
+    uint32_t cursor = 0;
+    const unsigned char *launcher = entry_launcher(snapshot, entry, &cursor);
+    uint16_t name_length = read_u16(record + 8);
+    const char *name = pool_string(snapshot, read_u32(record + 4), name_length);
+    char buffer[MAX_PATH_LENGTH];
+    const char *path = name ? build_entry_path(snapshot, read_u32(record), name, name_length, buffer) : NULL;
+    if (!path) {
+        return false;
+    }
+
+    const char *file_type = file_type_name(record[10]);
+    result->filename = nova_search_result_page_strndup(page, name, name_length);
+    result->path = nova_search_result_page_strndup(page, path, strlen(path));
+    result->file_type = nova_search_result_page_strndup(page, file_type, strlen(file_type));
+    result->size = (int64_t)read_u64(record + 16);
+    result->modified_time = (int64_t)read_u64(record + 24);
+    if (launcher) {
+        result->app_name = launcher_page_strndup(snapshot, page, launcher, APP_NAME);
+        result->app_icon = launcher_page_strndup(snapshot, page, launcher, APP_ICON);
+        result->app_exec = launcher_page_strndup(snapshot, page, launcher, APP_EXEC);
+    }
+    return result->filename && result->path && result->file_type;
+}
+
+/* Build the next ranked matches into a page, unless the file they were
+ * ranked in has been replaced since */
+static void snapshot_fill_page(void *data, SearchResultPage *page, int count) {
+    SnapshotResults *results = data;
+    NovaSearchSnapshot *snapshot = results->snapshot;
+    if (!snapshot->data || snapshot->device != results->device || snapshot->inode != results->inode) {
+        return;
+    }
+
+    while (page->count < count && results->position < results->count) {
+        /* Appended only once complete; unreadable entries are skipped */
+        SearchResult read = { 0 };
+        uint32_t entry = results->entries[results->position++];
+        const unsigned char *record = entry_record(snapshot, entry);
+        if (!record) {
+            /* Ranked from this very file, so it cannot be trusted */
+            snapshot_reject(snapshot);
+            return;
+        }
+        if (!read_entry(snapshot, page, entry, record, &read)) {
+            continue;
+        }
+
+        SearchResult *result = nova_search_result_page_add(page);
+        if (!result) {
+            return;
+        }
+        *result = read;
+    }
+}
+
+static void snapshot_results_free(void *data) {
+    SnapshotResults *results = data;
+    free(results->entries);
+    free(results);
+}
+
+static const NovaSearchCursorSource SNAPSHOT_CURSOR_SOURCE = { snapshot_fill_page, snapshot_results_free };
+
+/* Query the mapped snapshot in place */
+bool nova_search_snapshot_query(NovaSearchSnapshot *snapshot, const char *query, int max_results,
+                                NovaSearchCancelFunc is_cancelled, void *user_data,
+                                NovaSearchCursor **cursor) {
+    if (!cursor) {
+        return false;
+    }
+    *cursor = NULL;
+
+    if (!snapshot || !snapshot->data) {
+        return false;
+    }
+    if (!query || !*query) {
+        return true;
+    }
+
+    if (max_results <= 0) {
+        max_results = DEFAULT_MAX_RESULTS;
+    }
+
+    size_t query_length = strlen(query);
+    if (query_length > UINT16_MAX) {
+        return true;
+    }
+
+    char *folded_query = malloc(query_length + 1);
+    char *folded_name = malloc(UINT16_MAX + 1);
+    RankedMatch *top = malloc(sizeof(RankedMatch) * (size_t)max_results);
+    if (!folded_query || !folded_name || !top) {
+        free(folded_query);
+        free(folded_name);
+        free(top);
+        return false;
+    }
+    nova_search_fold(folded_query, query, query_length + 1);
+
+    /* Every match contains every trigram of the query; scan only the
+     * entries under the rarest one. Short queries scan all entries. */
+    const unsigned char *candidates = NULL;
+    uint32_t candidate_count = snapshot->entry_count;
+    bool may_match = true;
+
+    for (size_t i = 0; may_match && i + 3 <= query_length; i++) {
+        const unsigned char *bytes = (const unsigned char *)folded_query + i;
+        uint32_t key = ((uint32_t)bytes[0] << 16) | ((uint32_t)bytes[1] << 8) | bytes[2];
+        const unsigned char *postings;
+        uint32_t count;
+
+        if (!find_postings(snapshot, key, &postings, &count)) {
+            may_match = false;
+        } else if (!candidates || count < candidate_count) {
+            candidates = postings;
+            candidate_count = count;
+        }
+    }
+
+    int top_count = 0;
+    bool cancelled = false;
+    bool corrupt = false;
+    uint32_t launcher_cursor = 0;
+
+    for (uint32_t i = 0; may_match && i < candidate_count; i++) {
+        if (is_cancelled && i % CANCEL_CHECK_INTERVAL == 0 && is_cancelled(user_data)) {
+            cancelled = true;
+            break;
+        }
+
+        uint32_t entry = candidates ? read_u32(candidates + (size_t)i * 4) : i;
+        const unsigned char *record = entry_record(snapshot, entry);
+        if (!record) {
+            corrupt = true;
+            break;
+        }
+
+        const unsigned char *launcher = entry_launcher(snapshot, entry, &launcher_cursor);
+        int tier = match_entry(snapshot, record, launcher, query, folded_query, query_length,
+                               folded_name);
+        if (tier >= 0) {
+            uint16_t name_length = read_u16(record + 8);
+            const char *name = pool_string(snapshot, read_u32(record + 4), name_length);
+            RankedMatch match = { entry, tier, entry_frecency(snapshot, entry, record), name, name_length };
+            nova_search_offer_match(top, &top_count, max_results, match);
+        }
+    }
+
+    /* Only the ranked entries are kept; their results are built a page at a
+     * time, straight into the page */
+    SnapshotResults *results = NULL;
+    uint32_t *entries = NULL;
+    if (!cancelled && !corrupt && top_count > 0) {
+        results = malloc(sizeof(SnapshotResults));
+        entries = malloc(sizeof(uint32_t) * (size_t)top_count);
+    }
+    if (results && entries) {
+        for (int i = 0; i < top_count; i++) {
+            entries[i] = top[i].entry;
+        }
+        results->snapshot = snapshot;
+        results->device = snapshot->device;
+        results->inode = snapshot->inode;
+        results->entries = entries;
+        results->count = top_count;
+        results->position = 0;
+        *cursor = nova_search_cursor_from_source(&SNAPSHOT_CURSOR_SOURCE, results, top_count);
+    } else {
+        free(results);
+        free(entries);
+    }
+
+    free(folded_query);
+    free(folded_name);
+    free(top);
+
+    /* A posting naming no entry means the file cannot be trusted */
+    if (corrupt) {
+        snapshot_reject(snapshot);
+        return false;
+    }
+    return true;
+}
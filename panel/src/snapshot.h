@@ -0,0 +1,84 @@
+/* NovaSearch Panel - Index Snapshot Header */
+
+#ifndef NOVASEARCH_SNAPSHOT_H
+#define NOVASEARCH_SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "database.h"
+
+/* Read-only view of the index snapshot the daemon writes next to the
+ * database (format NSSNAP02, defined in daemon/src/snapshot.rs).
+ *
+ * The file is mapped and queried in place: entries are sorted by folded
+ * filename and trigram postings narrow longer queries, so nothing is
+ * decoded up front. The daemon replaces the file by renaming a new one over
+ * it; refreshing maps the new file and drops the old one. */
+
+/* A launched entry, ranked by the frecency the database holds for it */
+typedef struct {
+    uint32_t entry;
+    uint32_t frecency;
+} SnapshotLaunch;
+
+/* Launched entries of the mapped file, sorted by entry. While data_version
+ * is -1 entries rank by the frecency stored in the file instead. */
+typedef struct {
+    SnapshotLaunch *launches;
+    uint32_t count;
+    int64_t data_version;        /* Database version they were loaded at */
+} SnapshotFrecencies;
+
+typedef struct {
+    char *path;
+    const unsigned char *data;
+    size_t size;
+    dev_t device;
+    ino_t inode;                 /* Identity of the mapped file */
+    dev_t rejected_device;
+    ino_t rejected_inode;        /* Last file found invalid, not retried */
+
+    uint64_t generation;
+    uint32_t entry_count;
+    uint32_t dir_count;
+    uint32_t trigram_count;
+    uint32_t posting_count;
+    uint32_t app_count;
+    const unsigned char *pool;
+    uint64_t pool_size;
+    const unsigned char *dirs;
+    const unsigned char *entries;
+    const unsigned char *trigrams;
+    const unsigned char *postings;
+    const unsigned char *apps;
+
+    SnapshotFrecencies frecencies;
+} NovaSearchSnapshot;
+
+/* Snapshot lifecycle */
+NovaSearchSnapshot* nova_search_snapshot_new(const char *path);
+void nova_search_snapshot_free(NovaSearchSnapshot *snapshot);
+
+/* Map the snapshot, or the newer one if the file was replaced. Returns
+ * false if no valid snapshot is available. */
+bool nova_search_snapshot_refresh(NovaSearchSnapshot *snapshot);
+
+/* Refresh the snapshot and check it against the database. It is only used
+ * while it holds the database's generation, and ranks by the frecencies
+ * recorded there, which launches change without a new snapshot. Returns
+ * false if the snapshot should not be queried. */
+bool nova_search_snapshot_sync(NovaSearchSnapshot *snapshot, NovaSearchDB *db);
+
+/* Find up to max_results entries matching the query, ranked like the
+ * database query, and set *cursor to a cursor over them. Each page is built
+ * straight from the mapped file; once another file is mapped, or this one
+ * is found corrupt, the cursor has no further results. *cursor is NULL if
+ * nothing matched or the query was cancelled. Returns false if no file is
+ * mapped or it was found corrupt, which also drops it. */
+bool nova_search_snapshot_query(NovaSearchSnapshot *snapshot, const char *query, int max_results,
+                                NovaSearchCancelFunc is_cancelled, void *user_data,
+                                NovaSearchCursor **cursor);
+
+#endif /* NOVASEARCH_SNAPSHOT_H */
@@ -4,11 +4,72 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <sqlite3.h>
 #include "../src/database.h"
 
 #define TEST_DB_PATH "/tmp/novasearch_test.db"
+#define TEST_SYSTEM_DB_PATH "/tmp/novasearch_test_system.db"
+
+/* The query socket is looked up next to the database */
+#define SERVER_TEST_DIR "/tmp/novasearch_server_test"
+#define SERVER_TEST_DB_PATH SERVER_TEST_DIR "/index.db"
+#define SERVER_TEST_SOCKET_PATH SERVER_TEST_DIR "/query.sock"
+
+/* Schema of the daemon's index, shared by the user and system databases */
+static const char *TEST_SCHEMA =
+    "CREATE TABLE IF NOT EXISTS files ("
+    "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "  dir_id INTEGER NOT NULL,"
+    "  filename TEXT NOT NULL,"
+    "  size INTEGER NOT NULL,"
+    "  modified_time INTEGER NOT NULL,"
+    "  file_type INTEGER NOT NULL,"
+    "  indexed_time INTEGER NOT NULL,"
+    "  frecency INTEGER NOT NULL DEFAULT 0,"
+    "  UNIQUE (dir_id, filename)"
+    ");"
+    "CREATE TABLE IF NOT EXISTS dirs ("
+    "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "  path TEXT NOT NULL UNIQUE,"
+    "  modified_time_ns INTEGER"
+    ");"
+    "CREATE VIEW IF NOT EXISTS file_paths AS "
+    "SELECT f.id AS id, f.dir_id AS dir_id, f.filename AS filename,"
+    "  d.path || '/' || f.filename AS path, f.size AS size, f.modified_time AS modified_time,"
+    "  CASE f.file_type WHEN 0 THEN 'regular' WHEN 1 THEN 'directory'"
+    "    WHEN 2 THEN 'symlink' ELSE 'other' END AS file_type,"
+    "  f.indexed_time AS indexed_time, f.frecency AS frecency "
+    "FROM files f JOIN dirs d ON d.id = f.dir_id;"
+    "CREATE TABLE IF NOT EXISTS usage_stats ("
+    "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "  file_id INTEGER NOT NULL,"
+    "  launch_count INTEGER NOT NULL DEFAULT 0,"
+    "  last_launched INTEGER"
+    ");"
+    "CREATE TABLE IF NOT EXISTS app_metadata ("
+    "  file_id INTEGER PRIMARY KEY,"
+    "  name TEXT NOT NULL,"
+    "  icon TEXT NOT NULL,"
+    "  exec TEXT NOT NULL,"
+    "  keywords TEXT NOT NULL"
+    ");"
+    "CREATE INDEX IF NOT EXISTS idx_filename ON files(filename COLLATE NOCASE);"
+    "CREATE INDEX IF NOT EXISTS idx_frecency ON files(frecency DESC, filename COLLATE NOCASE);"
+    "CREATE VIRTUAL TABLE IF NOT EXISTS files_fts USING fts5("
+    "  filename, content='files', content_rowid='id', tokenize='trigram'"
+    ");"
+    "CREATE TRIGGER IF NOT EXISTS files_fts_insert AFTER INSERT ON files BEGIN"
+    "  INSERT INTO files_fts (rowid, filename) VALUES (new.id, new.filename);"
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS files_fts_delete AFTER DELETE ON files BEGIN"
+    "  INSERT INTO files_fts (files_fts, rowid, filename) VALUES ('delete', old.id, old.filename);"
+    "END;";
 
 /* Helper function to create a test database */
 void create_test_database(void) {
@@ -16,32 +77,24 @@ void create_test_database(void) {
     int rc = sqlite3_open(TEST_DB_PATH, &db);
     assert(rc == SQLITE_OK);
     
-    /* Create schema */
-    const char *schema = 
-        "CREATE TABLE IF NOT EXISTS files ("
-        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
-        "  filename TEXT NOT NULL,"
-        "  path TEXT NOT NULL UNIQUE,"
-        "  size INTEGER NOT NULL,"
-        "  modified_time INTEGER NOT NULL,"
-        "  file_type TEXT NOT NULL,"
-        "  indexed_time INTEGER NOT NULL"
-        ");"
-        "CREATE INDEX IF NOT EXISTS idx_filename ON files(filename COLLATE NOCASE);"
-        "CREATE INDEX IF NOT EXISTS idx_path ON files(path COLLATE NOCASE);";
-    
     char *err_msg = NULL;
-    rc = sqlite3_exec(db, schema, NULL, NULL, &err_msg);
+    rc = sqlite3_exec(db, TEST_SCHEMA, NULL, NULL, &err_msg);
     assert(rc == SQLITE_OK);
     
     /* Insert test data */
     const char *insert = 
-        "INSERT OR REPLACE INTO files (filename, path, size, modified_time, file_type, indexed_time) VALUES "
-        "('document.txt', '/home/user/document.txt', 1024, 1234567890, 'Regular', 1234567890),"
-        "('Document.pdf', '/home/user/Document.pdf', 2048, 1234567891, 'Regular', 1234567891),"
-        "('my_document.doc', '/home/user/my_document.doc', 4096, 1234567892, 'Regular', 1234567892),"
-        "('image.png', '/home/user/image.png', 8192, 1234567893, 'Regular', 1234567893),"
-        "('test.txt', '/home/user/test.txt', 512, 1234567894, 'Regular', 1234567894);";
+        "INSERT OR IGNORE INTO dirs (id, path) VALUES (1, '/home/user');"
+        "INSERT OR REPLACE INTO files (dir_id, filename, size, modified_time, file_type, indexed_time) VALUES "
+        "(1, 'document.txt', 1024, 1234567890, 0, 1234567890),"
+        "(1, 'Document.pdf', 2048, 1234567891, 0, 1234567891),"
+        "(1, 'my_document.doc', 4096, 1234567892, 0, 1234567892),"
+        "(1, 'image.png', 8192, 1234567893, 0, 1234567893),"
+        "(1, 'test.txt', 512, 1234567894, 0, 1234567894);"
+        "INSERT OR IGNORE INTO dirs (id, path) VALUES (3, '/usr/share/applications');"
+        "INSERT OR REPLACE INTO files (id, dir_id, filename, size, modified_time, file_type, indexed_time) "
+        "VALUES (100, 3, 'org.gnome.Terminal.desktop', 256, 1234567895, 0, 1234567895);"
+        "INSERT OR REPLACE INTO app_metadata (file_id, name, icon, exec, keywords) "
+        "VALUES (100, 'Terminal', 'utilities-terminal', 'gnome-terminal', 'shell;prompt;command;');";
     
     rc = sqlite3_exec(db, insert, NULL, NULL, &err_msg);
     assert(rc == SQLITE_OK);
@@ -146,6 +199,71 @@ void test_result_limit(void) {
     printf("  ✓ Result limit enforcement works\n");
 }
 
+/* Test that results can be read a page at a time */
+void test_paged_results(void) {
+    printf("Testing paged results...\n");
+    
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(db != NULL);
+    assert(nova_search_db_open(db) == true);
+    
+    /* Pages of a ranked query keep its order and outlive their cursor */
+    NovaSearchCursor *cursor = nova_search_db_query_cursor(db, "document", 50, NULL, NULL);
+    assert(cursor != NULL);
+    SearchResultPage *first = nova_search_cursor_next_page(cursor, 2);
+    assert(first != NULL && first->count == 2);
+    assert(nova_search_result_count(first->results) == 2);
+    assert(strcmp(first->results->filename, "Document.pdf") == 0);
+    assert(strcmp(first->results->next->path, "/home/user/document.txt") == 0);
+    assert(nova_search_cursor_has_more(cursor));
+    
+    SearchResultPage *second = nova_search_cursor_next_page(cursor, 2);
+    assert(second != NULL && second->count == 1);
+    assert(strcmp(second->results->filename, "my_document.doc") == 0);
+    assert(second->results->size == 4096);
+    assert(!nova_search_cursor_has_more(cursor));
+    assert(nova_search_cursor_next_page(cursor, 2) == NULL);
+    nova_search_cursor_free(cursor);
+    nova_search_result_page_free(first);
+    nova_search_result_page_free(second);
+    
+    /* A query without matches has nothing to page through */
+    cursor = nova_search_db_query_cursor(db, "nonexistent", 50, NULL, NULL);
+    assert(cursor != NULL);
+    assert(!nova_search_cursor_has_more(cursor));
+    assert(nova_search_cursor_next_page(cursor, 2) == NULL);
+    nova_search_cursor_free(cursor);
+    assert(nova_search_db_query_cursor(db, "", 50, NULL, NULL) == NULL);
+    
+    /* Ids that are no longer indexed are skipped; page size 0 takes all */
+    int64_t ids[] = { 100, 999, 1 };
+    cursor = nova_search_db_fetch_cursor(db, ids, 3);
+    assert(cursor != NULL);
+    SearchResultPage *page = nova_search_cursor_next_page(cursor, 0);
+    assert(page != NULL && page->count == 2);
+    assert(strcmp(page->results->app_name, "Terminal") == 0);
+    assert(strcmp(page->results->next->filename, "document.txt") == 0);
+    assert(page->results->next->app_name == NULL);
+    assert(!nova_search_cursor_has_more(cursor));
+    nova_search_result_page_free(page);
+    nova_search_cursor_free(cursor);
+    
+    /* Result lists are handed out in slices; the rest goes with the cursor */
+    cursor = nova_search_cursor_from_list(nova_search_db_query(db, "document", 50));
+    assert(cursor != NULL);
+    page = nova_search_cursor_next_page(cursor, 1);
+    assert(page != NULL && page->count == 1);
+    assert(page->results->next == NULL);
+    assert(strcmp(page->results->filename, "Document.pdf") == 0);
+    assert(nova_search_cursor_has_more(cursor));
+    nova_search_result_page_free(page);
+    nova_search_cursor_free(cursor);
+    
+    nova_search_db_free(db);
+    
+    printf("  ✓ Paged results work\n");
+}
+
 /* Test query with no matches */
 void test_no_matches(void) {
     printf("Testing query with no matches...\n");
@@ -163,6 +281,249 @@ void test_no_matches(void) {
     printf("  ✓ No matches handled correctly\n");
 }
 
+/* Test substring matches in the middle of a filename */
+void test_substring_match(void) {
+    printf("Testing substring matching...\n");
+    
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(db != NULL);
+    assert(nova_search_db_open(db) == true);
+    
+    SearchResult *results = nova_search_db_query(db, "y_doc", 50);
+    assert(results != NULL);
+    assert(nova_search_result_count(results) == 1);
+    assert(strcmp(results->filename, "my_document.doc") == 0);
+    
+    nova_search_result_list_free(results);
+    nova_search_db_free(db);
+    
+    printf("  ✓ Substring matching works\n");
+}
+
+/* Test queries too short for the trigram index */
+void test_short_query(void) {
+    printf("Testing short queries...\n");
+    
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(db != NULL);
+    assert(nova_search_db_open(db) == true);
+    
+    SearchResult *results = nova_search_db_query(db, "ng", 50);
+    assert(results != NULL);
+    assert(nova_search_result_count(results) == 1);
+    assert(strcmp(results->filename, "image.png") == 0);
+    
+    nova_search_result_list_free(results);
+    nova_search_db_free(db);
+    
+    printf("  ✓ Short queries work\n");
+}
+
+/* Test that cached statements are reused across queries */
+void test_repeated_queries(void) {
+    printf("Testing repeated queries...\n");
+    
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(db != NULL);
+    assert(nova_search_db_open(db) == true);
+    
+    for (int i = 0; i < 3; i++) {
+        SearchResult *results = nova_search_db_query(db, "document", 50);
+        assert(nova_search_result_count(results) == 3);
+        nova_search_result_list_free(results);
+        
+        results = nova_search_db_query(db, "ng", 50);
+        assert(nova_search_result_count(results) == 1);
+        nova_search_result_list_free(results);
+    }
+    
+    assert(db->query_fts_stmt != NULL);
+    assert(db->query_scan_stmt != NULL);
+    
+    nova_search_db_free(db);
+    
+    printf("  ✓ Repeated queries work\n");
+}
+
+/* Count the cached result lists for a query */
+static int cached_entries(NovaSearchDB *db, const char *query) {
+    int entries = 0;
+    for (int i = 0; i < QUERY_CACHE_SIZE; i++) {
+        if (db->query_cache[i].query && strcmp(db->query_cache[i].query, query) == 0) {
+            entries++;
+        }
+    }
+    return entries;
+}
+
+/* Run a statement on a separate connection, as the daemon would */
+static void exec_as_daemon(const char *sql) {
+    sqlite3 *conn;
+    assert(sqlite3_open(TEST_DB_PATH, &conn) == SQLITE_OK);
+    assert(sqlite3_exec(conn, sql, NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_close(conn);
+}
+
+/* Test that repeated queries are cached until the database changes */
+void test_query_cache(void) {
+    printf("Testing the query result cache...\n");
+    
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(db != NULL);
+    assert(nova_search_db_open(db) == true);
+    
+    /* Hits return their own copy of the results */
+    SearchResult *first = nova_search_db_query(db, "probe", 50);
+    assert(first == NULL);
+    assert(cached_entries(db, "probe") == 1);
+    
+    first = nova_search_db_query(db, "document", 50);
+    SearchResult *second = nova_search_db_query(db, "document", 50);
+    assert(first != second);
+    assert(cached_entries(db, "document") == 1);
+    nova_search_result_list_free(first);
+    assert(nova_search_result_count(second) == 3);
+    assert(strcmp(second->filename, "Document.pdf") == 0);
+    nova_search_result_list_free(second);
+    
+    /* A commit by another connection drops every cached list */
+    exec_as_daemon("INSERT INTO files (dir_id, filename, size, modified_time, file_type, indexed_time) "
+                   "VALUES (1, 'probe.txt', 1, 1234567896, 0, 1234567896)");
+    SearchResult *results = nova_search_db_query(db, "probe", 50);
+    assert(nova_search_result_count(results) == 1);
+    assert(cached_entries(db, "document") == 0);
+    nova_search_result_list_free(results);
+    
+    exec_as_daemon("DELETE FROM files WHERE filename = 'probe.txt'");
+    assert(nova_search_db_query(db, "probe", 50) == NULL);
+    
+    /* The least recently used list makes room for a new one */
+    for (int i = 0; i < QUERY_CACHE_SIZE; i++) {
+        char query[16];
+        snprintf(query, sizeof(query), "miss%d", i);
+        assert(nova_search_db_query(db, query, 50) == NULL);
+        if (i == 0) {
+            nova_search_result_list_free(nova_search_db_query(db, "probe", 50));
+        }
+    }
+    char last[16];
+    snprintf(last, sizeof(last), "miss%d", QUERY_CACHE_SIZE - 1);
+    assert(cached_entries(db, "probe") == 1);
+    assert(cached_entries(db, "miss0") == 0);
+    assert(cached_entries(db, last) == 1);
+    
+    nova_search_db_free(db);
+    
+    printf("  ✓ Query result cache works\n");
+}
+
+static bool always_cancelled(void *user_data) {
+    int *calls = user_data;
+    (*calls)++;
+    return true;
+}
+
+static bool cancelled_after_first_check(void *user_data) {
+    int *calls = user_data;
+    return ++(*calls) > 1;
+}
+
+static bool never_cancelled(void *user_data) {
+    (void)user_data;
+    return false;
+}
+
+/* Test that a cancelled query is abandoned */
+void test_cancelled_query(void) {
+    printf("Testing query cancellation...\n");
+    
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(db != NULL);
+    assert(nova_search_db_open(db) == true);
+    
+    int calls = 0;
+    SearchResult *results = nova_search_db_query_cancellable(db, "document", 50,
+                                                             always_cancelled, &calls);
+    assert(results == NULL);
+    assert(calls > 0);
+    
+    results = nova_search_db_query_cancellable(db, "document", 50, never_cancelled, NULL);
+    assert(nova_search_result_count(results) == 3);
+    nova_search_result_list_free(results);
+    
+    /* A long-running query is interrupted by the progress handler */
+    sqlite3 *writer = NULL;
+    assert(sqlite3_open(TEST_DB_PATH, &writer) == SQLITE_OK);
+    assert(sqlite3_exec(writer,
+        "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 5000) "
+        "INSERT INTO files (dir_id, filename, size, modified_time, file_type, indexed_time) "
+        "SELECT 2, 'zz' || i || '.bin', 1, 1, 0, 1 FROM n;"
+        "INSERT INTO dirs (id, path) VALUES (2, '/home/user/bulk')",
+        NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_close(writer);
+    
+    calls = 0;
+    results = nova_search_db_query_cancellable(db, "zz", 5000, cancelled_after_first_check, &calls);
+    assert(results == NULL);
+    assert(calls == 2);
+    
+    results = nova_search_db_query(db, "zz", 5000);
+    assert(nova_search_result_count(results) == 5000);
+    nova_search_result_list_free(results);
+    
+    /* The progress handler is removed once the query finishes */
+    results = nova_search_db_query(db, "document", 50);
+    assert(nova_search_result_count(results) == 3);
+    nova_search_result_list_free(results);
+    
+    nova_search_db_free(db);
+    
+    printf("  ✓ Query cancellation works\n");
+}
+
+/* Test usage tracking through the read-write handle */
+void test_record_launch(void) {
+    printf("Testing launch recording...\n");
+    
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(db != NULL);
+    assert(nova_search_db_open(db) == true);
+    assert(db->rw_db == NULL);
+    
+    assert(nova_search_db_record_launch(db, "/home/user/my_document.doc") == true);
+    assert(nova_search_db_record_launch(db, "/home/user/my_document.doc") == true);
+    assert(nova_search_db_record_launch(db, "/home/user/missing.txt") == false);
+    assert(db->rw_db != NULL);
+    
+    /* Launched files rank first among substring matches */
+    SearchResult *results = nova_search_db_query(db, "ocum", 50);
+    assert(results != NULL);
+    assert(strcmp(results->filename, "my_document.doc") == 0);
+    nova_search_result_list_free(results);
+    
+    sqlite3_stmt *stmt = NULL;
+    assert(sqlite3_prepare_v2(db->db,
+        "SELECT COUNT(*), MAX(launch_count) FROM usage_stats", -1, &stmt, NULL) == SQLITE_OK);
+    assert(sqlite3_step(stmt) == SQLITE_ROW);
+    assert(sqlite3_column_int(stmt, 0) == 1);
+    assert(sqlite3_column_int(stmt, 1) == 2);
+    sqlite3_finalize(stmt);
+
+    /* Two launches score a half-life's worth above a single one */
+    int64_t launched = (int64_t)time(NULL);
+    assert(sqlite3_prepare_v2(db->db,
+        "SELECT frecency FROM files WHERE filename = 'my_document.doc'", -1, &stmt, NULL) == SQLITE_OK);
+    assert(sqlite3_step(stmt) == SQLITE_ROW);
+    int64_t frecency = sqlite3_column_int64(stmt, 0);
+    int64_t single = (int64_t)((double)launched / (30.0 * 24 * 60 * 60) * 1024.0);
+    assert(frecency >= single + 1023 && frecency <= single + 1026);
+    sqlite3_finalize(stmt);
+    
+    nova_search_db_free(db);
+    
+    printf("  ✓ Launch recording works\n");
+}
+
 /* Test result data completeness */
 void test_result_data_completeness(void) {
     printf("Testing result data completeness...\n");
@@ -190,6 +551,287 @@ void test_result_data_completeness(void) {
     printf("  ✓ Result data completeness verified\n");
 }
 
+/* Append little-endian fields to a response being built */
+static size_t put_le(unsigned char *buffer, size_t at, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buffer[at + i] = (unsigned char)(value >> (8 * i));
+    }
+    return at + bytes;
+}
+
+static size_t put_field(unsigned char *buffer, size_t at, const char *text) {
+    size_t length = strlen(text);
+    at = put_le(buffer, at, length, 4);
+    memcpy(buffer + at, text, length);
+    return at + length;
+}
+
+/* Answer queries on one connection the way the daemon does, then exit */
+static void serve_queries(int listener, int count) {
+    int client = accept(listener, NULL, NULL);
+    assert(client >= 0);
+
+    for (int i = 0; i < count; i++) {
+        unsigned char request[64];
+        ssize_t received = 0;
+        while (received < 14) {
+            ssize_t n = recv(client, request + received, sizeof(request) - received, 0);
+            assert(n > 0);
+            received += n;
+        }
+        /* Length 10, query opcode, a limit of 10 and the query */
+        assert(received == 14);
+        assert(request[0] == 10 && request[4] == 1 && request[5] == 10);
+        assert(memcmp(request + 9, "notes", 5) == 0);
+
+        unsigned char response[512];
+        size_t at = put_le(response, 4, 0, 1);
+        at = put_le(response, at, 2, 4);
+        at = put_le(response, at, 2048, 8);
+        at = put_le(response, at, 1700000000, 8);
+        at = put_field(response, at, "notes.txt");
+        at = put_field(response, at, "/home/user/notes.txt");
+        at = put_field(response, at, "regular");
+        at = put_field(response, at, "");
+        at = put_field(response, at, "");
+        at = put_field(response, at, "");
+        at = put_le(response, at, 512, 8);
+        at = put_le(response, at, 1700000001, 8);
+        at = put_field(response, at, "notes.desktop");
+        at = put_field(response, at, "/usr/share/applications/notes.desktop");
+        at = put_field(response, at, "regular");
+        at = put_field(response, at, "Notes");
+        at = put_field(response, at, "notes");
+        at = put_field(response, at, "notes %f");
+        put_le(response, 0, at - 4, 4);
+
+        assert(send(client, response, at, 0) == (ssize_t)at);
+    }
+    close(client);
+}
+
+/* Test that queries go to the daemon's query server when it is running */
+void test_query_server(void) {
+    printf("Testing query server client...\n");
+
+    mkdir(SERVER_TEST_DIR, 0700);
+    unlink(SERVER_TEST_SOCKET_PATH);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(listener >= 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SERVER_TEST_SOCKET_PATH);
+    assert(bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    assert(listen(listener, 1) == 0);
+
+    pid_t server = fork();
+    assert(server >= 0);
+    if (server == 0) {
+        serve_queries(listener, 2);
+        _exit(0);
+    }
+    close(listener);
+
+    /* Served without ever opening the database */
+    NovaSearchDB *db = nova_search_db_new(SERVER_TEST_DB_PATH);
+    assert(db != NULL);
+    SearchResult *results = nova_search_db_query(db, "notes", 10);
+    assert(results != NULL);
+    assert(db->is_connected == false);
+    assert(strcmp(results->filename, "notes.txt") == 0);
+    assert(strcmp(results->path, "/home/user/notes.txt") == 0);
+    assert(strcmp(results->file_type, "regular") == 0);
+    assert(results->size == 2048);
+    assert(results->modified_time == 1700000000);
+    assert(results->app_name == NULL && results->app_icon == NULL && results->app_exec == NULL);
+    assert(strcmp(results->next->app_exec, "notes %f") == 0);
+    assert(results->next->next == NULL);
+    nova_search_result_list_free(results);
+
+    /* Paged, each page built from the response into its own arena */
+    NovaSearchCursor *cursor = NULL;
+    assert(nova_search_db_query_server(db, "notes", 10, &cursor));
+    SearchResultPage *page = nova_search_cursor_next_page(cursor, 1);
+    assert(page != NULL && page->count == 1 && page->blocks != NULL);
+    assert(strcmp(page->results->path, "/home/user/notes.txt") == 0);
+    assert(page->results->app_name == NULL && page->results->next == NULL);
+    nova_search_result_page_free(page);
+    assert(nova_search_cursor_has_more(cursor));
+    page = nova_search_cursor_next_page(cursor, 1);
+    assert(page != NULL && page->count == 1);
+    assert(page->results->size == 512 && page->results->modified_time == 1700000001);
+    assert(strcmp(page->results->app_name, "Notes") == 0);
+    assert(strcmp(page->results->app_icon, "notes") == 0);
+    nova_search_result_page_free(page);
+    assert(!nova_search_cursor_has_more(cursor));
+    nova_search_cursor_free(cursor);
+
+    int status;
+    assert(waitpid(server, &status, 0) == server);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    /* Once the server is gone, queries fall back to SQLite */
+    assert(nova_search_db_query(db, "notes", 10) == NULL);
+    assert(db->server_fd == -1);
+    assert(nova_search_db_has_server(db) == false);
+    nova_search_db_free(db);
+
+    unlink(SERVER_TEST_SOCKET_PATH);
+    rmdir(SERVER_TEST_DIR);
+
+    printf("  ✓ Query server client works\n");
+}
+
+/* Test that applications match on their indexed name and keywords */
+void test_application_match(void) {
+    printf("Testing application metadata matches...\n");
+    
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(db != NULL);
+    assert(nova_search_db_open(db) == true);
+    
+    /* Keyword through the trigram path, and through the short-query scan */
+    const char *queries[] = { "prompt", "sh", "terminal" };
+    for (int i = 0; i < 3; i++) {
+        SearchResult *results = nova_search_db_query(db, queries[i], 50);
+        assert(nova_search_result_count(results) == 1);
+        assert(strcmp(results->path, "/usr/share/applications/org.gnome.Terminal.desktop") == 0);
+        assert(strcmp(results->app_name, "Terminal") == 0);
+        assert(strcmp(results->app_icon, "utilities-terminal") == 0);
+        assert(strcmp(results->app_exec, "gnome-terminal") == 0);
+        nova_search_result_list_free(results);
+    }
+    
+    /* Other entries carry no application fields */
+    SearchResult *results = nova_search_db_query(db, "image", 50);
+    assert(nova_search_result_count(results) == 1);
+    assert(results->app_name == NULL && results->app_icon == NULL && results->app_exec == NULL);
+    nova_search_result_list_free(results);
+    
+    nova_search_db_free(db);
+    
+    printf("  ✓ Application metadata matches work\n");
+}
+
+/* Test that the system index is searched alongside the user's own */
+void test_system_index(void) {
+    printf("Testing the shared system index...\n");
+    
+    sqlite3 *conn;
+    assert(sqlite3_open(TEST_SYSTEM_DB_PATH, &conn) == SQLITE_OK);
+    assert(sqlite3_exec(conn, TEST_SCHEMA, NULL, NULL, NULL) == SQLITE_OK);
+    assert(sqlite3_exec(conn,
+        "INSERT INTO dirs (id, path) VALUES (1, '/usr/share/applications'),"
+        "  (2, '/var/lib/flatpak/exports/share/applications');"
+        "INSERT INTO files (id, dir_id, filename, size, modified_time, file_type, indexed_time) VALUES "
+        "(6, 1, 'org.gnome.Terminal.desktop', 256, 1234567895, 0, 1234567895),"
+        "(7, 2, 'org.mozilla.firefox.desktop', 256, 1234567896, 0, 1234567896);"
+        "INSERT INTO app_metadata (file_id, name, icon, exec, keywords) "
+        "VALUES (7, 'Firefox', 'firefox', 'firefox %u', 'web;browser;');",
+        NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_close(conn);
+    exec_as_daemon("CREATE TABLE IF NOT EXISTS system_usage ("
+                   "  path TEXT PRIMARY KEY, launch_count INTEGER NOT NULL DEFAULT 0,"
+                   "  last_launched INTEGER, frecency INTEGER NOT NULL DEFAULT 0)");
+    
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(db != NULL);
+    nova_search_db_set_system_index(db, TEST_SYSTEM_DB_PATH);
+    assert(nova_search_db_open(db) == true);
+    assert(db->system_attached);
+    
+    /* By keyword through the trigram path, and through the short-query scan */
+    const char *queries[] = { "browser", "fox", "zi" };
+    for (int i = 0; i < 3; i++) {
+        SearchResult *results = nova_search_db_query(db, queries[i], 50);
+        assert(nova_search_result_count(results) == 1);
+        assert(strcmp(results->path,
+                      "/var/lib/flatpak/exports/share/applications/org.mozilla.firefox.desktop") == 0);
+        assert(strcmp(results->app_name, "Firefox") == 0);
+        nova_search_result_list_free(results);
+    }
+    
+    /* A directory the user indexes as well is only searched once */
+    SearchResult *results = nova_search_db_query(db, "terminal", 50);
+    assert(nova_search_result_count(results) == 1);
+    nova_search_result_list_free(results);
+    
+    /* Launches of system entries are recorded in the user's database and
+     * rank them among the user's own entries */
+    results = nova_search_db_query(db, "desktop", 50);
+    assert(nova_search_result_count(results) == 2);
+    assert(strcmp(results->filename, "org.gnome.Terminal.desktop") == 0);
+    nova_search_result_list_free(results);
+    
+    assert(nova_search_db_record_launch(db,
+        "/var/lib/flatpak/exports/share/applications/org.mozilla.firefox.desktop") == true);
+    assert(nova_search_db_record_launch(db,
+        "/var/lib/flatpak/exports/share/applications/missing.desktop") == false);
+    results = nova_search_db_query(db, "desktop", 50);
+    assert(nova_search_result_count(results) == 2);
+    assert(strcmp(results->filename, "org.mozilla.firefox.desktop") == 0);
+    nova_search_result_list_free(results);
+    
+    sqlite3_stmt *stmt = NULL;
+    assert(sqlite3_prepare_v2(db->db,
+        "SELECT launch_count, frecency FROM system_usage", -1, &stmt, NULL) == SQLITE_OK);
+    assert(sqlite3_step(stmt) == SQLITE_ROW);
+    assert(sqlite3_column_int(stmt, 0) == 1);
+    assert(sqlite3_column_int64(stmt, 1) > 0);
+    sqlite3_finalize(stmt);
+    
+    /* The search engine knows system entries by their negated ids */
+    int64_t ids[] = { -7, 1 };
+    results = nova_search_db_fetch(db, ids, 2);
+    assert(nova_search_result_count(results) == 2);
+    assert(strcmp(results->filename, "org.mozilla.firefox.desktop") == 0);
+    assert(strcmp(results->next->filename, "document.txt") == 0);
+    nova_search_result_list_free(results);
+    
+    NovaSearchCursor *cursor = nova_search_db_fetch_cursor(db, ids, 2);
+    SearchResultPage *page = nova_search_cursor_next_page(cursor, 1);
+    assert(page != NULL && page->count == 1);
+    assert(strcmp(page->results->app_exec, "firefox %u") == 0);
+    nova_search_result_page_free(page);
+    nova_search_cursor_free(cursor);
+    
+    /* Rebuilding the system index changes the data version */
+    int64_t version = nova_search_db_data_version(db);
+    assert(sqlite3_open(TEST_SYSTEM_DB_PATH, &conn) == SQLITE_OK);
+    assert(sqlite3_exec(conn, "DELETE FROM files WHERE id = 7", NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_close(conn);
+    assert(nova_search_db_data_version(db) != version);
+    results = nova_search_db_query(db, "fox", 50);
+    assert(results == NULL);
+    
+    nova_search_db_free(db);
+    
+    /* The system index itself is never written through the panel */
+    db = nova_search_db_new(TEST_DB_PATH);
+    nova_search_db_set_system_index(db, TEST_SYSTEM_DB_PATH);
+    assert(nova_search_db_open(db) == true);
+    assert(nova_search_db_record_launch(db, "/usr/share/applications/org.gnome.Terminal.desktop") == true);
+    assert(sqlite3_exec(db->rw_db, "DELETE FROM system.files", NULL, NULL, NULL) != SQLITE_OK);
+    nova_search_db_free(db);
+    
+    /* Without a system index only the user's entries are searched */
+    db = nova_search_db_new(TEST_DB_PATH);
+    nova_search_db_set_system_index(db, "/tmp/novasearch_missing_system.db");
+    assert(nova_search_db_open(db) == true);
+    assert(!db->system_attached);
+    results = nova_search_db_query(db, "desktop", 50);
+    assert(nova_search_result_count(results) == 1);
+    nova_search_result_list_free(results);
+    nova_search_db_free(db);
+    
+    exec_as_daemon("DROP TABLE system_usage");
+    unlink(TEST_SYSTEM_DB_PATH);
+    
+    printf("  ✓ Shared system index works\n");
+}
+
 /* Cleanup test database */
 void cleanup_test_database(void) {
     unlink(TEST_DB_PATH);
@@ -206,8 +848,18 @@ int main(void) {
     test_case_insensitive();
     test_result_ranking();
     test_result_limit();
+    test_paged_results();
     test_no_matches();
+    test_substring_match();
+    test_short_query();
+    test_repeated_queries();
+    test_query_cache();
+    test_cancelled_query();
     test_result_data_completeness();
+    test_record_launch();
+    test_application_match();
+    test_system_index();
+    test_query_server();
     
     /* Cleanup */
     cleanup_test_database();
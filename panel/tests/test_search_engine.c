@@ -0,0 +1,399 @@
+/* NovaSearch Panel - In-Memory Search Engine Test */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sqlite3.h>
+#include "../src/database.h"
+#include "../src/search_engine.h"
+
+#define TEST_DB_PATH "/tmp/novasearch_engine_test.db"
+#define TEST_SYSTEM_DB_PATH "/tmp/novasearch_engine_system_test.db"
+
+/* Helper function to create a test database */
+void create_test_database(void) {
+    sqlite3 *db;
+    int rc = sqlite3_open(TEST_DB_PATH, &db);
+    assert(rc == SQLITE_OK);
+
+    const char *schema =
+        "CREATE TABLE IF NOT EXISTS files ("
+        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  dir_id INTEGER NOT NULL,"
+        "  filename TEXT NOT NULL,"
+        "  size INTEGER NOT NULL,"
+        "  modified_time INTEGER NOT NULL,"
+        "  file_type INTEGER NOT NULL,"
+        "  indexed_time INTEGER NOT NULL,"
+        "  frecency INTEGER NOT NULL DEFAULT 0,"
+        "  UNIQUE (dir_id, filename)"
+        ");"
+        "CREATE TABLE IF NOT EXISTS dirs ("
+        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  path TEXT NOT NULL UNIQUE,"
+        "  modified_time_ns INTEGER"
+        ");"
+        "CREATE VIEW IF NOT EXISTS file_paths AS "
+        "SELECT f.id AS id, f.dir_id AS dir_id, f.filename AS filename,"
+        "  d.path || '/' || f.filename AS path, f.size AS size, f.modified_time AS modified_time,"
+        "  CASE f.file_type WHEN 0 THEN 'regular' WHEN 1 THEN 'directory'"
+        "    WHEN 2 THEN 'symlink' ELSE 'other' END AS file_type,"
+        "  f.indexed_time AS indexed_time, f.frecency AS frecency "
+        "FROM files f JOIN dirs d ON d.id = f.dir_id;"
+        "CREATE TABLE IF NOT EXISTS usage_stats ("
+        "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "  file_id INTEGER NOT NULL,"
+        "  launch_count INTEGER NOT NULL DEFAULT 0,"
+        "  last_launched INTEGER"
+        ");"
+        "CREATE TABLE IF NOT EXISTS app_metadata ("
+        "  file_id INTEGER PRIMARY KEY,"
+        "  name TEXT NOT NULL,"
+        "  icon TEXT NOT NULL,"
+        "  exec TEXT NOT NULL,"
+        "  keywords TEXT NOT NULL"
+        ");";
+
+    rc = sqlite3_exec(db, schema, NULL, NULL, NULL);
+    assert(rc == SQLITE_OK);
+
+    const char *insert =
+        "INSERT INTO dirs (id, path) VALUES (1, '/home/user');"
+        "INSERT INTO files (dir_id, filename, size, modified_time, file_type, indexed_time) VALUES "
+        "(1, 'document.txt', 1024, 1234567890, 0, 1234567890),"
+        "(1, 'Document.pdf', 2048, 1234567891, 0, 1234567891),"
+        "(1, 'my_document.doc', 4096, 1234567892, 0, 1234567892),"
+        "(1, 'image.png', 8192, 1234567893, 0, 1234567893),"
+        "(1, 'doc', 0, 1234567894, 1, 1234567894);"
+        "UPDATE files SET frecency = 3 WHERE id = 2;";
+
+    rc = sqlite3_exec(db, insert, NULL, NULL, NULL);
+    assert(rc == SQLITE_OK);
+
+    sqlite3_close(db);
+}
+
+/* Run a statement against the test database from a separate connection */
+static void write_test_database(const char *sql) {
+    sqlite3 *db;
+    assert(sqlite3_open(TEST_DB_PATH, &db) == SQLITE_OK);
+    assert(sqlite3_exec(db, sql, NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_close(db);
+}
+
+/* Get the filenames for matched ids, in order */
+static SearchResult* fetch_matches(NovaSearchDB *db, NovaSearchEngine *engine,
+                                   const char *query, int *count) {
+    int64_t ids[50];
+    *count = nova_search_engine_query(engine, query, ids, 50, NULL, NULL);
+    assert(*count >= 0);
+    return nova_search_db_fetch(db, ids, *count);
+}
+
+/* Test loading the snapshot */
+void test_load(void) {
+    printf("Testing snapshot loading...\n");
+
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(nova_search_db_open(db) == true);
+
+    NovaSearchEngine *engine = nova_search_engine_new();
+    assert(engine != NULL);
+    assert(nova_search_engine_is_current(engine, db) == false);
+
+    assert(nova_search_engine_load(engine, db) == true);
+    assert(engine->count == 5);
+    assert(nova_search_engine_is_current(engine, db) == true);
+
+    /* Filenames are stored lowercased, then as indexed */
+    for (uint32_t i = 0; i < engine->count; i++) {
+        const char *name = engine->arena + engine->offsets[i];
+        size_t length = strlen(name);
+        assert(2 * (length + 1) == engine->offsets[i + 1] - engine->offsets[i]);
+        assert(strcmp(name, "document.pdf") != 0 ||
+               (engine->frecencies[i] == 3 && strcmp(name + length + 1, "Document.pdf") == 0));
+    }
+
+    nova_search_engine_free(engine);
+    nova_search_db_free(db);
+
+    printf("  ✓ Snapshot loading works\n");
+}
+
+/* Test ranking of exact, prefix and substring matches */
+void test_ranking(void) {
+    printf("Testing match ranking...\n");
+
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(nova_search_db_open(db) == true);
+    NovaSearchEngine *engine = nova_search_engine_new();
+    assert(nova_search_engine_load(engine, db) == true);
+
+    int count = 0;
+    SearchResult *results = fetch_matches(db, engine, "doc", &count);
+    assert(count == 4);
+
+    /* Exact, then prefix ordered by frecency, then substring */
+    const char *expected[] = { "doc", "Document.pdf", "document.txt", "my_document.doc" };
+    SearchResult *current = results;
+    for (int i = 0; i < count; i++) {
+        assert(current != NULL);
+        assert(strcmp(current->filename, expected[i]) == 0);
+        current = current->next;
+    }
+    nova_search_result_list_free(results);
+
+    /* An exact match is case-sensitive, as in SQLite; otherwise prefix
+     * matches rank by frecency, then by name */
+    results = fetch_matches(db, engine, "DOC", &count);
+    const char *expected_upper[] = { "Document.pdf", "doc", "document.txt", "my_document.doc" };
+    assert(count == 4);
+    current = results;
+    for (int i = 0; i < count; i++) {
+        assert(strcmp(current->filename, expected_upper[i]) == 0);
+        current = current->next;
+    }
+    nova_search_result_list_free(results);
+
+    /* Characters in order but not adjacent do not match */
+    results = fetch_matches(db, engine, "mdcd", &count);
+    assert(count == 0);
+    assert(results == NULL);
+
+    results = fetch_matches(db, engine, "xyz", &count);
+    assert(count == 0);
+    assert(results == NULL);
+
+    nova_search_engine_free(engine);
+    nova_search_db_free(db);
+
+    printf("  ✓ Match ranking works\n");
+}
+
+/* Test narrowing the candidates as the query grows */
+void test_narrowing(void) {
+    printf("Testing incremental narrowing...\n");
+
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(nova_search_db_open(db) == true);
+    NovaSearchEngine *engine = nova_search_engine_new();
+    assert(nova_search_engine_load(engine, db) == true);
+
+    int64_t ids[50];
+    assert(nova_search_engine_query(engine, "d", ids, 50, NULL, NULL) == 4);
+    assert(engine->candidate_count == 4);
+
+    assert(nova_search_engine_query(engine, "do", ids, 50, NULL, NULL) == 4);
+    assert(nova_search_engine_query(engine, "docu", ids, 50, NULL, NULL) == 3);
+    assert(engine->candidate_count == 3);
+
+    /* A limit smaller than the candidate list keeps every candidate */
+    assert(nova_search_engine_query(engine, "docum", ids, 1, NULL, NULL) == 1);
+    assert(engine->candidate_count == 3);
+
+    /* Queries that do not extend the previous one scan everything */
+    assert(nova_search_engine_query(engine, "png", ids, 50, NULL, NULL) == 1);
+    assert(nova_search_engine_query(engine, "e", ids, 50, NULL, NULL) == 4);
+
+    nova_search_engine_free(engine);
+    nova_search_db_free(db);
+
+    printf("  ✓ Incremental narrowing works\n");
+}
+
+static bool always_cancelled(void *user_data) {
+    (void)user_data;
+    return true;
+}
+
+/* Test that cancellation discards the narrowing state */
+void test_cancellation(void) {
+    printf("Testing cancellation...\n");
+
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(nova_search_db_open(db) == true);
+    NovaSearchEngine *engine = nova_search_engine_new();
+    assert(nova_search_engine_load(engine, db) == true);
+
+    int64_t ids[50];
+    assert(nova_search_engine_query(engine, "doc", ids, 50, NULL, NULL) == 4);
+    assert(nova_search_engine_query(engine, "docu", ids, 50, always_cancelled, NULL) == -1);
+    assert(engine->last_query == NULL);
+    assert(nova_search_engine_query(engine, "image", ids, 50, NULL, NULL) == 1);
+
+    nova_search_engine_free(engine);
+    nova_search_db_free(db);
+
+    printf("  ✓ Cancellation works\n");
+}
+
+/* Test that changes made by another connection invalidate the snapshot */
+void test_reload(void) {
+    printf("Testing snapshot invalidation...\n");
+
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(nova_search_db_open(db) == true);
+    NovaSearchEngine *engine = nova_search_engine_new();
+    assert(nova_search_engine_load(engine, db) == true);
+
+    write_test_database(
+        "INSERT INTO files (dir_id, filename, size, modified_time, file_type, indexed_time) "
+        "VALUES (1, 'notes.md', 1, 1, 0, 1);"
+        "DELETE FROM files WHERE filename = 'image.png';");
+
+    assert(nova_search_engine_is_current(engine, db) == false);
+
+    /* Ids of deleted files are skipped when fetching */
+    int count = 0;
+    SearchResult *results = fetch_matches(db, engine, "image", &count);
+    assert(count == 1);
+    assert(results == NULL);
+
+    assert(nova_search_engine_load(engine, db) == true);
+    assert(nova_search_engine_is_current(engine, db) == true);
+    assert(engine->count == 5);
+
+    results = fetch_matches(db, engine, "notes", &count);
+    assert(count == 1);
+    assert(strcmp(results->path, "/home/user/notes.md") == 0);
+    nova_search_result_list_free(results);
+
+    nova_search_engine_free(engine);
+    nova_search_db_free(db);
+
+    printf("  ✓ Snapshot invalidation works\n");
+}
+
+/* Test that entries of the system index are loaded under negated ids */
+void test_system_index(void) {
+    printf("Testing system index entries...\n");
+
+    /* A copy of the schema holding one application */
+    unlink(TEST_SYSTEM_DB_PATH);
+    write_test_database("VACUUM INTO '" TEST_SYSTEM_DB_PATH "'");
+    sqlite3 *conn;
+    assert(sqlite3_open(TEST_SYSTEM_DB_PATH, &conn) == SQLITE_OK);
+    assert(sqlite3_exec(conn,
+        "DELETE FROM files; DELETE FROM dirs;"
+        "INSERT INTO dirs (id, path) VALUES (1, '/usr/share/applications');"
+        "INSERT INTO files (id, dir_id, filename, size, modified_time, file_type, indexed_time) "
+        "VALUES (4, 1, 'docviewer.desktop', 1, 1, 0, 1);",
+        NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_close(conn);
+    write_test_database(
+        "CREATE TABLE system_usage (path TEXT PRIMARY KEY, launch_count INTEGER NOT NULL DEFAULT 0,"
+        "  last_launched INTEGER, frecency INTEGER NOT NULL DEFAULT 0);"
+        "INSERT INTO system_usage (path, launch_count, frecency) "
+        "VALUES ('/usr/share/applications/docviewer.desktop', 1, 100);");
+
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    nova_search_db_set_system_index(db, TEST_SYSTEM_DB_PATH);
+    assert(nova_search_db_open(db) == true);
+    assert(db->system_attached);
+    NovaSearchEngine *engine = nova_search_engine_new();
+    assert(nova_search_engine_load(engine, db) == true);
+    assert(engine->count == 6);
+
+    /* Its launches rank it first among the prefix matches */
+    int count = 0;
+    SearchResult *results = fetch_matches(db, engine, "docv", &count);
+    assert(count == 1);
+    assert(strcmp(results->path, "/usr/share/applications/docviewer.desktop") == 0);
+    nova_search_result_list_free(results);
+
+    int64_t ids[50];
+    count = nova_search_engine_query(engine, "doc", ids, 50, NULL, NULL);
+    assert(count >= 2);
+    assert(ids[1] == -4);
+
+    nova_search_engine_free(engine);
+    nova_search_db_free(db);
+
+    write_test_database("DROP TABLE system_usage");
+    unlink(TEST_SYSTEM_DB_PATH);
+
+    printf("  ✓ System index entries work\n");
+}
+
+/* Test that launchers match by their name and keywords */
+void test_launchers(void) {
+    printf("Testing launcher matching...\n");
+
+    write_test_database(
+        "INSERT INTO files (id, dir_id, filename, size, modified_time, file_type, indexed_time) "
+        "VALUES (20, 1, 'org.darktable.desktop', 1, 1, 0, 1);"
+        "INSERT INTO app_metadata (file_id, name, icon, exec, keywords) "
+        "VALUES (20, 'Darktable', 'darktable', 'darktable %U', 'photo;raw;');");
+
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    assert(nova_search_db_open(db) == true);
+    NovaSearchEngine *engine = nova_search_engine_new();
+    assert(nova_search_engine_load(engine, db) == true);
+    assert(engine->launchers.count == 1);
+
+    int64_t ids[50];
+    assert(nova_search_engine_query(engine, "ph", ids, 50, NULL, NULL) == 1);
+    assert(ids[0] == 20);
+    assert(nova_search_engine_query(engine, "PHOTO", ids, 50, NULL, NULL) == 1);
+    assert(ids[0] == 20);
+    assert(nova_search_engine_query(engine, "raw", ids, 50, NULL, NULL) == 1);
+
+    /* The application name is a prefix match where the filename is not */
+    int count = 0;
+    SearchResult *results = fetch_matches(db, engine, "Darkt", &count);
+    assert(count == 1);
+    assert(strcmp(results->app_name, "Darktable") == 0);
+    nova_search_result_list_free(results);
+
+    nova_search_engine_free(engine);
+    nova_search_db_free(db);
+
+    write_test_database("DELETE FROM files WHERE id = 20; DELETE FROM app_metadata;");
+
+    printf("  ✓ Launcher matching works\n");
+}
+
+/* Test NULL safety */
+void test_null_safety(void) {
+    printf("Testing NULL safety...\n");
+
+    int64_t ids[1];
+    assert(nova_search_engine_load(NULL, NULL) == false);
+    assert(nova_search_engine_is_current(NULL, NULL) == false);
+    assert(nova_search_engine_query(NULL, "doc", ids, 1, NULL, NULL) == 0);
+    nova_search_engine_free(NULL);
+
+    NovaSearchEngine *engine = nova_search_engine_new();
+    assert(nova_search_engine_query(engine, "doc", ids, 1, NULL, NULL) == 0);
+    nova_search_engine_free(engine);
+
+    printf("  ✓ NULL safety works\n");
+}
+
+/* Cleanup test database */
+void cleanup_test_database(void) {
+    unlink(TEST_DB_PATH);
+}
+
+int main(void) {
+    printf("\n=== NovaSearch Search Engine Tests ===\n\n");
+
+    cleanup_test_database();
+    create_test_database();
+
+    test_load();
+    test_ranking();
+    test_narrowing();
+    test_cancellation();
+    test_null_safety();
+    test_reload();
+    test_system_index();
+    test_launchers();
+
+    cleanup_test_database();
+
+    printf("\n=== All search engine tests passed! ===\n\n");
+    return 0;
+}
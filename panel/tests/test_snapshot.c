@@ -0,0 +1,578 @@
+/* NovaSearch Panel - Index Snapshot Test */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sqlite3.h>
+#include "../src/database.h"
+#include "../src/snapshot.h"
+
+#define TEST_SNAPSHOT_PATH "/tmp/novasearch_snapshot_test.snap"
+#define TEST_SNAPSHOT_TEMP "/tmp/novasearch_snapshot_test.snap.tmp"
+#define TEST_DB_PATH "/tmp/novasearch_snapshot_test.db"
+
+/* A fixture entry; all of them live in /home/user. Launchers have their
+ * name, icon, exec line and keywords set. */
+typedef struct {
+    const char *filename;
+    unsigned char type;
+    uint32_t frecency;
+    uint64_t size;
+    const char *app[4];
+} FixtureEntry;
+
+/* Sorted by folded filename, as the daemon writes them */
+static const FixtureEntry fixture[] = {
+    { "doc", 1, 0, 0, { NULL } },
+    { "Document.pdf", 0, 3, 2048, { NULL } },
+    { "document.txt", 0, 0, 1024, { NULL } },
+    { "firefox.desktop", 0, 0, 512, { "Firefox", "firefox", "firefox %u", "web;browser;" } },
+    { "image.png", 0, 0, 8192, { NULL } },
+    { "my_document.doc", 0, 0, 4096, { NULL } },
+};
+#define FIXTURE_COUNT (sizeof(fixture) / sizeof(fixture[0]))
+
+/* Directory chain: "" (root), "home", "user" */
+static const char *fixture_dirs[] = { "", "home", "user" };
+#define FIXTURE_DIR_COUNT 3
+
+typedef struct {
+    uint32_t key;
+    uint32_t entry;
+} Posting;
+
+static void put_u16(unsigned char *p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static size_t align8(size_t offset) {
+    return (offset + 7) & ~(size_t)7;
+}
+
+static int compare_postings(const void *a, const void *b) {
+    const Posting *x = a;
+    const Posting *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    if (x->entry != y->entry) return x->entry < y->entry ? -1 : 1;
+    return 0;
+}
+
+/* Add the trigrams of a text to the postings of an entry */
+static void post_trigrams(Posting *postings, size_t *posting_count, const char *text, size_t entry) {
+    for (size_t j = 0; j + 3 <= strlen(text); j++) {
+        uint32_t key = 0;
+        for (int k = 0; k < 3; k++) {
+            char c = text[j + k];
+            if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+            key = (key << 8) | (unsigned char)c;
+        }
+        postings[*posting_count].key = key;
+        postings[*posting_count].entry = entry;
+        (*posting_count)++;
+    }
+}
+
+/* Encode the fixture in the daemon's NSSNAP02 format and write it to path */
+static void write_fixture(const char *path, uint64_t generation) {
+    unsigned char pool[512];
+    uint32_t name_offsets[FIXTURE_COUNT];
+    uint32_t dir_offsets[FIXTURE_DIR_COUNT];
+    size_t pool_size = 0;
+
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        name_offsets[i] = pool_size;
+        memcpy(pool + pool_size, fixture[i].filename, strlen(fixture[i].filename));
+        pool_size += strlen(fixture[i].filename);
+    }
+    for (size_t i = 0; i < FIXTURE_DIR_COUNT; i++) {
+        dir_offsets[i] = pool_size;
+        memcpy(pool + pool_size, fixture_dirs[i], strlen(fixture_dirs[i]));
+        pool_size += strlen(fixture_dirs[i]);
+    }
+    uint32_t app_offsets[FIXTURE_COUNT][4];
+    size_t app_count = 0;
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        for (int field = 0; fixture[i].app[0] && field < 4; field++) {
+            app_offsets[i][field] = pool_size;
+            memcpy(pool + pool_size, fixture[i].app[field], strlen(fixture[i].app[field]));
+            pool_size += strlen(fixture[i].app[field]);
+        }
+        app_count += fixture[i].app[0] != NULL;
+    }
+
+    /* One posting per distinct (trigram, entry) pair, sorted by trigram */
+    Posting postings[256];
+    size_t posting_count = 0;
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        post_trigrams(postings, &posting_count, fixture[i].filename, i);
+        if (fixture[i].app[0]) {
+            post_trigrams(postings, &posting_count, fixture[i].app[0], i);
+            post_trigrams(postings, &posting_count, fixture[i].app[3], i);
+        }
+    }
+    qsort(postings, posting_count, sizeof(Posting), compare_postings);
+    size_t unique = 0;
+    for (size_t i = 0; i < posting_count; i++) {
+        if (unique == 0 || compare_postings(&postings[i], &postings[unique - 1]) != 0) {
+            postings[unique++] = postings[i];
+        }
+    }
+    posting_count = unique;
+    size_t trigram_count = 0;
+    for (size_t i = 0; i < posting_count; i++) {
+        if (i == 0 || postings[i].key != postings[i - 1].key) trigram_count++;
+    }
+
+    size_t pool_offset = 104;
+    size_t dirs_offset = align8(pool_offset + pool_size);
+    size_t entries_offset = align8(dirs_offset + FIXTURE_DIR_COUNT * 12);
+    size_t trigrams_offset = align8(entries_offset + FIXTURE_COUNT * 32);
+    size_t postings_offset = align8(trigrams_offset + trigram_count * 12);
+    size_t apps_offset = align8(postings_offset + posting_count * 4);
+    size_t file_size = apps_offset + app_count * 36;
+
+    unsigned char *data = calloc(1, file_size);
+    assert(data != NULL);
+
+    memcpy(data, "NSSNAP02", 8);
+    put_u64(data + 8, generation);
+    put_u32(data + 16, FIXTURE_COUNT);
+    put_u32(data + 20, FIXTURE_DIR_COUNT);
+    put_u32(data + 24, trigram_count);
+    put_u32(data + 28, posting_count);
+    put_u64(data + 32, pool_offset);
+    put_u64(data + 40, pool_size);
+    put_u64(data + 48, dirs_offset);
+    put_u64(data + 56, entries_offset);
+    put_u64(data + 64, trigrams_offset);
+    put_u64(data + 72, postings_offset);
+    put_u64(data + 80, file_size);
+    put_u32(data + 88, app_count);
+    put_u64(data + 96, apps_offset);
+    memcpy(data + pool_offset, pool, pool_size);
+
+    for (size_t i = 0; i < FIXTURE_DIR_COUNT; i++) {
+        unsigned char *record = data + dirs_offset + i * 12;
+        put_u32(record, i == 0 ? UINT32_MAX : i - 1);
+        put_u32(record + 4, dir_offsets[i]);
+        put_u32(record + 8, strlen(fixture_dirs[i]));
+    }
+
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        unsigned char *record = data + entries_offset + i * 32;
+        put_u32(record, FIXTURE_DIR_COUNT - 1);
+        put_u32(record + 4, name_offsets[i]);
+        put_u16(record + 8, strlen(fixture[i].filename));
+        record[10] = fixture[i].type;
+        put_u32(record + 12, fixture[i].frecency);
+        put_u64(record + 16, fixture[i].size);
+        put_u64(record + 24, 1234567890 + i);
+    }
+
+    size_t trigram = 0;
+    for (size_t i = 0; i < posting_count; i++) {
+        if (i == 0 || postings[i].key != postings[i - 1].key) {
+            size_t count = 1;
+            while (i + count < posting_count && postings[i + count].key == postings[i].key) count++;
+            unsigned char *record = data + trigrams_offset + trigram * 12;
+            put_u32(record, postings[i].key);
+            put_u32(record + 4, i);
+            put_u32(record + 8, count);
+            trigram++;
+        }
+        put_u32(data + postings_offset + i * 4, postings[i].entry);
+    }
+
+    size_t app = 0;
+    for (size_t i = 0; i < FIXTURE_COUNT; i++) {
+        if (!fixture[i].app[0]) continue;
+        unsigned char *record = data + apps_offset + app * 36;
+        put_u32(record, i);
+        for (int field = 0; field < 4; field++) {
+            put_u32(record + 4 + field * 8, app_offsets[i][field]);
+            put_u32(record + 8 + field * 8, strlen(fixture[i].app[field]));
+        }
+        app++;
+    }
+
+    /* Replace the file by renaming, as the daemon does */
+    FILE *file = fopen(TEST_SNAPSHOT_TEMP, "wb");
+    assert(file != NULL);
+    assert(fwrite(data, 1, file_size, file) == file_size);
+    fclose(file);
+    assert(rename(TEST_SNAPSHOT_TEMP, path) == 0);
+    free(data);
+}
+
+/* Check the filenames of a result list, in order */
+static void assert_filenames(SearchResult *results, const char **expected, int count) {
+    assert(nova_search_result_count(results) == count);
+    SearchResult *current = results;
+    for (int i = 0; i < count; i++) {
+        assert(strcmp(current->filename, expected[i]) == 0);
+        current = current->next;
+    }
+}
+
+/* Test mapping and header parsing */
+void test_refresh(void) {
+    printf("Testing snapshot mapping...\n");
+
+    NovaSearchSnapshot *snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(snapshot != NULL);
+    assert(nova_search_snapshot_refresh(snapshot));
+    assert(snapshot->generation == 7);
+    assert(snapshot->entry_count == FIXTURE_COUNT);
+    assert(snapshot->dir_count == FIXTURE_DIR_COUNT);
+
+    /* Unchanged file: the mapping is kept */
+    const unsigned char *data = snapshot->data;
+    assert(nova_search_snapshot_refresh(snapshot));
+    assert(snapshot->data == data);
+
+    nova_search_snapshot_free(snapshot);
+
+    printf("  ✓ Snapshot mapping works\n");
+}
+
+/* Run a query and take all of its results as one page */
+static SearchResultPage *query_page(NovaSearchSnapshot *snapshot, const char *query, int max_results) {
+    NovaSearchCursor *cursor;
+    assert(nova_search_snapshot_query(snapshot, query, max_results, NULL, NULL, &cursor));
+    assert(cursor != NULL);
+    SearchResultPage *page = nova_search_cursor_next_page(cursor, 0);
+    assert(page != NULL && !nova_search_cursor_has_more(cursor));
+    nova_search_cursor_free(cursor);
+    return page;
+}
+
+/* Check that a query is answered with no matches */
+static void assert_no_matches(NovaSearchSnapshot *snapshot, const char *query,
+                              NovaSearchCancelFunc is_cancelled) {
+    NovaSearchCursor *cursor;
+    assert(nova_search_snapshot_query(snapshot, query, 10, is_cancelled, NULL, &cursor));
+    assert(cursor == NULL);
+}
+
+/* Test ranking and the decoded result fields */
+void test_query(void) {
+    printf("Testing snapshot queries...\n");
+
+    NovaSearchSnapshot *snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(nova_search_snapshot_refresh(snapshot));
+
+    /* Exact, then prefix (highest frecency first), then substring */
+    SearchResultPage *page = query_page(snapshot, "doc", 10);
+    SearchResult *results = page->results;
+    const char *expected[] = { "doc", "Document.pdf", "document.txt", "my_document.doc" };
+    assert_filenames(results, expected, 4);
+
+    assert(strcmp(results->path, "/home/user/doc") == 0);
+    assert(strcmp(results->file_type, "directory") == 0);
+    assert(strcmp(results->next->path, "/home/user/Document.pdf") == 0);
+    assert(strcmp(results->next->file_type, "regular") == 0);
+    assert(results->next->size == 2048);
+    assert(results->next->modified_time == 1234567891);
+    nova_search_result_page_free(page);
+
+    /* Case-insensitive matching */
+    page = query_page(snapshot, "PNG", 10);
+    results = page->results;
+    const char *expected_png[] = { "image.png" };
+    assert_filenames(results, expected_png, 1);
+    assert(strcmp(results->path, "/home/user/image.png") == 0);
+    nova_search_result_page_free(page);
+
+    /* Only the best results are kept */
+    page = query_page(snapshot, "doc", 2);
+    results = page->results;
+    assert_filenames(results, expected, 2);
+    nova_search_result_page_free(page);
+
+    nova_search_snapshot_free(snapshot);
+
+    printf("  ✓ Snapshot queries work\n");
+}
+
+/* Test matching launchers by their name and keywords */
+void test_launchers(void) {
+    printf("Testing launcher matching...\n");
+
+    NovaSearchSnapshot *snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(nova_search_snapshot_refresh(snapshot));
+    assert(snapshot->app_count == 1);
+
+    /* By keyword, through the trigram postings, with the metadata decoded */
+    SearchResultPage *page = query_page(snapshot, "BROWSER", 10);
+    SearchResult *results = page->results;
+    const char *expected[] = { "firefox.desktop" };
+    assert_filenames(results, expected, 1);
+    assert(strcmp(results->app_name, "Firefox") == 0);
+    assert(strcmp(results->app_icon, "firefox") == 0);
+    assert(strcmp(results->app_exec, "firefox %u") == 0);
+    nova_search_result_page_free(page);
+
+    /* By keyword in the full scan of short queries */
+    page = query_page(snapshot, "we", 10);
+    results = page->results;
+    assert_filenames(results, expected, 1);
+    nova_search_result_page_free(page);
+
+    /* Other entries carry no metadata */
+    page = query_page(snapshot, "image", 10);
+    results = page->results;
+    assert(results->app_name == NULL && results->app_icon == NULL && results->app_exec == NULL);
+    nova_search_result_page_free(page);
+
+    nova_search_snapshot_free(snapshot);
+
+    printf("  ✓ Launcher matching works\n");
+}
+
+/* Test trigram lookups and the full scan used for short queries */
+void test_trigrams(void) {
+    printf("Testing trigram narrowing...\n");
+
+    NovaSearchSnapshot *snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(nova_search_snapshot_refresh(snapshot));
+
+    /* A trigram no filename contains */
+    assert_no_matches(snapshot, "xyz", NULL);
+
+    /* Every trigram is present, but not contiguously */
+    assert_no_matches(snapshot, "docimage", NULL);
+
+    SearchResultPage *page = query_page(snapshot, "ment.t", 10);
+    SearchResult *results = page->results;
+    const char *expected[] = { "document.txt" };
+    assert_filenames(results, expected, 1);
+    nova_search_result_page_free(page);
+
+    /* Shorter than a trigram */
+    page = query_page(snapshot, "g", 10);
+    results = page->results;
+    const char *expected_short[] = { "image.png" };
+    assert_filenames(results, expected_short, 1);
+    nova_search_result_page_free(page);
+
+    nova_search_snapshot_free(snapshot);
+
+    printf("  ✓ Trigram narrowing works\n");
+}
+
+static bool always_cancelled(void *user_data) {
+    (void)user_data;
+    return true;
+}
+
+/* Test that a cancelled query returns nothing */
+void test_cancellation(void) {
+    printf("Testing cancellation...\n");
+
+    NovaSearchSnapshot *snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(nova_search_snapshot_refresh(snapshot));
+    assert_no_matches(snapshot, "doc", always_cancelled);
+    nova_search_snapshot_free(snapshot);
+
+    printf("  ✓ Cancellation works\n");
+}
+
+/* Run statements on the test database, as the daemon or a launch would */
+static void exec_sql(const char *sql) {
+    sqlite3 *conn;
+    assert(sqlite3_open(TEST_DB_PATH, &conn) == SQLITE_OK);
+    assert(sqlite3_exec(conn, sql, NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_close(conn);
+}
+
+/* Test that the snapshot is only used at the database's generation, ranked
+ * by the frecencies recorded there */
+void test_sync(void) {
+    printf("Testing snapshot validation...\n");
+
+    unlink(TEST_DB_PATH);
+    exec_sql("CREATE TABLE metadata (key TEXT PRIMARY KEY, value TEXT NOT NULL);"
+             "INSERT INTO metadata VALUES ('index_generation', '7');"
+             "CREATE TABLE file_paths (path TEXT NOT NULL, frecency INTEGER NOT NULL);"
+             "INSERT INTO file_paths VALUES ('/home/user/document.txt', 4);");
+
+    NovaSearchDB *db = nova_search_db_new(TEST_DB_PATH);
+    nova_search_db_set_system_index(db, NULL);
+    assert(nova_search_db_open(db));
+
+    NovaSearchSnapshot *snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(nova_search_snapshot_sync(snapshot, db));
+
+    /* The frecency stored in the file is not what the database holds */
+    SearchResultPage *page = query_page(snapshot, "doc", 10);
+    SearchResult *results = page->results;
+    const char *expected[] = { "doc", "document.txt", "Document.pdf", "my_document.doc" };
+    assert_filenames(results, expected, 4);
+    nova_search_result_page_free(page);
+
+    /* A launch recorded since the snapshot was written */
+    exec_sql("INSERT INTO file_paths VALUES ('/home/user/Document.pdf', 6);");
+    assert(nova_search_snapshot_sync(snapshot, db));
+    page = query_page(snapshot, "doc", 10);
+    results = page->results;
+    const char *expected_launched[] = { "doc", "Document.pdf", "document.txt", "my_document.doc" };
+    assert_filenames(results, expected_launched, 4);
+    nova_search_result_page_free(page);
+
+    /* The daemon committed without writing a new snapshot */
+    exec_sql("UPDATE metadata SET value = '8' WHERE key = 'index_generation';");
+    assert(!nova_search_snapshot_sync(snapshot, db));
+
+    nova_search_snapshot_free(snapshot);
+    nova_search_db_free(db);
+    unlink(TEST_DB_PATH);
+
+    printf("  ✓ Snapshot validation works\n");
+}
+
+/* Test that a replaced file is remapped and an invalid one ignored */
+void test_replacement(void) {
+    printf("Testing snapshot replacement...\n");
+
+    NovaSearchSnapshot *snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(nova_search_snapshot_refresh(snapshot));
+    assert(snapshot->generation == 7);
+
+    /* Results are built a page at a time from the file they were ranked in */
+    NovaSearchCursor *cursor;
+    assert(nova_search_snapshot_query(snapshot, "doc", 10, NULL, NULL, &cursor));
+    SearchResultPage *page = nova_search_cursor_next_page(cursor, 1);
+    assert(page != NULL && page->count == 1);
+    assert(strcmp(page->results->filename, "doc") == 0);
+    assert(nova_search_cursor_has_more(cursor));
+    nova_search_result_page_free(page);
+
+    write_fixture(TEST_SNAPSHOT_PATH, 8);
+    assert(nova_search_snapshot_refresh(snapshot));
+    assert(snapshot->generation == 8);
+
+    /* Once it is replaced, the cursor has nothing more to give */
+    assert(nova_search_cursor_next_page(cursor, 1) == NULL);
+    assert(!nova_search_cursor_has_more(cursor));
+    nova_search_cursor_free(cursor);
+
+    /* A corrupt replacement keeps the last good mapping */
+    FILE *file = fopen(TEST_SNAPSHOT_TEMP, "wb");
+    assert(file != NULL);
+    char garbage[128] = "NOTASNAP";
+    fwrite(garbage, 1, sizeof(garbage), file);
+    fclose(file);
+    assert(rename(TEST_SNAPSHOT_TEMP, TEST_SNAPSHOT_PATH) == 0);
+
+    assert(nova_search_snapshot_refresh(snapshot));
+    assert(snapshot->generation == 8);
+    nova_search_snapshot_free(snapshot);
+
+    /* Nothing valid to map for a fresh reader */
+    snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(!nova_search_snapshot_refresh(snapshot));
+    assert(!nova_search_snapshot_query(snapshot, "doc", 10, NULL, NULL, &cursor));
+    assert(cursor == NULL);
+    nova_search_snapshot_free(snapshot);
+
+    unlink(TEST_SNAPSHOT_PATH);
+    snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(!nova_search_snapshot_refresh(snapshot));
+    nova_search_snapshot_free(snapshot);
+
+    printf("  ✓ Snapshot replacement works\n");
+}
+
+/* Point the first posting of a snapshot file past its last entry */
+static void corrupt_posting(const char *path) {
+    FILE *file = fopen(path, "r+b");
+    assert(file != NULL);
+    unsigned char header[104];
+    assert(fread(header, 1, sizeof(header), file) == sizeof(header));
+
+    uint64_t postings_offset = 0;
+    for (int i = 7; i >= 0; i--) postings_offset = (postings_offset << 8) | header[72 + i];
+    unsigned char entry[4];
+    put_u32(entry, FIXTURE_COUNT + 100);
+    assert(fseek(file, (long)postings_offset, SEEK_SET) == 0);
+    assert(fwrite(entry, 1, sizeof(entry), file) == sizeof(entry));
+    fclose(file);
+}
+
+/* Test that an entry index past the entries drops the file */
+void test_corrupt_entries(void) {
+    printf("Testing corrupt entry indices...\n");
+
+    write_fixture(TEST_SNAPSHOT_PATH, 7);
+    corrupt_posting(TEST_SNAPSHOT_PATH);
+
+    /* The header is valid, so the file is mapped */
+    NovaSearchSnapshot *snapshot = nova_search_snapshot_new(TEST_SNAPSHOT_PATH);
+    assert(nova_search_snapshot_refresh(snapshot));
+
+    /* The first trigram's postings hold the bad index; searching them
+     * rejects the file rather than skipping it */
+    uint32_t first_key = 0;
+    for (int i = 3; i >= 0; i--) first_key = (first_key << 8) | snapshot->trigrams[i];
+    char query[4] = { (char)(first_key >> 16), (char)(first_key >> 8), (char)first_key, '\0' };
+    NovaSearchCursor *cursor;
+    assert(!nova_search_snapshot_query(snapshot, query, 10, NULL, NULL, &cursor));
+    assert(cursor == NULL);
+    assert(snapshot->data == NULL);
+
+    /* Nor is it mapped again, until it is replaced */
+    assert(!nova_search_snapshot_refresh(snapshot));
+    write_fixture(TEST_SNAPSHOT_PATH, 7);
+    assert(nova_search_snapshot_refresh(snapshot));
+    assert_no_matches(snapshot, "xyz", NULL);
+    nova_search_snapshot_free(snapshot);
+
+    printf("  ✓ Corrupt entry indices are rejected\n");
+}
+
+/* Test NULL handling */
+void test_null_safety(void) {
+    printf("Testing NULL safety...\n");
+
+    assert(nova_search_snapshot_new(NULL) == NULL);
+    assert(!nova_search_snapshot_refresh(NULL));
+    assert(!nova_search_snapshot_sync(NULL, NULL));
+    NovaSearchCursor *cursor;
+    assert(!nova_search_snapshot_query(NULL, "doc", 10, NULL, NULL, &cursor));
+    assert(cursor == NULL);
+    nova_search_snapshot_free(NULL);
+
+    printf("  ✓ NULL safety works\n");
+}
+
+int main(void) {
+    printf("\n=== NovaSearch Index Snapshot Tests ===\n\n");
+
+    write_fixture(TEST_SNAPSHOT_PATH, 7);
+
+    test_refresh();
+    test_query();
+    test_trigrams();
+    test_launchers();
+    test_cancellation();
+    test_sync();
+    test_replacement();
+    test_corrupt_entries();
+    test_null_safety();
+
+    unlink(TEST_SNAPSHOT_PATH);
+
+    printf("\n=== All index snapshot tests passed! ===\n\n");
+    return 0;
+}